@@ -0,0 +1,85 @@
+/**
+ * @file alarm.h
+ * @author Auska Wang
+ *
+ * @brief Header file of alarm.c
+ *        This file contains
+ *        - Alarm_Rule struct, one configured threshold
+ *        - Alarm_Stats struct with evaluation time and output latency
+ *        - functions to evaluate and acknowledge the alarms
+ *        Values are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_ALARM_H_
+#define INC_ALARM_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief Values a rule can watch.
+ */
+typedef enum {
+	ALARM_TEMPERATURE 	= 0,	//tenths of a degree C
+	ALARM_HUMIDITY 		= 1,	//tenths of a percent
+	ALARM_DEW_POINT 	= 2,	//tenths of a degree C
+	ALARM_SOURCES 		= 3
+} ALARM_SOURCE;
+
+/**
+ * @brief Side of the threshold that raises the alarm.
+ */
+typedef enum {
+	ALARM_ABOVE 	= 0,
+	ALARM_BELOW 	= 1
+} ALARM_DIRECTION;
+
+/**
+ * @brief Outputs, combined in Alarm_Rule.outputs.
+ */
+#define ALARM_OUTPUT_LED 0x01		//user LED, PA5
+#define ALARM_OUTPUT_BUZZER 0x02	//buzzer or relay, BUZZER_Pin
+
+#define ALARM_NEAR_MARGIN 10		//tenths, a value this close to raising a rule counts as near
+#define ALARM_RULES 5				//rules in alarm.c, each with its threshold in the settings
+
+/**
+ * @brief One threshold. The alarm is raised once the value has been beyond threshold
+ *        for hold_off_s, and cleared once it is back by more than hysteresis. A
+ *        latching alarm stays raised after it clears until alarm_acknowledge().
+ */
+typedef struct {
+	uint8_t source;				//ALARM_SOURCE
+	uint8_t direction;			//ALARM_DIRECTION
+	uint8_t latching;			//1 = stays raised until acknowledged
+	uint8_t outputs;			//ALARM_OUTPUT_* driven while raised
+	int16_t threshold;			//tenths, default of the threshold setting
+	uint16_t hysteresis;		//tenths
+	uint16_t hold_off_s;		//seconds beyond the threshold before raising
+} Alarm_Rule;
+
+/**
+ * @brief Evaluation time and latency from a frame being decoded to the outputs changing.
+ */
+typedef struct {
+	uint32_t last_cycles;			//alarm_evaluate()
+	uint32_t max_cycles;
+	uint32_t last_latency_cycles;	//sample ready to output written, last output change
+	uint32_t max_latency_cycles;
+	uint32_t raised;				//alarms raised since boot
+} Alarm_Stats;
+
+extern Alarm_Stats alarm_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void alarm_init(void);
+int16_t alarm_threshold(uint8_t rule, ALARM_SOURCE* source, ALARM_DIRECTION* direction);
+uint8_t alarm_threshold_valid(uint8_t rule, int32_t threshold);
+void alarm_set_threshold(uint8_t rule, int16_t threshold);
+void alarm_evaluate(const int16_t* values, uint32_t now_ms, uint32_t ready_cycles);
+uint8_t alarm_latched(void);
+uint8_t alarm_near(void);
+void alarm_acknowledge(void);
+void alarm_task(void);
+
+#endif /* INC_ALARM_H_ */
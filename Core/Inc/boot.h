@@ -0,0 +1,32 @@
+/**
+ * @file boot.h
+ * @author Auska Wang
+ *
+ * @brief Header file of boot.c
+ *        This file contains
+ *        - Boot_Stats struct with the timestamps of each boot stage
+ *        - the boot pipeline run between hardware_init() and the main loop
+ */
+
+#ifndef INC_BOOT_H_
+#define INC_BOOT_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief Milliseconds since reset at which each stage completed.
+ */
+typedef struct {
+	uint32_t hardware_ready_ms;		//clocks, GPIO, timers, DMA and I2C configured
+	uint32_t display_ready_ms;		//display initialized and placeholder shown
+	uint32_t first_reading_ms;		//first valid reading on the display, 0 if boot gave up on the sensor
+	uint8_t sensor_attempts;		//sensor requests until the first valid reading or the fault
+} Boot_Stats;
+
+extern Boot_Stats boot_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void boot_run();
+
+#endif /* INC_BOOT_H_ */
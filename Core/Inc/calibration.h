@@ -0,0 +1,46 @@
+/**
+ * @file calibration.h
+ * @author Auska Wang
+ *
+ * @brief Header file of calibration.c
+ *        This file contains
+ *        - Calibration_Point struct, one breakpoint of a channel's correction
+ *        - the results of validating a table
+ *        - functions to load tables and correct samples
+ *        Samples are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_CALIBRATION_H_
+#define INC_CALIBRATION_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "history.h"
+
+#define CALIBRATION_MAX_POINTS 8
+
+/**
+ * @brief The sensor reading raw is corrected to corrected, both in tenths.
+ */
+typedef struct {
+	int16_t raw;
+	int16_t corrected;
+} Calibration_Point;
+
+/**
+ * @brief Outcome of calibration_load().
+ */
+typedef enum {
+	CALIBRATION_OK 				= 0,
+	CALIBRATION_POINT_COUNT 	= 1,	//fewer than 2 or more than CALIBRATION_MAX_POINTS points
+	CALIBRATION_NOT_MONOTONIC 	= 2,	//raw or corrected values not strictly increasing
+	CALIBRATION_SLOPE_RANGE 	= 3		//a segment's slope outside (0, 4]
+} Calibration_Status;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void calibration_init(void);
+Calibration_Status calibration_load(HISTORY_CHANNEL channel, const Calibration_Point* points, uint8_t count);
+uint8_t calibration_points(HISTORY_CHANNEL channel, Calibration_Point* points);
+int16_t calibration_apply(HISTORY_CHANNEL channel, int16_t raw);
+
+#endif /* INC_CALIBRATION_H_ */
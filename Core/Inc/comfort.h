@@ -0,0 +1,41 @@
+/**
+ * @file comfort.h
+ * @author Auska Wang
+ *
+ * @brief Header file of comfort.c
+ *        This file contains
+ *        - Comfort_Metrics struct with the values derived from a reading
+ *        - Comfort_Cost struct, to check the computation time on target
+ *        Inputs are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_COMFORT_H_
+#define INC_COMFORT_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief Values derived from temperature and relative humidity.
+ */
+typedef struct {
+	int16_t dew_point;				//tenths of a degree Celsius
+	int16_t heat_index;				//tenths of a degree Celsius, NWS definition
+	uint16_t absolute_humidity;		//hundredths of a gram of water per cubic metre
+} Comfort_Metrics;
+
+/**
+ * @brief Worst case cost of comfort_compute().
+ */
+typedef struct {
+	uint32_t last_cycles;
+	uint32_t max_cycles;
+} Comfort_Cost;
+
+extern Comfort_Cost comfort_cost;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void comfort_compute(int16_t temperature, int16_t humidity, Comfort_Metrics* metrics);
+int16_t comfort_dew_point(int16_t temperature, int16_t humidity);
+
+#endif /* INC_COMFORT_H_ */
@@ -0,0 +1,209 @@
+/**
+ * @file config.h
+ * @author Auska Wang
+ *
+ * @brief Build time configuration of the firmware.
+ *        This file contains
+ *        - selection of hardware backends fitted to a given enclosure
+ *        - switches for optional diagnostics
+ *        Change the values here instead of editing the individual modules. Every switch
+ *        can also be set on the compiler command line, e.g. -DFLASH_LOG=1.
+ *
+ *        The optional features are off by default: with all of them on the image does not
+ *        fit the 32 KB part. The README's flash budget lists what each one adds; the link
+ *        fails if the image runs into the settings pages, or with FLASH_LOG into the log.
+ */
+
+#ifndef INC_CONFIG_H_
+#define INC_CONFIG_H_
+
+/**
+ * @brief Display the readings are rendered to.
+ *        DISPLAY_LCD  - 16x2 HD44780 character LCD (see LCD_TRANSPORT)
+ *        DISPLAY_OLED - 128x64 SSD1306 OLED on hi2c1
+ */
+#define DISPLAY_LCD 0
+#define DISPLAY_OLED 1
+#define DISPLAY_BACKEND DISPLAY_LCD
+
+/**
+ * @brief Set to 1 to show a trend graph of the last few minutes next to each reading,
+ *        drawn in the display's user glyphs. TREND_GRAPH_STYLE is TREND_SPARKLINE or TREND_BAR.
+ */
+#ifndef TREND_GRAPH
+#define TREND_GRAPH 0
+#endif
+#define TREND_GRAPH_STYLE TREND_SPARKLINE
+
+/**
+ * @brief Set to 1 to keep every sample in a delta encoded history besides the rollup
+ *        tiers. PACKED_HISTORY_BLOCKS blocks of 128 bytes, at about 3 bytes a sample.
+ */
+#ifndef PACKED_HISTORY
+#define PACKED_HISTORY 0
+#endif
+#define PACKED_HISTORY_BLOCKS 8
+
+/**
+ * @brief Set to 1 to log the mean reading of every FLASH_LOG_INTERVAL_S seconds to the
+ *        3 flash pages below the settings pages, kept across resets. With 0 the image
+ *        may grow over those pages.
+ */
+#ifndef FLASH_LOG
+#define FLASH_LOG 0
+#endif
+#define FLASH_LOG_INTERVAL_S 60
+
+/**
+ * @brief Set to 1 to filter every frame before it is displayed, logged or fed to the
+ *        statistics. The stages run in this order, each can be left out:
+ *        FILTER_MAX_RATE_*   - drop frames whose channel moved faster than this since the
+ *                              last accepted frame, tenths per second, 0 = off
+ *        FILTER_REJECT_LIMIT - after this many drops in a row the new level is accepted
+ *        FILTER_MEDIAN       - median of the last N frames, odd, up to 7, 1 = off
+ *        FILTER_EMA_SHIFT    - moving average giving a new frame weight 1 / 2^shift, 0 = off
+ *        FILTER_KALMAN       - scalar Kalman filter with process variance FILTER_KALMAN_Q
+ *                              and measurement variance FILTER_KALMAN_R per frame, tenths^2
+ */
+#ifndef FILTER
+#define FILTER 0
+#endif
+#define FILTER_MAX_RATE_TEMPERATURE 10
+#define FILTER_MAX_RATE_HUMIDITY 50
+#define FILTER_REJECT_LIMIT 3
+#define FILTER_MEDIAN 3
+#define FILTER_EMA_SHIFT 0
+#define FILTER_KALMAN 1
+#define FILTER_KALMAN_Q 1
+#define FILTER_KALMAN_R 4
+
+/**
+ * @brief Set to 1 to check every filtered frame against the alarm rules in alarm.c and
+ *        drive the user LED (PA5) and the buzzer output. The view button acknowledges
+ *        latched alarms before it changes the view.
+ */
+#ifndef ALARM
+#define ALARM 0
+#endif
+
+/**
+ * @brief Set to 1 to fit trend lines to temperature, humidity and the dew point spread
+ *        and show them in a trend view. Frames are averaged into one point every
+ *        FORECAST_INTERVAL_S seconds, the line runs through the last FORECAST_POINTS.
+ */
+#ifndef FORECAST
+#define FORECAST 0
+#endif
+#define FORECAST_INTERVAL_S 10
+#define FORECAST_POINTS 32
+
+/**
+ * @brief Set to 1 to adapt the sampling interval to the readings and send only display
+ *        lines that changed. While readings move by SCHEDULER_ACTIVE_DELTA tenths between
+ *        frames, or an alarm threshold is near, the sensor is read every 2 s and for
+ *        SCHEDULER_FAST_HOLD more frames; then the interval doubles up to SCHEDULER_SLOW_S.
+ */
+#ifndef SCHEDULER
+#define SCHEDULER 0
+#endif
+#define SCHEDULER_ACTIVE_DELTA 2
+#define SCHEDULER_FAST_HOLD 15
+#define SCHEDULER_SLOW_S 30
+
+/**
+ * @brief Set to 1 to send a binary frame per sensor read on USART2, the ST-Link virtual
+ *        COM port, at TELEMETRY_BAUD, 8N1. See telemetry.c for the format.
+ *        921600 baud is the fastest the ST-Link carries reliably, 0.16 % off from 48 MHz,
+ *        and lets export.c send the full 6 KB log in 0.075 s. Use 115200 for slower adapters.
+ */
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+#define TELEMETRY_BAUD 921600
+
+/**
+ * @brief Set to 1 to take text commands on USART2, at TELEMETRY_BAUD. See console.c for the
+ *        commands. Reception uses DMA channel 2, so I2C reads use interrupts instead.
+ */
+#ifndef CONSOLE
+#define CONSOLE 0
+#endif
+
+/**
+ * @brief Set to 1 to answer Modbus RTU requests on USART2 as slave MODBUS_ADDRESS, at
+ *        MODBUS_BAUD, 8E1. USART2 carries one protocol: TELEMETRY and CONSOLE must be 0.
+ *        TIM17 times the end of each request. See modbus.h for the registers.
+ */
+#ifndef MODBUS
+#define MODBUS 0
+#endif
+#define MODBUS_BAUD 19200
+#define MODBUS_ADDRESS 1
+
+/**
+ * @brief Set to 1 to join an RS-485 network on USART2 as node NETWORK_ADDRESS, at NETWORK_BAUD,
+ *        8N1, the transceiver's driver enable on PA1. The node sends its reading in the time
+ *        slot the concentrator's beacons assign it; TIM17 times the slot. USART2 carries one
+ *        protocol: TELEMETRY, CONSOLE, MODBUS and DIAG_PRINT must be 0. See network.c.
+ */
+#ifndef NETWORK
+#define NETWORK 0
+#endif
+#define NETWORK_BAUD 115200
+#define NETWORK_ADDRESS 1
+
+/**
+ * @brief Set to 1 to send printf() output on USART2, at TELEMETRY_BAUD, through the transmit
+ *        ring. See diag.c. DIAG_OVERFLOW picks what a print does when the ring is full:
+ *        DIAG_DROP_NEWEST - the text that does not fit is dropped and counted, never waits
+ *        DIAG_BLOCK       - waits for room, up to DIAG_BLOCK_TIMEOUT_MS, with interrupts enabled only
+ */
+#define DIAG_DROP_NEWEST 0
+#define DIAG_BLOCK 1
+#ifndef DIAG_PRINT
+#define DIAG_PRINT 0
+#endif
+#define DIAG_OVERFLOW DIAG_DROP_NEWEST
+#define DIAG_BLOCK_TIMEOUT_MS 50
+
+/**
+ * @brief LCD transport used at boot.
+ *        LCD_TRANSPORT_I2C  - HD44780 behind a PCF8574 I2C expander on hi2c1
+ *        LCD_TRANSPORT_GPIO - HD44780 wired directly to the LCD_GPIO_* pins
+ */
+#define LCD_TRANSPORT_I2C 0
+#define LCD_TRANSPORT_GPIO 1
+#define LCD_TRANSPORT LCD_TRANSPORT_I2C
+
+/**
+ * @brief Data bus width of the GPIO transport, 4 or 8 bits.
+ */
+#define LCD_GPIO_BUS_WIDTH 4
+
+/**
+ * @brief Set to 1 to time a full LCD refresh on both transports at boot.
+ *        Results are kept in lcd_benchmark_result. Not yet run on a board.
+ */
+#ifndef LCD_TRANSPORT_BENCHMARK
+#define LCD_TRANSPORT_BENCHMARK 0
+#endif
+
+/**
+ * @brief Set to 1 to compare the integer formatter with snprintf("%.2f") at boot.
+ *        Results are kept in format_benchmark_result. Needs float printf enabled
+ *        in the project settings, which the normal build leaves out, and HEAP_FREE 0.
+ *        Not yet run on a board, the target figures are unmeasured.
+ */
+#ifndef FORMAT_BENCHMARK
+#define FORMAT_BENCHMARK 0
+#endif
+
+/**
+ * @brief Set to 1 for a build without heap: every buffer is a static array, _sbrk
+ *        refuses all requests and the firmware halts if anything made one.
+ */
+#ifndef HEAP_FREE
+#define HEAP_FREE 1
+#endif
+
+#endif /* INC_CONFIG_H_ */
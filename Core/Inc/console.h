@@ -0,0 +1,40 @@
+/**
+ * @file console.h
+ * @author Auska Wang
+ *
+ * @brief Header file of console.c
+ *        This file contains
+ *        - Console_Stats struct with the commands run and the input lost
+ *        - functions to receive and run text commands on USART2
+ */
+
+#ifndef INC_CONSOLE_H_
+#define INC_CONSOLE_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define CONSOLE_RX_BYTES 256		//circular DMA buffer, 2.8 ms of input at 921600 baud
+#define CONSOLE_LINE_BYTES 96		//longest command, terminator included, cal with 8 points
+#define CONSOLE_MAX_ARGS 10			//command and its arguments
+
+/**
+ * @brief Commands and lost input since boot.
+ */
+typedef struct {
+	uint32_t bytes;					//received and parsed
+	uint32_t commands;				//lines run, errors included
+	uint32_t errors;				//unknown commands and bad arguments
+	uint32_t overlong;				//lines over CONSOLE_LINE_BYTES or CONSOLE_MAX_ARGS, dropped
+	uint32_t rx_restarts;			//reception restarted after a UART error
+	uint32_t max_cycles;			//slowest console_task() that ran a command
+} Console_Stats;
+
+extern Console_Stats console_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void console_init(void);
+void console_task(void);
+uint16_t console_feed(const uint8_t* bytes, uint16_t length);
+
+#endif /* INC_CONSOLE_H_ */
@@ -0,0 +1,44 @@
+/**
+ * @file console_line.h
+ * @author Auska Wang
+ *
+ * @brief Header file of console_line.c
+ *        This file contains
+ *        - Console_Line struct holding a command line split into arguments as it arrives
+ *        - the events a byte can end a line with
+ *        - functions to clear a line and add a byte to it
+ */
+
+#ifndef INC_CONSOLE_LINE_H_
+#define INC_CONSOLE_LINE_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "console.h"
+
+/**
+ * @brief What a byte did to the line.
+ */
+typedef enum {
+	CONSOLE_LINE_PENDING = 0,		//line not ended, or empty
+	CONSOLE_LINE_READY,				//line ended, args[0] is the command
+	CONSOLE_LINE_OVERLONG			//line ended after going over CONSOLE_LINE_BYTES or CONSOLE_MAX_ARGS
+} CONSOLE_LINE_EVENT;
+
+/**
+ * @brief A line being received, split into arguments each ended by '\0'.
+ */
+typedef struct {
+	char text[CONSOLE_LINE_BYTES];
+	char* args[CONSOLE_MAX_ARGS];
+	uint8_t length;
+	uint8_t count;					//arguments started
+	uint8_t in_argument;
+	uint8_t overlong;				//line dropped, waiting for its end
+} Console_Line;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void console_line_clear(Console_Line* line);
+CONSOLE_LINE_EVENT console_line_put(Console_Line* line, char c);
+
+#endif /* INC_CONSOLE_LINE_H_ */
@@ -0,0 +1,21 @@
+/**
+ * @file crc.h
+ * @author Auska Wang
+ *
+ * @brief Header file of crc.c
+ *        This file contains
+ *        - functions to set up the CRC unit and compute CRC-16/CCITT and CRC-16/MODBUS with it
+ */
+
+#ifndef INC_CRC_H_
+#define INC_CRC_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Function prototypes ------------------------------------------------------------------*/
+void crc_init(void);
+uint16_t crc16_ccitt(const uint8_t* data, uint16_t length);
+uint16_t crc16_modbus(const uint8_t* data, uint16_t length);
+
+#endif /* INC_CRC_H_ */
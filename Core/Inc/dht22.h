@@ -35,10 +35,19 @@ typedef struct {
 	uint8_t check_byte;
 } DHT22_Data;
 
+/**
+ * @brief Timing limits of the sensor.
+ */
+#define DHT22_POWER_ON_MS 1000		//no request within 1 s of power up, readings are unstable
+#define DHT22_MIN_INTERVAL_MS 2000	//minimum time between two requests
+
 /* Function prototypes ------------------------------------------------------------------*/
-void DHT22_getData(DHT22_Data* data);
+DHT22_Status DHT22_getData(DHT22_Data* data);
+uint8_t DHT22_checksumValid(const DHT22_Data* data);
 float getTemperatureC(uint8_t, uint8_t);
 float getTemperatureF(uint8_t, uint8_t);
 float getHumidity(uint8_t, uint8_t);
+int16_t getTemperatureTenthsC(uint8_t, uint8_t);
+uint16_t getHumidityTenths(uint8_t, uint8_t);
 
 #endif /* INC_DHT22_H_ */
@@ -0,0 +1,39 @@
+/**
+ * @file diag.h
+ * @author Auska Wang
+ *
+ * @brief Header file of diag.c
+ *        This file contains
+ *        - Diag_Stats struct with the prints queued, dropped and waited for
+ *        - the function routing printf() to the USART2 transmit ring
+ */
+
+#ifndef INC_DIAG_H_
+#define INC_DIAG_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "uart_tx.h"
+
+#define DIAG_CHUNK_BYTES (UART_TX_RING_BYTES / 2)	//longest single write into the ring
+#define DIAG_LINE_BYTES 128							//stdout buffer, a longer line is sent in pieces
+
+/**
+ * @brief Prints since boot.
+ */
+typedef struct {
+	uint32_t writes;				//_write() calls, expected one per line with stdout line buffered
+	uint32_t bytes;					//queued
+	uint32_t dropped_writes;		//writes cut short, ring full
+	uint32_t dropped_bytes;
+	uint32_t blocked_writes;		//DIAG_BLOCK: writes that waited for room
+	uint32_t max_wait_cycles;		//DIAG_BLOCK: longest wait
+	uint32_t isr_drops;				//prints from an interrupt, dropped
+} Diag_Stats;
+
+extern Diag_Stats diag_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void diag_init(void);
+
+#endif /* INC_DIAG_H_ */
@@ -0,0 +1,56 @@
+/**
+ * @file display.h
+ * @author Auska Wang
+ *
+ * @brief Header file of the display backends.
+ *        This file contains
+ *        - Display_Driver struct which lets the reading renderer in lcd_data_display.c
+ *        target either the 16x2 character LCD or the 128x64 OLED
+ *        - the size of the text area every backend provides
+ */
+
+#ifndef INC_DISPLAY_H_
+#define INC_DISPLAY_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief Text area shared by all backends, 2 rows of 16 characters.
+ */
+#define DISPLAY_COLUMNS 16
+#define DISPLAY_ROWS 2
+
+/**
+ * @brief Character drawn as a degree sign (HD44780 ROM code A00).
+ */
+#define DISPLAY_DEGREE_CHAR ((char)0xDF)
+
+/**
+ * @brief User defined glyphs, 5x8 pixels each (HD44780 CGRAM).
+ *        Glyph n is drawn by character code DISPLAY_GLYPH_CHAR(n); codes 8 - 15
+ *        mirror CGRAM 0 - 7 so a glyph never terminates a string.
+ */
+#define DISPLAY_GLYPHS 8
+#define DISPLAY_GLYPH_WIDTH 5
+#define DISPLAY_GLYPH_HEIGHT 8
+#define DISPLAY_GLYPH_CHAR(n) ((char)(8 + (n)))
+
+/**
+ * @brief Operations a display backend provides to the renderer.
+ */
+typedef struct {
+	void (*init_start)(void);							//(re)start the init sequence
+	uint8_t (*init_step)(void);							//non-blocking init, call until it returns 1
+	void (*clear)(void);
+	void (*write_line)(uint8_t row, const char* text);	//text is padded with spaces to DISPLAY_COLUMNS
+	void (*flush)(void);								//push pending changes to the panel
+	void (*set_light)(uint8_t light_mode);				//backlight/brightness, off = 0, on = 1
+	void (*write_glyph_rows)(uint8_t glyph, uint8_t first_row, const uint8_t* rows, uint8_t count);	//rows of a user glyph, bit 4 = left pixel
+} Display_Driver;
+
+/* Backends ------------------------------------------------------------------*/
+extern const Display_Driver display_lcd;
+extern const Display_Driver display_oled;
+
+#endif /* INC_DISPLAY_H_ */
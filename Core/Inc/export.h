@@ -0,0 +1,55 @@
+/**
+ * @file export.h
+ * @author Auska Wang
+ *
+ * @brief Header file of export.c
+ *        This file contains
+ *        - the sources of a bulk export and their block sizes
+ *        - Export_Stats struct with the records sent and the time of the last export
+ *        - functions to start an export and send its blocks from the main loop
+ */
+
+#ifndef INC_EXPORT_H_
+#define INC_EXPORT_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define EXPORT_HEADER_BYTES 11			//type, source, first and next offset, record count
+#define EXPORT_LOG_RECORDS 8			//flash log records per block, 16 bytes each as stored
+#define EXPORT_HISTORY_RECORDS 7		//history records per block, 19 bytes each
+#define EXPORT_HISTORY_RECORD_BYTES 19
+#define EXPORT_SAMPLE_RECORDS 16		//packed history samples per block, 8 bytes each
+#define EXPORT_SAMPLE_RECORD_BYTES 8
+
+/**
+ * @brief What an export sends, and what its offsets count.
+ */
+typedef enum {
+	EXPORT_LOG 		= 0,	//flash log records, offset is the sequence number
+	EXPORT_HISTORY 	= 1,	//hours, minutes and raw samples in time order, offset is the HAL tick
+	EXPORT_SAMPLES 	= 2		//every sample the packed history holds, offset is the HAL tick
+} EXPORT_SOURCE;
+
+/**
+ * @brief Exports since boot and the last one's throughput.
+ */
+typedef struct {
+	uint32_t exports;				//finished
+	uint32_t blocks;
+	uint32_t records;
+	uint32_t skipped;				//log records overwritten or torn, not sent
+	uint32_t last_ms;				//start to end frame queued
+	uint32_t last_bytes;			//bytes queued on USART2 meanwhile, reading frames included
+	uint32_t max_block_cycles;		//reading and queueing one block
+} Export_Stats;
+
+extern Export_Stats export_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+uint32_t export_oldest(EXPORT_SOURCE source);
+uint8_t export_start(EXPORT_SOURCE source, uint32_t from);
+void export_task(void);
+uint8_t export_active(void);
+
+#endif /* INC_EXPORT_H_ */
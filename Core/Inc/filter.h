@@ -0,0 +1,55 @@
+/**
+ * @file filter.h
+ * @author Auska Wang
+ *
+ * @brief Header file of filter.c
+ *        This file contains
+ *        - the stages of the filter between the sensor and the rest of the firmware
+ *        - Filter_Stats struct with frame and rejection counts
+ *        - Filter_Cost struct, to check the time of each stage on target
+ *        Samples are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_FILTER_H_
+#define INC_FILTER_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "history.h"
+
+/**
+ * @brief Stages in the order a frame passes them.
+ */
+typedef enum {
+	FILTER_STAGE_RATE 		= 0,	//rejects frames changing faster than FILTER_MAX_RATE_*
+	FILTER_STAGE_MEDIAN 	= 1,	//median of the last FILTER_MEDIAN frames
+	FILTER_STAGE_EMA 		= 2,	//exponential moving average, weight 1 / 2^FILTER_EMA_SHIFT
+	FILTER_STAGE_KALMAN 	= 3,	//scalar Kalman filter, random walk model
+	FILTER_STAGES 			= 4
+} FILTER_STAGE;
+
+/**
+ * @brief Frame and rejection counts.
+ */
+typedef struct {
+	uint32_t frames;						//frames passed to filter_apply()
+	uint32_t rejected;						//frames dropped by the rate check
+	uint32_t channel_rejected[HISTORY_CHANNELS];	//channel over its rate limit, a frame may count in both
+	uint32_t reseeds;						//new level accepted after FILTER_REJECT_LIMIT rejections in a row
+} Filter_Stats;
+
+/**
+ * @brief Cycles of one stage for both channels, last frame and slowest frame.
+ */
+typedef struct {
+	uint32_t last_cycles;
+	uint32_t max_cycles;
+} Filter_Cost;
+
+extern Filter_Stats filter_stats;
+extern Filter_Cost filter_cost[FILTER_STAGES];
+
+/* Function prototypes ------------------------------------------------------------------*/
+uint8_t filter_apply(int16_t* values, uint32_t now_ms);
+
+#endif /* INC_FILTER_H_ */
@@ -0,0 +1,42 @@
+/**
+ * @file fixed_format.h
+ * @author Auska Wang
+ *
+ * @brief Header file of fixed_format.c
+ *        This file contains
+ *        - functions appending text and fixed-point numbers to a display line
+ *        - the optional benchmark against snprintf("%.2f")
+ *        Numbers are scaled integers (e.g. hundredths), no float and no varargs are involved.
+ */
+
+#ifndef INC_FIXED_FORMAT_H_
+#define INC_FIXED_FORMAT_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "config.h"
+
+#define FORMAT_TENTHS 1
+#define FORMAT_HUNDREDTHS 2
+
+#if FORMAT_BENCHMARK
+/**
+ * @brief Cost of formatting one reading, snprintf("%.2f") against format_append_fixed().
+ */
+typedef struct {
+	uint32_t snprintf_cycles;
+	uint32_t fixed_cycles;
+	uint32_t snprintf_stack_bytes;
+	uint32_t fixed_stack_bytes;
+} Format_Benchmark_Result;
+
+extern Format_Benchmark_Result format_benchmark_result;
+void format_benchmark(void);
+#endif
+
+/* Function prototypes ------------------------------------------------------------------*/
+void format_append_char(char* buffer, uint8_t size, char c);
+void format_append_str(char* buffer, uint8_t size, const char* str);
+void format_append_fixed(char* buffer, uint8_t size, int32_t value, uint8_t decimals);
+
+#endif /* INC_FIXED_FORMAT_H_ */
@@ -0,0 +1,58 @@
+/**
+ * @file flash_log.h
+ * @author Auska Wang
+ *
+ * @brief Header file of flash_log.c
+ *        This file contains
+ *        - Flash_Log_Record struct, one CRC protected reading in flash
+ *        - Flash_Log_Stats struct with boot recovery and programming times
+ *        - functions to queue readings, program them between frames and read them back
+ */
+
+#ifndef INC_FLASH_LOG_H_
+#define INC_FLASH_LOG_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "history.h"
+
+#define FLASH_LOG_RECORD_BYTES 16		//two double words
+#define FLASH_LOG_QUEUE 4				//records waiting to be programmed
+
+/**
+ * @brief A logged reading, the mean over FLASH_LOG_INTERVAL_S. There is no RTC, so the
+ *        time is the boot number and the seconds since that boot.
+ */
+typedef struct {
+	uint32_t sequence;					//position in the log, slot n of a page holds page base + n
+	uint32_t uptime_s;					//start of the interval
+	uint16_t boot;
+	int16_t values[HISTORY_CHANNELS];	//tenths
+	uint16_t crc;						//CRC-16/CCITT of the bytes before it
+} Flash_Log_Record;
+
+/**
+ * @brief Counters and times of the log.
+ */
+typedef struct {
+	uint32_t init_us;				//head search at boot
+	uint8_t pages;					//pages of the log, set by the image size
+	uint32_t records_written;
+	uint32_t erases;
+	uint32_t dropped;				//queue full, should stay 0
+	uint32_t max_program_us;		//one record
+	uint32_t max_erase_us;			//one page
+	uint32_t errors;				//HAL_FLASH_Program or HAL_FLASHEx_Erase failed
+} Flash_Log_Stats;
+
+extern Flash_Log_Stats flash_log_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void flash_log_init(void);
+void flash_log_add(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms);
+void flash_log_task(void);
+uint32_t flash_log_oldest(void);
+uint32_t flash_log_next(void);
+uint8_t flash_log_read(uint32_t sequence, Flash_Log_Record* record);
+
+#endif /* INC_FLASH_LOG_H_ */
@@ -0,0 +1,24 @@
+/**
+ * @file font5x7.h
+ * @author Auska Wang
+ *
+ * @brief Header file of font5x7.c
+ *        This file contains
+ *        - the compile time 5x7 glyph table used by pixel displays
+ *        Each glyph is 5 column bytes, bit 0 is the top row.
+ */
+
+#ifndef INC_FONT5X7_H_
+#define INC_FONT5X7_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define FONT5X7_WIDTH 5
+#define FONT5X7_FIRST_CHAR 0x20
+#define FONT5X7_LAST_CHAR 0x7E
+
+/* Function prototypes ------------------------------------------------------------------*/
+const uint8_t* font5x7_glyph(char c);
+
+#endif /* INC_FONT5X7_H_ */
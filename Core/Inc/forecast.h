@@ -0,0 +1,58 @@
+/**
+ * @file forecast.h
+ * @author Auska Wang
+ *
+ * @brief Header file of forecast.c
+ *        This file contains
+ *        - the channels with a trend line
+ *        - Forecast struct, the fitted level and slope of a channel
+ *        - functions to feed frames, query the trend and extrapolate it
+ *        Values are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_FORECAST_H_
+#define INC_FORECAST_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define FORECAST_MIN_POINTS 6		//points before a trend is reported, one minute at 10 s
+#define FORECAST_MAX_MINUTES 999	//longer estimates are reported as none
+
+/**
+ * @brief Channels with a trend line.
+ */
+typedef enum {
+	FORECAST_TEMPERATURE 	= 0,	//tenths of a degree C
+	FORECAST_HUMIDITY 		= 1,	//tenths of a percent
+	FORECAST_DEW_SPREAD 	= 2,	//temperature minus dew point, tenths of a degree C
+	FORECAST_CHANNELS 		= 3
+} FORECAST_CHANNEL;
+
+/**
+ * @brief Least squares line through a channel's window.
+ */
+typedef struct {
+	int16_t level;		//fitted value at the newest point, tenths
+	int16_t slope;		//hundredths per minute
+} Forecast;
+
+/**
+ * @brief Cycles of the last and slowest update and query.
+ */
+typedef struct {
+	uint32_t last_add_cycles;
+	uint32_t max_add_cycles;
+	uint32_t last_query_cycles;
+	uint32_t max_query_cycles;
+} Forecast_Cost;
+
+extern Forecast_Cost forecast_cost;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void forecast_add(const int16_t* values, uint32_t now_ms);
+uint8_t forecast_get(FORECAST_CHANNEL channel, Forecast* forecast);
+int16_t forecast_extrapolate(const Forecast* forecast, uint16_t minutes);
+int16_t forecast_minutes_until(const Forecast* forecast, int16_t target);
+
+#endif /* INC_FORECAST_H_ */
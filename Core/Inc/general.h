@@ -23,10 +23,26 @@
 #define DHT22_Pin GPIO_PIN_9
 #define UNITS_Button_Port GPIOA
 #define UNITS_Button_Pin GPIO_PIN_7
-#define ON_OFF_Button_Port GPIOB
-#define ON_OFF_Button_Pin GPIO_PIN_0
+#define VIEW_Button_Port GPIOB
+#define VIEW_Button_Pin GPIO_PIN_0
 #define LIGHT_Button_Pin GPIO_PIN_3
 #define LIGHT_Button_Port GPIOB
+#define LED_Port GPIOA
+#define LED_Pin GPIO_PIN_5
+#define BUZZER_Port GPIOA
+#define BUZZER_Pin GPIO_PIN_8
+
+/**
+ * @brief Pins for an HD44780 wired directly to GPIO (no PCF8574 expander).
+ *        D0 - D7 sit on consecutive pins starting at LCD_GPIO_DATA_SHIFT so
+ *        that data, RS and backlight are written with a single BSRR store.
+ *        In 4-bit mode only D4 - D7 (PB12 - PB15) are used.
+ */
+#define LCD_GPIO_Port GPIOB
+#define LCD_GPIO_RS_Pin GPIO_PIN_4
+#define LCD_GPIO_E_Pin GPIO_PIN_5
+#define LCD_GPIO_BL_Pin GPIO_PIN_7
+#define LCD_GPIO_DATA_SHIFT 8
 
 /**
  * @brief Input or output for pin configuration.
@@ -36,9 +52,18 @@ typedef enum {
 	GPIO_OUTPUT 	= 1
 } GPIO_Mode;
 
+/**
+ * @brief Converts a cycle count from get_cycle_count() to microseconds.
+ */
+#define CYCLES_TO_US(cycles) ((cycles) / (SystemCoreClock / 1000000U))
+
 /* Function prototypes ------------------------------------------------------------------*/
 void hardware_init();
-void micro_delay(int microseconds);
+void sampling_start();
+void sampling_set_interval(uint32_t interval_ms);
+void MX_I2C1_Init(void);
+void micro_delay(uint32_t microseconds);
+uint32_t get_cycle_count(void);
 void set_pin_mode(GPIO_TypeDef* GPIOx, uint16_t pin, GPIO_Mode mode);
 void Error_Handler();
 
@@ -0,0 +1,91 @@
+/**
+ * @file history.h
+ * @author Auska Wang
+ *
+ * @brief Header file of history.c
+ *        This file contains
+ *        - the tiers of the reading history: raw samples, closed minutes, closed hours
+ *        - History_Bucket struct aggregating a channel over a minute or an hour
+ *        - History_Record struct returned by range queries
+ *        - the observer interface rolling_stats.c uses to follow the rings
+ *        Samples are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_HISTORY_H_
+#define INC_HISTORY_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define HISTORY_RAW_SAMPLES 32		//1 min at the DHT22's 2 s minimum interval, plus slack
+#define HISTORY_MINUTES 60			//closed minutes kept
+#define HISTORY_HOURS 24			//closed hours kept
+#define HISTORY_MINUTE_MS 60000U
+#define HISTORY_HOUR_MS 3600000U
+
+/**
+ * @brief Measured quantities, samples in tenths of a degree Celsius / percent.
+ */
+typedef enum {
+	HISTORY_TEMPERATURE 	= 0,
+	HISTORY_HUMIDITY 		= 1,
+	HISTORY_CHANNELS 		= 2
+} HISTORY_CHANNEL;
+
+/**
+ * @brief Resolution tiers, each one cascading into the next as its buckets close.
+ */
+typedef enum {
+	HISTORY_RAW 	= 0,
+	HISTORY_MINUTE 	= 1,
+	HISTORY_HOUR 	= 2,
+	HISTORY_TIERS 	= 3
+} HISTORY_TIER;
+
+/**
+ * @brief Aggregate of one channel over a bucket, in tenths. 12 bytes, no padding.
+ *        A minute holds at most 30 samples and an hour 1800, whose squares of
+ *        |value| <= 1000 still fit sum_squares.
+ */
+typedef struct {
+	int32_t sum;
+	uint32_t sum_squares;
+	int16_t min;
+	int16_t max;
+} History_Bucket;
+
+/**
+ * @brief One entry of a range query, a raw sample or a closed (or still open) bucket.
+ */
+typedef struct {
+	uint32_t start_ms;		//HAL tick of the sample or bucket start
+	uint16_t count;			//samples aggregated, 1 for raw samples
+	uint8_t tier;			//HISTORY_TIER the entry comes from
+	int16_t min[HISTORY_CHANNELS];
+	int16_t max[HISTORY_CHANNELS];
+	int16_t mean[HISTORY_CHANNELS];
+} History_Record;
+
+/**
+ * @brief Told about every entry entering or leaving a tier's ring, from history_add().
+ *        position indexes the ring; tier buckets may be empty (history_count() == 0).
+ */
+typedef struct {
+	void (*entered)(HISTORY_TIER tier, uint8_t position);
+	void (*leaving)(HISTORY_TIER tier, uint8_t position);
+	void (*cleared)(void);
+} History_Observer;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void history_set_observer(const History_Observer* observer);
+void history_add(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms);
+void history_clear(void);
+uint16_t history_query(uint32_t from_ms, uint32_t to_ms, History_Record* records, uint16_t max_records);
+const int16_t* history_raw(uint8_t position);
+const History_Bucket* history_bucket(HISTORY_TIER tier, uint8_t position);
+uint16_t history_count(HISTORY_TIER tier, uint8_t position);
+const History_Bucket* history_open(HISTORY_TIER tier, uint16_t* count);
+uint8_t history_length(HISTORY_TIER tier);
+uint8_t history_start_ms(HISTORY_TIER tier, uint32_t* start_ms);
+
+#endif /* INC_HISTORY_H_ */
@@ -0,0 +1,117 @@
+/**
+ * @file i2c_bus.h
+ * @author Auska Wang
+ *
+ * @brief Header file of i2c_bus.c
+ *        This file contains
+ *        - I2C_Transaction struct drivers use to queue transfers on hi2c1
+ *        - priorities, so short sensor transfers overtake display refreshes
+ *        - per device latency and queue depth statistics
+ *        - I2C_Bus_Stats struct counting faults and the time spent recovering
+ */
+
+#ifndef INC_I2C_BUS_H_
+#define INC_I2C_BUS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "stm32c0xx_hal.h"
+
+#define I2C_BUS_MAX_DEVICES 4
+
+/**
+ * @brief Queue a transaction waits in, lower value is served first.
+ */
+typedef enum {
+	I2C_PRIORITY_SENSOR 	= 0,
+	I2C_PRIORITY_STORAGE 	= 1,
+	I2C_PRIORITY_DISPLAY 	= 2,
+	I2C_PRIORITIES 			= 3
+} I2C_Priority;
+
+/**
+ * @brief Kind of transfer.
+ */
+typedef enum {
+	I2C_OP_WRITE 		= 0,
+	I2C_OP_READ 		= 1,
+	I2C_OP_MEM_WRITE 	= 2,	//8-bit register/control byte, then data
+	I2C_OP_MEM_READ 	= 3
+} I2C_Op;
+
+struct I2C_Transaction;
+
+/**
+ * @brief Called from interrupt context when a transaction finished.
+ *        error is HAL_I2C_ERROR_NONE on success. The transaction may be resubmitted from here.
+ */
+typedef void (*I2C_Callback)(struct I2C_Transaction* t, uint32_t error);
+
+/**
+ * @brief A queued transfer. Owned by the driver, which must keep it and its data
+ *        untouched until the callback ran; the bus never copies or allocates.
+ */
+typedef struct I2C_Transaction {
+	uint8_t device;				//id from i2c_bus_register()
+	uint8_t address;			//8-bit device address
+	uint8_t op;					//I2C_Op
+	uint8_t mem_address;		//register/control byte for I2C_OP_MEM_*
+	uint8_t priority;			//I2C_Priority
+	uint16_t size;
+	uint16_t hold_us;			//time the device needs after this transfer before its next one
+	uint8_t* data;
+	I2C_Callback done;			//may be NULL
+	void* context;				//free for the driver
+	volatile uint8_t pending;	//set while queued or in flight
+	uint32_t queued_at_cycle;
+	struct I2C_Transaction* next;
+} I2C_Transaction;
+
+/**
+ * @brief Traffic and latency of one device.
+ */
+typedef struct {
+	const char* name;
+	uint32_t transactions;		//completed successfully
+	uint32_t errors;			//failed or dropped
+	uint32_t bytes;
+	uint32_t total_latency_us;	//queued to completed, sum for the mean
+	uint32_t max_latency_us;
+	uint8_t queued;				//transactions currently queued or in flight
+	uint8_t max_queued;
+} I2C_Device_Stats;
+
+/**
+ * @brief Fault counters and recovery timing of hi2c1.
+ */
+typedef struct {
+	uint32_t transfers;				//transfers started
+	uint32_t nacks;					//address or data not acknowledged
+	uint32_t arbitration_losses;
+	uint32_t bus_errors;			//misplaced start/stop
+	uint32_t timeouts;				//SCL/SDA held or flag never set
+	uint32_t other_errors;
+	uint32_t recoveries;			//bus recoveries performed
+	uint32_t last_recovery_us;		//SCL clocking and peripheral reinit
+	uint32_t max_recovery_us;
+	uint32_t last_resume_us;		//recovery plus display replay, until the screen is correct again
+	uint32_t max_resume_us;
+	uint8_t queue_depth;			//transactions queued, all devices
+	uint8_t max_queue_depth;
+} I2C_Bus_Stats;
+
+extern I2C_Bus_Stats i2c_bus_stats;
+extern I2C_Device_Stats i2c_device_stats[I2C_BUS_MAX_DEVICES];
+
+/* Function prototypes ------------------------------------------------------------------*/
+uint8_t i2c_bus_register(const char* name);
+HAL_StatusTypeDef i2c_bus_submit(I2C_Transaction* t);
+void i2c_bus_hold(uint8_t device, uint16_t us);
+uint8_t i2c_bus_online(void);
+uint8_t i2c_bus_idle(void);
+void i2c_bus_report_error(uint32_t error);
+void i2c_bus_run(void);
+uint8_t i2c_bus_poll(void);
+void i2c_bus_resumed(uint32_t start_cycle);
+
+#endif /* INC_I2C_BUS_H_ */
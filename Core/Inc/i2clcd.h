@@ -8,8 +8,27 @@
 #ifndef INC_I2CLCD_H_
 #define INC_I2CLCD_H_
 #include <stdint.h>
+#include "config.h"
+#include "lcd_transport.h"
+
+#if LCD_TRANSPORT_BENCHMARK
+/**
+ * @brief Time for a full refresh of both lines on each transport.
+ */
+typedef struct {
+	uint32_t i2c_refresh_us;
+	uint32_t gpio_refresh_us;
+} LCD_Benchmark_Result;
+
+extern LCD_Benchmark_Result lcd_benchmark_result;
+void lcd_benchmark_transports(void);
+#endif
+
 /* Function prototypes ------------------------------------------------------------------*/
+void lcd_set_transport(const LCD_Transport*);
 void lcd_init();
+void lcd_init_restart();
+uint8_t lcd_init_step();
 void send_cmd(char, uint8_t);
 void send_data(char, uint8_t);
 void printString(char[], uint8_t);
@@ -5,6 +5,7 @@
  * @brief Header file of lcd_data_display.c
  *        This file contains
  *        - Enums for flag naming purposes
+ *        - Enums for the views cycled by the view button
  *        - ISR for EXTI interrupts through button presses
  *        - ISR for recurring timer interrupts
  */
@@ -12,6 +13,11 @@
 #ifndef LCD_DATA_DISPLAY_H_
 #define LCD_DATA_DISPLAY_H_
 
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "dht22.h"
+#include "config.h"
+
 /**
  * @brief Display on or off.
  */
@@ -28,8 +34,37 @@ typedef enum {
 	CELSIUS 		= 1
 } TEMP_UNITS;
 
+/**
+ * @brief What the display shows, cycled by the view button.
+ */
+typedef enum {
+	VIEW_READINGS 		= 0,
+	VIEW_STATS_MINUTE 	= 1,
+	VIEW_STATS_HOUR 	= 2,
+	VIEW_STATS_DAY 		= 3,
+	VIEW_COMFORT 		= 4,
+#if FORECAST
+	VIEW_TREND 			= 5,
+	VIEWS 				= 6
+#else
+	VIEWS 				= 5
+#endif
+} DISPLAY_VIEW;
+
 /* Function prototypes ------------------------------------------------------------------*/
+void display_load_settings();
+void display_init();
+void display_init_start();
+uint8_t display_init_step();
+void print_placeholder();
+void display_sensor_fault();
+DHT22_Status sample_sensor();
 void print_temp_and_humidity_data();
+void display_task();
+void display_set_units(TEMP_UNITS units);
+void display_set_light(uint8_t on);
+uint8_t display_reading(int16_t* values);
+uint32_t display_reading_ms(void);
 void TIM14_IRQHandler_Extended();
 void EXTI0_1_IRQHandler_Extended();
 void EXTI2_3_IRQHandler_Extended();
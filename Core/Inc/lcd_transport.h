@@ -0,0 +1,44 @@
+/**
+ * @file lcd_transport.h
+ * @author Auska Wang
+ *
+ * @brief Header file of the LCD transport backends.
+ *        This file contains
+ *        - LCD_Transport struct which hides how bytes reach the HD44780
+ *        - the PCF8574 I2C expander backend (lcd_transport_i2c.c)
+ *        - the direct GPIO backend (lcd_transport_gpio.c)
+ *        i2clcd.c only talks to the display through one of these.
+ */
+
+#ifndef INC_LCD_TRANSPORT_H_
+#define INC_LCD_TRANSPORT_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief HD44780 register selected by the RS line.
+ */
+typedef enum {
+	LCD_REGISTER_INSTRUCTION 	= 0,
+	LCD_REGISTER_DATA 			= 1
+} LCD_Register;
+
+/**
+ * @brief Operations a backend provides to i2clcd.c.
+ */
+typedef struct {
+	void (*init)(void);												//configure pins/peripherals, no LCD traffic
+	void (*write_wakeup)(uint8_t cmd);								//single 8-bit mode write of upper nibble, used by init handshake
+	void (*write)(uint8_t byte, LCD_Register reg, uint8_t light_mode);	//full byte to instruction or data register
+	void (*hold)(uint16_t us);										//LCD needs us after the last write (clear/home), without blocking
+	uint8_t (*busy)(void);											//writes still on their way to the LCD
+	uint8_t interface_cmd;											//last handshake write, selects 4 or 8-bit interface
+	uint8_t function_set;											//function set command for this bus width, 2 lines 5x8 font
+} LCD_Transport;
+
+/* Backends ------------------------------------------------------------------*/
+extern const LCD_Transport lcd_transport_i2c;
+extern const LCD_Transport lcd_transport_gpio;
+
+#endif /* INC_LCD_TRANSPORT_H_ */
@@ -0,0 +1,48 @@
+/**
+ * @file mem_usage.h
+ * @author Auska Wang
+ *
+ * @brief Header file of mem_usage.c
+ *        This file contains
+ *        - Sbrk_Stats struct counting heap requests made through _sbrk (sysmem.c)
+ *        - Memory_Report struct with static, heap and stack use of the 12 KB RAM
+ *        - the runtime check of the heap-free build (HEAP_FREE in config.h)
+ */
+
+#ifndef INC_MEM_USAGE_H_
+#define INC_MEM_USAGE_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief Every call newlib made to _sbrk.
+ */
+typedef struct {
+	uint32_t calls;
+	uint32_t refused;			//refused in the heap-free build or for lack of room
+	uint32_t heap_bytes;		//heap handed out, the heap never shrinks
+	void* first_caller;			//return address of the first call, to find who allocates
+} Sbrk_Stats;
+
+/**
+ * @brief RAM use in bytes.
+ */
+typedef struct {
+	uint32_t data_bytes;		//initialized statics
+	uint32_t bss_bytes;			//zeroed statics, every buffer of the application
+	uint32_t heap_bytes;
+	uint32_t stack_reserved_bytes;	//_Min_Stack_Size, checked by the linker
+	uint32_t stack_peak_bytes;	//deepest stack seen since mem_usage_paint_stack()
+	uint32_t free_bytes;		//never touched by statics, heap or stack
+} Memory_Report;
+
+extern Sbrk_Stats sbrk_stats;
+extern Memory_Report memory_report;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void mem_usage_paint_stack(void);
+void mem_usage_update(void);
+void mem_usage_check(void);
+
+#endif /* INC_MEM_USAGE_H_ */
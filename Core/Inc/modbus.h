@@ -0,0 +1,88 @@
+/**
+ * @file modbus.h
+ * @author Auska Wang
+ *
+ * @brief Header file of modbus.c
+ *        This file contains
+ *        - the input and holding register map
+ *        - Modbus_Stats struct with request counts and response latency
+ *        - functions to receive requests on USART2 and answer them
+ *        Readings are in tenths, statistics in hundredths, signed values as two's complement.
+ */
+
+#ifndef INC_MODBUS_H_
+#define INC_MODBUS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "config.h"
+#include "calibration.h"
+#include "rolling_stats.h"
+
+#define MODBUS_RX_BYTES 256			//circular DMA buffer, the longest RTU frame
+#define MODBUS_MAX_FRAME 256
+#define MODBUS_CHAR_US (11000000U / MODBUS_BAUD)		//8 data bits, parity and stop bit
+#define MODBUS_GAP_US (MODBUS_BAUD > 19200 ? 1750U : MODBUS_CHAR_US * 7 / 2)	//3.5 characters, fixed above 19200 baud
+#define MODBUS_TIMER_US (MODBUS_GAP_US - MODBUS_CHAR_US)	//TIM17, started once the line was idle for a character
+
+/**
+ * @brief Input registers, function 04, read only.
+ */
+typedef enum {
+	MODBUS_IN_TEMPERATURE 		= 0,	//tenths of a degree C
+	MODBUS_IN_HUMIDITY 			= 1,	//tenths of a percent
+	MODBUS_IN_DEW_POINT 		= 2,	//tenths of a degree C
+	MODBUS_IN_STATUS 			= 3,	//MODBUS_STATUS_* bits
+	MODBUS_IN_UPTIME_HIGH 		= 4,	//seconds since boot, high word
+	MODBUS_IN_UPTIME_LOW 		= 5,
+	MODBUS_IN_ALARMS_RAISED 	= 6,	//since boot, low 16 bits
+	MODBUS_IN_REJECTED 			= 7,	//frames dropped by the filter, low 16 bits
+	MODBUS_IN_LATENCY_LAST 		= 8,	//response latency of the previous answered request, microseconds
+	MODBUS_IN_LATENCY_MAX 		= 9,	//slowest since boot, microseconds
+	MODBUS_IN_STATS 			= 10,	//per window (1 min, 1 h, 24 h), per channel: min, mean, max, deviation (hundredths), count
+	MODBUS_IN_REGISTERS 		= MODBUS_IN_STATS + STATS_WINDOWS * STATS_CHANNELS * 5
+} MODBUS_INPUT;
+
+#define MODBUS_STATUS_READING 0x0001		//a reading was taken since boot
+#define MODBUS_STATUS_ALARM_LATCHED 0x0002	//a latched alarm waits for acknowledgement
+#define MODBUS_STATUS_ALARM_NEAR 0x0004		//a value is near or beyond an alarm threshold
+
+/**
+ * @brief Holding registers, functions 03, 06 and 16. A calibration block is written whole
+ *        by function 16 from its first register: point count, then raw and corrected
+ *        value of each point, tenths.
+ */
+typedef enum {
+	MODBUS_HOLD_UNITS 				= 0,	//displayed units, 0 Fahrenheit, 1 Celsius
+	MODBUS_HOLD_LIGHT 				= 1,	//backlight, 0 off, 1 on
+	MODBUS_HOLD_INTERVAL 			= 2,	//sampling interval in seconds, 2 to 81, 0 adaptive
+	MODBUS_HOLD_ALARM_ACK 			= 3,	//1 while an alarm is latched, write 1 to acknowledge
+	MODBUS_HOLD_ALARM_THRESHOLDS 	= 4,	//threshold of each alarm rule, tenths, signed, stored
+	MODBUS_HOLD_CAL_TEMPERATURE 	= 10,
+	MODBUS_HOLD_CAL_HUMIDITY 		= 30,
+	MODBUS_HOLD_REGISTERS 			= MODBUS_HOLD_CAL_HUMIDITY + 1 + 2 * CALIBRATION_MAX_POINTS
+} MODBUS_HOLDING;
+
+/**
+ * @brief Traffic and response latency, from the end of the request gap to the response queued.
+ */
+typedef struct {
+	uint32_t frames;				//frames seen on the line, any address
+	uint32_t requests;				//addressed to this slave or broadcast, CRC good
+	uint32_t exceptions;			//answered with an exception
+	uint32_t crc_errors;
+	uint32_t overruns;				//frames lost, the main loop fell behind
+	uint32_t rx_restarts;			//reception restarted after a UART error
+	uint32_t last_latency_cycles;
+	uint32_t max_latency_cycles;
+} Modbus_Stats;
+
+extern Modbus_Stats modbus_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void modbus_init(void);
+void modbus_task(void);
+void modbus_gap_elapsed(void);
+uint16_t modbus_process(const uint8_t* request, uint16_t length, uint8_t* response);
+
+#endif /* INC_MODBUS_H_ */
@@ -0,0 +1,88 @@
+/**
+ * @file network.h
+ * @author Auska Wang
+ *
+ * @brief Header file of network.c
+ *        This file contains
+ *        - the frame types and layouts of the RS-485 network
+ *        - Network_Schedule struct, a beacon as this node reads it
+ *        - Network_Stats struct with the slots used and missed and the beacon handling time
+ *        - functions to follow the beacons and send readings in the assigned slot
+ *        Frames use the telemetry format: payload, CRC-16, COBS, 0x00. Little endian.
+ */
+
+#ifndef INC_NETWORK_H_
+#define INC_NETWORK_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "config.h"
+
+#define NETWORK_RX_BYTES 256			//circular DMA buffer
+#define NETWORK_MAX_SLOTS 64			//nodes a beacon can list, the most network_sim keeps in their slots
+#define NETWORK_BEACON_BYTES 12			//beacon payload before the slot table
+#define NETWORK_READING_BYTES 11
+#define NETWORK_CHAR_US ((10000000U + NETWORK_BAUD - 1) / NETWORK_BAUD)	//start, 8 data and stop bit
+#define NETWORK_READING_US ((NETWORK_READING_BYTES + 4) * NETWORK_CHAR_US)	//CRC, COBS byte and delimiter
+#define NETWORK_MAX_PERIOD_US 10000000U	//beacon period, well inside the 89 s the cycle count spans
+#define NETWORK_MIN_LEAD_US 100			//time needed between arming TIM17 and the slot
+#define NETWORK_JOIN_CHANCE 4			//a node without a slot asks in one open slot out of this many
+
+/**
+ * @brief First payload byte, after the telemetry frame types.
+ *        Beacon, from the concentrator: type, cycle (2), period in us (4), lead in us (2),
+ *        slot length in us (2), slot count, then the address owning each slot, 0 for open.
+ *        The first slot starts lead us after the beacon's last byte, the next one each
+ *        slot length later; the next beacon follows one period after this one.
+ *        Reading, in the node's slot: type, address, cycle answered (2), age of the reading
+ *        in ms (2), temperature and humidity in tenths (2 + 2), NETWORK_STATUS_* bits.
+ *        Join, in an open slot: type, address. The concentrator assigns it a slot.
+ */
+typedef enum {
+	NETWORK_FRAME_BEACON 	= 0x10,
+	NETWORK_FRAME_READING 	= 0x11,
+	NETWORK_FRAME_JOIN 		= 0x12
+} NETWORK_FRAME;
+
+#define NETWORK_STATUS_READING 0x01			//a reading was taken since boot
+#define NETWORK_STATUS_ALARM_LATCHED 0x02	//a latched alarm waits for acknowledgement
+#define NETWORK_STATUS_ALARM_NEAR 0x04		//a value is near or beyond an alarm threshold
+
+/**
+ * @brief A beacon, from this node's point of view.
+ */
+typedef struct {
+	uint16_t cycle;
+	uint32_t period_us;				//to the next beacon
+	uint16_t lead_us;				//beacon end to the first slot
+	uint16_t slot_us;
+	uint8_t slots;
+	int16_t slot;					//this node's slot, -1 if it has none
+	int16_t open_slot;				//first open slot, -1 if none
+} Network_Schedule;
+
+/**
+ * @brief Traffic and timing since boot.
+ */
+typedef struct {
+	uint32_t frames;				//received whole, any type
+	uint32_t bad_frames;			//malformed or failing their CRC
+	uint32_t beacons;
+	uint32_t sent;					//readings sent in this node's slot
+	uint32_t joins;					//join requests sent in an open slot
+	uint32_t late;					//slots missed, the beacon was handled too late
+	uint32_t unsynced;				//slots skipped, the beacon's timing was not trusted
+	uint32_t rx_restarts;			//reception restarted after a UART error
+	uint32_t max_handling_us;		//beacon end to slot armed, the lead the concentrator must give
+	int32_t clock_ppm;				//this node's clock against the concentrator's
+} Network_Stats;
+
+extern Network_Stats network_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void network_init(void);
+void network_task(void);
+void network_slot_elapsed(void);
+uint8_t network_schedule(const uint8_t* payload, uint8_t length, uint8_t address, Network_Schedule* schedule);
+
+#endif /* INC_NETWORK_H_ */
@@ -0,0 +1,74 @@
+/**
+ * @file packed_history.h
+ * @author Auska Wang
+ *
+ * @brief Header file of packed_history.c
+ *        This file contains
+ *        - Packed_Block struct, one block of delta encoded samples
+ *        - Packed_Cursor struct streaming samples back out from a given time
+ *        - Packed_History_Stats struct with density and encode/decode cost
+ *        Samples are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_PACKED_HISTORY_H_
+#define INC_PACKED_HISTORY_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "history.h"
+
+#define PACKED_BLOCK_BYTES 128
+#define PACKED_BLOCK_HEADER_BYTES 12
+#define PACKED_BLOCK_PAYLOAD (PACKED_BLOCK_BYTES - PACKED_BLOCK_HEADER_BYTES)
+
+/**
+ * @brief A block starts with its first sample in full. Every further sample is three
+ *        zigzag varints: the change of the sampling interval in ms, then the change
+ *        of each channel in tenths. A steady 2 s interval and slow readings take
+ *        one byte per varint.
+ */
+typedef struct {
+	uint32_t start_ms;					//HAL tick of the first sample, the seek index
+	int16_t base[HISTORY_CHANNELS];		//first sample
+	uint16_t reserved;
+	uint8_t count;						//samples in the block, base included
+	uint8_t used;						//payload bytes
+	uint8_t data[PACKED_BLOCK_PAYLOAD];
+} Packed_Block;
+
+/**
+ * @brief Read position, filled by packed_history_seek() and advanced by packed_history_next().
+ */
+typedef struct {
+	uint8_t blocks_left;		//blocks after the current one
+	uint8_t block;				//ring position
+	uint8_t index;				//next sample of the block
+	uint8_t offset;				//payload byte of the next sample
+	uint32_t time_ms;
+	uint32_t interval_ms;
+	int16_t values[HISTORY_CHANNELS];
+} Packed_Cursor;
+
+/**
+ * @brief Density and cost, density and decode figures refreshed by packed_history_report().
+ */
+typedef struct {
+	uint32_t samples;				//samples held
+	uint32_t bytes;					//bytes of the blocks holding them
+	uint16_t samples_per_kb;
+	uint32_t last_encode_cycles;
+	uint32_t max_encode_cycles;
+	uint32_t decode_cycles_per_sample;
+} Packed_History_Stats;
+
+extern Packed_History_Stats packed_history_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void packed_history_add(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms);
+void packed_history_clear(void);
+uint8_t packed_history_oldest(uint32_t* time_ms);
+uint8_t packed_history_seek(Packed_Cursor* cursor, uint32_t from_ms);
+uint8_t packed_history_next(Packed_Cursor* cursor, uint32_t* time_ms, int16_t values[HISTORY_CHANNELS]);
+void packed_history_report(void);
+
+#endif /* INC_PACKED_HISTORY_H_ */
@@ -0,0 +1,69 @@
+/**
+ * @file rolling_stats.h
+ * @author Auska Wang
+ *
+ * @brief Header file of rolling_stats.c
+ *        This file contains
+ *        - the channels and sliding windows statistics are kept for
+ *        - Stats_Summary struct returned by queries, in hundredths
+ *        - functions to feed samples and query a window
+ *        Samples are in tenths, as delivered by the DHT22.
+ */
+
+#ifndef INC_ROLLING_STATS_H_
+#define INC_ROLLING_STATS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "history.h"
+
+/**
+ * @brief Measured quantities, samples in tenths of a degree Celsius / percent.
+ */
+typedef enum {
+	STATS_TEMPERATURE 	= HISTORY_TEMPERATURE,
+	STATS_HUMIDITY 		= HISTORY_HUMIDITY,
+	STATS_CHANNELS 		= HISTORY_CHANNELS
+} STATS_CHANNEL;
+
+/**
+ * @brief Sliding windows over the history tiers. The minute window holds raw samples,
+ *        the hour window closed minutes and the day window closed hours, each plus the
+ *        buckets still open.
+ */
+typedef enum {
+	STATS_MINUTE 	= 0,
+	STATS_HOUR 		= 1,
+	STATS_DAY 		= 2,
+	STATS_WINDOWS 	= 3
+} STATS_WINDOW;
+
+/**
+ * @brief Statistics of one channel over one window, in hundredths.
+ */
+typedef struct {
+	int32_t min;
+	int32_t max;
+	int32_t mean;
+	uint32_t stddev;		//population standard deviation
+	uint32_t count;			//samples in the window
+} Stats_Summary;
+
+/**
+ * @brief Worst case cost, to check the O(1) updates on target.
+ */
+typedef struct {
+	uint32_t last_add_cycles;
+	uint32_t max_add_cycles;
+	uint32_t max_query_cycles;
+} Rolling_Stats_Cost;
+
+extern Rolling_Stats_Cost rolling_stats_cost;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void rolling_stats_init(void);
+void rolling_stats_add(const int16_t values[STATS_CHANNELS], uint32_t now_ms);
+uint8_t rolling_stats_get(STATS_CHANNEL channel, STATS_WINDOW window, Stats_Summary* summary);
+void rolling_stats_reset(void);
+
+#endif /* INC_ROLLING_STATS_H_ */
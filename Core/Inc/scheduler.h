@@ -0,0 +1,39 @@
+/**
+ * @file scheduler.h
+ * @author Auska Wang
+ *
+ * @brief Header file of scheduler.c
+ *        This file contains
+ *        - Scheduler_Stats struct with the work done against a fixed 2 s schedule
+ *        - functions to choose the next sampling interval and account for the work
+ *        - functions to fix the interval instead
+ */
+
+#ifndef INC_SCHEDULER_H_
+#define INC_SCHEDULER_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/**
+ * @brief Work done since boot. A fixed schedule would have read the sensor
+ *        elapsed_ms / DHT22_MIN_INTERVAL_MS times and written DISPLAY_ROWS lines each time.
+ */
+typedef struct {
+	uint32_t elapsed_ms;		//since the first sample
+	uint32_t frames;			//sensor reads
+	uint32_t fast_frames;		//reads at the fastest rate
+	uint32_t interval_ms;		//current sampling interval
+	uint32_t lines_written;		//display lines sent
+	uint32_t lines_skipped;		//display lines unchanged and not sent
+	uint32_t active_us;			//sampling and rendering, summed
+} Scheduler_Stats;
+
+extern Scheduler_Stats scheduler_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void scheduler_update(uint8_t sampled, const int16_t* values, uint8_t alarm_near, uint32_t now_ms);
+void scheduler_set_fixed(uint32_t interval_ms);
+uint32_t scheduler_fixed(void);
+
+#endif /* INC_SCHEDULER_H_ */
@@ -0,0 +1,64 @@
+/**
+ * @file settings.h
+ * @author Auska Wang
+ *
+ * @brief Header file of settings.c
+ *        This file contains
+ *        - the keys of the settings kept in flash
+ *        - Settings_Stats struct with boot load time and flash use
+ *        - functions to read, change and persist settings
+ */
+
+#ifndef INC_SETTINGS_H_
+#define INC_SETTINGS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "calibration.h"
+#include "alarm.h"
+
+#define SETTINGS_QUIET_MS 5000U		//a change is written once nothing changed for this long
+
+/**
+ * @brief Settings kept across resets. Keys are stored in flash, never renumber them.
+ */
+typedef enum {
+	SETTING_TEMP_UNITS 			= 0,	//TEMP_UNITS
+	SETTING_LIGHT_MODE 			= 1,	//off = 0, on = 1
+	SETTING_CALIBRATION 		= 2,	//per channel: point count, then each point (raw << 16 | corrected)
+	SETTING_ALARM_THRESHOLDS 	= SETTING_CALIBRATION + HISTORY_CHANNELS * (1 + CALIBRATION_MAX_POINTS),	//per alarm rule, tenths
+	SETTINGS 					= SETTING_ALARM_THRESHOLDS + ALARM_RULES
+} SETTING_KEY;
+
+/**
+ * @brief Key of a channel's calibration point count, its points follow.
+ */
+#define SETTING_CALIBRATION_POINTS(channel) ((SETTING_KEY)(SETTING_CALIBRATION + (channel) * (1 + CALIBRATION_MAX_POINTS)))
+
+/**
+ * @brief Key of an alarm rule's threshold.
+ */
+#define SETTING_ALARM_THRESHOLD(rule) ((SETTING_KEY)(SETTING_ALARM_THRESHOLDS + (rule)))
+
+#define SETTING_UNSET INT32_MIN		//default of settings whose module has its own default
+
+/**
+ * @brief Boot load time and flash use.
+ */
+typedef struct {
+	uint32_t load_us;			//settings_init(), page scan included
+	uint16_t records;			//records in the active page, its header included
+	uint32_t writes;			//records programmed
+	uint32_t compactions;		//current values copied into the other page, which then became active
+	uint32_t errors;			//HAL_FLASH_Program or HAL_FLASHEx_Erase failed
+} Settings_Stats;
+
+extern Settings_Stats settings_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void settings_init(void);
+int32_t settings_get(SETTING_KEY key);
+void settings_set(SETTING_KEY key, int32_t value);
+void settings_task(void);
+
+#endif /* INC_SETTINGS_H_ */
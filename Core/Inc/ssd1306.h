@@ -0,0 +1,43 @@
+/**
+ * @file ssd1306.h
+ * @author Auska Wang
+ *
+ * @brief Header file of ssd1306.c
+ *        This file contains
+ *        - geometry of the 128x64 SSD1306 OLED
+ *        - statistics of the dirty region flushes
+ *        - the functions to draw into the framebuffer and push it over DMA
+ */
+
+#ifndef INC_SSD1306_H_
+#define INC_SSD1306_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define SSD1306_WIDTH 128
+#define SSD1306_HEIGHT 64
+#define SSD1306_PAGES (SSD1306_HEIGHT / 8)
+
+/**
+ * @brief Counters for the bytes actually sent to the panel.
+ */
+typedef struct {
+	uint32_t flushes;			//completed flushes
+	uint32_t page_transfers;	//dirty page windows sent
+	uint32_t bytes_sent;		//framebuffer bytes sent, excluding commands
+	uint16_t last_flush_bytes;	//framebuffer bytes of the most recent flush
+} SSD1306_Stats;
+
+extern SSD1306_Stats ssd1306_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void ssd1306_init(void);
+void ssd1306_clear(void);
+void ssd1306_draw_char(uint8_t x, uint8_t page, char c);
+void ssd1306_draw_string(uint8_t x, uint8_t page, const char* str, uint8_t width);
+void ssd1306_flush(void);
+uint8_t ssd1306_busy(void);
+void ssd1306_set_contrast(uint8_t contrast);
+
+#endif /* INC_SSD1306_H_ */
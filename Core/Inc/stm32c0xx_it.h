@@ -51,8 +51,15 @@ void HardFault_Handler(void);
 void SVC_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
+void EXTI0_1_IRQHandler(void);
+void EXTI2_3_IRQHandler(void);
 void EXTI4_15_IRQHandler(void);
+void DMA1_Channel1_IRQHandler(void);
+void DMA1_Channel2_3_IRQHandler(void);
 void TIM14_IRQHandler(void);
+void TIM17_IRQHandler(void);
+void I2C1_IRQHandler(void);
+void USART2_IRQHandler(void);
 /* USER CODE BEGIN EFP */
 
 /* USER CODE END EFP */
@@ -0,0 +1,58 @@
+/**
+ * @file telemetry.h
+ * @author Auska Wang
+ *
+ * @brief Header file of telemetry.c
+ *        This file contains
+ *        - the frame types and reading status bits of the binary stream on USART2
+ *        - Telemetry_Stats struct with frame counts and encoding time
+ *        - functions to build, check and send frames
+ */
+
+#ifndef INC_TELEMETRY_H_
+#define INC_TELEMETRY_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "dht22.h"
+
+#define TELEMETRY_MAX_PAYLOAD 144		//bytes before the CRC, an export block
+#define TELEMETRY_FRAME_BYTES (TELEMETRY_MAX_PAYLOAD + 4)	//longest frame on the wire: CRC, COBS overhead byte and delimiter
+
+/**
+ * @brief First byte of every frame's payload.
+ */
+typedef enum {
+	TELEMETRY_FRAME_READING 		= 0x01,
+	TELEMETRY_FRAME_EXPORT_BLOCK 	= 0x02,		//records of an export, see export.c
+	TELEMETRY_FRAME_EXPORT_END 		= 0x03
+} TELEMETRY_FRAME;
+
+/**
+ * @brief Status bits of a reading frame.
+ */
+#define TELEMETRY_STATUS_READ_FAILED 0x01	//no answer or bad checksum, values are the previous ones
+#define TELEMETRY_STATUS_REJECTED 0x02		//dropped by the rate check, values are the previous ones
+#define TELEMETRY_STATUS_ALARM_NEAR 0x04	//a value is near or beyond an alarm threshold
+
+/**
+ * @brief Frames sent and refused, and the cost of building one.
+ */
+typedef struct {
+	uint32_t frames;				//queued whole
+	uint32_t dropped;				//refused, transmit ring full
+	uint32_t last_cycles;			//CRC, COBS and queueing of the last frame
+	uint32_t max_cycles;
+} Telemetry_Stats;
+
+extern Telemetry_Stats telemetry_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+uint16_t telemetry_encode(const uint8_t* payload, uint8_t length, uint8_t* frame);
+uint8_t telemetry_decode(uint8_t* frame, uint16_t length);
+uint8_t telemetry_send(const uint8_t* payload, uint8_t length);
+void telemetry_send_reading(const DHT22_Data* raw, uint8_t status, const int16_t* values, uint32_t now_ms);
+void telemetry_stream(uint8_t on);
+uint8_t telemetry_streaming(void);
+
+#endif /* INC_TELEMETRY_H_ */
@@ -0,0 +1,56 @@
+/**
+ * @file trend_graph.h
+ * @author Auska Wang
+ *
+ * @brief Header file of trend_graph.c
+ *        This file contains
+ *        - the channels and styles of the trend graphs
+ *        - functions to feed samples and redraw the graphs into user glyphs
+ *        Each channel owns TREND_GLYPHS_PER_CHANNEL consecutive display glyphs.
+ */
+
+#ifndef INC_TREND_GRAPH_H_
+#define INC_TREND_GRAPH_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "display.h"
+
+#define TREND_GLYPHS_PER_CHANNEL 4
+#define TREND_SAMPLES_PER_COLUMN 6	//one pixel column per 12 s at 2 s sampling, 20 columns = 4 minutes
+
+/**
+ * @brief Measured quantities with a graph.
+ */
+typedef enum {
+	TREND_TEMPERATURE 	= 0,
+	TREND_HUMIDITY 		= 1,
+	TREND_CHANNELS 		= 2
+} TREND_CHANNEL;
+
+/**
+ * @brief Graph drawing style.
+ */
+typedef enum {
+	TREND_SPARKLINE 	= 0,
+	TREND_BAR 			= 1
+} TREND_STYLE;
+
+/**
+ * @brief Glyph rows actually sent, to check the extra display traffic.
+ */
+typedef struct {
+	uint32_t renders;			//redraws that found a new column
+	uint32_t rows_uploaded;		//glyph rows written to the display
+	uint16_t last_rows_uploaded;
+} Trend_Stats;
+
+extern Trend_Stats trend_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+void trend_graph_add(TREND_CHANNEL channel, int16_t value);
+void trend_graph_render(const Display_Driver* display, TREND_STYLE style);
+void trend_graph_invalidate(void);
+char trend_graph_char(TREND_CHANNEL channel, uint8_t index);
+
+#endif /* INC_TREND_GRAPH_H_ */
@@ -0,0 +1,37 @@
+/**
+ * @file uart_tx.h
+ * @author Auska Wang
+ *
+ * @brief Header file of uart_tx.c
+ *        This file contains
+ *        - Uart_Tx_Stats struct with the traffic and overflows of the transmit ring
+ *        - functions to queue bytes for USART2 without waiting for the line
+ */
+
+#ifndef INC_UART_TX_H_
+#define INC_UART_TX_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#define UART_TX_RING_BYTES 512		//one slot stays free to tell full from empty
+
+/**
+ * @brief Traffic through the ring.
+ */
+typedef struct {
+	uint32_t bytes;					//queued
+	uint32_t dropped_writes;		//writes refused, not enough room
+	uint32_t dma_starts;			//transfers handed to the DMA
+	uint32_t dma_errors;			//HAL_UART_Transmit_DMA refused a transfer
+	uint16_t max_queued;			//bytes waiting, highest seen
+} Uart_Tx_Stats;
+
+extern Uart_Tx_Stats uart_tx_stats;
+
+/* Function prototypes ------------------------------------------------------------------*/
+uint8_t uart_tx_write(const uint8_t* data, uint16_t length);
+uint8_t uart_tx_write_delimited(const uint8_t* data, uint16_t length);
+uint16_t uart_tx_free(void);
+
+#endif /* INC_UART_TX_H_ */
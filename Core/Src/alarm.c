@@ -0,0 +1,289 @@
+/**
+ * @file alarm.c
+ * @author Auska Wang
+ * @brief Over and under limit alarms on temperature, humidity and dew point, driving the
+ *        user LED and a buzzer or relay output.
+ *
+ *        Every rule keeps its own state, so a new frame only compares each rule's value
+ *        against one bound and, while a hold-off runs, checks its elapsed time. With
+ *        the rules below that is about 150 cycles, 3 us at 48 MHz, and the outputs are
+ *        written with one BSRR store each only when they change. alarm_stats keeps the
+ *        measured evaluation time and the latency from the frame being decoded to an
+ *        output being asserted, which includes calibration, filtering and the dew point.
+ *
+ *        rules holds the defaults. The thresholds can be changed at run time from the
+ *        console or Modbus and are kept across resets by settings.c; the other fields
+ *        are edited here.
+ */
+
+/* Includes */
+#include "alarm.h"
+#include "general.h"
+#include "settings.h"
+
+/* Defines */
+#define THRESHOLD_MIN_TEMPERATURE -400		//tenths, the DHT22's range
+#define THRESHOLD_MAX_TEMPERATURE 800
+#define THRESHOLD_MAX_HUMIDITY 1000
+
+/**
+ * @brief States of a rule.
+ */
+typedef enum {
+	RULE_IDLE 		= 0,	//value within the threshold
+	RULE_PENDING 	= 1,	//beyond the threshold, hold-off running
+	RULE_RAISED 	= 2,	//alarm raised, outputs driven
+	RULE_LATCHED 	= 3		//value back, held raised until acknowledged
+} RULE_STATE;
+
+/* Variables */
+Alarm_Stats alarm_stats;
+
+static const Alarm_Rule rules[ALARM_RULES] = {
+	//source			direction		latching	outputs									threshold	hysteresis	hold_off_s
+	{ALARM_TEMPERATURE,	ALARM_ABOVE,	0,			ALARM_OUTPUT_LED,						300,		10,			60},
+	{ALARM_TEMPERATURE,	ALARM_BELOW,	1,			ALARM_OUTPUT_LED | ALARM_OUTPUT_BUZZER,	50,			10,			60},
+	{ALARM_HUMIDITY,	ALARM_ABOVE,	0,			ALARM_OUTPUT_LED,						700,		30,			300},
+	{ALARM_HUMIDITY,	ALARM_BELOW,	0,			ALARM_OUTPUT_LED,						250,		30,			300},
+	{ALARM_DEW_POINT,	ALARM_ABOVE,	1,			ALARM_OUTPUT_LED | ALARM_OUTPUT_BUZZER,	180,		10,			120},
+};
+
+static int16_t thresholds[ALARM_RULES];		//in use, rules[].threshold or the stored setting
+static uint8_t states[ALARM_RULES];
+static uint32_t pending_since_ms[ALARM_RULES];
+static uint8_t applied_outputs = 0;
+static volatile uint8_t latched = 0;				//a rule is in RULE_LATCHED
+static uint8_t near = 0;							//last frame near a threshold or an alarm not idle
+static volatile uint8_t acknowledge_due = 0;		//set by alarm_acknowledge()
+
+/**
+ * @brief Drives an output pin with a single store.
+ *
+ * @param port Port, pin Pin, on 1 to set, 0 to reset
+ * @return None
+ */
+static inline void write_output(GPIO_TypeDef* port, uint16_t pin, uint8_t on)
+{
+	port->BSRR = on ? pin : (uint32_t)pin << 16;
+}
+
+/**
+ * @brief Collects the outputs of the raised and latched rules and writes those that
+ *        changed.
+ *
+ * @param None
+ * @return 1 if an output was asserted
+ */
+static uint8_t update_outputs(void)
+{
+	uint8_t outputs = 0, any_latched = 0;
+
+	for (uint8_t i = 0; i < ALARM_RULES; i++)
+	{
+		if (states[i] >= RULE_RAISED)
+			outputs |= rules[i].outputs;
+		any_latched |= states[i] == RULE_LATCHED;
+	}
+	latched = any_latched;
+
+	uint8_t changed = outputs ^ applied_outputs;
+
+	if (changed & ALARM_OUTPUT_LED)
+		write_output(LED_Port, LED_Pin, outputs & ALARM_OUTPUT_LED);
+	if (changed & ALARM_OUTPUT_BUZZER)
+		write_output(BUZZER_Port, BUZZER_Pin, outputs & ALARM_OUTPUT_BUZZER);
+	applied_outputs = outputs;
+	return (changed & outputs) != 0;
+}
+
+/**
+ * @brief Takes each rule's threshold from the settings, or its default if none is
+ *        stored (SETTING_UNSET) or the stored one is out of range. Called at boot after settings_init().
+ *
+ * @param None
+ * @return None
+ */
+void alarm_init(void)
+{
+	for (uint8_t i = 0; i < ALARM_RULES; i++)
+	{
+		int32_t stored = settings_get(SETTING_ALARM_THRESHOLD(i));
+
+		thresholds[i] = alarm_threshold_valid(i, stored) ? (int16_t)stored : rules[i].threshold;
+	}
+}
+
+/**
+ * @brief Threshold of a rule and what it watches.
+ *
+ * @param rule Rule, below ALARM_RULES, source and direction Filled in if not NULL
+ * @return Threshold in use, tenths
+ */
+int16_t alarm_threshold(uint8_t rule, ALARM_SOURCE* source, ALARM_DIRECTION* direction)
+{
+	if (source)
+		*source = (ALARM_SOURCE)rules[rule].source;
+	if (direction)
+		*direction = (ALARM_DIRECTION)rules[rule].direction;
+	return thresholds[rule];
+}
+
+/**
+ * @brief Tells whether a threshold is within the sensor's range for the rule's source.
+ *
+ * @param rule Rule, threshold Tenths
+ * @return 1 if valid
+ */
+uint8_t alarm_threshold_valid(uint8_t rule, int32_t threshold)
+{
+	if (rule >= ALARM_RULES)
+		return 0;
+	if (rules[rule].source == ALARM_HUMIDITY)
+		return threshold >= 0 && threshold <= THRESHOLD_MAX_HUMIDITY;
+	return threshold >= THRESHOLD_MIN_TEMPERATURE && threshold <= THRESHOLD_MAX_TEMPERATURE;
+}
+
+/**
+ * @brief Changes a rule's threshold, from the next frame on, and stores it. The rule
+ *        keeps its state, so a raised alarm clears by the hysteresis of the new value.
+ *
+ * @param rule Rule, threshold Tenths, checked with alarm_threshold_valid()
+ * @return None
+ */
+void alarm_set_threshold(uint8_t rule, int16_t threshold)
+{
+	thresholds[rule] = threshold;
+	settings_set(SETTING_ALARM_THRESHOLD(rule), threshold);
+}
+
+/**
+ * @brief Advances every rule with a new frame and updates the outputs.
+ *
+ * @param values ALARM_SOURCES values, tenths, now_ms Time of the frame,
+ *        ready_cycles get_cycle_count() when the frame was decoded
+ * @return None
+ */
+void alarm_evaluate(const int16_t* values, uint32_t now_ms, uint32_t ready_cycles)
+{
+	uint32_t start = get_cycle_count();
+	uint8_t any_near = 0;
+
+	for (uint8_t i = 0; i < ALARM_RULES; i++)
+	{
+		const Alarm_Rule* rule = &rules[i];
+		int16_t value = values[rule->source];
+		int16_t threshold = thresholds[i];
+		uint8_t beyond, back;
+		int32_t margin;			//distance left before the rule raises
+
+		if (rule->direction == ALARM_ABOVE)
+		{
+			beyond = value > threshold;
+			back = value < threshold - rule->hysteresis;
+			margin = threshold - value;
+		}
+		else
+		{
+			beyond = value < threshold;
+			back = value > threshold + rule->hysteresis;
+			margin = value - threshold;
+		}
+		any_near |= margin < ALARM_NEAR_MARGIN;
+
+		switch (states[i])
+		{
+		case RULE_IDLE:
+			if (!beyond)
+				break;
+			states[i] = RULE_PENDING;
+			pending_since_ms[i] = now_ms;
+			//a rule without hold-off raises on this frame
+			//fall through
+		case RULE_PENDING:
+			if (!beyond)
+				states[i] = RULE_IDLE;
+			else if (now_ms - pending_since_ms[i] >= rule->hold_off_s * 1000U)
+			{
+				states[i] = RULE_RAISED;
+				alarm_stats.raised++;
+			}
+			break;
+		case RULE_RAISED:
+			if (back)
+				states[i] = rule->latching ? RULE_LATCHED : RULE_IDLE;
+			break;
+		default:	//RULE_LATCHED
+			if (beyond)
+				states[i] = RULE_RAISED;
+			break;
+		}
+		any_near |= states[i] != RULE_IDLE;
+	}
+	near = any_near;
+
+	if (update_outputs())
+	{
+		alarm_stats.last_latency_cycles = get_cycle_count() - ready_cycles;
+		if (alarm_stats.last_latency_cycles > alarm_stats.max_latency_cycles)
+			alarm_stats.max_latency_cycles = alarm_stats.last_latency_cycles;
+	}
+
+	alarm_stats.last_cycles = get_cycle_count() - start;
+	if (alarm_stats.last_cycles > alarm_stats.max_cycles)
+		alarm_stats.max_cycles = alarm_stats.last_cycles;
+}
+
+/**
+ * @brief Whether a latched alarm waits for acknowledgement. Safe from an ISR.
+ *
+ * @param None
+ * @return 1 if an alarm is latched
+ */
+uint8_t alarm_latched(void)
+{
+	return latched;
+}
+
+/**
+ * @brief Whether the last frame was within ALARM_NEAR_MARGIN of raising a rule, or a
+ *        rule was pending, raised or latched.
+ *
+ * @param None
+ * @return 1 if an alarm is near
+ */
+uint8_t alarm_near(void)
+{
+	return near;
+}
+
+/**
+ * @brief Requests that latched alarms whose value is back are cleared. Safe from an ISR,
+ *        the request is carried out by alarm_task().
+ *
+ * @param None
+ * @return None
+ */
+void alarm_acknowledge(void)
+{
+	acknowledge_due = 1;
+}
+
+/**
+ * @brief Clears acknowledged alarms. Called from the main loop.
+ *
+ * @param None
+ * @return None
+ */
+void alarm_task(void)
+{
+	if (!acknowledge_due)
+		return;
+	acknowledge_due = 0;
+
+	for (uint8_t i = 0; i < ALARM_RULES; i++)
+	{
+		if (states[i] == RULE_LATCHED)
+			states[i] = RULE_IDLE;
+	}
+	update_outputs();
+}
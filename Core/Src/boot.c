@@ -0,0 +1,70 @@
+/**
+ * @file boot.c
+ * @author Auska Wang
+ * @brief Boot pipeline from hardware_init() to the first valid reading.
+ *
+ *        The display and the DHT22 both need time after power up (40 ms and 1 s).
+ *        Instead of waiting for them one after the other, both waits count from
+ *        reset and run alongside each other: the display init is stepped as its
+ *        deadlines pass, a placeholder appears as soon as it is ready, and the
+ *        sensor is only asked once its own power-up time is over.
+ *        A sensor that fails BOOT_SENSOR_ATTEMPTS reads in a row is shown as a fault and
+ *        the main loop starts without a reading; sampling keeps trying the sensor from there.
+ */
+
+/* Includes */
+#include "boot.h"
+#include "general.h"
+#include "dht22.h"
+#include "lcd_data_display.h"
+
+/* Defines */
+#define BOOT_SENSOR_ATTEMPTS 5		//10 s of reads at the sensor's 2 s minimum interval
+
+/* Variables */
+Boot_Stats boot_stats;
+
+/**
+ * @brief Runs the boot stages until the first valid reading is on the display,
+ *        or until the sensor failed BOOT_SENSOR_ATTEMPTS times, then starts periodic sampling.
+ *
+ * @param None
+ * @return None
+ */
+void boot_run()
+{
+	uint8_t display_ready = 0;
+	uint32_t next_request_ms = DHT22_POWER_ON_MS;
+
+	boot_stats.hardware_ready_ms = HAL_GetTick();
+	display_init_start();
+
+	while (1)
+	{
+		if (!display_ready && display_init_step())
+		{
+			display_ready = 1;
+			print_placeholder();
+			boot_stats.display_ready_ms = HAL_GetTick();
+		}
+
+		if (display_ready && HAL_GetTick() >= next_request_ms)
+		{
+			boot_stats.sensor_attempts++;
+			if (sample_sensor() == DHT22_RESPONSE_SUCCESSFUL)
+			{
+				print_temp_and_humidity_data();
+				boot_stats.first_reading_ms = HAL_GetTick();
+				break;
+			}
+			if (boot_stats.sensor_attempts >= BOOT_SENSOR_ATTEMPTS)
+			{
+				display_sensor_fault();	//no reading yet, display_reading() and the Modbus status report it invalid
+				break;
+			}
+			next_request_ms = HAL_GetTick() + DHT22_MIN_INTERVAL_MS;
+		}
+	}
+
+	sampling_start();
+}
@@ -0,0 +1,170 @@
+/**
+ * @file calibration.c
+ * @author Auska Wang
+ * @brief Per-sensor correction of the readings by piecewise linear tables.
+ *
+ *        Each channel has up to CALIBRATION_MAX_POINTS breakpoints mapping a raw
+ *        reading to the reference reading, measured per unit. The slope of every
+ *        segment is computed once, as a Q16 fraction, when a table is loaded, so a
+ *        correction is a binary search over at most 7 segments, one multiply and a
+ *        shift: about 30 cycles, no division. Readings beyond the end points follow
+ *        the first or last segment.
+ *
+ *        Tables are stored through settings.c, one key for the point count and one per
+ *        point, so they survive resets. Without a stored table a channel uses its
+ *        default: temperature unchanged, humidity 7.0 % lower, the offset the firmware
+ *        always applied.
+ */
+
+/* Includes */
+#include "calibration.h"
+#include "settings.h"
+
+/* Defines */
+#define SLOPE_ONE 65536				//Q16
+#define MAX_SLOPE (4 * SLOPE_ONE)	//keeps (raw - breakpoint) * slope inside int32_t
+
+/**
+ * @brief A channel's breakpoints and the slope of the segment starting at each.
+ */
+typedef struct {
+	uint8_t count;
+	int16_t raw[CALIBRATION_MAX_POINTS];
+	int16_t corrected[CALIBRATION_MAX_POINTS];
+	int32_t slope[CALIBRATION_MAX_POINTS - 1];		//Q16 corrected per raw tenth
+} Calibration_Table;
+
+/* Variables */
+static Calibration_Table tables[HISTORY_CHANNELS];
+
+static const Calibration_Point default_temperature[] = {{-400, -400}, {800, 800}};
+static const Calibration_Point default_humidity[] = {{0, -70}, {1000, 930}};
+
+/**
+ * @brief Validates points and builds a table from them.
+ *
+ * @param table Table, replaced only if the points are valid, points Breakpoints, count Number of points
+ * @return CALIBRATION_OK or the first problem found
+ */
+static Calibration_Status build(Calibration_Table* table, const Calibration_Point* points, uint8_t count)
+{
+	Calibration_Table built;
+
+	if (count < 2 || count > CALIBRATION_MAX_POINTS)
+		return CALIBRATION_POINT_COUNT;
+
+	built.count = count;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		built.raw[i] = points[i].raw;
+		built.corrected[i] = points[i].corrected;
+		if (i == 0)
+			continue;
+
+		int32_t raw_span = points[i].raw - points[i - 1].raw;
+		int32_t corrected_span = points[i].corrected - points[i - 1].corrected;
+
+		if (raw_span <= 0 || corrected_span <= 0)
+			return CALIBRATION_NOT_MONOTONIC;
+		if (corrected_span > raw_span * (MAX_SLOPE / SLOPE_ONE))
+			return CALIBRATION_SLOPE_RANGE;
+		built.slope[i - 1] = (corrected_span * SLOPE_ONE + raw_span / 2) / raw_span;
+	}
+
+	*table = built;
+	return CALIBRATION_OK;
+}
+
+/**
+ * @brief Restores the stored tables, or the defaults where none is stored or a stored
+ *        one is invalid. Called at boot after settings_init().
+ *
+ * @return None
+ */
+void calibration_init(void)
+{
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		SETTING_KEY key = SETTING_CALIBRATION_POINTS(ch);
+		Calibration_Point points[CALIBRATION_MAX_POINTS];
+		int32_t count = settings_get(key);
+
+		for (int i = 0; i < count && i < CALIBRATION_MAX_POINTS; i++)
+		{
+			uint32_t packed = (uint32_t)settings_get(key + 1 + i);
+
+			points[i].raw = (int16_t)(packed >> 16);
+			points[i].corrected = (int16_t)packed;
+		}
+
+		if (count > CALIBRATION_MAX_POINTS || build(&tables[ch], points, (uint8_t)count) != CALIBRATION_OK)
+		{
+			if (ch == HISTORY_TEMPERATURE)
+				build(&tables[ch], default_temperature, sizeof(default_temperature) / sizeof(default_temperature[0]));
+			else
+				build(&tables[ch], default_humidity, sizeof(default_humidity) / sizeof(default_humidity[0]));
+		}
+	}
+}
+
+/**
+ * @brief Replaces a channel's table and stores it. An invalid table changes nothing.
+ *
+ * @param channel Channel, points Breakpoints in increasing order, count Number of points
+ * @return CALIBRATION_OK or the first problem found
+ */
+Calibration_Status calibration_load(HISTORY_CHANNEL channel, const Calibration_Point* points, uint8_t count)
+{
+	SETTING_KEY key = SETTING_CALIBRATION_POINTS(channel);
+	Calibration_Status status = build(&tables[channel], points, count);
+
+	if (status != CALIBRATION_OK)
+		return status;
+
+	settings_set(key, count);
+	for (uint8_t i = 0; i < count; i++)
+		settings_set(key + 1 + i, (int32_t)(((uint32_t)(uint16_t)points[i].raw << 16) | (uint16_t)points[i].corrected));
+	return CALIBRATION_OK;
+}
+
+/**
+ * @brief The breakpoints a channel is corrected with, stored or default.
+ *
+ * @param channel Channel, points Filled with up to CALIBRATION_MAX_POINTS points
+ * @return Number of points
+ */
+uint8_t calibration_points(HISTORY_CHANNEL channel, Calibration_Point* points)
+{
+	const Calibration_Table* table = &tables[channel];
+
+	for (uint8_t i = 0; i < table->count; i++)
+	{
+		points[i].raw = table->raw[i];
+		points[i].corrected = table->corrected[i];
+	}
+	return table->count;
+}
+
+/**
+ * @brief Corrects a reading.
+ *
+ * @param channel Channel, raw Reading in tenths
+ * @return Corrected reading in tenths
+ */
+int16_t calibration_apply(HISTORY_CHANNEL channel, int16_t raw)
+{
+	const Calibration_Table* table = &tables[channel];
+	uint8_t low = 0, high = table->count - 2;	//segment whose start is the last at or below raw
+
+	while (low < high)
+	{
+		uint8_t middle = (low + high + 1) / 2;
+
+		if (table->raw[middle] <= raw)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	return table->corrected[low] + (((raw - table->raw[low]) * table->slope[low] + SLOPE_ONE / 2) >> 16);
+}
@@ -0,0 +1,300 @@
+/**
+ * @file comfort.c
+ * @author Auska Wang
+ * @brief Dew point, heat index and absolute humidity in integer arithmetic.
+ *
+ *        The textbook formulas need log and exp, hundreds of microseconds each as
+ *        soft float on the M0+. Here:
+ *        - the dew point inverts the Magnus formula (b = 17.62, c = 243.12 C) through
+ *          a table of ln(es(T) / es(0)) every 3.2 C, with precomputed inverse slopes,
+ *          and ln(RH) from the bit length of RH and a 16 segment ln(1 + f) table
+ *        - the heat index is the NWS Rothfusz polynomial with its low humidity and
+ *          high humidity adjustments, in 64 bit fixed point, in Fahrenheit as defined
+ *        - the absolute humidity scales a table of saturation density every 1.6 C
+ *        Against the same formulas in double precision, over -40 to 80 C and 1 to
+ *        100 %RH, the errors stay within 0.07 C dew point, 0.06 C heat index and 0.5 %
+ *        absolute humidity, well inside the DHT22's own accuracy (Tests/test_comfort.c).
+ */
+
+/* Includes */
+#include "comfort.h"
+#include "general.h"
+
+/* Defines */
+#define DEW_TABLE_FIRST -640		//tenths of a degree, first entry of ln_saturation
+#define DEW_TABLE_STEP_SHIFT 5		//entries every 32 tenths
+#define DEW_TABLE_ENTRIES 47		//-64.0 to 83.2 C
+#define AH_TABLE_FIRST -400			//tenths of a degree, first entry of saturation_density
+#define AH_TABLE_STEP_SHIFT 4		//entries every 16 tenths
+#define AH_TABLE_ENTRIES 76			//-40.0 to 80.0 C
+#define LN2_Q16 45426
+#define LN1000_Q16 452708
+#define HEAT_INDEX_SHIFT 44			//coefficient scale of the Rothfusz polynomial
+#define HEAT_INDEX_MAX_F 15000		//hundredths of a degree, the polynomial is clamped above
+
+/* Variables */
+Comfort_Cost comfort_cost;
+
+/**
+ * @brief b * T / (c + T) = ln(es(T) / es(0)) of the Magnus formula, Q16, every 3.2 C from -64 C.
+ */
+static const int32_t ln_saturation[DEW_TABLE_ENTRIES] = {
+	-412593, -385084, -358523, -332864, -308060, -284070, -260854, -238375,
+	-216599, -195493, -175028, -155173, -135902, -117190, -99013, -81349,
+	-64175, -47472, -31220, -15402, 0, 15002, 29618, 43865,
+	57755, 71303, 84519, 97417, 110008, 122303, 134312, 146044,
+	157510, 168718, 179677, 190395, 200880, 211139, 221180, 231010,
+	240634, 250061, 259294, 268342, 277208, 285899, 294419
+};
+
+/**
+ * @brief 32 tenths * 2^24 / (ln_saturation[i + 1] - ln_saturation[i]), tenths per Q16 step, Q24.
+ */
+static const int32_t ln_saturation_inverse[DEW_TABLE_ENTRIES - 1] = {
+	19516, 20213, 20923, 21645, 22379, 23125, 23883, 24654,
+	25437, 26234, 27040, 27859, 28691, 29536, 30394, 31261,
+	32142, 33034, 33941, 34857, 35787, 36732, 37683, 38652,
+	39627, 40623, 41624, 42639, 43666, 44706, 45761, 46823,
+	47901, 48989, 50091, 51204, 52332, 53468, 54616, 55785,
+	56950, 58147, 59336, 60554, 61773, 63013
+};
+
+/**
+ * @brief ln(1 + i / 16), Q16.
+ */
+static const int32_t ln_one_plus[17] = {
+	0, 3973, 7719, 11262, 14624, 17821, 20870, 23783,
+	26573, 29248, 31818, 34292, 36675, 38975, 41196, 43345,
+	45426
+};
+
+/**
+ * @brief Water vapour density at saturation, mg/m^3, every 1.6 C from -40 C.
+ *        216.7 * es(T) / (273.15 + T), es from the Magnus formula in hPa.
+ */
+static const uint32_t saturation_density[AH_TABLE_ENTRIES] = {
+	177, 207, 242, 282, 328, 380, 440, 508,
+	585, 673, 772, 883, 1009, 1151, 1310, 1489,
+	1688, 1911, 2159, 2436, 2743, 3084, 3461, 3879,
+	4340, 4849, 5409, 6026, 6702, 7445, 8258, 9148,
+	10120, 11181, 12338, 13597, 14966, 16453, 18066, 19814,
+	21707, 23754, 25966, 28352, 30925, 33697, 36679, 39885,
+	43328, 47022, 50983, 55225, 59765, 64620, 69807, 75343,
+	81249, 87543, 94245, 101378, 108962, 117020, 125576, 134653,
+	144278, 154475, 165271, 176693, 188771, 201533, 215010, 229232,
+	244231, 260040, 276693, 294224
+};
+
+/**
+ * @brief Rothfusz coefficients scaled by 2^44 for T in hundredths of a degree F and RH in
+ *        tenths, giving the heat index in hundredths: 1, T, RH, T RH, T^2, RH^2, T^2 RH,
+ *        T RH^2, T^2 RH^2.
+ */
+static const int64_t heat_index_coefficients[9] = {
+	-74553925237630560LL, 36046657134002LL, 1784433708119824LL, -395393898721LL,
+	-1202923775LL, -964353853068LL, 21616223LL, 150029681LL, -3501LL
+};
+
+/**
+ * @brief Linear interpolation between two table entries.
+ *
+ * @param low/high Entries, fraction Position between them, shift Bits of fraction
+ * @return Interpolated value
+ */
+static inline int32_t interpolate(int32_t low, int32_t high, int32_t fraction, uint8_t shift)
+{
+	return low + (((high - low) * fraction) >> shift);
+}
+
+/**
+ * @brief Natural logarithm of a relative humidity.
+ *
+ * @param humidity Tenths of a percent, 1 to 1000
+ * @return ln(humidity / 1000), Q16
+ */
+static int32_t ln_humidity(uint32_t humidity)
+{
+	int32_t exponent = 15;		//humidity is normalized to 1.f * 2^15 in [0x8000, 0xFFFF]
+	uint32_t fraction;
+
+	if (humidity < 0x80)
+	{
+		humidity <<= 8;
+		exponent -= 8;
+	}
+	if (humidity < 0x800)
+	{
+		humidity <<= 4;
+		exponent -= 4;
+	}
+	while (humidity < 0x8000)
+	{
+		humidity <<= 1;
+		exponent--;
+	}
+
+	fraction = humidity - 0x8000;		//Q15, 4 bits of segment then 11 bits within it
+	return exponent * LN2_Q16
+			+ interpolate(ln_one_plus[fraction >> 11], ln_one_plus[(fraction >> 11) + 1], fraction & 0x7FF, 11)
+			- LN1000_Q16;
+}
+
+/**
+ * @brief Dew point by inverting ln(es) of the Magnus formula. Also used on its own by
+ *        the alarms, without the cost of the other metrics.
+ *
+ * @param temperature Tenths of a degree C, humidity Tenths of a percent
+ * @return Dew point in tenths of a degree C, at least -64.0
+ */
+int16_t comfort_dew_point(int16_t temperature, int16_t humidity)
+{
+	int32_t offset, gamma;
+	uint8_t low = 0, high = DEW_TABLE_ENTRIES - 2;
+
+	if (temperature < DEW_TABLE_FIRST)
+		temperature = DEW_TABLE_FIRST;
+	if (temperature >= DEW_TABLE_FIRST + ((DEW_TABLE_ENTRIES - 1) << DEW_TABLE_STEP_SHIFT))
+		temperature = DEW_TABLE_FIRST + ((DEW_TABLE_ENTRIES - 1) << DEW_TABLE_STEP_SHIFT) - 1;
+	if (humidity < 1)
+		humidity = 1;
+	if (humidity > 1000)
+		humidity = 1000;
+
+	offset = temperature - DEW_TABLE_FIRST;
+	gamma = interpolate(ln_saturation[offset >> DEW_TABLE_STEP_SHIFT], ln_saturation[(offset >> DEW_TABLE_STEP_SHIFT) + 1],
+			offset & ((1 << DEW_TABLE_STEP_SHIFT) - 1), DEW_TABLE_STEP_SHIFT)
+			+ ln_humidity(humidity);		//ln(e / es(0)), e the vapour pressure
+	if (gamma < ln_saturation[0])
+		return DEW_TABLE_FIRST;
+
+	while (low < high)		//last table entry at or below gamma
+	{
+		uint8_t middle = (low + high + 1) / 2;
+
+		if (ln_saturation[middle] <= gamma)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	return DEW_TABLE_FIRST + (low << DEW_TABLE_STEP_SHIFT)
+			+ (int32_t)(((uint32_t)(gamma - ln_saturation[low]) * (uint32_t)ln_saturation_inverse[low] + (1U << 23)) >> 24);
+}
+
+/**
+ * @brief Integer square root.
+ *
+ * @param n Radicand
+ * @return floor(sqrt(n))
+ */
+static uint32_t isqrt(uint32_t n)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > n)
+		bit >>= 2;
+	while (bit)
+	{
+		if (n >= root + bit)
+		{
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return root;
+}
+
+/**
+ * @brief Heat index as the US National Weather Service computes it: Steadman's simple
+ *        formula below 80 F, else the Rothfusz regression with its two adjustments.
+ *
+ * @param temperature Tenths of a degree C, humidity Tenths of a percent
+ * @return Heat index in tenths of a degree C
+ */
+static int16_t heat_index(int16_t temperature, int16_t humidity)
+{
+	int32_t t = temperature * 18 + 3200;		//hundredths of a degree F
+	int32_t rh = humidity;
+	int32_t simple = 110 * t - 103000 + 47 * rh;	//Steadman, 100 * hundredths of a degree F
+	int32_t index;
+
+	if (simple + 100 * t < 1600000)		//mean of simple and t below 80 F
+		index = (simple + (simple < 0 ? -50 : 50)) / 100;
+	else
+	{
+		int64_t a, b, sum;
+
+		if (t > HEAT_INDEX_MAX_F)
+			t = HEAT_INDEX_MAX_F;
+		a = t;
+		b = rh;
+		sum = heat_index_coefficients[0] + heat_index_coefficients[1] * a + heat_index_coefficients[2] * b
+				+ heat_index_coefficients[3] * a * b + heat_index_coefficients[4] * a * a
+				+ heat_index_coefficients[5] * b * b + heat_index_coefficients[6] * a * a * b
+				+ heat_index_coefficients[7] * a * b * b + heat_index_coefficients[8] * a * a * b * b;
+		index = (int32_t)((sum + (1LL << (HEAT_INDEX_SHIFT - 1))) >> HEAT_INDEX_SHIFT);
+
+		if (rh < 130 && t >= 8000 && t <= 11200)
+		{
+			//(13 - RH) / 4 * sqrt((17 - |T - 95|) / 17), the root in Q12
+			int32_t distance = t > 9500 ? t - 9500 : 9500 - t;
+			uint32_t root = isqrt((uint32_t)(1700 - distance) * 9869);		//2^24 / 1700
+
+			index -= (int32_t)(((uint32_t)(130 - rh) * 5 * root) >> 13);
+		}
+		else if (rh > 850 && t >= 8000 && t <= 8700)
+			index += (rh - 850) * (8700 - t) / 500;		//(RH - 85) / 10 * (87 - T) / 5
+	}
+
+	index -= 3200;		//hundredths of a degree F above freezing, to tenths of a degree C
+	return (index + (index < 0 ? -9 : 9)) / 18;
+}
+
+/**
+ * @brief Absolute humidity from the saturation density at the temperature.
+ *
+ * @param temperature Tenths of a degree C, humidity Tenths of a percent
+ * @return Hundredths of a gram per cubic metre
+ */
+static uint16_t absolute_humidity(int16_t temperature, int16_t humidity)
+{
+	int32_t offset;
+	uint32_t density;
+
+	if (temperature < AH_TABLE_FIRST)
+		temperature = AH_TABLE_FIRST;
+	if (temperature >= AH_TABLE_FIRST + ((AH_TABLE_ENTRIES - 1) << AH_TABLE_STEP_SHIFT))
+		temperature = AH_TABLE_FIRST + ((AH_TABLE_ENTRIES - 1) << AH_TABLE_STEP_SHIFT) - 1;
+	if (humidity < 0)
+		humidity = 0;
+	if (humidity > 1000)
+		humidity = 1000;
+
+	offset = temperature - AH_TABLE_FIRST;
+	density = interpolate(saturation_density[offset >> AH_TABLE_STEP_SHIFT], saturation_density[(offset >> AH_TABLE_STEP_SHIFT) + 1],
+			offset & ((1 << AH_TABLE_STEP_SHIFT) - 1), AH_TABLE_STEP_SHIFT);
+	return (uint16_t)((humidity * density + 5000) / 10000);
+}
+
+/**
+ * @brief Derives dew point, heat index and absolute humidity from a reading.
+ *
+ * @param temperature Tenths of a degree C, humidity Tenths of a percent, metrics Filled in
+ * @return None
+ */
+void comfort_compute(int16_t temperature, int16_t humidity, Comfort_Metrics* metrics)
+{
+	uint32_t start = get_cycle_count();
+
+	metrics->dew_point = comfort_dew_point(temperature, humidity);
+	metrics->heat_index = heat_index(temperature, humidity);
+	metrics->absolute_humidity = absolute_humidity(temperature, humidity);
+
+	comfort_cost.last_cycles = get_cycle_count() - start;
+	if (comfort_cost.last_cycles > comfort_cost.max_cycles)
+		comfort_cost.max_cycles = comfort_cost.last_cycles;
+}
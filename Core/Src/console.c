@@ -0,0 +1,766 @@
+/**
+ * @file console.c
+ * @author Auska Wang
+ * @brief Text command console on USART2, the ST-Link virtual COM port.
+ *
+ *        USART2 receives by circular DMA into rx[], which never stops and needs no CPU per
+ *        byte. The UART's idle line interrupt, and the DMA's half and full transfer ones,
+ *        only record how far the DMA has written: a command is a burst followed by a
+ *        pause, so the parser sees it whole. console_task() feeds it from the main loop to
+ *        console_line.c, which splits the arguments in place as they arrive, so a command
+ *        is ready to run when its line ends. No buffer is allocated or copied.
+ *
+ *        console_task() runs after the sensor work of the loop and runs at most one command
+ *        per call, only once the transmit ring has room for its whole reply; replies are
+ *        never dropped, the command waits instead. A log dump sends a few records per call,
+ *        a binary export (export.c) a few blocks, and commands wait until either ends.
+ *        A command costs well under 1 ms, so a sensor read is never pushed back by more.
+ *
+ *        Commands, one per line, values in degrees C and percent with one decimal:
+ *        help, units [c|f], light [on|off], cal t|h [raw:corrected ...],
+ *        alarm [rule threshold], rate [s|auto], stats [1m|1h|24h], log [from [count]],
+ *        export log|history|samples [from], stream [on|off].
+ *        Each answers its value or ok, or a line starting with err.
+ */
+
+/* Includes */
+#include <string.h>
+#include "console.h"
+#include "console_line.h"
+#include "general.h"
+#include "config.h"
+#include "dht22.h"
+#include "uart_tx.h"
+#include "fixed_format.h"
+#include "lcd_data_display.h"
+#include "calibration.h"
+#include "alarm.h"
+#include "rolling_stats.h"
+#include "scheduler.h"
+#include "flash_log.h"
+#include "telemetry.h"
+#include "export.h"
+#include "packed_history.h"
+
+/* Defines */
+#define REPLY_BYTES 112				//one reply line, CRLF included
+#define TX_ROOM 240					//free transmit ring a command needs, its longest reply
+#define DUMP_READS_PER_CALL 16		//log records read per console_task() during a dump
+
+/**
+ * @brief A command. run() sends the reply on success.
+ */
+typedef struct {
+	const char* name;
+	const char* (*run)(uint8_t argc, char** argv);	//NULL on success, else the error
+	const char* usage;
+} Command;
+
+/* Variables */
+extern UART_HandleTypeDef huart2;
+extern TEMP_UNITS temp_units;
+extern uint8_t light_mode;
+
+Console_Stats console_stats;
+
+static uint8_t rx[CONSOLE_RX_BYTES];
+static volatile uint16_t rx_head = 0;		//written by the DMA up to here at the last event
+static uint16_t rx_tail = 0;				//parsed up to here
+
+static Console_Line command;				//split by console_line.c as it arrives
+
+static char reply[REPLY_BYTES];
+
+#if FLASH_LOG
+static uint8_t dumping = 0;
+static uint32_t dump_next;
+static uint32_t dump_end;
+#endif
+#if !SCHEDULER
+static uint32_t interval_ms = DHT22_MIN_INTERVAL_MS;
+#endif
+
+/**
+ * @brief Starts a reply line.
+ *
+ * @param text First text of the line
+ * @return None
+ */
+static void reply_start(const char* text)
+{
+	reply[0] = '\0';
+	format_append_str(reply, sizeof(reply), text);
+}
+
+/**
+ * @brief Appends a space and a fixed point value to the reply.
+ *
+ * @param value Value, decimals Number of decimals
+ * @return None
+ */
+static void reply_value(int32_t value, uint8_t decimals)
+{
+	format_append_char(reply, sizeof(reply), ' ');
+	format_append_fixed(reply, sizeof(reply), value, decimals);
+}
+
+/**
+ * @brief Ends the reply line and queues it. console_task() made sure it fits.
+ *
+ * @param None
+ * @return None
+ */
+static void reply_send(void)
+{
+	format_append_str(reply, sizeof(reply), "\r\n");
+	uart_tx_write((const uint8_t*)reply, (uint16_t)strlen(reply));
+}
+
+/**
+ * @brief Parses a value with at most one decimal into tenths, "-4", "23.5".
+ *
+ * @param text Text, advanced past the value, tenths Filled with the value
+ * @return 1 if a value was read, 0 otherwise
+ */
+static uint8_t parse_tenths(const char** text, int32_t* tenths)
+{
+	const char* c = *text;
+	int32_t value = 0;
+	uint8_t negative = (*c == '-'), digits = 0;
+
+	if (negative)
+		c++;
+	while (*c >= '0' && *c <= '9' && digits < 4)
+	{
+		value = value * 10 + (*c++ - '0');
+		digits++;
+	}
+	if (digits == 0)
+		return 0;
+
+	value *= 10;
+	if (*c == '.' && c[1] >= '0' && c[1] <= '9')
+	{
+		value += c[1] - '0';
+		c += 2;
+	}
+	*tenths = negative ? -value : value;
+	*text = c;
+	return 1;
+}
+
+/**
+ * @brief Parses a whole argument as an unsigned number.
+ *
+ * @param text Argument, value Filled with the number
+ * @return 1 if the argument is a number that fits 32 bits, 0 otherwise
+ */
+static uint8_t parse_number(const char* text, uint32_t* value)
+{
+	uint32_t number = 0;
+	uint8_t digits = 0;
+
+	for (; *text >= '0' && *text <= '9'; text++, digits++)
+	{
+		uint32_t digit = (uint32_t)(*text - '0');
+
+		if (number > (0xFFFFFFFFU - digit) / 10)
+			return 0;		//over 32 bits
+		number = number * 10 + digit;
+	}
+	if (digits == 0 || *text != '\0')
+		return 0;
+
+	*value = number;
+	return 1;
+}
+
+/**
+ * @brief Parses the channel argument of cal.
+ *
+ * @param text "t" or "h", channel Filled with the channel
+ * @return 1 if valid, 0 otherwise
+ */
+static uint8_t parse_channel(const char* text, HISTORY_CHANNEL* channel)
+{
+	if (strcmp(text, "t") == 0)
+		*channel = HISTORY_TEMPERATURE;
+	else if (strcmp(text, "h") == 0)
+		*channel = HISTORY_HUMIDITY;
+	else
+		return 0;
+	return 1;
+}
+
+static const char* run_help(uint8_t argc, char** argv);
+
+/**
+ * @brief units [c|f]: displayed temperature units.
+ */
+static const char* run_units(uint8_t argc, char** argv)
+{
+	if (argc > 2)
+		return "usage: units [c|f]";
+	if (argc == 2)
+	{
+		if (strcmp(argv[1], "c") == 0)
+			display_set_units(CELSIUS);
+		else if (strcmp(argv[1], "f") == 0)
+			display_set_units(FAHRENHEIT);
+		else
+			return "usage: units [c|f]";
+	}
+
+	reply_start(temp_units == CELSIUS ? "units c" : "units f");
+	reply_send();
+	return NULL;
+}
+
+/**
+ * @brief light [on|off]: display backlight.
+ */
+static const char* run_light(uint8_t argc, char** argv)
+{
+	if (argc > 2)
+		return "usage: light [on|off]";
+	if (argc == 2)
+	{
+		if (strcmp(argv[1], "on") == 0)
+			display_set_light(1);
+		else if (strcmp(argv[1], "off") == 0)
+			display_set_light(0);
+		else
+			return "usage: light [on|off]";
+	}
+
+	reply_start(light_mode ? "light on" : "light off");
+	reply_send();
+	return NULL;
+}
+
+/**
+ * @brief cal t|h [raw:corrected ...]: a channel's calibration points, replaced and stored
+ *        when points are given.
+ */
+static const char* run_cal(uint8_t argc, char** argv)
+{
+	HISTORY_CHANNEL channel;
+	Calibration_Point points[CALIBRATION_MAX_POINTS];
+
+	if (argc < 2 || !parse_channel(argv[1], &channel))
+		return "usage: cal t|h [raw:corrected ...]";
+
+	if (argc > 2)
+	{
+		uint8_t points_given = argc - 2;
+
+		if (points_given > CALIBRATION_MAX_POINTS)
+			return "too many points";
+		for (uint8_t i = 0; i < points_given; i++)
+		{
+			const char* text = argv[2 + i];
+			int32_t raw, corrected;
+
+			if (!parse_tenths(&text, &raw) || *text++ != ':' || !parse_tenths(&text, &corrected) || *text != '\0')
+				return "points are raw:corrected, e.g. 21.5:21.2";
+			points[i].raw = (int16_t)raw;
+			points[i].corrected = (int16_t)corrected;
+		}
+
+		switch (calibration_load(channel, points, points_given))
+		{
+		case CALIBRATION_OK:
+			break;
+		case CALIBRATION_POINT_COUNT:
+			return "2 to 8 points";
+		case CALIBRATION_NOT_MONOTONIC:
+			return "points not increasing";
+		default:
+			return "slope out of range";
+		}
+	}
+
+	uint8_t points_used = calibration_points(channel, points);
+
+	reply_start(channel == HISTORY_TEMPERATURE ? "cal t" : "cal h");
+	for (uint8_t i = 0; i < points_used; i++)
+	{
+		reply_value(points[i].raw, FORMAT_TENTHS);
+		format_append_char(reply, sizeof(reply), ':');
+		format_append_fixed(reply, sizeof(reply), points[i].corrected, FORMAT_TENTHS);
+	}
+	reply_send();
+	return NULL;
+}
+
+#if ALARM
+/**
+ * @brief alarm [rule threshold]: every rule as number, value, side and threshold,
+ *        "0:t>30.0"; a threshold given for a rule replaces it and is stored.
+ */
+static const char* run_alarm(uint8_t argc, char** argv)
+{
+	static const char sources[ALARM_SOURCES] = {'t', 'h', 'd'};
+	ALARM_SOURCE source;
+	ALARM_DIRECTION direction;
+	uint32_t rule;
+	int32_t threshold;
+
+	if (argc != 1 && argc != 3)
+		return "usage: alarm [rule threshold]";
+	if (argc == 3)
+	{
+		const char* text = argv[2];
+
+		if (!parse_number(argv[1], &rule) || rule >= ALARM_RULES || !parse_tenths(&text, &threshold) || *text != '\0')
+			return "usage: alarm [rule threshold]";
+		if (!alarm_threshold_valid((uint8_t)rule, threshold))
+			return "threshold out of range";
+		alarm_set_threshold((uint8_t)rule, (int16_t)threshold);
+	}
+
+	reply_start("alarm");
+	for (uint8_t i = 0; i < ALARM_RULES; i++)
+	{
+		threshold = alarm_threshold(i, &source, &direction);
+		reply_value(i, 0);
+		format_append_char(reply, sizeof(reply), ':');
+		format_append_char(reply, sizeof(reply), sources[source]);
+		format_append_char(reply, sizeof(reply), direction == ALARM_ABOVE ? '>' : '<');
+		format_append_fixed(reply, sizeof(reply), threshold, FORMAT_TENTHS);
+	}
+	reply_send();
+	return NULL;
+}
+#endif
+
+/**
+ * @brief rate [s|auto]: sampling interval, fixed in seconds or adapted by the scheduler.
+ */
+static const char* run_rate(uint8_t argc, char** argv)
+{
+	uint32_t seconds;
+
+	if (argc > 2)
+		return "usage: rate [2-81|auto]";
+	if (argc == 2)
+	{
+#if SCHEDULER
+		if (strcmp(argv[1], "auto") == 0)
+			scheduler_set_fixed(0);
+		else
+#endif
+		if (parse_number(argv[1], &seconds) && seconds * 1000U >= DHT22_MIN_INTERVAL_MS && seconds <= 81)
+		{
+#if SCHEDULER
+			scheduler_set_fixed(seconds * 1000U);	//applied after the next sample
+#else
+			interval_ms = seconds * 1000U;
+			sampling_set_interval(interval_ms);
+#endif
+		}
+		else
+			return "usage: rate [2-81|auto]";
+	}
+
+	reply_start("rate");
+#if SCHEDULER
+	uint32_t fixed_ms = scheduler_fixed();
+
+	reply_value((fixed_ms ? fixed_ms : scheduler_stats.interval_ms) / 1000U, 0);
+	format_append_str(reply, sizeof(reply), fixed_ms ? " fixed" : " auto");
+#else
+	reply_value(interval_ms / 1000U, 0);
+	format_append_str(reply, sizeof(reply), " fixed");
+#endif
+	reply_send();
+	return NULL;
+}
+
+/**
+ * @brief stats [1m|1h|24h]: latest reading, min, mean, max and deviation over a window,
+ *        the packed history's samples, density and decode cost, the serial traffic and the
+ *        exports finished, with the duration and bytes of the last one.
+ */
+static const char* run_stats(uint8_t argc, char** argv)
+{
+	static const char* const names[STATS_WINDOWS] = {"1m", "1h", "24h"};
+	STATS_WINDOW window = STATS_MINUTE;
+	int16_t values[STATS_CHANNELS];
+
+	if (argc > 2)
+		return "usage: stats [1m|1h|24h]";
+	if (argc == 2)
+	{
+		for (window = STATS_MINUTE; window < STATS_WINDOWS; window++)
+			if (strcmp(argv[1], names[window]) == 0)
+				break;
+		if (window == STATS_WINDOWS)
+			return "usage: stats [1m|1h|24h]";
+	}
+
+	reply_start("now");
+	if (display_reading(values))
+	{
+		reply_value(values[STATS_TEMPERATURE], FORMAT_TENTHS);
+		reply_value(values[STATS_HUMIDITY], FORMAT_TENTHS);
+	}
+	else
+		format_append_str(reply, sizeof(reply), " none");
+	reply_send();
+
+	for (STATS_CHANNEL ch = STATS_TEMPERATURE; ch < STATS_CHANNELS; ch++)
+	{
+		Stats_Summary summary;
+
+		reply_start(names[window]);
+		format_append_str(reply, sizeof(reply), ch == STATS_TEMPERATURE ? " t" : " h");
+		if (rolling_stats_get(ch, window, &summary))
+		{
+			reply_value(summary.min, FORMAT_HUNDREDTHS);
+			reply_value(summary.mean, FORMAT_HUNDREDTHS);
+			reply_value(summary.max, FORMAT_HUNDREDTHS);
+			reply_value((int32_t)summary.stddev, FORMAT_HUNDREDTHS);
+			reply_value((int32_t)summary.count, 0);
+		}
+		else
+			format_append_str(reply, sizeof(reply), " none");
+		reply_send();
+	}
+
+#if PACKED_HISTORY
+	packed_history_report();	//decodes the whole history, under 1 ms with 8 blocks
+	reply_start("samples");
+	reply_value((int32_t)packed_history_stats.samples, 0);
+	format_append_str(reply, sizeof(reply), " per_kb");
+	reply_value(packed_history_stats.samples_per_kb, 0);
+	format_append_str(reply, sizeof(reply), " decode_cycles");
+	reply_value((int32_t)packed_history_stats.decode_cycles_per_sample, 0);
+	reply_send();
+#endif
+
+	reply_start("serial tx");
+	reply_value((int32_t)uart_tx_stats.bytes, 0);
+	format_append_str(reply, sizeof(reply), " dropped");
+	reply_value((int32_t)uart_tx_stats.dropped_writes, 0);
+	format_append_str(reply, sizeof(reply), " rx");
+	reply_value((int32_t)console_stats.bytes, 0);
+	reply_send();
+
+	reply_start("export");
+	reply_value((int32_t)export_stats.exports, 0);
+	format_append_str(reply, sizeof(reply), " last_ms");
+	reply_value((int32_t)export_stats.last_ms, 0);
+	format_append_str(reply, sizeof(reply), " last_bytes");
+	reply_value((int32_t)export_stats.last_bytes, 0);
+	reply_send();
+	return NULL;
+}
+
+#if FLASH_LOG
+/**
+ * @brief log [from [count]]: the log's sequence range, or a dump of its records as
+ *        "sequence boot uptime_s temperature humidity" lines ended by ok.
+ */
+static const char* run_log(uint8_t argc, char** argv)
+{
+	uint32_t from = 0, records = 0xFFFFFFFFU;
+	uint32_t oldest = flash_log_oldest(), next = flash_log_next();
+
+	if (argc > 3 || (argc >= 2 && !parse_number(argv[1], &from)) || (argc == 3 && !parse_number(argv[2], &records)))
+		return "usage: log [from [count]]";
+
+	if (argc == 1)
+	{
+		reply_start("log");
+		reply_value((int32_t)oldest, 0);
+		reply_value((int32_t)next, 0);
+		reply_send();
+		return NULL;
+	}
+
+	dump_end = ((int32_t)(next - from) <= 0 || next - from < records) ? next : from + records;
+	dump_next = (int32_t)(from - oldest) < 0 ? oldest : from;
+	dumping = 1;
+	return NULL;
+}
+
+/**
+ * @brief Sends the next records of a dump, as many as the transmit ring takes.
+ *
+ * @param None
+ * @return None
+ */
+static void dump_records(void)
+{
+	Flash_Log_Record record;
+
+	for (uint8_t reads = 0; reads < DUMP_READS_PER_CALL && (int32_t)(dump_end - dump_next) > 0; reads++)
+	{
+		if (uart_tx_free() < REPLY_BYTES)
+			return;
+		if (!flash_log_read(dump_next++, &record))
+			continue;	//overwritten since, or never written whole
+
+		reply_start("");
+		format_append_fixed(reply, sizeof(reply), (int32_t)record.sequence, 0);
+		reply_value(record.boot, 0);
+		reply_value((int32_t)record.uptime_s, 0);
+		reply_value(record.values[HISTORY_TEMPERATURE], FORMAT_TENTHS);
+		reply_value(record.values[HISTORY_HUMIDITY], FORMAT_TENTHS);
+		reply_send();
+	}
+
+	if ((int32_t)(dump_end - dump_next) <= 0 && uart_tx_free() >= REPLY_BYTES)
+	{
+		reply_start("ok");
+		reply_send();
+		dumping = 0;
+	}
+}
+#endif
+
+#if TELEMETRY
+/**
+ * @brief export log|history|samples [from]: streams the records as binary blocks, from the oldest or
+ *        from the next offset of the last block received. No text reply, an end frame closes it.
+ */
+static const char* run_export(uint8_t argc, char** argv)
+{
+	EXPORT_SOURCE source;
+	uint32_t from;
+
+	if (argc < 2 || argc > 3)
+		return "usage: export log|history|samples [from]";
+	if (strcmp(argv[1], "log") == 0)
+		source = EXPORT_LOG;
+	else if (strcmp(argv[1], "history") == 0)
+		source = EXPORT_HISTORY;
+	else if (strcmp(argv[1], "samples") == 0)
+		source = EXPORT_SAMPLES;
+	else
+		return "usage: export log|history|samples [from]";
+
+	from = export_oldest(source);
+	if (argc == 3 && !parse_number(argv[2], &from))
+		return "usage: export log|history|samples [from]";
+	if (!export_start(source, from))
+		return "export not available";
+	return NULL;
+}
+#endif
+
+/**
+ * @brief stream [on|off]: binary reading frames on the same port, off while a terminal is used.
+ */
+static const char* run_stream(uint8_t argc, char** argv)
+{
+	if (argc > 2)
+		return "usage: stream [on|off]";
+	if (argc == 2)
+	{
+		if (strcmp(argv[1], "on") == 0)
+			telemetry_stream(1);
+		else if (strcmp(argv[1], "off") == 0)
+			telemetry_stream(0);
+		else
+			return "usage: stream [on|off]";
+	}
+
+	reply_start(telemetry_streaming() ? "stream on" : "stream off");
+	reply_send();
+	return NULL;
+}
+
+static const Command commands[] = {
+	{"help", run_help, "help"},
+	{"units", run_units, "units [c|f]"},
+	{"light", run_light, "light [on|off]"},
+	{"cal", run_cal, "cal t|h [raw:corrected ...]"},
+#if ALARM
+	{"alarm", run_alarm, "alarm [rule threshold]"},
+#endif
+	{"rate", run_rate, "rate [2-81|auto]"},
+	{"stats", run_stats, "stats [1m|1h|24h]"},
+#if FLASH_LOG
+	{"log", run_log, "log [from [count]]"},
+#endif
+#if TELEMETRY
+	{"export", run_export, "export log|history|samples [from]"},
+#endif
+	{"stream", run_stream, "stream [on|off]"},
+};
+
+#define COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+/**
+ * @brief help: the commands and their arguments.
+ */
+static const char* run_help(uint8_t argc, char** argv)
+{
+	(void)argc;
+	(void)argv;
+	for (uint8_t i = 0; i < COMMANDS; i++)
+	{
+		reply_start(commands[i].usage);
+		reply_send();
+	}
+	return NULL;
+}
+
+/**
+ * @brief Runs the command in the received line and answers an error if it failed.
+ *
+ * @param None
+ * @return None
+ */
+static void run_line(void)
+{
+	const char* error = "unknown command, try help";
+
+	for (uint8_t i = 0; i < COMMANDS; i++)
+	{
+		if (strcmp(command.args[0], commands[i].name) == 0)
+		{
+			error = commands[i].run(command.count, command.args);
+			break;
+		}
+	}
+
+	console_stats.commands++;
+	if (error)
+	{
+		console_stats.errors++;
+		reply_start("err ");
+		format_append_str(reply, sizeof(reply), error);
+		reply_send();
+	}
+}
+
+/**
+ * @brief Parses received bytes with console_line.c and runs each line it ends. Stops
+ *        after a line was run or answered, so one call sends at most one reply.
+ *
+ * @param bytes Received bytes, length Number of bytes
+ * @return Bytes consumed, less than length if it stopped after a line
+ */
+uint16_t console_feed(const uint8_t* bytes, uint16_t length)
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		CONSOLE_LINE_EVENT event = console_line_put(&command, (char)bytes[i]);
+
+		console_stats.bytes++;
+		if (event == CONSOLE_LINE_PENDING)
+			continue;
+
+		if (event == CONSOLE_LINE_OVERLONG)
+		{
+			console_stats.overlong++;
+			console_stats.errors++;
+			reply_start("err line too long");
+			reply_send();
+		}
+		else
+			run_line();
+		console_line_clear(&command);
+		return i + 1;
+	}
+	return length;
+}
+
+/**
+ * @brief Starts the circular reception from the start of rx[].
+ *
+ * @param None
+ * @return None
+ */
+static void start_reception(void)
+{
+	rx_head = 0;
+	rx_tail = 0;
+	console_line_clear(&command);
+	HAL_UARTEx_ReceiveToIdle_DMA(&huart2, rx, CONSOLE_RX_BYTES);	//retried by console_task() if refused
+}
+
+/**
+ * @brief Starts receiving commands. Called once USART2 is initialized.
+ *
+ * @param None
+ * @return None
+ */
+void console_init(void)
+{
+	start_reception();
+}
+
+/**
+ * @brief Parses what arrived up to the last idle line and runs at most one command.
+ *        Called from the main loop after the sensor work.
+ *
+ * @param None
+ * @return None
+ */
+void console_task(void)
+{
+	uint32_t start = get_cycle_count();
+	uint32_t commands_before = console_stats.commands + console_stats.overlong;
+
+	if (huart2.RxState == HAL_UART_STATE_READY)		//stopped by an overrun or framing error
+	{
+		console_stats.rx_restarts++;
+		start_reception();
+		return;
+	}
+
+#if FLASH_LOG
+	if (dumping)
+	{
+		dump_records();
+		return;
+	}
+#endif
+	if (export_active())
+	{
+		export_task();
+		return;
+	}
+	if (uart_tx_free() < TX_ROOM)
+		return;		//the reply would not fit, the command waits
+
+	uint16_t head = rx_head;
+	uint16_t tail = rx_tail;
+
+	if (head == tail)
+		return;
+
+	uint16_t end = (head > tail) ? head : CONSOLE_RX_BYTES;
+	tail += console_feed(&rx[tail], end - tail);
+	if (tail == CONSOLE_RX_BYTES)
+		tail = 0;
+	rx_tail = tail;
+
+	if (console_stats.commands + console_stats.overlong != commands_before)
+	{
+		uint32_t cycles = get_cycle_count() - start;
+
+		if (cycles > console_stats.max_cycles)
+			console_stats.max_cycles = cycles;
+	}
+}
+
+#if CONSOLE
+/**
+ * @brief HAL callback, the line went idle or the DMA passed half or all of rx[].
+ *
+ * @param huart UART handle, size Bytes the DMA has written into rx[]
+ * @return None
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t size)
+{
+	if (huart != &huart2)
+		return;
+
+	rx_head = (size < CONSOLE_RX_BYTES) ? size : 0;
+}
+#endif
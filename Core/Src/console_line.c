@@ -0,0 +1,93 @@
+/**
+ * @file console_line.c
+ * @author Auska Wang
+ * @brief Splits console input into a command and its arguments, one byte at a time.
+ *
+ *        Arguments are split as the bytes arrive, in place, so a command is ready to run
+ *        when its line ends; nothing is copied. A CR or LF ends the line, spaces and tabs
+ *        separate arguments, backspace and DEL remove the last character and other
+ *        control bytes are ignored. A line over CONSOLE_LINE_BYTES or CONSOLE_MAX_ARGS is
+ *        dropped up to its end and reported once. Running the command is left to
+ *        console.c, so the parser has no side effects and is fed byte streams on a host
+ *        (Tests/test_console_line.c).
+ */
+
+/* Includes */
+#include "console_line.h"
+
+/**
+ * @brief Starts a new line.
+ *
+ * @param line Line
+ * @return None
+ */
+void console_line_clear(Console_Line* line)
+{
+	line->length = 0;
+	line->count = 0;
+	line->in_argument = 0;
+	line->overlong = 0;
+}
+
+/**
+ * @brief Adds a received byte to the line. After CONSOLE_LINE_READY or
+ *        CONSOLE_LINE_OVERLONG the caller handles the line and clears it before the next
+ *        byte.
+ *
+ * @param line Line, c Received byte
+ * @return CONSOLE_LINE_READY or CONSOLE_LINE_OVERLONG if c ended a line, else
+ *         CONSOLE_LINE_PENDING; an empty line, or the LF of a CRLF, ends nothing
+ */
+CONSOLE_LINE_EVENT console_line_put(Console_Line* line, char c)
+{
+	if (c == '\r' || c == '\n')
+	{
+		if (line->overlong)
+			return CONSOLE_LINE_OVERLONG;
+		if (line->count == 0)
+			return CONSOLE_LINE_PENDING;
+		if (line->in_argument)
+			line->text[line->length] = '\0';
+		return CONSOLE_LINE_READY;
+	}
+
+	if (line->overlong)
+		return CONSOLE_LINE_PENDING;
+
+	if (c == '\b' || c == 0x7F)
+	{
+		if (line->length == 0)
+			return CONSOLE_LINE_PENDING;
+		line->length--;
+		if (!line->in_argument)
+			line->in_argument = 1;	//removed the '\0' ending the last argument
+		else if (line->args[line->count - 1] == &line->text[line->length])
+		{
+			line->count--;
+			line->in_argument = 0;
+		}
+	}
+	else if (c == ' ' || c == '\t')
+	{
+		if (line->in_argument)
+		{
+			line->text[line->length++] = '\0';
+			line->in_argument = 0;
+		}
+	}
+	else if (c > ' ' && c <= '~')
+	{
+		if (line->length + 1 >= CONSOLE_LINE_BYTES || (!line->in_argument && line->count == CONSOLE_MAX_ARGS))
+		{
+			line->overlong = 1;
+			return CONSOLE_LINE_PENDING;
+		}
+		if (!line->in_argument)
+		{
+			line->args[line->count++] = &line->text[line->length];
+			line->in_argument = 1;
+		}
+		line->text[line->length++] = c;
+	}
+	return CONSOLE_LINE_PENDING;
+}
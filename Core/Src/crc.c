@@ -0,0 +1,73 @@
+/**
+ * @file crc.c
+ * @author Auska Wang
+ * @brief CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF, no reflection) and
+ *        CRC-16/MODBUS (polynomial 0x8005, initial value 0xFFFF, reflected) on the CRC
+ *        unit, programmed through its registers: the HAL CRC driver is not part of the
+ *        project.
+ *
+ *        Each byte written to the data register is folded in by the unit in a few
+ *        cycles, against about 80 cycles a byte for the bit by bit loop. The reflection
+ *        of the Modbus CRC is done by the unit too. The unit is shared by the flash log,
+ *        the telemetry and Modbus, all called from the main loop only, so no locking is
+ *        needed; each call sets the polynomial it uses.
+ */
+
+/* Includes */
+#include "crc.h"
+#include "general.h"
+
+/* Defines */
+#define CR_CCITT CRC_CR_POLYSIZE_0								//16 bit polynomial, input and output not reversed
+#define CR_MODBUS (CRC_CR_POLYSIZE_0 | CRC_CR_REV_IN_0 | CRC_CR_REV_OUT)	//16 bit, bits reversed in each byte and in the result
+
+/**
+ * @brief Enables the CRC unit and sets it to CRC-16/CCITT. Called from hardware_init().
+ *
+ * @param None
+ * @return None
+ */
+void crc_init(void)
+{
+	__HAL_RCC_CRC_CLK_ENABLE();
+	CRC->POL = 0x1021;
+	CRC->INIT = 0xFFFF;
+	CRC->CR = CR_CCITT;
+}
+
+/**
+ * @brief CRC of a block with the given polynomial and reflection, initial value 0xFFFF.
+ *
+ * @param polynomial Polynomial, control CR bits, data Bytes, length Number of bytes
+ * @return CRC
+ */
+static uint16_t crc16(uint16_t polynomial, uint32_t control, const uint8_t* data, uint16_t length)
+{
+	CRC->POL = polynomial;
+	CRC->CR = control | CRC_CR_RESET;	//load INIT
+	while (length--)
+		*(__IO uint8_t*)&CRC->DR = *data++;		//byte access, 8 bits per write
+	return (uint16_t)CRC->DR;
+}
+
+/**
+ * @brief CRC-16/CCITT of a block.
+ *
+ * @param data Bytes, length Number of bytes
+ * @return CRC
+ */
+uint16_t crc16_ccitt(const uint8_t* data, uint16_t length)
+{
+	return crc16(0x1021, CR_CCITT, data, length);
+}
+
+/**
+ * @brief CRC-16/MODBUS of a block, sent low byte first.
+ *
+ * @param data Bytes, length Number of bytes
+ * @return CRC
+ */
+uint16_t crc16_modbus(const uint8_t* data, uint16_t length)
+{
+	return crc16(0x8005, CR_MODBUS, data, length);
+}
@@ -146,27 +146,64 @@ float getHumidity(uint8_t h1, uint8_t h2)
 	return combineBytes(h1, h2) / 10.0;
 }
 
+/**
+ * @brief Gets temperature in tenths of a degree Celsius, without floating point
+ *
+ * @param t1 Upper temperature byte, t2 Lower temperature byte
+ * @return The temperature in 0.1 Celsius
+ * @note The most significant bit of t1 is the sign, the remaining 15 bits the magnitude.
+ */
+int16_t getTemperatureTenthsC(uint8_t t1, uint8_t t2)
+{
+	int16_t magnitude = combineBytes(t1 & 0x7F, t2);
+
+	return (t1 & 0x80) ? -magnitude : magnitude;
+}
+
+/**
+ * @brief Gets humidity in tenths of a percent, without floating point
+ *
+ * @param h1 Upper humidity byte, h2 Lower humidity byte
+ * @return Humidity in 0.1 %
+ */
+uint16_t getHumidityTenths(uint8_t h1, uint8_t h2)
+{
+	return combineBytes(h1, h2);
+}
+
+/**
+ * @brief Checks the fifth byte sent by DHT22 against the four data bytes
+ *
+ * @param data Bytes received from sensor
+ * @return 1 if the checksum matches, 0 otherwise
+ * @note The check byte is the lower 8 bits of the sum of the four data bytes.
+ */
+uint8_t DHT22_checksumValid(const DHT22_Data* data)
+{
+	uint8_t sum = data->humidity_first_byte + data->humidity_second_byte + data->temp_first_byte + data->temp_second_byte;
+
+	return sum == data->check_byte;
+}
+
 /**
  * @brief Get data from DHT22
  *
  * This function encapsulates the process of initializing and gathering data from sensor, and stores the data into data struct
  *
  * @param data Pointer to DHT22_Data struct where information will be stored in
- * @return none
+ * @return DHT22_RESPONSE_SUCCESSFUL if the sensor answered with a valid checksum, DHT22_RESPONSE_FAIL otherwise
  */
-void DHT22_getData(DHT22_Data* data)
+DHT22_Status DHT22_getData(DHT22_Data* data)
 {
-	//if sensor is responsive
-	if (DHT22_start() == DHT22_RESPONSE_SUCCESSFUL)
-	{
-	  data->humidity_first_byte = DHT22_read();	//first byte from sensor is first byte of humidity data
-	  data->humidity_second_byte = DHT22_read();	//second byte from sensor is second byte of humidity data
-	  data->temp_first_byte = DHT22_read();	//third byte from sensor is first byte of temperature data
-	  data->temp_second_byte = DHT22_read();	//fourth byte from sensor is second byte of temperature data
-	  data->check_byte = DHT22_read(); //fifth byte from sensor is check sum data
-	}
-
 	//if sensor is not responding, give error
-	else
-	  Error_Handler();
+	if (DHT22_start() != DHT22_RESPONSE_SUCCESSFUL)
+		return DHT22_RESPONSE_FAIL;
+
+	data->humidity_first_byte = DHT22_read();	//first byte from sensor is first byte of humidity data
+	data->humidity_second_byte = DHT22_read();	//second byte from sensor is second byte of humidity data
+	data->temp_first_byte = DHT22_read();	//third byte from sensor is first byte of temperature data
+	data->temp_second_byte = DHT22_read();	//fourth byte from sensor is second byte of temperature data
+	data->check_byte = DHT22_read(); //fifth byte from sensor is check sum data
+
+	return DHT22_checksumValid(data) ? DHT22_RESPONSE_SUCCESSFUL : DHT22_RESPONSE_FAIL;
 }
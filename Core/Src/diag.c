@@ -0,0 +1,164 @@
+/**
+ * @file diag.c
+ * @author Auska Wang
+ * @brief printf() diagnostics on USART2 through the transmit ring of uart_tx.c.
+ *
+ *        syscalls.c sends each byte of _write() to __io_putchar(), which nothing
+ *        implements. The _write() here replaces its weak one and copies the whole text
+ *        into the ring, which the DMA drains in the background: a print costs the
+ *        formatting and a memcpy, never a wait for the line. stdout is line buffered in
+ *        a static buffer of DIAG_LINE_BYTES: newlib then allocates no buffer of its own,
+ *        an unbuffered stream would format through a BUFSIZ buffer on the stack, and
+ *        _write() should be called once per line. That count is not verified on target
+ *        here; diag_stats.writes counts the calls so it can be read there.
+ *
+ *        Print from the main loop only. stdout and its buffer are shared and newlib does
+ *        not lock them, so a printf() from an interrupt can garble the line the main loop
+ *        is building. _write() drops whatever reaches it in handler mode and counts it in
+ *        diag_stats.isr_drops, so such a print shows up there instead of on the line.
+ *
+ *        When the ring is full, DIAG_OVERFLOW decides:
+ *        - DIAG_DROP_NEWEST: the text that does not fit is dropped and counted. Timing
+ *          is the same with or without prints, so they can stay in the sensor path.
+ *        - DIAG_BLOCK: the print waits for the DMA to make room, up to
+ *          DIAG_BLOCK_TIMEOUT_MS, so nothing is lost during bring-up at the cost of
+ *          stalling the caller. With interrupts masked the UART callback could not
+ *          run, so the text is dropped instead.
+ *
+ *        With TELEMETRY on, every chunk of text is queued with a 0x00 after it in the
+ *        same ring write, so no frame can land between the text and its delimiter. Each
+ *        chunk forms a frame of its own, which a frame receiver discards without losing
+ *        the next one; a long line arrives as several such chunks. A terminal ignores
+ *        the zeros.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include "diag.h"
+#include "general.h"
+#include "config.h"
+#include "uart_tx.h"
+
+/* Defines */
+#if DIAG_PRINT && MODBUS
+#error "DIAG_PRINT needs USART2 free of Modbus, text would corrupt the bus"
+#endif
+
+/* Variables */
+Diag_Stats diag_stats;
+
+static char stdout_buffer[DIAG_LINE_BYTES];
+
+/**
+ * @brief Adds to a counter with interrupts masked, interrupts may preempt each other.
+ *
+ * @param counter Counter, amount Amount to add
+ * @return None
+ */
+static void count(uint32_t* counter, uint32_t amount)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	*counter += amount;
+	__set_PRIMASK(primask);
+}
+
+#if DIAG_OVERFLOW == DIAG_BLOCK
+/**
+ * @brief Waits for room in the ring, with interrupts enabled only.
+ *
+ * @param length Bytes needed
+ * @return 1 if the room is there, 0 if waiting is not possible or timed out
+ */
+static uint8_t wait_for_room(uint16_t length)
+{
+	uint32_t start = get_cycle_count();
+	uint32_t start_ms = HAL_GetTick();
+
+	if (__get_PRIMASK() != 0)
+		return 0;
+
+	diag_stats.blocked_writes++;
+	while (uart_tx_free() < length)
+	{
+		if (HAL_GetTick() - start_ms >= DIAG_BLOCK_TIMEOUT_MS)
+			return 0;
+	}
+
+	uint32_t cycles = get_cycle_count() - start;
+	if (cycles > diag_stats.max_wait_cycles)
+		diag_stats.max_wait_cycles = cycles;
+	return 1;
+}
+#endif
+
+#if DIAG_PRINT
+/**
+ * @brief Queues a chunk of text, with TELEMETRY followed by its 0x00 in the same write.
+ *
+ * @param text Text, length Bytes
+ * @return 1 if queued, 0 if the ring had no room
+ */
+static uint8_t queue_chunk(const char* text, uint16_t length)
+{
+#if TELEMETRY
+	return uart_tx_write_delimited((const uint8_t*)text, length);
+#else
+	return uart_tx_write((const uint8_t*)text, length);
+#endif
+}
+
+/**
+ * @brief newlib output, replaces the weak one of syscalls.c. Copies the text into the
+ *        transmit ring in chunks; what finds no room is dropped or waited for.
+ *        Text from an interrupt is dropped, see the file comment.
+ *
+ * @param file Ignored, stdout and stderr alike, ptr Text, len Bytes
+ * @return len, dropped text counts as written so newlib does not retry it
+ */
+int _write(int file, char* ptr, int len)
+{
+	int written = 0;
+
+	(void)file;
+	if (__get_IPSR() != 0)
+	{
+		count(&diag_stats.isr_drops, 1);	//interrupts may nest, the count is masked
+		return len;
+	}
+	while (written < len)
+	{
+		uint16_t chunk = (len - written > DIAG_CHUNK_BYTES) ? DIAG_CHUNK_BYTES : (uint16_t)(len - written);
+
+		if (!queue_chunk(&ptr[written], chunk))
+		{
+#if DIAG_OVERFLOW == DIAG_BLOCK
+			if (wait_for_room(chunk + TELEMETRY))	//with TELEMETRY, room for the 0x00 as well
+				continue;
+#endif
+			diag_stats.dropped_writes++;
+			diag_stats.dropped_bytes += (uint32_t)(len - written);
+			break;
+		}
+		written += chunk;
+	}
+
+	diag_stats.writes++;
+	diag_stats.bytes += (uint32_t)written;
+	return len;
+}
+#endif
+
+/**
+ * @brief Line buffers stdout in a static buffer, so each line reaches _write() whole and
+ *        newlib allocates nothing. stderr stays unbuffered.
+ *
+ * @param None
+ * @return None
+ */
+void diag_init(void)
+{
+	setvbuf(stdout, stdout_buffer, _IOLBF, sizeof(stdout_buffer));
+	setvbuf(stderr, NULL, _IONBF, 0);
+}
@@ -0,0 +1,375 @@
+/**
+ * @file export.c
+ * @author Auska Wang
+ * @brief Bulk export of the flash log and the rolled-up history over USART2, as a
+ *        stream of telemetry frames the DMA sends back to back.
+ *
+ *        A record at a time, with an answer per record, leaves the line idle for a round
+ *        trip each time. Here the records go in blocks, each a telemetry frame with its
+ *        own CRC-16, and nothing is acknowledged: the receiver checks every block and
+ *        resumes from the last good one. Every block gives the offset of its first record
+ *        and the offset to resume from, so a lost block shows as a gap between them.
+ *
+ *        Block payload, little endian: type 0x02, source, first offset (4), next offset
+ *        (4), record count, then the records.
+ *        - EXPORT_LOG: flash log records as stored, 16 bytes with their own CRC. The
+ *          offset is the sequence number; records overwritten or torn are skipped.
+ *        - EXPORT_HISTORY: start in ms (4), sample count (2), tier, then min, max and
+ *          mean of temperature and humidity in tenths (2 each), 19 bytes. The offset is
+ *          the HAL tick. Hours come first, then minutes, then raw samples, each tier
+ *          from where the previous one stopped, so the records tile the time once; the
+ *          hour or minute overlapping the start of the next tier is sent whole.
+ *        - EXPORT_SAMPLES: every sample of the packed history (packed_history.c), tick
+ *          (4), temperature and humidity in tenths (2 each), 8 bytes. The offset is the
+ *          HAL tick; samples overwritten since the last block show as a gap.
+ *        End payload: type 0x03, source, next offset (4), records sent (4), skipped (4).
+ *
+ *        The export starts with a lone 0x00, which ends whatever text came before on the
+ *        port, and covers the records present when it started; a later export from the
+ *        last next offset picks up the rest. Reading frames keep interleaving with the
+ *        blocks, so sampling runs on, and the flash log keeps being written.
+ *
+ *        A log block is 139 payload bytes, 143 on the wire for 128 bytes of records. The
+ *        log's 3 pages hold at most 384 records (6 KB), 257 right after the oldest page
+ *        is erased: 48 blocks, 6883 bytes with the delimiter and end frame, 0.075 s at
+ *        921600 baud. The line stays busy as long as the main loop refills the ring
+ *        within the 5.5 ms the DMA needs to empty it; Tests/test_export.c simulates the
+ *        line and finds the rate kept with passes up to 4 ms apart, 58 % of it at 8 ms.
+ *        Reading and queueing a block is estimated at 4000 cycles (80 us) against 1.5 ms
+ *        to send it; export_stats keeps the measured figures, printed by "stats".
+ */
+
+/* Includes */
+#include <string.h>
+#include "export.h"
+#include "general.h"
+#include "config.h"
+#include "telemetry.h"
+#include "uart_tx.h"
+#include "flash_log.h"
+#include "history.h"
+#include "packed_history.h"
+
+/* Defines */
+#define BLOCKS_PER_CALL 4			//bounds export_task() when the log is mostly unreadable
+#define LOG_READS_PER_BLOCK (2 * EXPORT_LOG_RECORDS)
+#define END_BYTES 14
+
+#if EXPORT_HEADER_BYTES + EXPORT_LOG_RECORDS * FLASH_LOG_RECORD_BYTES > TELEMETRY_MAX_PAYLOAD || \
+	EXPORT_HEADER_BYTES + EXPORT_HISTORY_RECORDS * EXPORT_HISTORY_RECORD_BYTES > TELEMETRY_MAX_PAYLOAD || \
+	EXPORT_HEADER_BYTES + EXPORT_SAMPLE_RECORDS * EXPORT_SAMPLE_RECORD_BYTES > TELEMETRY_MAX_PAYLOAD
+#error "An export block must fit TELEMETRY_MAX_PAYLOAD"
+#endif
+
+/* Variables */
+Export_Stats export_stats;
+
+static uint8_t active = 0;
+static uint8_t finished = 0;			//every record sent, the end frame waits for room
+static EXPORT_SOURCE exporting;
+static uint32_t next_offset;
+static uint32_t end_offset;				//log: sequence after the last, history: tick of the start
+static uint32_t records;
+static uint32_t skipped;
+static uint32_t start_ms;
+static uint32_t start_bytes;
+
+/**
+ * @brief Stores a word little endian.
+ *
+ * @param out 4 bytes, value Word
+ * @return None
+ */
+static void put_u32(uint8_t* out, uint32_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+	out[2] = (uint8_t)(value >> 16);
+	out[3] = (uint8_t)(value >> 24);
+}
+
+/**
+ * @brief Stores a half word little endian.
+ *
+ * @param out 2 bytes, value Half word
+ * @return None
+ */
+static void put_u16(uint8_t* out, uint16_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Reads the next log records into a block. Unreadable ones are skipped and counted.
+ *
+ * @param out Room for EXPORT_LOG_RECORDS records
+ * @return Records read
+ */
+static uint8_t log_records(uint8_t* out)
+{
+	Flash_Log_Record record;
+	uint8_t count = 0;
+
+	for (uint8_t reads = 0; reads < LOG_READS_PER_BLOCK && count < EXPORT_LOG_RECORDS; reads++)
+	{
+		if ((int32_t)(end_offset - next_offset) <= 0)
+		{
+			finished = 1;
+			break;
+		}
+		if (!flash_log_read(next_offset++, &record))
+		{
+			skipped++;
+			continue;
+		}
+		memcpy(&out[count++ * FLASH_LOG_RECORD_BYTES], &record, FLASH_LOG_RECORD_BYTES);
+	}
+	if ((int32_t)(end_offset - next_offset) <= 0)
+		finished = 1;
+	return count;
+}
+
+/**
+ * @brief Reads the next history records into a block, from the coarsest tier that reaches
+ *        back to the offset. A tier is left for the next finer one at the finer one's start.
+ *
+ * @param out Room for EXPORT_HISTORY_RECORDS records
+ * @return Records read
+ */
+static uint8_t history_records(uint8_t* out)
+{
+	static const uint32_t span_ms[HISTORY_TIERS] = {1, HISTORY_MINUTE_MS, HISTORY_HOUR_MS};
+	History_Record record;
+	uint8_t count = 0;
+
+	while (count < EXPORT_HISTORY_RECORDS)
+	{
+		uint32_t finer_ms;
+
+		if (!history_query(next_offset, end_offset, &record, 1))
+		{
+			finished = 1;
+			break;
+		}
+		if (record.tier != HISTORY_RAW && history_start_ms((HISTORY_TIER)(record.tier - 1), &finer_ms)
+			&& (int32_t)(record.start_ms - finer_ms) >= 0 && (int32_t)(next_offset - finer_ms) < 0)
+		{
+			next_offset = finer_ms;		//the finer tier covers this time
+			continue;
+		}
+
+		uint8_t* r = &out[count++ * EXPORT_HISTORY_RECORD_BYTES];
+		put_u32(&r[0], record.start_ms);
+		put_u16(&r[4], record.count);
+		r[6] = record.tier;
+		for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		{
+			put_u16(&r[7 + 2 * ch], (uint16_t)record.min[ch]);
+			put_u16(&r[11 + 2 * ch], (uint16_t)record.max[ch]);
+			put_u16(&r[15 + 2 * ch], (uint16_t)record.mean[ch]);
+		}
+		next_offset = record.start_ms + span_ms[record.tier];
+	}
+	return count;
+}
+
+/**
+ * @brief Reads the next packed history samples into a block. The cursor is sought again
+ *        for every block, blocks overwritten in between are never decoded.
+ *
+ * @param out Room for EXPORT_SAMPLE_RECORDS records
+ * @return Records read
+ */
+static uint8_t sample_records(uint8_t* out)
+{
+	Packed_Cursor cursor;
+	uint32_t time_ms;
+	int16_t values[HISTORY_CHANNELS];
+	uint8_t count = 0;
+
+	if (!packed_history_seek(&cursor, next_offset))
+	{
+		finished = 1;
+		return 0;
+	}
+	while (count < EXPORT_SAMPLE_RECORDS)
+	{
+		if (!packed_history_next(&cursor, &time_ms, values) || (int32_t)(time_ms - end_offset) > 0)
+		{
+			finished = 1;
+			break;
+		}
+
+		uint8_t* r = &out[count++ * EXPORT_SAMPLE_RECORD_BYTES];
+		put_u32(&r[0], time_ms);
+		put_u16(&r[4], (uint16_t)values[HISTORY_TEMPERATURE]);
+		put_u16(&r[6], (uint16_t)values[HISTORY_HUMIDITY]);
+		next_offset = time_ms + 1;
+	}
+	return count;
+}
+
+/**
+ * @brief Reads and queues the next block. The ring must have TELEMETRY_FRAME_BYTES free.
+ *
+ * @param None
+ * @return None
+ */
+static void send_block(void)
+{
+	uint32_t start = get_cycle_count();
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+	uint32_t first = next_offset;
+	uint8_t count, record_bytes;
+
+	if (exporting == EXPORT_LOG)
+	{
+		count = log_records(&payload[EXPORT_HEADER_BYTES]);
+		record_bytes = FLASH_LOG_RECORD_BYTES;
+	}
+	else if (exporting == EXPORT_HISTORY)
+	{
+		count = history_records(&payload[EXPORT_HEADER_BYTES]);
+		record_bytes = EXPORT_HISTORY_RECORD_BYTES;
+	}
+	else
+	{
+		count = sample_records(&payload[EXPORT_HEADER_BYTES]);
+		record_bytes = EXPORT_SAMPLE_RECORD_BYTES;
+	}
+	if (count == 0)
+		return;
+
+	payload[0] = TELEMETRY_FRAME_EXPORT_BLOCK;
+	payload[1] = exporting;
+	put_u32(&payload[2], first);
+	put_u32(&payload[6], next_offset);
+	payload[10] = count;
+	telemetry_send(payload, EXPORT_HEADER_BYTES + count * record_bytes);
+
+	records += count;
+	export_stats.blocks++;
+	export_stats.records += count;
+	uint32_t cycles = get_cycle_count() - start;
+	if (cycles > export_stats.max_block_cycles)
+		export_stats.max_block_cycles = cycles;
+}
+
+/**
+ * @brief Queues the end frame and closes the export.
+ *
+ * @param None
+ * @return None
+ */
+static void send_end(void)
+{
+	uint8_t payload[END_BYTES];
+
+	payload[0] = TELEMETRY_FRAME_EXPORT_END;
+	payload[1] = exporting;
+	put_u32(&payload[2], next_offset);
+	put_u32(&payload[6], records);
+	put_u32(&payload[10], skipped);
+	telemetry_send(payload, END_BYTES);
+
+	active = 0;
+	export_stats.exports++;
+	export_stats.skipped += skipped;
+	export_stats.last_ms = HAL_GetTick() - start_ms;
+	export_stats.last_bytes = uart_tx_stats.bytes - start_bytes;
+}
+
+/**
+ * @brief Offset of the oldest record of a source, where a full export starts.
+ *
+ * @param source Source
+ * @return Sequence or HAL tick
+ */
+uint32_t export_oldest(EXPORT_SOURCE source)
+{
+	uint32_t oldest_ms;
+
+	if (source == EXPORT_LOG)
+		return flash_log_oldest();
+	if (source == EXPORT_SAMPLES)
+		return packed_history_oldest(&oldest_ms) ? oldest_ms : HAL_GetTick();
+	return history_start_ms(HISTORY_HOUR, &oldest_ms) ? oldest_ms : HAL_GetTick();
+}
+
+/**
+ * @brief Starts an export of the records present now, from an offset on. Offsets before
+ *        the oldest record start at the oldest.
+ *
+ * @param source Source, from Sequence or HAL tick to start from, the next offset of the last
+ *        block received to resume
+ * @return 1 if started, 0 if an export runs or the source is not built in
+ */
+uint8_t export_start(EXPORT_SOURCE source, uint32_t from)
+{
+	static const uint8_t delimiter = 0x00;
+
+	if (active)
+		return 0;
+#if !FLASH_LOG
+	if (source == EXPORT_LOG)
+		return 0;
+#endif
+#if !PACKED_HISTORY
+	if (source == EXPORT_SAMPLES)
+		return 0;
+#endif
+
+	exporting = source;
+	if (source == EXPORT_LOG)
+	{
+		uint32_t oldest = flash_log_oldest();
+
+		end_offset = flash_log_next();
+		next_offset = (int32_t)(from - oldest) < 0 ? oldest : from;
+	}
+	else
+	{
+		end_offset = HAL_GetTick();
+		next_offset = from;
+	}
+	records = 0;
+	skipped = 0;
+	finished = 0;
+	active = 1;
+	start_ms = HAL_GetTick();
+	start_bytes = uart_tx_stats.bytes;
+	uart_tx_write(&delimiter, 1);
+	return 1;
+}
+
+/**
+ * @brief Queues blocks while the transmit ring has room for one, then the end frame.
+ *        Called from the main loop; returns at once while the ring is full.
+ *
+ * @param None
+ * @return None
+ */
+void export_task(void)
+{
+	for (uint8_t blocks = 0; active && blocks < BLOCKS_PER_CALL; blocks++)
+	{
+		if (uart_tx_free() < TELEMETRY_FRAME_BYTES)
+			return;
+		if (finished)
+			send_end();
+		else
+			send_block();
+	}
+}
+
+/**
+ * @brief Whether an export runs. The console holds its replies meanwhile.
+ *
+ * @param None
+ * @return 1 if running, 0 otherwise
+ */
+uint8_t export_active(void)
+{
+	return active;
+}
@@ -0,0 +1,258 @@
+/**
+ * @file filter.c
+ * @author Auska Wang
+ * @brief Filtering of the calibrated frames before they reach the display, the history
+ *        and the logs.
+ *
+ *        A frame first passes a rate check: a channel may only have moved
+ *        FILTER_MAX_RATE_* tenths per second since the last accepted frame, plus one
+ *        tenth. A frame that moved further, typically a corrupted frame whose checksum
+ *        still matched, is dropped whole and the previous reading stays. A real step,
+ *        such as the unit being carried outdoors, is taken after FILTER_REJECT_LIMIT
+ *        drops in a row and every later stage restarts from it.
+ *
+ *        Accepted frames are then smoothed by up to three stages, all integer and
+ *        without data dependent loops, so each costs the same on every frame. Estimated
+ *        cycles for both channels on the M0+:
+ *        - rate check: about 60
+ *        - median of N: N * N compares, about 100 for 3 and 260 for 5
+ *        - moving average: about 20, state in Q8 so small steps are not lost
+ *        - Kalman: about 250, the gain P / (P + R) is a 15 step restoring division
+ *          rather than the library's data dependent one
+ *        The measured values of every stage are kept in filter_cost.
+ */
+
+/* Includes */
+#include "filter.h"
+#include "general.h"
+#include "config.h"
+
+/* Defines */
+#define RATE_MAX_INTERVAL_MS 65535U		//longer gaps are counted as this, keeps the limit in range
+#define EMA_SHIFT 8						//moving average state, Q8 tenths
+#define KALMAN_SHIFT 4					//Kalman estimate, Q4 tenths
+#define KALMAN_VARIANCE_SHIFT 8			//variances, Q8 tenths^2
+#define KALMAN_GAIN_SHIFT 15			//gain, Q15
+
+#if FILTER_MEDIAN < 1 || FILTER_MEDIAN > 7 || FILTER_MEDIAN % 2 == 0
+#error "FILTER_MEDIAN must be odd, 1 to 7"
+#endif
+#if FILTER_KALMAN_R < 1 || FILTER_KALMAN_R > 255 || FILTER_KALMAN_Q > 255
+#error "FILTER_KALMAN_Q and FILTER_KALMAN_R must be below 256, K * R has to fit 32 bits"
+#endif
+
+/* Variables */
+Filter_Stats filter_stats;
+Filter_Cost filter_cost[FILTER_STAGES];
+
+static uint8_t seeded = 0;
+static uint8_t rejects_in_row = 0;
+static uint32_t accepted_ms;
+static int16_t accepted[HISTORY_CHANNELS];		//last accepted frame, before smoothing
+static const uint16_t max_rate[HISTORY_CHANNELS] = {FILTER_MAX_RATE_TEMPERATURE, FILTER_MAX_RATE_HUMIDITY};
+
+static int16_t median_window[HISTORY_CHANNELS][FILTER_MEDIAN];
+static uint8_t median_next = 0;
+static int32_t ema_state[HISTORY_CHANNELS];		//Q8
+static int32_t kalman_estimate[HISTORY_CHANNELS];	//Q4
+static uint32_t kalman_variance[HISTORY_CHANNELS];	//Q8
+
+/**
+ * @brief Records the cycles of a stage.
+ *
+ * @param stage Stage, start Cycle count when the stage started
+ * @return Cycle count now, the start of the next stage
+ */
+static uint32_t stage_done(FILTER_STAGE stage, uint32_t start)
+{
+	uint32_t now = get_cycle_count();
+
+	filter_cost[stage].last_cycles = now - start;
+	if (filter_cost[stage].last_cycles > filter_cost[stage].max_cycles)
+		filter_cost[stage].max_cycles = filter_cost[stage].last_cycles;
+	return now;
+}
+
+/**
+ * @brief Restarts every stage from a frame, as if it had been read forever.
+ *
+ * @param values Frame, tenths
+ * @return None
+ */
+static void seed(const int16_t* values)
+{
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		for (int i = 0; i < FILTER_MEDIAN; i++)
+			median_window[ch][i] = values[ch];
+		ema_state[ch] = (int32_t)values[ch] << EMA_SHIFT;
+		kalman_estimate[ch] = (int32_t)values[ch] << KALMAN_SHIFT;
+		kalman_variance[ch] = (uint32_t)FILTER_KALMAN_R << KALMAN_VARIANCE_SHIFT;
+	}
+	seeded = 1;
+}
+
+/**
+ * @brief Checks a frame against the rate limits.
+ *
+ * @param values Frame, tenths, now_ms Time of the frame
+ * @return 1 if the frame is within the limits, 0 if any channel moved too fast
+ */
+static uint8_t rate_check(const int16_t* values, uint32_t now_ms)
+{
+	uint32_t interval_ms = now_ms - accepted_ms;
+	uint8_t within = 1;
+
+	if (interval_ms > RATE_MAX_INTERVAL_MS)
+		interval_ms = RATE_MAX_INTERVAL_MS;
+
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		int32_t change = values[ch] - accepted[ch];
+		int32_t limit = (int32_t)((max_rate[ch] * interval_ms) >> 10) + 1;	//per 1.024 s, no division
+
+		if (max_rate[ch] != 0 && (change > limit || change < -limit))
+		{
+			filter_stats.channel_rejected[ch]++;
+			within = 0;
+		}
+	}
+	return within;
+}
+
+/**
+ * @brief Median of a window, by counting for each entry how many are smaller and
+ *        equal. Always N * N compares, whatever the order of the window.
+ *
+ * @param window FILTER_MEDIAN samples
+ * @return The median
+ */
+static int16_t median(const int16_t* window)
+{
+	int16_t result = window[0];
+
+	for (int i = 0; i < FILTER_MEDIAN; i++)
+	{
+		uint8_t below = 0, equal = 0;
+
+		for (int j = 0; j < FILTER_MEDIAN; j++)
+		{
+			below += window[j] < window[i];
+			equal += window[j] == window[i];
+		}
+		if (below <= FILTER_MEDIAN / 2 && below + equal > FILTER_MEDIAN / 2)
+			result = window[i];
+	}
+	return result;
+}
+
+/**
+ * @brief numerator / denominator as a Q15 fraction, numerator < denominator, in a fixed
+ *        15 steps.
+ *
+ * @param numerator Numerator, below 2^31, denominator Denominator, below 2^31
+ * @return Quotient, Q15
+ */
+static uint32_t fraction_q15(uint32_t numerator, uint32_t denominator)
+{
+	uint32_t quotient = 0;
+
+	for (int i = 0; i < KALMAN_GAIN_SHIFT; i++)
+	{
+		numerator <<= 1;
+		quotient <<= 1;
+		if (numerator >= denominator)
+		{
+			numerator -= denominator;
+			quotient |= 1;
+		}
+	}
+	return quotient;
+}
+
+/**
+ * @brief One step of the scalar Kalman filter of a channel: the level is modelled as a
+ *        random walk with variance FILTER_KALMAN_Q per frame, measured with variance
+ *        FILTER_KALMAN_R.
+ *
+ * @param ch Channel, measurement Frame value, tenths
+ * @return Estimate, tenths
+ */
+static int16_t kalman(int ch, int16_t measurement)
+{
+	uint32_t variance = kalman_variance[ch] + ((uint32_t)FILTER_KALMAN_Q << KALMAN_VARIANCE_SHIFT);
+	uint32_t noise = (uint32_t)FILTER_KALMAN_R << KALMAN_VARIANCE_SHIFT;
+	uint32_t gain = fraction_q15(variance, variance + noise);
+	int32_t innovation = ((int32_t)measurement << KALMAN_SHIFT) - kalman_estimate[ch];
+
+	if (innovation > INT16_MAX)
+		innovation = INT16_MAX;
+	else if (innovation < INT16_MIN)
+		innovation = INT16_MIN;
+
+	kalman_estimate[ch] += (innovation * (int32_t)gain + (1 << (KALMAN_GAIN_SHIFT - 1))) >> KALMAN_GAIN_SHIFT;
+	kalman_variance[ch] = (gain * noise) >> KALMAN_GAIN_SHIFT;	//(1 - K) * P, equal to K * R
+	return (int16_t)((kalman_estimate[ch] + (1 << (KALMAN_SHIFT - 1))) >> KALMAN_SHIFT);
+}
+
+/**
+ * @brief Passes a frame through the configured stages.
+ *
+ * @param values Calibrated frame, tenths, replaced by the filtered values if accepted,
+ *        now_ms Time of the frame
+ * @return 1 if the frame was accepted, 0 if it was dropped and values are unchanged
+ */
+uint8_t filter_apply(int16_t* values, uint32_t now_ms)
+{
+	uint32_t start = get_cycle_count();
+
+	filter_stats.frames++;
+
+	if (seeded && !rate_check(values, now_ms))
+	{
+		if (rejects_in_row < FILTER_REJECT_LIMIT)
+		{
+			rejects_in_row++;
+			filter_stats.rejected++;
+			stage_done(FILTER_STAGE_RATE, start);
+			return 0;
+		}
+		filter_stats.reseeds++;
+		seeded = 0;
+	}
+	rejects_in_row = 0;
+	accepted_ms = now_ms;
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		accepted[ch] = values[ch];
+	if (!seeded)
+		seed(values);
+	start = stage_done(FILTER_STAGE_RATE, start);
+
+#if FILTER_MEDIAN > 1
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		median_window[ch][median_next] = values[ch];
+		values[ch] = median(median_window[ch]);
+	}
+	median_next = median_next + 1 < FILTER_MEDIAN ? median_next + 1 : 0;
+	start = stage_done(FILTER_STAGE_MEDIAN, start);
+#endif
+
+#if FILTER_EMA_SHIFT > 0
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		ema_state[ch] += (((int32_t)values[ch] << EMA_SHIFT) - ema_state[ch]) >> FILTER_EMA_SHIFT;
+		values[ch] = (int16_t)((ema_state[ch] + (1 << (EMA_SHIFT - 1))) >> EMA_SHIFT);
+	}
+	start = stage_done(FILTER_STAGE_EMA, start);
+#endif
+
+#if FILTER_KALMAN
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		values[ch] = kalman(ch, values[ch]);
+	start = stage_done(FILTER_STAGE_KALMAN, start);
+#endif
+
+	(void)start;
+	return 1;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file fixed_format.c
+ * @author Auska Wang
+ * @brief Integer-only formatting of readings into display lines.
+ *
+ *        Readings are kept as scaled integers (tenths from the DHT22, hundredths after
+ *        unit conversion), so they can be printed digit by digit without newlib's float
+ *        printf. Each function appends to a NUL terminated line and never writes past
+ *        size - 1 characters.
+ */
+
+/* Includes */
+#include <string.h>
+#include "fixed_format.h"
+#include "general.h"
+#if FORMAT_BENCHMARK
+#include <stdio.h>
+#include "dht22.h"
+#if HEAP_FREE
+#error "FORMAT_BENCHMARK needs HEAP_FREE 0, newlib's float printf allocates through _dtoa_r"
+#endif
+#endif
+
+/* Defines */
+#define DIV10_EXACT_LIMIT 81920		//n * 0xCCCD >> 19 equals n / 10 below this
+#define MAX_DIGITS 10				//4294967295
+
+/**
+ * @brief Divides by 10 with a multiply and shift, the M0+ has no divide instruction.
+ *
+ * @param n Dividend
+ * @return n / 10
+ */
+static inline uint32_t div10(uint32_t n)
+{
+	if (n < DIV10_EXACT_LIMIT)
+		return (n * 0xCCCDU) >> 19;
+	return n / 10;
+}
+
+/**
+ * @brief Appends a character to a line if there is room left.
+ *
+ * @param buffer NUL terminated line, size Size of buffer, c Character to append
+ * @return None
+ */
+void format_append_char(char* buffer, uint8_t size, char c)
+{
+	size_t length = strlen(buffer);
+
+	if (length + 1 < size)
+	{
+		buffer[length] = c;
+		buffer[length + 1] = '\0';
+	}
+}
+
+/**
+ * @brief Appends a string to a line, truncated to the room left.
+ *
+ * @param buffer NUL terminated line, size Size of buffer, str String to append
+ * @return None
+ */
+void format_append_str(char* buffer, uint8_t size, const char* str)
+{
+	size_t length = strlen(buffer);
+
+	while (*str && length + 1 < size)
+		buffer[length++] = *str++;
+	buffer[length] = '\0';
+}
+
+/**
+ * @brief Appends a signed fixed-point number, e.g. 2345 with 2 decimals as "23.45".
+ *        At least one digit is written before the decimal point ("-0.50").
+ *
+ * @param buffer NUL terminated line, size Size of buffer, value Scaled value,
+ *        decimals Digits after the decimal point (FORMAT_TENTHS, FORMAT_HUNDREDTHS)
+ * @return None
+ */
+void format_append_fixed(char* buffer, uint8_t size, int32_t value, uint8_t decimals)
+{
+	char digits[MAX_DIGITS];
+	uint8_t count = 0;
+	uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+	size_t length = strlen(buffer);
+
+	do
+	{
+		uint32_t quotient = div10(magnitude);
+		digits[count++] = '0' + (magnitude - quotient * 10);
+		magnitude = quotient;
+	} while ((magnitude || count <= decimals) && count < MAX_DIGITS);
+
+	if (value < 0 && length + 1 < size)
+		buffer[length++] = '-';
+	while (count && length + 1 < size)
+	{
+		if (count == decimals)
+		{
+			buffer[length++] = '.';
+			if (length + 1 >= size)
+				break;
+		}
+		buffer[length++] = digits[--count];
+	}
+	buffer[length] = '\0';
+}
+
+#if FORMAT_BENCHMARK
+#define BENCHMARK_LINE_SIZE 17
+#define STACK_PAINT_BYTES 1024	//deepest measurable use, larger results saturate here
+#define STACK_PAINT 0xA5A5A5A5U
+
+Format_Benchmark_Result format_benchmark_result;
+
+static char benchmark_line[BENCHMARK_LINE_SIZE];
+static volatile uint8_t benchmark_t1 = 0x00, benchmark_t2 = 0xEA;	//23.4 C, volatile so nothing folds
+
+/**
+ * @brief Reading to text the way print_temp_and_humidity_data() did it: float math and snprintf.
+ *        Needs "Use float with printf from newlib-nano" enabled in the project settings.
+ *
+ * @return None
+ */
+static void format_with_snprintf(void)
+{
+	snprintf(benchmark_line, sizeof(benchmark_line), "Temp:%.2f", getTemperatureF(benchmark_t1, benchmark_t2));
+}
+
+/**
+ * @brief The same line through integer conversion and format_append_fixed().
+ *
+ * @return None
+ */
+static void format_with_fixed(void)
+{
+	benchmark_line[0] = '\0';
+	format_append_str(benchmark_line, sizeof(benchmark_line), "Temp:");
+	format_append_fixed(benchmark_line, sizeof(benchmark_line),
+			getTemperatureTenthsC(benchmark_t1, benchmark_t2) * 18 + 3200, FORMAT_HUNDREDTHS);
+}
+
+/**
+ * @brief Measures the stack a function uses by painting the free stack below SP,
+ *        calling it and finding the deepest overwritten word.
+ *
+ * @param fn Function to measure
+ * @return Bytes of stack used, including the call itself
+ */
+static uint32_t stack_used(void (*fn)(void))
+{
+	uint32_t sp = __get_MSP();
+	uint32_t* bottom = (uint32_t*)(sp - STACK_PAINT_BYTES);
+	uint32_t* word;
+
+	for (word = bottom; (uint32_t)word < sp - 32; word++)	//32 bytes of slack for this frame
+		*word = STACK_PAINT;
+
+	fn();
+
+	for (word = bottom; (uint32_t)word < sp && *word == STACK_PAINT; word++)
+	{}
+	return sp - (uint32_t)word;
+}
+
+/**
+ * @brief Times one formatted line through each path and measures their stack depth.
+ *        Results are stored in format_benchmark_result.
+ *
+ * @return None
+ */
+void format_benchmark(void)
+{
+	uint32_t start;
+
+	format_with_snprintf();	//first call sets up newlib's reentrancy data, keep it out of the timing
+	start = get_cycle_count();
+	format_with_snprintf();
+	format_benchmark_result.snprintf_cycles = get_cycle_count() - start;
+
+	start = get_cycle_count();
+	format_with_fixed();
+	format_benchmark_result.fixed_cycles = get_cycle_count() - start;
+
+	format_benchmark_result.snprintf_stack_bytes = stack_used(format_with_snprintf);
+	format_benchmark_result.fixed_stack_bytes = stack_used(format_with_fixed);
+}
+#endif
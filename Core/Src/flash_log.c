@@ -0,0 +1,381 @@
+/**
+ * @file flash_log.c
+ * @author Auska Wang
+ * @brief Log of readings in the flash pages below the settings pages.
+ *
+ *        The linker script reserves the three 2 KB pages below the settings pages
+ *        (_flash_log_start to _flash_log_end) at a fixed address, so a new image of any
+ *        size finds the log the previous one wrote. The pages are used as a ring: records
+ *        are programmed one after the other into the head page, and when it is full
+ *        the next page, the oldest, is erased and becomes the head. Every page is
+ *        erased once per lap, which spreads the wear evenly.
+ *
+ *        A record is 16 bytes, two double words, and carries its sequence number and
+ *        a CRC. Slot n of a page always holds sequence page base + n; a record torn by
+ *        a reset fails its CRC and its sequence is simply skipped. At boot the page
+ *        whose first intact record has the highest sequence is the head, and a binary
+ *        search for its first erased slot finds the write position: normally one record
+ *        per page and 7 in the head page are read, well under a millisecond.
+ *
+ *        Programming stalls the CPU, an erase for about 22 ms, so readings are queued
+ *        in RAM and flash_log_task() programs one record or erases one page per frame,
+ *        after the sample and render and only while the I2C bus is idle.
+ */
+
+/* Includes */
+#include <stddef.h>
+#include <string.h>
+#include "flash_log.h"
+#include "general.h"
+#include "config.h"
+#include "i2c_bus.h"
+#include "crc.h"
+
+/* Defines */
+#define RECORDS_PER_PAGE (FLASH_PAGE_SIZE / FLASH_LOG_RECORD_BYTES)	//128
+
+/* Variables */
+extern uint8_t _flash_log_start; /* Symbol defined in the linker script */
+extern uint8_t _flash_log_end; /* Symbol defined in the linker script */
+
+Flash_Log_Stats flash_log_stats;
+
+#if FLASH_LOG
+__asm__(".global _flash_log_used\n.set _flash_log_used, 1");	//the linker script keeps the image out of the log pages
+#endif
+
+static uint8_t head_page;				//page being written
+static uint16_t head_slot;				//next slot, RECORDS_PER_PAGE when the page is full
+static uint32_t head_base;				//sequence of slot 0 of the head page
+static uint8_t head_erased = 0;			//head page erased and not written yet
+static uint32_t oldest_sequence = 0;
+static uint16_t boot = 0;
+
+static Flash_Log_Record queue[FLASH_LOG_QUEUE];
+static uint8_t queue_first = 0;
+static uint8_t queue_length = 0;
+
+static int32_t interval_sum[HISTORY_CHANNELS];	//readings of the interval being averaged
+static uint16_t interval_count = 0;
+static uint32_t interval_start_ms;
+
+_Static_assert(sizeof(Flash_Log_Record) == FLASH_LOG_RECORD_BYTES, "Flash_Log_Record is not two double words");
+
+/**
+ * @brief The record in a slot of the log, in place in flash.
+ *
+ * @param page Log page, slot Record in the page
+ * @return Record, possibly erased or torn
+ */
+static inline const Flash_Log_Record* slot_record(uint8_t page, uint16_t slot)
+{
+	return (const Flash_Log_Record*)(&_flash_log_start + page * FLASH_PAGE_SIZE) + slot;
+}
+
+/**
+ * @brief Tells whether a record was completely programmed.
+ *
+ * @param record Record in flash
+ * @return 1 if its CRC matches
+ */
+static inline uint8_t record_valid(const Flash_Log_Record* record)
+{
+	return record->crc == crc16_ccitt((const uint8_t*)record, offsetof(Flash_Log_Record, crc));
+}
+
+/**
+ * @brief Tells whether a slot was never programmed since its page was erased.
+ *
+ * @param record Record in flash
+ * @return 1 if every byte reads 0xFF
+ */
+static uint8_t record_erased(const Flash_Log_Record* record)
+{
+	const uint32_t* word = (const uint32_t*)record;
+
+	for (int i = 0; i < FLASH_LOG_RECORD_BYTES / 4; i++)
+	{
+		if (word[i] != 0xFFFFFFFFU)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief Finds the first intact record of a page. It is normally in slot 0; a reset or
+ *        a failed program while slot 0 was written leaves it torn, and the page is then
+ *        recognised by the next record. Slots are only ever programmed in order, so the
+ *        scan stops at the first erased one.
+ *
+ * @param page Log page, base Filled in with the sequence of slot 0 of the page
+ * @return Slot of the record, RECORDS_PER_PAGE if the page holds none of this log
+ */
+static uint16_t first_record(uint8_t page, uint32_t* base)
+{
+	for (uint16_t slot = 0; slot < RECORDS_PER_PAGE; slot++)
+	{
+		const Flash_Log_Record* record = slot_record(page, slot);
+
+		if (record_valid(record))
+		{
+			if (record->sequence % RECORDS_PER_PAGE != slot)
+				break;		//left over by another image
+			*base = record->sequence - slot;
+			return slot;
+		}
+		if (record_erased(record))
+			break;
+	}
+	return RECORDS_PER_PAGE;
+}
+
+/**
+ * @brief Finds the head of the log after a reset: the page whose first intact record
+ *        has the highest sequence, then its first erased slot by binary search. Slots
+ *        are only ever programmed in order, so erased slots form the tail of the page.
+ *
+ * @return None
+ */
+void flash_log_init(void)
+{
+	uint32_t start = get_cycle_count();
+	uint8_t found = 0;
+	uint16_t low = 0, high;
+
+	flash_log_stats.pages = (&_flash_log_end - &_flash_log_start) / FLASH_PAGE_SIZE;
+
+	for (uint8_t page = 0; page < flash_log_stats.pages; page++)
+	{
+		uint32_t base;
+		uint16_t slot = first_record(page, &base);
+
+		if (slot == RECORDS_PER_PAGE)
+			continue;	//erased, torn throughout, or left over by another image
+		if (!found || (int32_t)(base - head_base) > 0)
+		{
+			head_page = page;
+			head_base = base;
+			low = slot + 1;
+		}
+		if (!found || (int32_t)(base - oldest_sequence) < 0)
+			oldest_sequence = base;
+		found = 1;
+	}
+
+	if (!found)
+	{
+		head_page = flash_log_stats.pages - 1;		//empty log, the first record erases page 0
+		head_slot = RECORDS_PER_PAGE;
+		head_base = -RECORDS_PER_PAGE;
+		oldest_sequence = 0;
+	}
+	else
+	{
+		high = RECORDS_PER_PAGE;
+		while (low < high)
+		{
+			uint16_t middle = (low + high) / 2;
+
+			if (record_erased(slot_record(head_page, middle)))
+				high = middle;
+			else
+				low = middle + 1;
+		}
+		head_slot = low;
+
+		for (int slot = head_slot - 1; slot >= 0; slot--)	//boot number of the last complete record
+		{
+			if (record_valid(slot_record(head_page, slot)))
+			{
+				boot = slot_record(head_page, slot)->boot + 1;
+				break;
+			}
+		}
+
+		//pages left over by an older log may hold sequences the ring no longer reaches
+		if (head_base - oldest_sequence > (uint32_t)(flash_log_stats.pages - 1) * RECORDS_PER_PAGE)
+			oldest_sequence = head_base - (flash_log_stats.pages - 1) * RECORDS_PER_PAGE;
+	}
+
+	flash_log_stats.init_us = CYCLES_TO_US(get_cycle_count() - start);
+}
+
+/**
+ * @brief Averages readings over FLASH_LOG_INTERVAL_S and queues the mean as a record.
+ *        Called for every sample.
+ *
+ * @param values Sample of each channel in tenths, now_ms Time of the sample (HAL tick)
+ * @return None
+ */
+void flash_log_add(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms)
+{
+	Flash_Log_Record* record;
+
+	if (interval_count && now_ms - interval_start_ms >= FLASH_LOG_INTERVAL_S * 1000U)
+	{
+		if (queue_length == FLASH_LOG_QUEUE)
+			flash_log_stats.dropped++;
+		else
+		{
+			record = &queue[(queue_first + queue_length) % FLASH_LOG_QUEUE];
+			queue_length++;
+			record->uptime_s = interval_start_ms / 1000;
+			record->boot = boot;
+			for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+			{
+				int32_t sum = interval_sum[ch];
+
+				record->values[ch] = (sum * 2 + (sum < 0 ? -(int32_t)interval_count : (int32_t)interval_count)) / (2 * (int32_t)interval_count);
+			}
+		}
+		interval_count = 0;
+	}
+
+	if (interval_count == 0)
+	{
+		interval_start_ms = now_ms;
+		memset(interval_sum, 0, sizeof(interval_sum));
+	}
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		interval_sum[ch] += values[ch];
+	interval_count++;
+}
+
+/**
+ * @brief Erases the head page once the previous one is full, dropping the oldest page.
+ *
+ * @return None
+ */
+static void erase_head(void)
+{
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_PAGES,
+		.Page = ((uint32_t)&_flash_log_start - FLASH_BASE) / FLASH_PAGE_SIZE + head_page,
+		.NbPages = 1
+	};
+	uint32_t page_error;
+	uint32_t start = get_cycle_count();
+	uint32_t elapsed_us;
+
+	if (HAL_FLASHEx_Erase(&erase, &page_error) != HAL_OK)
+	{
+		flash_log_stats.errors++;
+		return;		//try again next frame
+	}
+	head_erased = 1;
+	flash_log_stats.erases++;
+	if (head_base - oldest_sequence > (uint32_t)(flash_log_stats.pages - 1) * RECORDS_PER_PAGE)
+		oldest_sequence = head_base - (flash_log_stats.pages - 1) * RECORDS_PER_PAGE;
+
+	elapsed_us = CYCLES_TO_US(get_cycle_count() - start);
+	if (elapsed_us > flash_log_stats.max_erase_us)
+		flash_log_stats.max_erase_us = elapsed_us;
+}
+
+/**
+ * @brief Programs the oldest queued record as two double words into the head slot.
+ *
+ * @return None
+ */
+static void program_record(void)
+{
+	Flash_Log_Record* record = &queue[queue_first];
+	uint32_t address = (uint32_t)slot_record(head_page, head_slot);
+	uint64_t double_words[2];
+	uint32_t start = get_cycle_count();
+	uint32_t elapsed_us;
+
+	record->sequence = head_base + head_slot;
+	record->crc = crc16_ccitt((const uint8_t*)record, offsetof(Flash_Log_Record, crc));
+	memcpy(double_words, record, sizeof(double_words));
+
+	//a failed slot is skipped like a torn one, the record is kept for the next slot
+	head_slot++;
+	head_erased = 0;
+	if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address, double_words[0]) != HAL_OK
+			|| HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + 8, double_words[1]) != HAL_OK)
+	{
+		flash_log_stats.errors++;
+		return;
+	}
+	queue_first = (queue_first + 1) % FLASH_LOG_QUEUE;
+	queue_length--;
+	flash_log_stats.records_written++;
+
+	elapsed_us = CYCLES_TO_US(get_cycle_count() - start);
+	if (elapsed_us > flash_log_stats.max_program_us)
+		flash_log_stats.max_program_us = elapsed_us;
+}
+
+/**
+ * @brief Programs one queued record, or erases the next page when the head page is
+ *        full. Called from the main loop right after a frame was sampled and rendered,
+ *        so the CPU stall falls in the 2 s before the next sensor read.
+ *
+ * @return None
+ */
+void flash_log_task(void)
+{
+	if (queue_length == 0 || !i2c_bus_idle())
+		return;
+
+	if (head_slot == RECORDS_PER_PAGE)
+	{
+		head_page = (head_page + 1) % flash_log_stats.pages;
+		head_base += RECORDS_PER_PAGE;
+		head_slot = 0;
+		head_erased = 0;
+	}
+
+	HAL_FLASH_Unlock();
+	if (head_slot == 0 && !head_erased)
+		erase_head();
+	else
+		program_record();
+	HAL_FLASH_Lock();
+}
+
+/**
+ * @brief Sequence of the oldest record still in flash.
+ *
+ * @return Sequence, equal to flash_log_next() while the log is empty
+ */
+uint32_t flash_log_oldest(void)
+{
+	return oldest_sequence;
+}
+
+/**
+ * @brief Sequence the next record will get.
+ *
+ * @return Sequence
+ */
+uint32_t flash_log_next(void)
+{
+	return head_base + head_slot;
+}
+
+/**
+ * @brief Reads a record by sequence.
+ *
+ * @param sequence From flash_log_oldest() to flash_log_next() - 1, record Filled in
+ * @return 1 if the record is in flash and intact, 0 if it was overwritten, torn or skipped
+ */
+uint8_t flash_log_read(uint32_t sequence, Flash_Log_Record* record)
+{
+	uint32_t pages_back;
+	uint8_t page;
+	const Flash_Log_Record* stored;
+
+	if ((int32_t)(sequence - oldest_sequence) < 0 || (int32_t)(sequence - flash_log_next()) >= 0)
+		return 0;
+
+	pages_back = (head_base - (sequence - sequence % RECORDS_PER_PAGE)) / RECORDS_PER_PAGE;
+	page = (head_page + flash_log_stats.pages - pages_back) % flash_log_stats.pages;
+	stored = slot_record(page, sequence % RECORDS_PER_PAGE);
+	if (!record_valid(stored) || stored->sequence != sequence)
+		return 0;
+
+	*record = *stored;
+	return 1;
+}
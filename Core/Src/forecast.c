@@ -0,0 +1,225 @@
+/**
+ * @file forecast.c
+ * @author Auska Wang
+ * @brief Trend lines of temperature, humidity and the dew point spread by least squares
+ *        over a sliding window, for trend arrows and short term estimates.
+ *
+ *        Frames are averaged into one point every FORECAST_INTERVAL_S seconds, so the
+ *        points are evenly spaced whatever the sampling rate and a point's index can
+ *        stand for its time. With x = 0 for the oldest point, the window needs only
+ *        sum(y) and sum(x * y): when the window slides, every x drops by one, so
+ *        sum(x * y) loses sum(y) of the points that stay and gains (N - 1) * y of the
+ *        new one. Both sums are exact integers, updated in O(1) without drift, and
+ *        sum(x), sum(x^2) follow from the point count.
+ *
+ *        Estimated cycles on the M0+: about 30 per frame, 250 when a point is pushed
+ *        (three divisions for the means, more when slow sampling leaves intervals to
+ *        interpolate), and 400 per query, mostly the 64 bit division.
+ *        The measured values are kept in forecast_cost.
+ */
+
+/* Includes */
+#include "forecast.h"
+#include "general.h"
+#include "config.h"
+
+/* Defines */
+#if FORECAST_POINTS < FORECAST_MIN_POINTS || FORECAST_POINTS > 64
+#error "FORECAST_POINTS must be FORECAST_MIN_POINTS to 64, the sums are int32_t"
+#endif
+
+/**
+ * @brief A channel's window and its running sums.
+ */
+typedef struct {
+	int16_t points[FORECAST_POINTS];	//ring, oldest at head once full
+	int32_t sum;						//sum(y)
+	int32_t weighted_sum;				//sum(x * y), x = 0 for the oldest point
+} Forecast_Window;
+
+/* Variables */
+Forecast_Cost forecast_cost;
+
+static Forecast_Window windows[FORECAST_CHANNELS];
+static uint8_t count = 0;				//points in every window
+static uint8_t head = 0;				//next slot to write
+static int32_t frame_sums[FORECAST_CHANNELS];
+static uint16_t frames = 0;				//frames averaged into the next point
+static uint32_t interval_start_ms;
+
+/**
+ * @brief Pushes one point per channel, dropping the oldest once the window is full.
+ *
+ * @param values FORECAST_CHANNELS values, tenths
+ * @return None
+ */
+static void push(const int16_t* values)
+{
+	for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+	{
+		Forecast_Window* window = &windows[ch];
+		int16_t value = values[ch];
+
+		if (count < FORECAST_POINTS)
+		{
+			window->weighted_sum += (int32_t)count * value;
+			window->sum += value;
+		}
+		else
+		{
+			int16_t oldest = window->points[head];
+
+			window->weighted_sum += (FORECAST_POINTS - 1) * value - (window->sum - oldest);
+			window->sum += value - oldest;
+		}
+		window->points[head] = value;
+	}
+
+	head = head + 1 < FORECAST_POINTS ? head + 1 : 0;
+	if (count < FORECAST_POINTS)
+		count++;
+}
+
+/**
+ * @brief Adds a frame. Every FORECAST_INTERVAL_S the frames since the last point are
+ *        averaged into a new point. When frames come slower than that, the intervals
+ *        without one get points interpolated between their neighbours, so the points
+ *        stay evenly spaced. After a gap as long as the window, it starts over.
+ *
+ * @param values FORECAST_CHANNELS values, tenths, now_ms Time of the frame
+ * @return None
+ */
+void forecast_add(const int16_t* values, uint32_t now_ms)
+{
+	uint32_t start = get_cycle_count();
+	uint32_t elapsed_ms = now_ms - interval_start_ms;
+
+	if ((count == 0 && frames == 0) || elapsed_ms >= FORECAST_POINTS * FORECAST_INTERVAL_S * 1000U)
+	{
+		for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+		{
+			windows[ch].sum = 0;
+			windows[ch].weighted_sum = 0;
+			frame_sums[ch] = 0;
+		}
+		count = 0;
+		head = 0;
+		frames = 0;
+		interval_start_ms = now_ms;
+	}
+	else if (elapsed_ms >= FORECAST_INTERVAL_S * 1000U)
+	{
+		uint32_t intervals = elapsed_ms / (FORECAST_INTERVAL_S * 1000U);
+		uint32_t empty = intervals;
+		int16_t points[FORECAST_CHANNELS];
+
+		if (frames > 0)		//close the interval the frames belong to
+		{
+			for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+			{
+				int32_t half = frame_sums[ch] < 0 ? -(frames / 2) : frames / 2;
+
+				points[ch] = (int16_t)((frame_sums[ch] + half) / frames);
+				frame_sums[ch] = 0;
+			}
+			frames = 0;
+			push(points);
+			empty--;
+		}
+
+		uint8_t last = head > 0 ? head - 1 : FORECAST_POINTS - 1;
+		for (uint32_t i = 1; i <= empty; i++)
+		{
+			for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+			{
+				int16_t from = windows[ch].points[last];
+
+				points[ch] = (int16_t)(from + (int32_t)(values[ch] - from) * (int32_t)i / (int32_t)(empty + 1));
+			}
+			push(points);
+		}
+		interval_start_ms += intervals * FORECAST_INTERVAL_S * 1000U;
+	}
+
+	for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+		frame_sums[ch] += values[ch];
+	frames++;
+
+	forecast_cost.last_add_cycles = get_cycle_count() - start;
+	if (forecast_cost.last_add_cycles > forecast_cost.max_add_cycles)
+		forecast_cost.max_add_cycles = forecast_cost.last_add_cycles;
+}
+
+/**
+ * @brief Divides, rounding halves away from zero.
+ *
+ * @param numerator Numerator, denominator Denominator, positive
+ * @return Rounded quotient
+ */
+static int64_t divide_rounded(int64_t numerator, int64_t denominator)
+{
+	return (numerator + (numerator < 0 ? -denominator : denominator) / 2) / denominator;
+}
+
+/**
+ * @brief Fits a line through a channel's window.
+ *
+ * @param channel Channel, forecast Filled with the level and slope
+ * @return 1 if the window holds FORECAST_MIN_POINTS points, 0 otherwise
+ */
+uint8_t forecast_get(FORECAST_CHANNEL channel, Forecast* forecast)
+{
+	uint32_t start = get_cycle_count();
+	const Forecast_Window* window = &windows[channel];
+	int32_t n = count;
+
+	if (n < FORECAST_MIN_POINTS)
+		return 0;
+
+	//sum(x) = n (n - 1) / 2, n sum(x^2) - sum(x)^2 = n^2 (n^2 - 1) / 12
+	int32_t sum_x = n * (n - 1) / 2;
+	int32_t spread = n * n * (n * n - 1) / 12;
+	int32_t covariance = n * window->weighted_sum - sum_x * window->sum;		//slope = covariance / spread per point
+
+	//hundredths per minute: tenths per point * 10 * points per minute
+	forecast->slope = (int16_t)divide_rounded((int64_t)covariance * 600, (int64_t)spread * FORECAST_INTERVAL_S);
+	//mean + slope * (n - 1 - mean x), with mean x = (n - 1) / 2
+	forecast->level = (int16_t)divide_rounded((int64_t)window->sum * 2 * spread + (int64_t)covariance * n * (n - 1), (int64_t)2 * n * spread);
+
+	forecast_cost.last_query_cycles = get_cycle_count() - start;
+	if (forecast_cost.last_query_cycles > forecast_cost.max_query_cycles)
+		forecast_cost.max_query_cycles = forecast_cost.last_query_cycles;
+	return 1;
+}
+
+/**
+ * @brief Value the trend line reaches after some minutes.
+ *
+ * @param forecast Trend from forecast_get(), minutes Minutes after the newest point
+ * @return Value, tenths
+ */
+int16_t forecast_extrapolate(const Forecast* forecast, uint16_t minutes)
+{
+	return (int16_t)(forecast->level + divide_rounded((int32_t)forecast->slope * minutes, 10));
+}
+
+/**
+ * @brief Minutes until the trend line reaches a value.
+ *
+ * @param forecast Trend from forecast_get(), target Value, tenths
+ * @return Minutes, 0 if already there, -1 if moving away, flat or beyond FORECAST_MAX_MINUTES
+ */
+int16_t forecast_minutes_until(const Forecast* forecast, int16_t target)
+{
+	int32_t distance = (int32_t)(target - forecast->level) * 10;		//hundredths
+	int32_t slope = forecast->slope;
+
+	if (distance == 0)
+		return 0;
+	if (slope == 0 || (distance < 0) != (slope < 0))
+		return -1;
+
+	int32_t minutes = (int32_t)divide_rounded(distance < 0 ? -distance : distance, slope < 0 ? -slope : slope);
+
+	return minutes > FORECAST_MAX_MINUTES ? -1 : (int16_t)minutes;
+}
@@ -10,13 +10,20 @@
 #include "general.h"
 #include <stdint.h>
 #include "stm32c0xx_hal.h"
-#include "i2clcd.h"
+#include "config.h"
+#include "crc.h"
+#include "modbus.h"
 
 /* Variables */
 TIM_HandleTypeDef htim3;
-//UART_HandleTypeDef huart2;
+UART_HandleTypeDef huart2;
 I2C_HandleTypeDef hi2c1;
 TIM_HandleTypeDef htim14;
+TIM_HandleTypeDef htim17;
+DMA_HandleTypeDef hdma_i2c1_tx;
+DMA_HandleTypeDef hdma_i2c1_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
+DMA_HandleTypeDef hdma_usart2_rx;
 
 /**
  * @brief Microsecond delay
@@ -26,7 +33,7 @@ TIM_HandleTypeDef htim14;
  * @param microseconds Number of microseconds to delay
  * @return None
  */
-void micro_delay(int microseconds)
+void micro_delay(uint32_t microseconds)
 {
 	__HAL_TIM_SET_COUNTER(&htim3, 0);	//set timer to 0
 	//each count of timer 3 is adjusted to last for 1 microsecond
@@ -34,6 +41,36 @@ void micro_delay(int microseconds)
 	{}
 }
 
+/**
+ * @brief Free running CPU cycle counter
+ *
+ * Cortex-M0+ has no DWT cycle counter, so this combines the HAL millisecond tick with the
+ * current SysTick down-counter. Unlike micro_delay(), it never resets a timer, so it can be
+ * used to timestamp and benchmark code from any context. Wraps every ~89 s at 48 MHz.
+ *
+ * @param None
+ * @return Number of core clock cycles since the HAL tick was started
+ */
+uint32_t get_cycle_count(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t ticks = uwTick;
+	uint32_t value = SysTick->VAL;
+
+	//SysTick reloaded but its ISR has not run yet (IRQs masked or a higher priority ISR is running)
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+	{
+		value = SysTick->VAL;
+		ticks++;
+	}
+
+	__set_PRIMASK(primask);
+
+	return ticks * (SysTick->LOAD + 1) + (SysTick->LOAD - value);
+}
+
 /**
  * @brief Sets and configures desired pin to output or input mode
  *
@@ -124,15 +161,49 @@ static void MX_TIM14_Init(void)
   {
     Error_Handler();
   }
-  if (HAL_TIM_Base_Start_IT(&htim14) != HAL_OK)
-  	{
-  		Error_Handler();
-  	}
 //  /* USER CODE END TIM14_Init 2 */
   HAL_NVIC_SetPriority(TIM14_IRQn, 3, 0);  // Set interrupt priority
   HAL_NVIC_EnableIRQ(TIM14_IRQn);          // Enable TIM14 interrupt
 }
 
+/**
+ * @brief Starts the periodic sensor sampling on TIM14
+ *
+ * Kept out of hardware_init() so the first period starts after the first reading,
+ * keeping the DHT22's minimum interval between requests.
+ *
+ * @param None
+ * @return None
+ */
+void sampling_start()
+{
+	__HAL_TIM_SET_COUNTER(&htim14, 0);
+	if (HAL_TIM_Base_Start_IT(&htim14) != HAL_OK)
+	{
+		Error_Handler();
+	}
+}
+
+/**
+ * @brief Changes the period of the sensor sampling on TIM14, from the next period on
+ *        when called right after a sample.
+ *
+ * TIM14 counts at 48 MHz / 60001, 0.8 ticks per millisecond, so the longest period is
+ * 81.9 s. The counter is pulled back if it already passed the new period, which would
+ * otherwise make it run the full 16 bits before the next update.
+ *
+ * @param interval_ms Period in milliseconds, 2000 to 81000
+ * @return None
+ */
+void sampling_set_interval(uint32_t interval_ms)
+{
+	uint32_t period = interval_ms * 4 / 5;
+
+	__HAL_TIM_SET_AUTORELOAD(&htim14, period);
+	if (__HAL_TIM_GET_COUNTER(&htim14) >= period)
+		__HAL_TIM_SET_COUNTER(&htim14, period - 1);
+}
+
 /**
  * @brief System Clock Init
  *
@@ -171,32 +242,83 @@ static void SystemClock_Config(void)
   }
 }
 
+/**
+ * @brief TIM17 Init
+ *
+ * This function initializes TIM17 as a one pulse timer counting microseconds. Modbus starts it
+ * on an idle line; its update interrupt marks the end of the 3.5 character gap. The network
+ * counts 10 us ticks instead, to reach slots up to 655 ms after a beacon.
+ *
+ * @param None
+ * @return None
+ */
+static void MX_TIM17_Init(void)
+{
+	htim17.Instance = TIM17;
+#if NETWORK
+	htim17.Init.Prescaler = 479;	//48 MHz / 480, 100 kHz
+	htim17.Init.Period = 0xFFFF;	//set for each slot
+#else
+	htim17.Init.Prescaler = 47;		//48 MHz / 48, 1 MHz
+	htim17.Init.Period = MODBUS_TIMER_US - 1;
+#endif
+	htim17.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim17.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim17.Init.RepetitionCounter = 0;
+	htim17.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if (HAL_TIM_Base_Init(&htim17) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	htim17.Instance->CR1 |= TIM_CR1_OPM;	//stops after one period
+	__HAL_TIM_CLEAR_FLAG(&htim17, TIM_FLAG_UPDATE);	//set by the init
+	__HAL_TIM_ENABLE_IT(&htim17, TIM_IT_UPDATE);
+}
+
 /**
  * @brief USART2 Init
  *
- * This function initializes USART2
+ * This function initializes USART2, 8N1 at TELEMETRY_BAUD, with MODBUS 8E1 at MODBUS_BAUD, or
+ * with NETWORK 8N1 at NETWORK_BAUD driving the RS-485 transceiver's DE pin
  *
  * @param None
  * @return None
  */
-//static void MX_USART2_UART_Init(void)
-//{
-//	huart2.Instance = USART2;
-//	huart2.Init.BaudRate = 9600;
-//	huart2.Init.WordLength = UART_WORDLENGTH_8B;
-//	huart2.Init.StopBits = UART_STOPBITS_1;
-//	huart2.Init.Parity = UART_PARITY_NONE;
-//	huart2.Init.Mode = UART_MODE_TX_RX;
-//	huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
-//	huart2.Init.OverSampling = UART_OVERSAMPLING_16;
-//	huart2.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
-//	huart2.Init.ClockPrescaler = UART_PRESCALER_DIV1;
-//	huart2.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
-//	if (HAL_UART_Init(&huart2) != HAL_OK)
-//	{
-//		Error_Handler();
-//	}
-//}
+static void MX_USART2_UART_Init(void)
+{
+	huart2.Instance = USART2;
+#if MODBUS
+	huart2.Init.BaudRate = MODBUS_BAUD;
+	huart2.Init.WordLength = UART_WORDLENGTH_9B;	//8 data bits and the parity bit
+	huart2.Init.Parity = UART_PARITY_EVEN;
+#elif NETWORK
+	huart2.Init.BaudRate = NETWORK_BAUD;
+	huart2.Init.WordLength = UART_WORDLENGTH_8B;
+	huart2.Init.Parity = UART_PARITY_NONE;
+#else
+	huart2.Init.BaudRate = TELEMETRY_BAUD;
+	huart2.Init.WordLength = UART_WORDLENGTH_8B;
+	huart2.Init.Parity = UART_PARITY_NONE;
+#endif
+	huart2.Init.StopBits = UART_STOPBITS_1;
+	huart2.Init.Mode = UART_MODE_TX_RX;
+	huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+	huart2.Init.OverSampling = UART_OVERSAMPLING_16;
+	huart2.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
+	huart2.Init.ClockPrescaler = UART_PRESCALER_DIV1;
+	huart2.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+#if NETWORK
+	//DE high a bit time before the start bit and after the stop bit, in 1/16 bit units
+	if (HAL_RS485Ex_Init(&huart2, UART_DE_POLARITY_HIGH, 16, 16) != HAL_OK)
+#else
+	if (HAL_UART_Init(&huart2) != HAL_OK)
+#endif
+	{
+		Error_Handler();
+	}
+	HAL_NVIC_SetPriority(USART2_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(USART2_IRQn);
+}
 
 /**
  * @brief GPIO Init
@@ -222,6 +344,13 @@ static void MX_GPIO_Init(void)
 	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
 	HAL_GPIO_Init(DHT22_Port, &GPIO_InitStruct);
 
+	/*Configure GPIO pins : alarm outputs, off until an alarm is raised */
+	HAL_GPIO_WritePin(LED_Port, LED_Pin, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(BUZZER_Port, BUZZER_Pin, GPIO_PIN_RESET);
+	GPIO_InitStruct.Pin = LED_Pin;
+	HAL_GPIO_Init(LED_Port, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = BUZZER_Pin;
+	HAL_GPIO_Init(BUZZER_Port, &GPIO_InitStruct);
 
 	/*Configure GPIO pin : UNITS_Button */
 	GPIO_InitStruct.Pin = UNITS_Button_Pin;
@@ -229,6 +358,12 @@ static void MX_GPIO_Init(void)
 	GPIO_InitStruct.Pull = GPIO_PULLDOWN;
 	HAL_GPIO_Init(UNITS_Button_Port, &GPIO_InitStruct);
 
+	/*Configure GPIO pin : VIEW_Button */
+	GPIO_InitStruct.Pin = VIEW_Button_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+	GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+	HAL_GPIO_Init(VIEW_Button_Port, &GPIO_InitStruct);
+
 	/*Configure GPIO pin : LIGHT_Button */
 	GPIO_InitStruct.Pin = LIGHT_Button_Pin;
 	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
@@ -239,17 +374,40 @@ static void MX_GPIO_Init(void)
 	HAL_NVIC_SetPriority(EXTI2_3_IRQn, 1, 0);
 	HAL_NVIC_EnableIRQ(EXTI2_3_IRQn);
 
+	//VIEW_Button priority
+	HAL_NVIC_SetPriority(EXTI0_1_IRQn, 2, 0);
+	HAL_NVIC_EnableIRQ(EXTI0_1_IRQn);
+
 	//UNITS_Button_Pin priority
 	HAL_NVIC_SetPriority(EXTI4_15_IRQn, 2, 0);
 	HAL_NVIC_EnableIRQ(EXTI4_15_IRQn);
 }
 
+/**
+ * @brief DMA Init
+ *
+ * This function enables the DMA controller clock and the interrupts of the channels used for
+ * I2C1 TX (1), I2C1 RX (2) or with CONSOLE, MODBUS or NETWORK USART2 RX (2), and USART2 TX (3)
+ *
+ * @param None
+ * @return None
+ */
+static void MX_DMA_Init(void)
+{
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+	HAL_NVIC_SetPriority(DMA1_Channel2_3_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+}
+
 /**
   * @brief I2C1 Initialization Function
   * @param None
   * @retval None
   */
-static void MX_I2C1_Init(void)
+void MX_I2C1_Init(void)
 {
 
   /* USER CODE BEGIN I2C1_Init 0 */
@@ -309,7 +467,8 @@ void Error_Handler(void)
 /**
  * @brief Board Init
  *
- * This function encapsulates the functions needed to initialize hardware for the board to run
+ * This function encapsulates the functions needed to initialize hardware for the board to run.
+ * The display and the sensor need power-up waits; they are brought up by boot_run() afterwards.
  *
  * @param None
  * @return None
@@ -320,10 +479,16 @@ void hardware_init()
 	SystemClock_Config();
 	MX_GPIO_Init();
 	MX_TIM3_Init();
-	//MX_USART2_UART_Init();
+	MX_DMA_Init();
+	crc_init();
+#if TELEMETRY || CONSOLE || MODBUS || DIAG_PRINT || NETWORK
+	MX_USART2_UART_Init();
+#endif
+#if MODBUS || NETWORK
+	MX_TIM17_Init();
+#endif
 	MX_I2C1_Init();
 	MX_TIM14_Init();
-	lcd_init();
 }
 
 #ifdef  USE_FULL_ASSERT
@@ -0,0 +1,424 @@
+/**
+ * @file history.c
+ * @author Auska Wang
+ * @brief Tiered history of the readings: raw samples, per-minute and per-hour rings.
+ *
+ *        A day of 2 s samples (43200 per channel) does not fit the RAM, so samples only
+ *        stay raw for a minute. Each sample is also added to the open minute bucket;
+ *        when a minute ends its bucket closes into the minute ring and is merged into
+ *        the open hour bucket, which closes into the hour ring every 60 minutes. Gaps
+ *        without samples close empty buckets, so ring positions stay aligned with time
+ *        and bucket start times need not be stored.
+ *
+ *        Every ring is a fixed array of packed buckets: the raw tier costs 256 B, the
+ *        minutes 1584 B and the hours 648 B, open buckets included, so the full 24 h
+ *        take about 2.4 KB. The build fails if they outgrow 3 KB.
+ */
+
+/* Includes */
+#include <string.h>
+#include "history.h"
+
+/* Defines */
+#define MINUTES_PER_HOUR 60
+#define MAX_CATCH_UP_MINUTES (HISTORY_MINUTES * HISTORY_HOURS)	//after a longer gap every tier is empty anyway
+
+/**
+ * @brief Ring of closed buckets, minutes or hours.
+ */
+typedef struct {
+	History_Bucket (*buckets)[HISTORY_CHANNELS];
+	uint16_t* counts;
+	uint8_t capacity;
+	uint8_t first;		//oldest entry
+	uint8_t length;
+} History_Ring;
+
+/* Variables */
+static int16_t raw_values[HISTORY_RAW_SAMPLES][HISTORY_CHANNELS];
+static uint32_t raw_time_ms[HISTORY_RAW_SAMPLES];
+static uint8_t raw_first = 0;
+static uint8_t raw_length = 0;
+
+static History_Bucket minute_buckets[HISTORY_MINUTES][HISTORY_CHANNELS];
+static uint16_t minute_counts[HISTORY_MINUTES];
+static History_Bucket hour_buckets[HISTORY_HOURS][HISTORY_CHANNELS];
+static uint16_t hour_counts[HISTORY_HOURS];
+static History_Ring rings[HISTORY_TIERS] = {
+	[HISTORY_MINUTE] = {minute_buckets, minute_counts, HISTORY_MINUTES, 0, 0},
+	[HISTORY_HOUR] = {hour_buckets, hour_counts, HISTORY_HOURS, 0, 0}
+};
+
+static History_Bucket open_buckets[HISTORY_TIERS][HISTORY_CHANNELS];	//minute and hour still open
+static uint16_t open_counts[HISTORY_TIERS];
+static uint8_t minutes_in_hour = 0;
+static uint32_t minute_start_ms;
+static uint8_t started = 0;
+static const History_Observer* observer = NULL;
+
+_Static_assert(sizeof(raw_values) + sizeof(raw_time_ms) + sizeof(minute_buckets) + sizeof(minute_counts)
+	+ sizeof(hour_buckets) + sizeof(hour_counts) + sizeof(open_buckets) + sizeof(open_counts) <= 3072,
+	"24 h of history must stay well under 4 KB");
+
+/**
+ * @brief Registers the module following the rings, rolling_stats.c.
+ *
+ * @param o Observer, NULL for none
+ * @return None
+ */
+void history_set_observer(const History_Observer* o)
+{
+	observer = o;
+}
+
+/**
+ * @brief Adds a sample to a bucket.
+ *
+ * @param b Bucket, count Samples already in it, value Sample in tenths
+ * @return None
+ */
+static inline void bucket_add(History_Bucket* b, uint16_t count, int16_t value)
+{
+	if (count == 0)
+	{
+		b->sum = 0;
+		b->sum_squares = 0;
+		b->min = b->max = value;
+	}
+	else if (value < b->min)
+		b->min = value;
+	else if (value > b->max)
+		b->max = value;
+
+	b->sum += value;
+	b->sum_squares += (uint32_t)((int32_t)value * value);
+}
+
+/**
+ * @brief Merges a bucket into a larger one.
+ *
+ * @param dst Bucket, dst_count Samples in it, src Bucket to add, src_count Samples in src
+ * @return None
+ */
+static inline void bucket_merge(History_Bucket* dst, uint16_t dst_count, const History_Bucket* src, uint16_t src_count)
+{
+	if (src_count == 0)
+		return;
+	if (dst_count == 0)
+	{
+		*dst = *src;
+		return;
+	}
+
+	dst->sum += src->sum;
+	dst->sum_squares += src->sum_squares;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/**
+ * @brief Appends the open bucket of a tier to its ring, dropping the oldest entry when full.
+ *
+ * @param tier HISTORY_MINUTE or HISTORY_HOUR
+ * @return None
+ */
+static void ring_push(HISTORY_TIER tier)
+{
+	History_Ring* ring = &rings[tier];
+	uint8_t position;
+
+	if (ring->length == ring->capacity)
+	{
+		if (observer)
+			observer->leaving(tier, ring->first);
+		ring->first = (ring->first + 1) % ring->capacity;
+		ring->length--;
+	}
+
+	position = (ring->first + ring->length) % ring->capacity;
+	ring->length++;
+	ring->counts[position] = open_counts[tier];
+	if (open_counts[tier])
+		memcpy(ring->buckets[position], open_buckets[tier], sizeof(open_buckets[tier]));
+	open_counts[tier] = 0;
+
+	if (observer)
+		observer->entered(tier, position);
+}
+
+/**
+ * @brief Closes the open minute, and the open hour every 60 minutes.
+ *
+ * @return None
+ */
+static void close_minute(void)
+{
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		bucket_merge(&open_buckets[HISTORY_HOUR][ch], open_counts[HISTORY_HOUR], &open_buckets[HISTORY_MINUTE][ch], open_counts[HISTORY_MINUTE]);
+	open_counts[HISTORY_HOUR] += open_counts[HISTORY_MINUTE];
+	ring_push(HISTORY_MINUTE);
+
+	if (++minutes_in_hour == MINUTES_PER_HOUR)
+	{
+		ring_push(HISTORY_HOUR);
+		minutes_in_hour = 0;
+	}
+}
+
+/**
+ * @brief Removes the oldest raw sample.
+ *
+ * @return None
+ */
+static void raw_expire_oldest(void)
+{
+	if (observer)
+		observer->leaving(HISTORY_RAW, raw_first);
+	raw_first = (raw_first + 1) % HISTORY_RAW_SAMPLES;
+	raw_length--;
+}
+
+/**
+ * @brief Empties every tier.
+ *
+ * @return None
+ */
+void history_clear(void)
+{
+	raw_first = raw_length = 0;
+	rings[HISTORY_MINUTE].first = rings[HISTORY_MINUTE].length = 0;
+	rings[HISTORY_HOUR].first = rings[HISTORY_HOUR].length = 0;
+	memset(open_counts, 0, sizeof(open_counts));
+	minutes_in_hour = 0;
+	started = 0;
+	if (observer)
+		observer->cleared();
+}
+
+/**
+ * @brief Adds a sample of every channel. Closes the buckets whose time has passed first,
+ *        then drops raw samples older than a minute.
+ *
+ * @param values Sample of each channel in tenths, now_ms Time of the sample (HAL tick)
+ * @return None
+ */
+void history_add(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms)
+{
+	uint8_t position;
+
+	for (int i = 0; started && now_ms - minute_start_ms >= HISTORY_MINUTE_MS; i++)
+	{
+		if (i == MAX_CATCH_UP_MINUTES)
+		{
+			history_clear();
+			break;
+		}
+		close_minute();
+		minute_start_ms += HISTORY_MINUTE_MS;
+	}
+	if (!started)
+	{
+		minute_start_ms = now_ms;
+		started = 1;
+	}
+
+	while (raw_length && now_ms - raw_time_ms[raw_first] >= HISTORY_MINUTE_MS)
+		raw_expire_oldest();
+	if (raw_length == HISTORY_RAW_SAMPLES)
+		raw_expire_oldest();
+
+	position = (raw_first + raw_length) % HISTORY_RAW_SAMPLES;
+	raw_length++;
+	raw_time_ms[position] = now_ms;
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		raw_values[position][ch] = values[ch];
+		bucket_add(&open_buckets[HISTORY_MINUTE][ch], open_counts[HISTORY_MINUTE], values[ch]);
+	}
+	open_counts[HISTORY_MINUTE]++;
+
+	if (observer)
+		observer->entered(HISTORY_RAW, position);
+}
+
+/**
+ * @brief Samples of every channel at a raw ring position.
+ *
+ * @param position Ring position
+ * @return Values in tenths, indexed by HISTORY_CHANNEL
+ */
+const int16_t* history_raw(uint8_t position)
+{
+	return raw_values[position];
+}
+
+/**
+ * @brief Buckets of every channel at a ring position of the minute or hour tier.
+ *
+ * @param tier HISTORY_MINUTE or HISTORY_HOUR, position Ring position
+ * @return Buckets indexed by HISTORY_CHANNEL, only valid if history_count() is not 0
+ */
+const History_Bucket* history_bucket(HISTORY_TIER tier, uint8_t position)
+{
+	return rings[tier].buckets[position];
+}
+
+/**
+ * @brief Samples aggregated at a ring position of the minute or hour tier.
+ *
+ * @param tier HISTORY_MINUTE or HISTORY_HOUR, position Ring position
+ * @return Sample count, 0 for a bucket closed without samples
+ */
+uint16_t history_count(HISTORY_TIER tier, uint8_t position)
+{
+	return rings[tier].counts[position];
+}
+
+/**
+ * @brief The bucket of a tier still being filled.
+ *
+ * @param tier HISTORY_MINUTE or HISTORY_HOUR, count Set to the samples in it
+ * @return Buckets indexed by HISTORY_CHANNEL, only valid if count is not 0
+ */
+const History_Bucket* history_open(HISTORY_TIER tier, uint16_t* count)
+{
+	*count = open_counts[tier];
+	return open_buckets[tier];
+}
+
+/**
+ * @brief Entries a tier's ring holds.
+ *
+ * @param tier Tier
+ * @return Raw samples or closed buckets held
+ */
+uint8_t history_length(HISTORY_TIER tier)
+{
+	return (tier == HISTORY_RAW) ? raw_length : rings[tier].length;
+}
+
+/**
+ * @brief Start of the oldest entry of a tier, the open bucket counting for the minute
+ *        and hour tiers. history_query() uses a tier from this time on.
+ *
+ * @param tier Tier, start_ms Set to the start in HAL ticks
+ * @return 1 if the tier holds an entry, 0 if it is empty
+ */
+uint8_t history_start_ms(HISTORY_TIER tier, uint32_t* start_ms)
+{
+	if (tier == HISTORY_RAW)
+	{
+		if (!raw_length)
+			return 0;
+		*start_ms = raw_time_ms[raw_first];
+		return 1;
+	}
+	if (!started)
+		return 0;
+
+	if (tier == HISTORY_MINUTE)
+		*start_ms = minute_start_ms - rings[HISTORY_MINUTE].length * HISTORY_MINUTE_MS;
+	else
+		*start_ms = minute_start_ms - minutes_in_hour * HISTORY_MINUTE_MS - rings[HISTORY_HOUR].length * HISTORY_HOUR_MS;
+	return 1;
+}
+
+/**
+ * @brief Fills a record from a bucket of every channel.
+ *
+ * @return None
+ */
+static void bucket_record(History_Record* record, HISTORY_TIER tier, uint32_t start_ms, const History_Bucket* buckets, uint16_t count)
+{
+	record->start_ms = start_ms;
+	record->count = count;
+	record->tier = tier;
+	for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+	{
+		int32_t sum = buckets[ch].sum;
+
+		record->min[ch] = buckets[ch].min;
+		record->max[ch] = buckets[ch].max;
+		record->mean[ch] = (sum * 2 + (sum < 0 ? -(int32_t)count : (int32_t)count)) / (2 * (int32_t)count);
+	}
+}
+
+/**
+ * @brief Copies the history between two times, oldest first, from the finest tier that
+ *        still reaches back to from_ms: raw samples for the last minute, minutes for the
+ *        last hour, hours beyond. The open bucket of the tier ends the list. The hour
+ *        tier covers every range, so the coarsest covering tier would always be hours;
+ *        the finest one gives the most detail the range still has.
+ *
+ * @param from_ms/to_ms Range in HAL ticks, records Output, max_records Room in records
+ * @return Records written
+ */
+uint16_t history_query(uint32_t from_ms, uint32_t to_ms, History_Record* records, uint16_t max_records)
+{
+	uint16_t written = 0;
+	uint32_t hour_start_ms = minute_start_ms - minutes_in_hour * HISTORY_MINUTE_MS;
+	HISTORY_TIER tier;
+	History_Ring* ring;
+	uint32_t span_ms, start_ms;
+
+	if (!started)
+		return 0;
+
+	if (raw_length && (int32_t)(from_ms - raw_time_ms[raw_first]) >= 0)
+	{
+		for (int i = 0; i < raw_length && written < max_records; i++)
+		{
+			uint8_t position = (raw_first + i) % HISTORY_RAW_SAMPLES;
+			History_Record* record = &records[written];
+
+			if ((int32_t)(raw_time_ms[position] - from_ms) < 0 || (int32_t)(raw_time_ms[position] - to_ms) > 0)
+				continue;
+			record->start_ms = raw_time_ms[position];
+			record->count = 1;
+			record->tier = HISTORY_RAW;
+			for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+				record->min[ch] = record->max[ch] = record->mean[ch] = raw_values[position][ch];
+			written++;
+		}
+		return written;
+	}
+
+	if ((int32_t)(from_ms - (minute_start_ms - rings[HISTORY_MINUTE].length * HISTORY_MINUTE_MS)) >= 0)
+	{
+		tier = HISTORY_MINUTE;
+		span_ms = HISTORY_MINUTE_MS;
+		start_ms = minute_start_ms;
+	}
+	else
+	{
+		tier = HISTORY_HOUR;
+		span_ms = HISTORY_HOUR_MS;
+		start_ms = hour_start_ms;
+	}
+	ring = &rings[tier];
+	start_ms -= ring->length * span_ms;		//start of the oldest closed bucket
+
+	for (int i = 0; i <= ring->length && written < max_records; i++, start_ms += span_ms)
+	{
+		const History_Bucket* buckets;
+		uint16_t count;
+
+		if ((int32_t)(start_ms + span_ms - from_ms) <= 0 || (int32_t)(start_ms - to_ms) > 0)
+			continue;
+		if (i < ring->length)
+		{
+			uint8_t position = (ring->first + i) % ring->capacity;
+			buckets = ring->buckets[position];
+			count = ring->counts[position];
+		}
+		else
+			buckets = history_open(tier, &count);
+		if (count == 0)
+			continue;
+
+		bucket_record(&records[written++], tier, start_ms, buckets, count);
+	}
+	return written;
+}
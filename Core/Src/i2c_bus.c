@@ -0,0 +1,469 @@
+/**
+ * @file i2c_bus.c
+ * @author Auska Wang
+ * @brief Transaction scheduler and fault handling for hi2c1.
+ *
+ *        Drivers queue I2C_Transaction structs they own. Transactions run back to back
+ *        from the completion interrupts, through DMA or interrupts, highest priority
+ *        first. A device can ask for a hold time after a transfer (e.g. an LCD clear);
+ *        only that device's later transactions wait, other devices keep the bus.
+ *
+ *        A failed transfer is classified and counted and the bus is taken offline.
+ *        i2c_bus_poll(), called from the main loop, then drops what is queued, frees
+ *        the bus by clocking SCL until the slave releases SDA, issues a STOP,
+ *        reinitializes hi2c1 and tells the caller to replay the display.
+ */
+
+/* Includes */
+#include "i2c_bus.h"
+#include "general.h"
+
+/* Defines */
+#define I2C_BUS_TIMEOUT_MS(size) (2U + (size) / 5U)	//~90 us per byte at 100 kHz, with 2x margin
+#define I2C_BUS_RETRY_MS 100				//minimum time between recoveries while the bus keeps failing
+#define I2C_DMA_THRESHOLD 16				//shorter transfers use interrupts, DMA setup is not worth it
+#define I2C_BUS_ERROR_DROPPED 0x80000000U	//error given to transactions still queued when the bus failed
+#define I2C_RECOVERY_CLOCKS 9				//a slave holding SDA releases it within 9 clocks
+#define I2C_RECOVERY_HALF_PERIOD_US 5		//100 kHz
+#define I2C_SCL_Port GPIOB
+#define I2C_SCL_Pin GPIO_PIN_6
+#define I2C_SDA_Port GPIOA
+#define I2C_SDA_Pin GPIO_PIN_10
+
+/* Variables */
+extern I2C_HandleTypeDef hi2c1;
+
+I2C_Bus_Stats i2c_bus_stats;
+I2C_Device_Stats i2c_device_stats[I2C_BUS_MAX_DEVICES];
+
+static I2C_Transaction* queue_head[I2C_PRIORITIES];
+static I2C_Transaction* queue_tail[I2C_PRIORITIES];
+static I2C_Transaction* volatile active = NULL;		//transaction on the bus
+static uint32_t active_started_ms;
+static uint32_t device_busy_since[I2C_BUS_MAX_DEVICES];	//cycle count the hold started at
+static uint32_t device_hold_cycles[I2C_BUS_MAX_DEVICES];	//compared as elapsed cycles, the count wraps every 89 s
+static uint8_t device_count = 0;
+static volatile uint8_t bus_offline = 0;	//fault seen, nothing starts until recovered
+static uint32_t last_attempt_ms = 0U - I2C_BUS_RETRY_MS;	//start of the last recovery, the first may run at once
+
+static void start_next(void);
+
+/**
+ * @brief Registers a device on the bus for statistics and hold times.
+ *
+ * @param name Label shown in the statistics
+ * @return Device id to put in I2C_Transaction.device
+ */
+uint8_t i2c_bus_register(const char* name)
+{
+	if (device_count >= I2C_BUS_MAX_DEVICES)
+		Error_Handler();	//configuration error, raise I2C_BUS_MAX_DEVICES
+
+	i2c_device_stats[device_count].name = name;
+	return device_count++;
+}
+
+/**
+ * @brief Counts a fault by kind and takes the bus offline until it is recovered.
+ *        Safe to call from the I2C/DMA interrupt callbacks.
+ *
+ * @param error HAL_I2C_ERROR_* bits of the failed transfer
+ * @return None
+ */
+void i2c_bus_report_error(uint32_t error)
+{
+	if (error & HAL_I2C_ERROR_AF)
+		i2c_bus_stats.nacks++;
+	else if (error & HAL_I2C_ERROR_ARLO)
+		i2c_bus_stats.arbitration_losses++;
+	else if (error & HAL_I2C_ERROR_BERR)
+		i2c_bus_stats.bus_errors++;
+	else if (error & HAL_I2C_ERROR_TIMEOUT)
+		i2c_bus_stats.timeouts++;
+	else
+		i2c_bus_stats.other_errors++;
+
+	bus_offline = 1;
+}
+
+/**
+ * @brief Tells whether transactions are currently accepted.
+ *
+ * @return 1 if the bus is usable, 0 while a fault awaits recovery
+ */
+uint8_t i2c_bus_online(void)
+{
+	return !bus_offline;
+}
+
+/**
+ * @brief Tells whether the bus has nothing to do, so a stall of the CPU (a flash erase)
+ *        cannot stretch a transfer into a timeout.
+ *
+ * @return 1 if no transaction is queued or on the bus, 0 otherwise
+ */
+uint8_t i2c_bus_idle(void)
+{
+	return i2c_bus_stats.queue_depth == 0;
+}
+
+/**
+ * @brief Finishes a transaction: statistics, device hold time, then the driver's callback.
+ *        Called with interrupts masked or from interrupt context.
+ *
+ * @param t Finished transaction, error HAL_I2C_ERROR_NONE on success
+ * @return None
+ */
+static void complete(I2C_Transaction* t, uint32_t error)
+{
+	I2C_Device_Stats* stats = &i2c_device_stats[t->device];
+	uint32_t now = get_cycle_count();
+	uint32_t latency_us = CYCLES_TO_US(now - t->queued_at_cycle);
+
+	if (error == HAL_I2C_ERROR_NONE)
+	{
+		stats->transactions++;
+		stats->bytes += t->size;
+		stats->total_latency_us += latency_us;
+		if (latency_us > stats->max_latency_us)
+			stats->max_latency_us = latency_us;
+	}
+	else
+		stats->errors++;
+
+	stats->queued--;
+	i2c_bus_stats.queue_depth--;
+	device_busy_since[t->device] = now;
+	device_hold_cycles[t->device] = t->hold_us * (SystemCoreClock / 1000000U);
+
+	t->pending = 0;
+	if (t->done)
+		t->done(t, error);
+}
+
+/**
+ * @brief Starts a transaction on the peripheral, through DMA for longer transfers.
+ *        Reads use interrupts when DMA channel 2 serves the console instead.
+ *
+ * @param t Transaction to start
+ * @return Result of the HAL call
+ */
+static HAL_StatusTypeDef start_transfer(I2C_Transaction* t)
+{
+	uint8_t use_dma = t->size >= I2C_DMA_THRESHOLD;
+	uint8_t use_rx_dma = use_dma && hi2c1.hdmarx != NULL;	//no receive channel when the console has it
+
+	switch (t->op)
+	{
+	case I2C_OP_WRITE:
+		return use_dma ? HAL_I2C_Master_Transmit_DMA(&hi2c1, t->address, t->data, t->size)
+				: HAL_I2C_Master_Transmit_IT(&hi2c1, t->address, t->data, t->size);
+	case I2C_OP_READ:
+		return use_rx_dma ? HAL_I2C_Master_Receive_DMA(&hi2c1, t->address, t->data, t->size)
+				: HAL_I2C_Master_Receive_IT(&hi2c1, t->address, t->data, t->size);
+	case I2C_OP_MEM_WRITE:
+		return use_dma ? HAL_I2C_Mem_Write_DMA(&hi2c1, t->address, t->mem_address, I2C_MEMADD_SIZE_8BIT, t->data, t->size)
+				: HAL_I2C_Mem_Write_IT(&hi2c1, t->address, t->mem_address, I2C_MEMADD_SIZE_8BIT, t->data, t->size);
+	default:
+		return use_rx_dma ? HAL_I2C_Mem_Read_DMA(&hi2c1, t->address, t->mem_address, I2C_MEMADD_SIZE_8BIT, t->data, t->size)
+				: HAL_I2C_Mem_Read_IT(&hi2c1, t->address, t->mem_address, I2C_MEMADD_SIZE_8BIT, t->data, t->size);
+	}
+}
+
+/**
+ * @brief Starts the first queued transaction, highest priority first, whose device is past
+ *        its hold time. Called with interrupts masked or from interrupt context.
+ *
+ * @return None
+ */
+static void start_next(void)
+{
+	uint32_t now;
+	uint8_t held = 0;	//devices in their hold time, bit per device id
+
+	if (active != NULL || bus_offline)
+		return;
+
+	now = get_cycle_count();
+	for (int p = 0; p < I2C_PRIORITIES; p++)
+	{
+		I2C_Transaction* previous = NULL;
+
+		for (I2C_Transaction* t = queue_head[p]; t != NULL; previous = t, t = t->next)
+		{
+			if ((held & (1U << t->device)) || now - device_busy_since[t->device] < device_hold_cycles[t->device])
+			{
+				held |= 1U << t->device;	//its later transactions keep their order behind this one
+				continue;
+			}
+
+			if (previous == NULL)
+				queue_head[p] = t->next;
+			else
+				previous->next = t->next;
+			if (queue_tail[p] == t)
+				queue_tail[p] = previous;
+
+			active = t;
+			active_started_ms = HAL_GetTick();
+			i2c_bus_stats.transfers++;
+			if (start_transfer(t) != HAL_OK)
+			{
+				uint32_t error = hi2c1.ErrorCode ? hi2c1.ErrorCode : HAL_I2C_ERROR_TIMEOUT;
+
+				active = NULL;
+				i2c_bus_report_error(error);
+				complete(t, error);
+			}
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Queues a transaction. Never waits for the bus; the driver's callback runs
+ *        once the transaction is done.
+ *
+ * @param t Transaction, with device, address, op, priority, data and size filled in
+ * @return HAL_OK if queued, HAL_BUSY if t is still pending, HAL_ERROR while the bus awaits recovery
+ */
+HAL_StatusTypeDef i2c_bus_submit(I2C_Transaction* t)
+{
+	uint32_t primask;
+	I2C_Device_Stats* stats = &i2c_device_stats[t->device];
+
+	if (bus_offline)
+		return HAL_ERROR;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (t->pending)
+	{
+		__set_PRIMASK(primask);
+		return HAL_BUSY;
+	}
+
+	t->pending = 1;
+	t->next = NULL;
+	t->queued_at_cycle = get_cycle_count();
+	if (queue_tail[t->priority] == NULL)
+		queue_head[t->priority] = t;
+	else
+		queue_tail[t->priority]->next = t;
+	queue_tail[t->priority] = t;
+
+	if (++stats->queued > stats->max_queued)
+		stats->max_queued = stats->queued;
+	if (++i2c_bus_stats.queue_depth > i2c_bus_stats.max_queue_depth)
+		i2c_bus_stats.max_queue_depth = i2c_bus_stats.queue_depth;
+
+	start_next();
+
+	__set_PRIMASK(primask);
+	return HAL_OK;
+}
+
+/**
+ * @brief Holds a device's next transactions back for a time from now, for a device that
+ *        still works on a transfer that already completed.
+ *
+ * @param device Device id, us Hold time
+ * @return None
+ */
+void i2c_bus_hold(uint8_t device, uint16_t us)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	device_busy_since[device] = get_cycle_count();
+	device_hold_cycles[device] = us * (SystemCoreClock / 1000000U);
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Ends the active transaction and starts the next one. Called from the HAL callbacks.
+ *
+ * @param error HAL_I2C_ERROR_NONE on success
+ * @return None
+ */
+static void transfer_done(uint32_t error)
+{
+	I2C_Transaction* t = active;
+
+	if (t == NULL)
+		return;
+
+	active = NULL;
+	if (error != HAL_I2C_ERROR_NONE)
+		i2c_bus_report_error(error);
+	complete(t, error);
+	start_next();
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	transfer_done(HAL_I2C_ERROR_NONE);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	transfer_done(HAL_I2C_ERROR_NONE);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	transfer_done(HAL_I2C_ERROR_NONE);
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	transfer_done(HAL_I2C_ERROR_NONE);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	transfer_done(HAL_I2C_GetError(hi2c) ? HAL_I2C_GetError(hi2c) : HAL_I2C_ERROR_TIMEOUT);
+}
+
+void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	transfer_done(HAL_I2C_ERROR_TIMEOUT);
+}
+
+/**
+ * @brief Fails the active and every queued transaction, before the peripheral is reset.
+ *
+ * @return None
+ */
+static void drop_all(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (active != NULL)
+	{
+		I2C_Transaction* t = active;
+		active = NULL;
+		complete(t, HAL_I2C_ERROR_TIMEOUT);
+	}
+
+	for (int p = 0; p < I2C_PRIORITIES; p++)
+	{
+		while (queue_head[p] != NULL)
+		{
+			I2C_Transaction* t = queue_head[p];
+			queue_head[p] = t->next;
+			complete(t, I2C_BUS_ERROR_DROPPED);
+		}
+		queue_tail[p] = NULL;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Frees the bus by hand: up to 9 SCL clocks until SDA is released, then a STOP.
+ *        hi2c1 must be deinitialized so the pins are plain GPIO.
+ *
+ * @return None
+ */
+static void clock_bus_free(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	HAL_GPIO_WritePin(I2C_SCL_Port, I2C_SCL_Pin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(I2C_SDA_Port, I2C_SDA_Pin, GPIO_PIN_SET);
+
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	GPIO_InitStruct.Pin = I2C_SCL_Pin;
+	HAL_GPIO_Init(I2C_SCL_Port, &GPIO_InitStruct);
+	GPIO_InitStruct.Pin = I2C_SDA_Pin;
+	HAL_GPIO_Init(I2C_SDA_Port, &GPIO_InitStruct);
+
+	for (int i = 0; i < I2C_RECOVERY_CLOCKS && !HAL_GPIO_ReadPin(I2C_SDA_Port, I2C_SDA_Pin); i++)
+	{
+		HAL_GPIO_WritePin(I2C_SCL_Port, I2C_SCL_Pin, GPIO_PIN_RESET);
+		micro_delay(I2C_RECOVERY_HALF_PERIOD_US);
+		HAL_GPIO_WritePin(I2C_SCL_Port, I2C_SCL_Pin, GPIO_PIN_SET);
+		micro_delay(I2C_RECOVERY_HALF_PERIOD_US);
+	}
+
+	//STOP: SDA rises while SCL is high
+	HAL_GPIO_WritePin(I2C_SCL_Port, I2C_SCL_Pin, GPIO_PIN_RESET);
+	micro_delay(I2C_RECOVERY_HALF_PERIOD_US);
+	HAL_GPIO_WritePin(I2C_SDA_Port, I2C_SDA_Pin, GPIO_PIN_RESET);
+	micro_delay(I2C_RECOVERY_HALF_PERIOD_US);
+	HAL_GPIO_WritePin(I2C_SCL_Port, I2C_SCL_Pin, GPIO_PIN_SET);
+	micro_delay(I2C_RECOVERY_HALF_PERIOD_US);
+	HAL_GPIO_WritePin(I2C_SDA_Port, I2C_SDA_Pin, GPIO_PIN_SET);
+	micro_delay(I2C_RECOVERY_HALF_PERIOD_US);
+}
+
+/**
+ * @brief Starts queued transactions whose device hold time has passed and turns a
+ *        transfer that ran past its timeout into a fault. Drivers waiting on their own
+ *        transactions call this while they spin.
+ *
+ * @return None
+ */
+void i2c_bus_run(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (active != NULL && HAL_GetTick() - active_started_ms > I2C_BUS_TIMEOUT_MS(active->size))
+		i2c_bus_report_error(HAL_I2C_ERROR_TIMEOUT);	//SCL held low, no callback will come
+	start_next();
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Bus housekeeping, called from the main loop: i2c_bus_run(), then recovery after a fault.
+ *
+ * @param None
+ * @return 1 if the bus was just recovered and devices must be brought back to their
+ *         previous state (call i2c_bus_resumed() when done), 0 otherwise
+ */
+uint8_t i2c_bus_poll(void)
+{
+	uint32_t start;
+
+	i2c_bus_run();
+
+	if (!bus_offline || (uint32_t)(HAL_GetTick() - last_attempt_ms) < I2C_BUS_RETRY_MS)	//elapsed time, safe across the tick wrap
+		return 0;
+
+	start = get_cycle_count();
+	last_attempt_ms = HAL_GetTick();
+
+	drop_all();
+	HAL_I2C_DeInit(&hi2c1);
+	clock_bus_free();
+	MX_I2C1_Init();
+
+	i2c_bus_stats.recoveries++;
+	i2c_bus_stats.last_recovery_us = CYCLES_TO_US(get_cycle_count() - start);
+	if (i2c_bus_stats.last_recovery_us > i2c_bus_stats.max_recovery_us)
+		i2c_bus_stats.max_recovery_us = i2c_bus_stats.last_recovery_us;
+
+	bus_offline = 0;
+	return 1;
+}
+
+/**
+ * @brief Records the total time from recovery start until the devices were replayed.
+ *
+ * @param start_cycle get_cycle_count() taken before i2c_bus_poll()
+ * @return None
+ */
+void i2c_bus_resumed(uint32_t start_cycle)
+{
+	i2c_bus_stats.last_resume_us = CYCLES_TO_US(get_cycle_count() - start_cycle);
+	if (i2c_bus_stats.last_resume_us > i2c_bus_stats.max_resume_us)
+		i2c_bus_stats.max_resume_us = i2c_bus_stats.last_resume_us;
+}
@@ -8,52 +8,154 @@
 #include "i2clcd.h"
 #include "main.h"
 #include "general.h"
+#include "config.h"
+#include "lcd_transport.h"
+#include "display.h"
+#include "i2c_bus.h"
 #include <stdio.h>
 #include <string.h>
 
 /* Defines */
-#define PCF8574_ADDR 0x27 << 1
-#define UPPER_BITS_MASK 0xF0
-#define INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_ON 0x0C
-#define INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_ON 0x08
-#define DATA_REGISTER_ENABLE_ON_LIGHT_ON 0x0D
-#define DATA_REGISTER_ENABLE_OFF_LIGHT_ON 0x09
-#define INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_OFF 0x04
-#define INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_OFF 0x01
-#define DATA_REGISTER_ENABLE_ON_LIGHT_OFF 0x05
-#define DATA_REGISTER_ENABLE_OFF_LIGHT_OFF 0x01
-#define BIT_MODE_4 4
-
-extern I2C_HandleTypeDef hi2c1;
+#define LCD_POWER_ON_MS 40	//HD44780 needs > 40 ms after VCC reaches 2.7 V
+#define LCD_CLEAR_TIME_US 1600	//clear display executes in 1.52 ms
+
+/**
+ * @brief What an init step sends.
+ */
+typedef enum {
+	LCD_INIT_WAKEUP 		= 0,	//8-bit mode nibble write of value
+	LCD_INIT_INTERFACE 		= 1,	//transport's interface_cmd as wakeup write
+	LCD_INIT_FUNCTION_SET 	= 2,	//transport's function_set as instruction
+	LCD_INIT_COMMAND 		= 3		//value as instruction
+} LCD_Init_Kind;
+
+/**
+ * @brief Step of the HD44780 init sequence and the time it needs before the next one.
+ */
+typedef struct {
+	uint8_t kind;
+	uint8_t value;
+	uint16_t wait_us;
+} LCD_Init_Step;
+
+/* Variables */
 extern uint8_t light_mode;
 
+static const LCD_Init_Step init_sequence[] = {
+	{LCD_INIT_WAKEUP, 0x30, 4100},
+	{LCD_INIT_WAKEUP, 0x30, 100},
+	{LCD_INIT_WAKEUP, 0x30, 100},
+	{LCD_INIT_INTERFACE, 0, 100},
+	{LCD_INIT_FUNCTION_SET, 0, 40},
+	{LCD_INIT_COMMAND, 0x08, 40},		//display off
+	{LCD_INIT_COMMAND, 0x01, 1600},		//clear
+	{LCD_INIT_COMMAND, 0x06, 40},		//entry mode, increment
+	{LCD_INIT_COMMAND, 0x0C, 40}		//display on, cursor off
+};
+static uint8_t init_index = 0;
+static uint8_t init_transport_ready = 0;
+static uint32_t init_ready_at_cycle;
+static uint16_t init_wait_us = 0;		//wait of the last step, counted once the transport delivered it
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_GPIO
+static const LCD_Transport* transport = &lcd_transport_gpio;
+#else
+static const LCD_Transport* transport = &lcd_transport_i2c;
+#endif
+
+#if LCD_TRANSPORT_BENCHMARK
+LCD_Benchmark_Result lcd_benchmark_result;
+#endif
+
+/**
+ * @brief Selects the transport used by every following LCD access.
+ *
+ * @param t Backend to use, e.g. &lcd_transport_i2c or &lcd_transport_gpio
+ * @return None
+ */
+void lcd_set_transport(const LCD_Transport* t)
+{
+	transport = t;
+}
+
 /**
- * @brief Initializes LCD display in 4-bit mode according to HD44780 datasheet.
+ * @brief Starts the LCD init sequence over, lcd_init_step() then runs it.
+ *
+ * @return None
+ */
+void lcd_init_restart()
+{
+	init_index = 0;
+	init_transport_ready = 0;
+}
+
+/**
+ * @brief Runs the next step of the HD44780 init sequence if its wait has elapsed.
+ *
+ * Never blocks: the power-on wait and the execution time of each step are deadlines,
+ * so the caller can bring up other hardware while the LCD initializes. A step's wait
+ * starts once the transport has delivered it, queued I2C writes may still be in flight. The power-on
+ * wait counts from reset (HAL tick 0), overlapping with everything done since then.
+ *
+ * @return 1 once the LCD is initialized and ready for data, 0 while still in progress
+ */
+uint8_t lcd_init_step()
+{
+	const LCD_Init_Step* step;
+
+	if (!init_transport_ready)
+	{
+		transport->init();
+		init_transport_ready = 1;
+		init_ready_at_cycle = get_cycle_count();
+		init_wait_us = 0;
+	}
+
+	if (transport->busy())
+		return 0;
+	if (init_wait_us)
+	{
+		init_ready_at_cycle = get_cycle_count() + init_wait_us * (SystemCoreClock / 1000000U);
+		init_wait_us = 0;
+	}
+
+	if (HAL_GetTick() < LCD_POWER_ON_MS || (int32_t)(get_cycle_count() - init_ready_at_cycle) < 0)
+		return 0;
+	if (init_index >= sizeof(init_sequence) / sizeof(init_sequence[0]))
+		return 1;
+
+	step = &init_sequence[init_index++];
+	switch (step->kind)
+	{
+	case LCD_INIT_WAKEUP:
+		transport->write_wakeup(step->value);
+		break;
+	case LCD_INIT_INTERFACE:
+		transport->write_wakeup(transport->interface_cmd);
+		break;
+	case LCD_INIT_FUNCTION_SET:
+		send_cmd(transport->function_set, light_mode);
+		break;
+	default:
+		send_cmd(step->value, light_mode);
+		break;
+	}
+	init_wait_us = step->wait_us;
+
+	return 0;
+}
+
+/**
+ * @brief Initializes LCD display according to HD44780 datasheet, blocking until done.
+ *        The bus width (4 or 8-bit) is chosen by the selected transport.
  *
  * @return None
  */
 void lcd_init()
 {
-	HAL_Delay(30);
-	send_cmd(0x30, light_mode);
-	HAL_Delay(5);
-	send_cmd(0x30, light_mode);
-	HAL_Delay(1);
-	send_cmd(0x30, light_mode);
-	HAL_Delay(1);
-	send_cmd(0x20, light_mode);
-	HAL_Delay(1);
-
-	send_cmd(0x28, light_mode);
-	HAL_Delay(1);
-	send_cmd(0x08, light_mode);
-	HAL_Delay(1);
-	send_cmd(0x01, light_mode);
-	HAL_Delay(1);
-	send_cmd(0x06, light_mode);
-	HAL_Delay(1);
-	send_cmd(0x0C, light_mode);
-	HAL_Delay(1);
+	lcd_init_restart();
+	while (!lcd_init_step())
+	{}
 }
 
 /**
@@ -64,7 +166,7 @@ void lcd_init()
 void clear_display()
 {
 	send_cmd(0x01, light_mode);
-	micro_delay(2000);
+	transport->hold(LCD_CLEAR_TIME_US);
 }
 
 /**
@@ -75,7 +177,6 @@ void clear_display()
 void carriage_return()
 {
 	send_cmd(0xC0, light_mode);
-	micro_delay(1000);
 }
 
 /**
@@ -86,7 +187,6 @@ void carriage_return()
 void display_off()
 {
 	send_cmd(0x08, light_mode);
-	micro_delay(40);
 }
 
 /**
@@ -97,7 +197,6 @@ void display_off()
 void display_on()
 {
 	send_cmd(0x0C, light_mode);
-	micro_delay(40);
 }
 
 /**
@@ -108,40 +207,18 @@ void display_on()
  */
 void send_cmd (char cmd, uint8_t light_mode)
 {
-	uint8_t t[BIT_MODE_4];
-	char u, l;
-
-	u = cmd & UPPER_BITS_MASK;
-	l = (cmd << 4) & UPPER_BITS_MASK;
-	t[0] = u | (light_mode ? INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_ON : INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_OFF); //rs = 0, e = 1
-	t[1] = u | (light_mode ? INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_ON : INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_OFF); // rs = 0, e = 0
-	t[2] = l | (light_mode ? INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_ON : INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_OFF); //rs = 0, e = 1
-	t[3] = l | (light_mode ? INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_ON : INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_OFF); // rs = 0, e = 0
-
-	if (HAL_I2C_Master_Transmit(&hi2c1, PCF8574_ADDR, t, sizeof(t), HAL_MAX_DELAY) != HAL_OK)
-		Error_Handler();
+	transport->write(cmd, LCD_REGISTER_INSTRUCTION, light_mode);
 }
 
 /**
  * @brief Sends data to data register of LCD.
  *
- * @param cmd Instruction byte to be sent, light_mode Backlight on or off
+ * @param data Character to be sent, light_mode Backlight on or off
  * @return None
  */
 void send_data (char data, uint8_t light_mode)
 {
-	uint8_t t[BIT_MODE_4];
-	char u, l;
-
-	u = data & UPPER_BITS_MASK;
-	l = (data << 4) & UPPER_BITS_MASK;
-	t[0] = u | (light_mode ? DATA_REGISTER_ENABLE_ON_LIGHT_ON : DATA_REGISTER_ENABLE_ON_LIGHT_OFF); //rs = 1, e = 1
-	t[1] = u | (light_mode ? DATA_REGISTER_ENABLE_OFF_LIGHT_ON : DATA_REGISTER_ENABLE_OFF_LIGHT_OFF); // rs = 1, e = 0
-	t[2] = l | (light_mode ? DATA_REGISTER_ENABLE_ON_LIGHT_ON : DATA_REGISTER_ENABLE_ON_LIGHT_OFF); //rs = 1, e = 1
-	t[3] = l | (light_mode ? DATA_REGISTER_ENABLE_OFF_LIGHT_ON : DATA_REGISTER_ENABLE_OFF_LIGHT_OFF); // rs = 1, e = 0
-
-	if (HAL_I2C_Master_Transmit(&hi2c1, PCF8574_ADDR, t, sizeof(t), HAL_MAX_DELAY) != HAL_OK)
-		Error_Handler();
+	transport->write(data, LCD_REGISTER_DATA, light_mode);
 }
 
 /**
@@ -152,9 +229,98 @@ void send_data (char data, uint8_t light_mode)
  */
 void printString(char str[], uint8_t light_mode)
 {
-	for (int i = 0; i < strlen(str); i++)
+	size_t length = strlen(str);
+
+	for (size_t i = 0; i < length; i++)
 	{
 		send_data(str[i], light_mode);
 	}
 }
 
+/* Display backend -----------------------------------------------------------*/
+static void lcd_write_line(uint8_t row, const char* text)
+{
+	uint8_t end_of_string = 0;
+
+	send_cmd(row ? 0xC0 : 0x80, light_mode);	//DDRAM address of the row start
+	for (int i = 0; i < DISPLAY_COLUMNS; i++)
+	{
+		if (text[i] == '\0')
+			end_of_string = 1;
+		send_data(end_of_string ? ' ' : text[i], light_mode);
+	}
+}
+
+static void lcd_flush(void)
+{
+	//characters are written through immediately
+}
+
+static void lcd_set_light(uint8_t light_mode)
+{
+	//backlight bit travels with every write, applied on the next refresh
+}
+
+static void lcd_write_glyph_rows(uint8_t glyph, uint8_t first_row, const uint8_t* rows, uint8_t count)
+{
+	send_cmd(0x40 | (glyph << 3) | first_row, light_mode);	//CGRAM address, auto increments per row
+	for (int i = 0; i < count; i++)
+		send_data(rows[i], light_mode);
+}
+
+const Display_Driver display_lcd = {
+	.init_start = lcd_init_restart,
+	.init_step = lcd_init_step,
+	.clear = clear_display,
+	.write_line = lcd_write_line,
+	.flush = lcd_flush,
+	.set_light = lcd_set_light,
+	.write_glyph_rows = lcd_write_glyph_rows
+};
+
+#if LCD_TRANSPORT_BENCHMARK
+/**
+ * @brief Rewrites both lines of the LCD with the current transport.
+ *
+ * @return Time taken in microseconds
+ */
+static uint32_t time_full_refresh(void)
+{
+	uint32_t start = get_cycle_count();
+
+	send_cmd(0x80, light_mode);
+	for (int i = 0; i < 16; i++)
+		send_data('A' + i, light_mode);
+	send_cmd(0xC0, light_mode);
+	for (int i = 0; i < 16; i++)
+		send_data('a' + i, light_mode);
+	while (transport->busy())	//queued I2C writes count until they reached the LCD
+		i2c_bus_run();
+
+	return CYCLES_TO_US(get_cycle_count() - start);
+}
+
+/**
+ * @brief Times a full two line refresh (2 address commands + 32 characters) on each transport.
+ *
+ * Results are stored in lcd_benchmark_result. The GPIO transport is initialized
+ * for the run even if no display is wired to it; the previous transport is restored afterwards.
+ *
+ * @return None
+ */
+void lcd_benchmark_transports(void)
+{
+	const LCD_Transport* saved = transport;
+
+	lcd_set_transport(&lcd_transport_i2c);
+	transport->init();
+	lcd_benchmark_result.i2c_refresh_us = time_full_refresh();
+
+	lcd_set_transport(&lcd_transport_gpio);
+	transport->init();
+	lcd_benchmark_result.gpio_refresh_us = time_full_refresh();
+
+	lcd_set_transport(saved);
+	clear_display();
+}
+#endif
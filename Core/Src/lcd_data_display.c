@@ -1,19 +1,53 @@
 /**
  * @file lcd_data_display.c
  * @author Auska Wang
- * @brief Contains function that prints data to LCD.
+ * @brief Contains functions that sample the sensor and print data to the display.
+ *
+ *        Interrupts only raise flags; sampling and drawing run from display_task()
+ *        in the main loop, so a slow I2C display never runs inside an ISR.
  */
 
 #include <string.h>
-#include <stdio.h>
 #include "lcd_data_display.h"
 #include "general.h"
 #include "i2clcd.h"
 #include "dht22.h"
+#include "config.h"
+#include "display.h"
+#include "trend_graph.h"
+#include "i2c_bus.h"
+#include "fixed_format.h"
+#include "rolling_stats.h"
+#include "packed_history.h"
+#include "flash_log.h"
+#include "settings.h"
+#include "calibration.h"
+#include "comfort.h"
+#include "filter.h"
+#include "alarm.h"
+#include "forecast.h"
+#include "scheduler.h"
+#include "telemetry.h"
 
 /* Defines */
-#define LCD_DISPLAY_LENGTH 16
-#define HUMIDITY_MEASUREMENT_OFFSET -7.0
+#if TREND_GRAPH
+#define TEXT_COLUMNS (DISPLAY_COLUMNS - TREND_GLYPHS_PER_CHANNEL)	//graph takes the right end of each row
+#define TEMPERATURE_LABEL "Temp:"
+#define HUMIDITY_LABEL "Hum: "
+#else
+#define TEXT_COLUMNS DISPLAY_COLUMNS
+#define TEMPERATURE_LABEL "Temp: "
+#define HUMIDITY_LABEL "Humidity: "
+#endif
+#define BUTTON_DEBOUNCE_MS 50	//a press counts if the pin is still high this long after its last edge
+
+typedef enum
+{
+	BUTTON_VIEW,
+	BUTTON_LIGHT,
+	BUTTON_UNITS,
+	BUTTONS
+} BUTTON;
 
 
 /* Variables */
@@ -22,82 +56,770 @@ extern TIM_HandleTypeDef htim14;
 TEMP_UNITS temp_units = FAHRENHEIT;
 DISPLAY_MODE display_mode = ON;
 uint8_t light_mode = 1; //off = 0, on = 1
+DISPLAY_VIEW display_view = VIEW_READINGS;
+
+static volatile uint8_t sample_due = 0;		//set by TIM14, sensor read pending
+static volatile uint8_t render_due = 0;		//set by buttons, redraw of the last reading pending
+static volatile uint8_t button_pending[BUTTONS];	//set by the EXTI edge, cleared once debounced
+static volatile uint32_t button_edge_ms[BUTTONS];	//time of the last edge
+static GPIO_TypeDef* const button_ports[BUTTONS] = {VIEW_Button_Port, LIGHT_Button_Port, UNITS_Button_Port};
+static const uint16_t button_pins[BUTTONS] = {VIEW_Button_Pin, LIGHT_Button_Pin, UNITS_Button_Pin};
+static uint8_t applied_light_mode = 1;
+static int16_t last_values[STATS_CHANNELS];	//calibrated, tenths
+static uint8_t have_reading = 0;
+static uint8_t sensor_fault = 0;			//boot gave up on the sensor, shown until a read succeeds
+static uint32_t reading_ms;					//time of last_values
+static uint8_t stats_page = 0;		//statistics views alternate between range and deviation
+static const char* const window_labels[STATS_WINDOWS] = {"1m", "1h", "24h"};
+
+#if SCHEDULER
+static char shown[DISPLAY_ROWS][DISPLAY_COLUMNS + 1];	//lines on the display, not sent again unchanged
+static uint8_t shown_valid = 0;							//bit per row, shown[row] matches the display
+#endif
+
+#if DISPLAY_BACKEND == DISPLAY_OLED
+static const Display_Driver* display = &display_oled;
+#else
+static const Display_Driver* display = &display_lcd;
+#endif
 
 /**
- * @brief Prints temperature and humidity data to LCD.
+ * @brief Restores the operator's settings from flash. Called at boot before the display is initialized.
+ *
+ * @param None
+ * @return none
+ */
+void display_load_settings()
+{
+	settings_init();
+	temp_units = (TEMP_UNITS)settings_get(SETTING_TEMP_UNITS);
+	light_mode = applied_light_mode = (uint8_t)settings_get(SETTING_LIGHT_MODE);
+	calibration_init();
+#if ALARM
+	alarm_init();
+#endif
+}
+
+/**
+ * @brief Sends a line to the display, unless it shows that line already.
+ *
+ * @param row Row, text Line, at most DISPLAY_COLUMNS chars
+ * @return None
+ */
+static void show_line(uint8_t row, const char* text)
+{
+#if SCHEDULER
+	if ((shown_valid & (1 << row)) && strncmp(shown[row], text, DISPLAY_COLUMNS) == 0)
+	{
+		scheduler_stats.lines_skipped++;
+		return;
+	}
+	strncpy(shown[row], text, DISPLAY_COLUMNS);
+	shown_valid |= 1 << row;
+	scheduler_stats.lines_written++;
+#endif
+	display->write_line(row, text);
+}
+
+/**
+ * @brief Forgets what the display shows, every line is sent on the next refresh.
+ *
+ * @param None
+ * @return None
+ */
+static void forget_shown_lines(void)
+{
+#if SCHEDULER
+	shown_valid = 0;
+#endif
+}
+
+/**
+ * @brief Initializes the display selected in config.h, blocking until it is ready.
+ *
+ * @param None
+ * @return none
+ */
+void display_init()
+{
+	forget_shown_lines();
+	display->init_start();
+	while (!display->init_step())
+	{}
+}
+
+/**
+ * @brief Starts the display init, display_init_step() then runs it without blocking.
+ *
+ * @param None
+ * @return none
+ */
+void display_init_start()
+{
+	forget_shown_lines();
+	display->init_start();
+}
+
+/**
+ * @brief Runs the next step of the display init without blocking.
+ *
+ * @param None
+ * @return 1 once the display is ready, 0 while still in progress
+ */
+uint8_t display_init_step()
+{
+	return display->init_step();
+}
+
+#if TREND_GRAPH
+/**
+ * @brief Pads a display line to TEXT_COLUMNS and appends the glyphs of a trend graph.
+ *
+ * @param buffer Line of DISPLAY_COLUMNS + 1 chars, channel Graph to append
+ * @return none
+ */
+static void append_trend(char* buffer, TREND_CHANNEL channel)
+{
+	size_t length = strlen(buffer);
+
+	memset(buffer + length, ' ', TEXT_COLUMNS - length);
+	for (int i = 0; i < TREND_GLYPHS_PER_CHANNEL; i++)
+		buffer[TEXT_COLUMNS + i] = trend_graph_char(channel, i);
+}
+#endif
+
+/**
+ * @brief Shows a placeholder until the first valid reading arrives.
+ *
+ * @param None
+ * @return none
+ */
+void print_placeholder()
+{
+	show_line(0, "Temp: --");
+	show_line(1, sensor_fault ? "Sensor fault" : "Humidity: --");
+	display->flush();
+}
+
+/**
+ * @brief Shows that the sensor did not answer at boot, in place of the placeholder.
+ *        The fault stays on the display until the first valid reading.
+ *
+ * @param None
+ * @return None
+ */
+void display_sensor_fault()
+{
+	sensor_fault = 1;
+	print_placeholder();
+}
+
+#if TELEMETRY
+/**
+ * @brief Sends the telemetry frame of a sensor read with the values now displayed.
+ *
+ * @param data Bytes from the sensor, status TELEMETRY_STATUS_* bits, now_ms Time of the read
+ * @return None
+ */
+static void send_telemetry(const DHT22_Data* data, uint8_t status, uint32_t now_ms)
+{
+#if ALARM
+	if (alarm_near())
+		status |= TELEMETRY_STATUS_ALARM_NEAR;
+#endif
+	telemetry_send_reading(data, status, last_values, now_ms);
+}
+#endif
+
+/**
+ * @brief Reads the sensor and keeps the reading if it is valid, calibrated and filtered.
+ *
+ * @param None
+ * @return DHT22_RESPONSE_SUCCESSFUL if a new valid reading was stored
+ */
+DHT22_Status sample_sensor()
+{
+	DHT22_Data data = {0};
+	int16_t values[STATS_CHANNELS];
+	uint32_t now_ms = HAL_GetTick();
+
+	if (DHT22_getData(&data) != DHT22_RESPONSE_SUCCESSFUL)
+	{
+#if TELEMETRY
+		send_telemetry(&data, TELEMETRY_STATUS_READ_FAILED, now_ms);
+#endif
+		return DHT22_RESPONSE_FAIL;
+	}
+#if ALARM
+	uint32_t ready_cycles = get_cycle_count();
+#endif
+
+	values[STATS_TEMPERATURE] = calibration_apply(HISTORY_TEMPERATURE, getTemperatureTenthsC(data.temp_first_byte, data.temp_second_byte));
+	values[STATS_HUMIDITY] = calibration_apply(HISTORY_HUMIDITY, getHumidityTenths(data.humidity_first_byte, data.humidity_second_byte));
+#if FILTER
+	if (!filter_apply(values, now_ms))
+	{
+#if TELEMETRY
+		send_telemetry(&data, TELEMETRY_STATUS_REJECTED, now_ms);
+#endif
+		return DHT22_RESPONSE_FAIL;		//implausible jump, dropped like a failed read
+	}
+#endif
+#if ALARM || FORECAST
+	int16_t dew_point = comfort_dew_point(values[STATS_TEMPERATURE], values[STATS_HUMIDITY]);
+#endif
+#if ALARM
+	int16_t alarm_values[ALARM_SOURCES];
+
+	alarm_values[ALARM_TEMPERATURE] = values[STATS_TEMPERATURE];
+	alarm_values[ALARM_HUMIDITY] = values[STATS_HUMIDITY];
+	alarm_values[ALARM_DEW_POINT] = dew_point;
+	alarm_evaluate(alarm_values, now_ms, ready_cycles);		//first, before the slower consumers
+#endif
+	memcpy(last_values, values, sizeof(last_values));
+	reading_ms = now_ms;
+	have_reading = 1;
+#if TELEMETRY
+	send_telemetry(&data, 0, now_ms);
+#endif
+	rolling_stats_add(values, now_ms);
+#if PACKED_HISTORY
+	packed_history_add(values, now_ms);
+#endif
+#if FLASH_LOG
+	flash_log_add(values, now_ms);
+#endif
+#if FORECAST
+	int16_t forecast_values[FORECAST_CHANNELS];
+
+	forecast_values[FORECAST_TEMPERATURE] = values[STATS_TEMPERATURE];
+	forecast_values[FORECAST_HUMIDITY] = values[STATS_HUMIDITY];
+	forecast_values[FORECAST_DEW_SPREAD] = values[STATS_TEMPERATURE] - dew_point;
+	forecast_add(forecast_values, now_ms);
+#endif
+#if TREND_GRAPH
+	trend_graph_add(TREND_TEMPERATURE, values[STATS_TEMPERATURE]);
+	trend_graph_add(TREND_HUMIDITY, values[STATS_HUMIDITY]);
+#endif
+	return DHT22_RESPONSE_SUCCESSFUL;
+}
+
+/**
+ * @brief Rounds hundredths to tenths, halves away from zero.
+ *
+ * @param hundredths Value in hundredths
+ * @return Value in tenths
+ */
+static int32_t round_to_tenths(int32_t hundredths)
+{
+	return (hundredths + (hundredths < 0 ? -5 : 5)) / 10;
+}
+
+/**
+ * @brief Formats one channel of a statistics view: "T21.3<22.8<24.5" on the range page,
+ *        "T sd0.42 1h" on the deviation page.
+ *
+ * @param buffer Line of DISPLAY_COLUMNS + 1 chars, label Channel letter, window Window,
+ *        channel Channel, temperatures in the selected unit
+ * @return None
+ */
+static void format_stats_line(char* buffer, char label, STATS_WINDOW window, STATS_CHANNEL channel)
+{
+	Stats_Summary summary;
+
+	buffer[0] = label;
+	buffer[1] = '\0';
+	if (!rolling_stats_get(channel, window, &summary))
+	{
+		format_append_str(buffer, DISPLAY_COLUMNS + 1, " --");
+		return;
+	}
+
+	if (channel == STATS_TEMPERATURE && temp_units == FAHRENHEIT)
+	{
+		summary.min = summary.min * 9 / 5 + 3200;
+		summary.max = summary.max * 9 / 5 + 3200;
+		summary.mean = summary.mean * 9 / 5 + 3200;
+		summary.stddev = summary.stddev * 9 / 5;
+	}
+
+	if (stats_page == 0)
+	{
+		format_append_fixed(buffer, DISPLAY_COLUMNS + 1, round_to_tenths(summary.min), FORMAT_TENTHS);
+		format_append_char(buffer, DISPLAY_COLUMNS + 1, '<');
+		format_append_fixed(buffer, DISPLAY_COLUMNS + 1, round_to_tenths(summary.mean), FORMAT_TENTHS);
+		format_append_char(buffer, DISPLAY_COLUMNS + 1, '<');
+		format_append_fixed(buffer, DISPLAY_COLUMNS + 1, round_to_tenths(summary.max), FORMAT_TENTHS);
+	}
+	else
+	{
+		format_append_str(buffer, DISPLAY_COLUMNS + 1, " sd");
+		format_append_fixed(buffer, DISPLAY_COLUMNS + 1, summary.stddev, FORMAT_HUNDREDTHS);
+		format_append_char(buffer, DISPLAY_COLUMNS + 1, ' ');
+		format_append_str(buffer, DISPLAY_COLUMNS + 1, window_labels[window]);
+	}
+}
+
+/**
+ * @brief Prints min < mean < max of both channels over a window, alternating with
+ *        their standard deviation on every refresh.
+ *
+ * @param window Window to show
+ * @return none
+ */
+static void print_stats(STATS_WINDOW window)
+{
+	char buffer[DISPLAY_COLUMNS + 1];
+
+	format_stats_line(buffer, 'T', window, STATS_TEMPERATURE);
+	show_line(0, buffer);
+	format_stats_line(buffer, 'H', window, STATS_HUMIDITY);
+	show_line(1, buffer);
+	display->flush();
+	stats_page = !stats_page;
+}
+
+/**
+ * @brief Appends a temperature in the selected unit, e.g. "12.3°C".
+ *
+ * @param buffer Line of DISPLAY_COLUMNS + 1 chars, tenths_c Temperature in tenths of a degree C
+ * @return None
+ */
+static void append_temperature(char* buffer, int16_t tenths_c)
+{
+	int32_t tenths = (temp_units == FAHRENHEIT) ? round_to_tenths(tenths_c * 18 + 3200) : tenths_c;
+
+	format_append_fixed(buffer, DISPLAY_COLUMNS + 1, tenths, FORMAT_TENTHS);
+	format_append_char(buffer, DISPLAY_COLUMNS + 1, DISPLAY_DEGREE_CHAR);
+	format_append_char(buffer, DISPLAY_COLUMNS + 1, (temp_units == FAHRENHEIT) ? 'F' : 'C');
+}
+
+/**
+ * @brief Prints the metrics derived from the last reading: "Dew pt 12.3°C" and
+ *        "HI27.1°C AH9.4", absolute humidity in g/m^3. The widest second line,
+ *        "HI105.3°F AH25.3" or "HI-40.0°F AH0.1", fills the 16 columns; absolute
+ *        humidity is shown in whole g/m^3 from 100 on.
+ *
+ * @return none
+ */
+static void print_comfort(void)
+{
+	char buffer[DISPLAY_COLUMNS + 1] = {0};
+	Comfort_Metrics metrics;
+
+	comfort_compute(last_values[STATS_TEMPERATURE], last_values[STATS_HUMIDITY], &metrics);
+
+	format_append_str(buffer, DISPLAY_COLUMNS + 1, "Dew pt ");
+	append_temperature(buffer, metrics.dew_point);
+	show_line(0, buffer);
+	memset(buffer, 0, sizeof(buffer));
+	format_append_str(buffer, DISPLAY_COLUMNS + 1, "HI");
+	append_temperature(buffer, metrics.heat_index);
+	format_append_str(buffer, DISPLAY_COLUMNS + 1, " AH");
+	if (metrics.absolute_humidity < 9995)
+		format_append_fixed(buffer, DISPLAY_COLUMNS + 1, (metrics.absolute_humidity + 5) / 10, FORMAT_TENTHS);
+	else
+		format_append_fixed(buffer, DISPLAY_COLUMNS + 1, (metrics.absolute_humidity + 50) / 100, 0);
+	show_line(1, buffer);
+	display->flush();
+}
+
+#if FORECAST
+/**
+ * @brief Rate of change of a channel, in tenths of its display unit per hour.
+ *
+ * @param channel Channel, rate Filled with the rate
+ * @return 1 if the channel has a trend yet
+ */
+static uint8_t hourly_rate(FORECAST_CHANNEL channel, int32_t* rate)
+{
+	Forecast forecast;
+
+	if (!forecast_get(channel, &forecast))
+		return 0;
+
+	*rate = forecast.slope * 6;		//hundredths per minute to tenths per hour
+	if (channel == FORECAST_TEMPERATURE && temp_units == FAHRENHEIT)
+		*rate = *rate * 9 / 5;
+	return 1;
+}
+
+/**
+ * @brief Arrow for a rate of change, steady below half a unit per hour.
+ *
+ * @param rate Tenths per hour
+ * @return '^' rising, 'v' falling or '=' steady
+ */
+static char trend_arrow(int32_t rate)
+{
+	if (rate >= 5)
+		return '^';
+	return (rate <= -5) ? 'v' : '=';
+}
+
+/**
+ * @brief Appends a channel's trend, e.g. "T^+1.2".
+ *
+ * @param buffer Line of DISPLAY_COLUMNS + 1 chars, label Channel letter, channel Channel
+ * @return None
+ */
+static void append_rate(char* buffer, char label, FORECAST_CHANNEL channel)
+{
+	int32_t rate;
+
+	format_append_char(buffer, DISPLAY_COLUMNS + 1, label);
+	if (!hourly_rate(channel, &rate))
+	{
+		format_append_str(buffer, DISPLAY_COLUMNS + 1, " --");
+		return;
+	}
+	format_append_char(buffer, DISPLAY_COLUMNS + 1, trend_arrow(rate));
+	if (rate >= 0)
+		format_append_char(buffer, DISPLAY_COLUMNS + 1, '+');
+	format_append_fixed(buffer, DISPLAY_COLUMNS + 1, rate, FORMAT_TENTHS);
+}
+
+/**
+ * @brief Prints the trends: "T^+1.2 Hv-3.0/h", per hour in the display units, and the
+ *        time until the temperature falls to the dew point, "Dew pt in ~25min".
+ *
+ * @return none
+ */
+static void print_trend(void)
+{
+	char buffer[DISPLAY_COLUMNS + 1] = {0};
+	Forecast spread;
+
+	append_rate(buffer, 'T', FORECAST_TEMPERATURE);
+	format_append_char(buffer, DISPLAY_COLUMNS + 1, ' ');
+	append_rate(buffer, 'H', FORECAST_HUMIDITY);
+	format_append_str(buffer, DISPLAY_COLUMNS + 1, "/h");
+	show_line(0, buffer);
+
+	memset(buffer, 0, sizeof(buffer));
+	format_append_str(buffer, DISPLAY_COLUMNS + 1, "Dew pt ");
+	if (!forecast_get(FORECAST_DEW_SPREAD, &spread))
+		format_append_str(buffer, DISPLAY_COLUMNS + 1, "--");
+	else if (spread.level <= 0)
+		format_append_str(buffer, DISPLAY_COLUMNS + 1, "reached");
+	else
+	{
+		int16_t minutes = forecast_minutes_until(&spread, 0);
+
+		if (minutes < 0)
+			format_append_str(buffer, DISPLAY_COLUMNS + 1, "not near");
+		else
+		{
+			format_append_str(buffer, DISPLAY_COLUMNS + 1, "in ~");
+			format_append_fixed(buffer, DISPLAY_COLUMNS + 1, minutes, 0);
+			format_append_str(buffer, DISPLAY_COLUMNS + 1, "min");
+		}
+	}
+	show_line(1, buffer);
+	display->flush();
+}
+#endif
+
+/**
+ * @brief Prints the last temperature and humidity reading to the display.
  *
  * @param None
  * @return none
  */
 void print_temp_and_humidity_data()
 {
-	DHT22_Data data;
-	DHT22_getData(&data);
-	volatile float temperature = (temp_units == FAHRENHEIT) ? getTemperatureF(data.temp_first_byte, data.temp_second_byte) : getTemperatureC(data.temp_first_byte, data.temp_second_byte);
-	volatile float humidity = getHumidity(data.humidity_first_byte, data.humidity_second_byte) + HUMIDITY_MEASUREMENT_OFFSET;	//software calibration
+	if (!have_reading)
+	{
+		print_placeholder();
+		return;
+	}
+
+	if (light_mode != applied_light_mode)
+	{
+		display->set_light(light_mode);
+		applied_light_mode = light_mode;
+		forget_shown_lines();	//the LCD backlight bit travels with the next writes
+	}
+
+	if (display_view == VIEW_COMFORT)
+	{
+		print_comfort();
+		return;
+	}
+#if FORECAST
+	if (display_view == VIEW_TREND)
+	{
+		print_trend();
+		return;
+	}
+#endif
+	if (display_view != VIEW_READINGS)
+	{
+		print_stats((STATS_WINDOW)(display_view - VIEW_STATS_MINUTE));
+		return;
+	}
+
+	int16_t temperature_tenths_c = last_values[STATS_TEMPERATURE];
+	int32_t temperature = (temp_units == FAHRENHEIT) ? temperature_tenths_c * 18 + 3200 : temperature_tenths_c * 10;	//hundredths, F = C * 9 / 5 + 32 exactly
+	int32_t humidity = last_values[STATS_HUMIDITY] * 10;
+
+	char buffer[DISPLAY_COLUMNS + 1] = {0};
+#if TREND_GRAPH
+	trend_graph_render(display, TREND_GRAPH_STYLE);	//before the lines, see trend_graph_render()
+#endif
+	format_append_str(buffer, TEXT_COLUMNS + 1, TEMPERATURE_LABEL);
+	format_append_fixed(buffer, TEXT_COLUMNS + 1, temperature, FORMAT_HUNDREDTHS);
+	format_append_char(buffer, TEXT_COLUMNS + 1, DISPLAY_DEGREE_CHAR);
+	format_append_char(buffer, TEXT_COLUMNS + 1, (temp_units == FAHRENHEIT) ? 'F' : 'C');
+#if TREND_GRAPH
+	append_trend(buffer, TREND_TEMPERATURE);
+#endif
+	show_line(0, buffer);
+	memset(buffer, 0, sizeof(buffer));
+	format_append_str(buffer, TEXT_COLUMNS + 1, HUMIDITY_LABEL);
+	format_append_fixed(buffer, TEXT_COLUMNS + 1, humidity, FORMAT_HUNDREDTHS);
+	format_append_char(buffer, TEXT_COLUMNS + 1, '%');
+#if TREND_GRAPH
+	append_trend(buffer, TREND_HUMIDITY);
+#endif
+	show_line(1, buffer);
+	display->flush();
+}
+
+/**
+ * @brief Acts on a debounced button press.
+ *
+ * @param button Button that was pressed
+ * @return None
+ */
+static void button_pressed(BUTTON button)
+{
+	switch (button)
+	{
+	case BUTTON_VIEW:
+#if ALARM
+		if (alarm_latched())
+			alarm_acknowledge();
+		else
+#endif
+		if (display_mode == ON)
+		{
+			display_view = (DISPLAY_VIEW)((display_view + 1) % VIEWS);
+			stats_page = 0;
+			render_due = 1;
+		}
+		break;
+	case BUTTON_LIGHT:
+		display_set_light(!light_mode);
+		break;
+	case BUTTON_UNITS:
+		if (display_mode == ON)
+			display_set_units((temp_units == FAHRENHEIT) ? CELSIUS : FAHRENHEIT);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Debounces the button edges recorded by the EXTI interrupts.
+ *
+ *        The edge only stamps the time, so the ISR never waits. Once no edge came for
+ *        BUTTON_DEBOUNCE_MS, a pin that is still high is a press; a low pin was a release bounce.
+ * @param None
+ * @return None
+ */
+static void buttons_task(void)
+{
+	for (int button = 0; button < BUTTONS; button++)
+	{
+		if (!button_pending[button] || (uint32_t)(HAL_GetTick() - button_edge_ms[button]) < BUTTON_DEBOUNCE_MS)
+			continue;
+		button_pending[button] = 0;
+		if (HAL_GPIO_ReadPin(button_ports[button], button_pins[button]) == GPIO_PIN_SET)
+			button_pressed((BUTTON)button);
+	}
+}
+
+/**
+ * @brief Services the flags raised by the timer and button interrupts.
+ *        Called from the main loop.
+ *
+ * @param None
+ * @return none
+ */
+void display_task()
+{
+	uint32_t recovery_start = get_cycle_count();
+
+	//after an I2C fault the display lost its state (a 4-bit LCD may be out of nibble sync), replay it
+	if (i2c_bus_poll())
+	{
+		display_init();
+#if TREND_GRAPH
+		trend_graph_invalidate();
+#endif
+		print_temp_and_humidity_data();
+		i2c_bus_resumed(recovery_start);
+	}
+
+	buttons_task();
+
+	uint32_t work_start = get_cycle_count();
+	uint8_t worked = sample_due || render_due;
+
+	if (sample_due)
+	{
+		sample_due = 0;
+		DHT22_Status status = sample_sensor();	//on a failed read the previous reading stays on the display
+#if SCHEDULER
+#if ALARM
+		uint8_t near = alarm_near();
+#else
+		uint8_t near = 0;
+#endif
+		scheduler_update(status == DHT22_RESPONSE_SUCCESSFUL, last_values, near, HAL_GetTick());
+#else
+		(void)status;
+#endif
+		render_due = 1;
+	}
+
+	if (render_due)
+	{
+		render_due = 0;
+		if (display_mode == ON)
+			print_temp_and_humidity_data();
+	}
+#if SCHEDULER
+	if (worked)
+		scheduler_stats.active_us += CYCLES_TO_US(get_cycle_count() - work_start);
+#else
+	(void)worked;
+	(void)work_start;
+#endif
+#if ALARM
+	alarm_task();
+#endif
+#if FLASH_LOG
+	flash_log_task();	//between frames, the next sensor read is up to 2 s away
+#endif
+	settings_task();
+}
+
+/**
+ * @brief Sets and stores the temperature units, from the button or the console.
+ *
+ * @param units Units to display
+ * @return None
+ */
+void display_set_units(TEMP_UNITS units)
+{
+	temp_units = units;
+	settings_set(SETTING_TEMP_UNITS, temp_units);
+	render_due = 1;
+}
+
+/**
+ * @brief Sets and stores the backlight mode, from the button or the console.
+ *
+ * @param on 1 for the backlight on, 0 for off
+ * @return None
+ */
+void display_set_light(uint8_t on)
+{
+	light_mode = on;
+	settings_set(SETTING_LIGHT_MODE, light_mode);
+	render_due = 1;
+}
 
-	char buffer[LCD_DISPLAY_LENGTH] = {0};
-	clear_display();
-	snprintf(buffer, sizeof(buffer), "Temp: %.2f", temperature);
-	buffer[strlen(buffer)] = 0xDF;
-	buffer[strlen(buffer)] = (temp_units == FAHRENHEIT) ? 'F' : 'C';
-	printString(buffer, light_mode);
-	carriage_return();
-	snprintf(buffer, sizeof(buffer), "Humidity: %.2f", humidity);
-	buffer[strlen(buffer)] = '%';
-	printString(buffer, light_mode);
+/**
+ * @brief Latest calibrated and filtered reading.
+ *
+ * @param values Filled with STATS_CHANNELS values, tenths
+ * @return 1 if a reading was taken since boot, 0 otherwise
+ */
+uint8_t display_reading(int16_t* values)
+{
+	for (int ch = 0; ch < STATS_CHANNELS; ch++)
+		values[ch] = last_values[ch];
+	return have_reading;
+}
+
+/**
+ * @brief Time of the latest reading, for its age.
+ *
+ * @param None
+ * @return HAL tick of the read, only valid once display_reading() returns 1
+ */
+uint32_t display_reading_ms(void)
+{
+	return reading_ms;
 }
 
 /**
  * @brief ISR for TIM14
  *
- * Timer is set so that every two seconds, LCD updates temperature and humidity information.
+ * Timer is set so that every two seconds, a sensor read and display update is requested.
+ * With SCHEDULER the period is adapted after every read, see scheduler.c.
  * @param None
  * @return none
  */
 void TIM14_IRQHandler_Extended()
 {
-	print_temp_and_humidity_data();
+	sample_due = 1;
 	HAL_TIM_IRQHandler(&htim14);
 
 }
 
+/**
+ * @brief Records a rising edge of a button, display_task() acts on it once the contacts settled.
+ *
+ * @param button Button that raised the interrupt
+ * @return None
+ */
+static void button_edge(BUTTON button)
+{
+	button_edge_ms[button] = HAL_GetTick();	//every bounce restarts the debounce time
+	button_pending[button] = 1;
+}
+
+/**
+ * @brief ISR for EXTI0_1 interrupts
+ *
+ * An interrupt requests the next view (readings, 1 min, 1 h, 24 h statistics, comfort, trend), linked to PB0, rising edge.
+ * While an alarm is latched, it acknowledges the alarm instead.
+ * @param None
+ * @return none
+ */
+void EXTI0_1_IRQHandler_Extended()
+{
+	button_edge(BUTTON_VIEW);
+	__HAL_GPIO_EXTI_CLEAR_RISING_IT(VIEW_Button_Pin);
+}
+
 /**
  * @brief ISR for EXTI2_3 interrupts
  *
- * An interrupt will toggle the back light of the LCD, linked to PB3, rising edge
+ * An interrupt requests a toggle of the back light of the LCD, linked to PB3, rising edge
  * @param None
  * @return none
  */
 void EXTI2_3_IRQHandler_Extended()
 {
-	micro_delay(50000); //debouncing
-	micro_delay(50000); //debouncing
-	micro_delay(50000); //debouncing
-
-	light_mode = !light_mode;
-	print_temp_and_humidity_data();
+	button_edge(BUTTON_LIGHT);
 	__HAL_GPIO_EXTI_CLEAR_RISING_IT(LIGHT_Button_Pin);
 }
 
 /**
  * @brief ISR for EXTI4_15 interrupts
  *
- * An interrupt will toggle the units for temperature, linked to PA7, rising edge
+ * An interrupt requests a toggle of the units for temperature, linked to PA7, rising edge
  * @param None
  * @return none
  */
 void EXTI4_15_IRQHandler_Extended()
 {
-	micro_delay(50000); //debouncing
-	micro_delay(50000); //debouncing
-	micro_delay(50000); //debouncing
-
-	if (display_mode == ON)
-	{
-		temp_units = (temp_units == FAHRENHEIT) ? CELSIUS : FAHRENHEIT;
-		print_temp_and_humidity_data();
-	}
-
+	button_edge(BUTTON_UNITS);
 	__HAL_GPIO_EXTI_CLEAR_RISING_IT(UNITS_Button_Pin);
 }
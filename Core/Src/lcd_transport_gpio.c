@@ -0,0 +1,163 @@
+/**
+ * @file lcd_transport_gpio.c
+ * @author Auska Wang
+ * @brief LCD transport for an HD44780 wired directly to GPIO pins, in 4 or 8-bit mode.
+ *
+ *        Data, RS and backlight are driven with a single BSRR store, then E is pulsed.
+ *        RW is tied low, so the busy flag cannot be read; instead the time the controller
+ *        needs to execute a write is tracked and only waited out right before the next
+ *        write, letting the caller do other work in between.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "lcd_transport.h"
+#include "config.h"
+#include "general.h"
+
+/* Defines */
+#if LCD_GPIO_BUS_WIDTH == 8
+#define LCD_GPIO_DATA_MASK (0xFFU << LCD_GPIO_DATA_SHIFT)
+#elif LCD_GPIO_BUS_WIDTH == 4
+#define LCD_GPIO_DATA_MASK (0xF0U << LCD_GPIO_DATA_SHIFT)
+#else
+#error "LCD_GPIO_BUS_WIDTH must be 4 or 8"
+#endif
+#define LCD_GPIO_BUS_MASK (LCD_GPIO_DATA_MASK | LCD_GPIO_RS_Pin | LCD_GPIO_BL_Pin)
+#define LCD_EXECUTION_TIME_US 40	//37 us for every instruction except clear/home, which callers wait out
+#define E_PULSE_NOPS 24				//PW_EH >= 450 ns at 3.3 V, ~21 ns per NOP at 48 MHz
+
+/* Variables */
+static uint32_t busy_since = 0;		//cycle count of the last write
+static uint32_t busy_cycles = 0;	//its execution time; the count wraps every 89 s, so only the elapsed time is compared
+
+/**
+ * @brief Holds E high for the minimum enable pulse width, then releases it to latch the bus.
+ *
+ * @return None
+ */
+static inline void pulse_enable(void)
+{
+	LCD_GPIO_Port->BSRR = LCD_GPIO_E_Pin;
+	for (int i = 0; i < E_PULSE_NOPS; i++)
+		__NOP();
+	LCD_GPIO_Port->BSRR = (uint32_t)LCD_GPIO_E_Pin << 16;
+	for (int i = 0; i < E_PULSE_NOPS; i++)	//E low time before the next nibble
+		__NOP();
+}
+
+/**
+ * @brief Places bits on D0 - D7 (D4 - D7 in 4-bit mode), RS and backlight with one store and latches them.
+ *
+ * @param bits Bus value, reg Instruction or data register, light_mode Backlight on or off
+ * @return None
+ */
+static inline void bus_write(uint8_t bits, LCD_Register reg, uint8_t light_mode)
+{
+	uint32_t set = ((uint32_t)bits << LCD_GPIO_DATA_SHIFT) & LCD_GPIO_DATA_MASK;
+
+	if (reg == LCD_REGISTER_DATA)
+		set |= LCD_GPIO_RS_Pin;
+	if (light_mode)
+		set |= LCD_GPIO_BL_Pin;
+
+	LCD_GPIO_Port->BSRR = set | ((LCD_GPIO_BUS_MASK & ~set) << 16);
+	pulse_enable();
+}
+
+/**
+ * @brief Busy waits until the LCD has finished executing the previous write.
+ *
+ * @return None
+ */
+static inline void wait_ready(void)
+{
+	while (get_cycle_count() - busy_since < busy_cycles)
+	{}
+}
+
+/**
+ * @brief Configures data, RS, E and backlight pins as push-pull outputs, E low.
+ *
+ * @return None
+ */
+static void gpio_transport_init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	__HAL_RCC_GPIOB_CLK_ENABLE();
+	HAL_GPIO_WritePin(LCD_GPIO_Port, LCD_GPIO_E_Pin, GPIO_PIN_RESET);
+
+	GPIO_InitStruct.Pin = LCD_GPIO_DATA_MASK | LCD_GPIO_RS_Pin | LCD_GPIO_E_Pin | LCD_GPIO_BL_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(LCD_GPIO_Port, &GPIO_InitStruct);
+}
+
+/**
+ * @brief Single write while the LCD is still in 8-bit mode (init handshake).
+ *        Callers wait the handshake delays themselves.
+ *
+ * @param cmd Instruction to latch, only its upper nibble is seen in 4-bit wiring
+ * @return None
+ */
+static void gpio_transport_write_wakeup(uint8_t cmd)
+{
+	bus_write(cmd, LCD_REGISTER_INSTRUCTION, 1);
+}
+
+/**
+ * @brief Sends a byte to the LCD, as one bus write in 8-bit mode or two nibbles in 4-bit mode.
+ *
+ * @param byte Byte to be sent, reg Instruction or data register, light_mode Backlight on or off
+ * @return None
+ */
+static void gpio_transport_write(uint8_t byte, LCD_Register reg, uint8_t light_mode)
+{
+	wait_ready();
+#if LCD_GPIO_BUS_WIDTH == 8
+	bus_write(byte, reg, light_mode);
+#else
+	bus_write(byte, reg, light_mode);			//upper nibble on D4 - D7
+	bus_write(byte << 4, reg, light_mode);		//lower nibble on D4 - D7
+#endif
+	busy_since = get_cycle_count();
+	busy_cycles = LCD_EXECUTION_TIME_US * (SystemCoreClock / 1000000U);
+}
+
+/**
+ * @brief Extends the wait before the next write, for instructions slower than LCD_EXECUTION_TIME_US.
+ *
+ * @param us Execution time of the last written instruction
+ * @return None
+ */
+static void gpio_transport_hold(uint16_t us)
+{
+	busy_since = get_cycle_count();
+	busy_cycles = us * (SystemCoreClock / 1000000U);
+}
+
+/**
+ * @brief Writes go straight to the pins, nothing is ever in flight.
+ *
+ * @return 0
+ */
+static uint8_t gpio_transport_busy(void)
+{
+	return 0;
+}
+
+const LCD_Transport lcd_transport_gpio = {
+	.init = gpio_transport_init,
+	.write_wakeup = gpio_transport_write_wakeup,
+	.write = gpio_transport_write,
+	.hold = gpio_transport_hold,
+	.busy = gpio_transport_busy,
+#if LCD_GPIO_BUS_WIDTH == 8
+	.interface_cmd = 0x30,	//stay in 8-bit interface
+	.function_set = 0x38	//8-bit, 2 lines, 5x8 font
+#else
+	.interface_cmd = 0x20,	//switch to 4-bit interface
+	.function_set = 0x28	//4-bit, 2 lines, 5x8 font
+#endif
+};
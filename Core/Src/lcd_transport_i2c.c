@@ -0,0 +1,242 @@
+/**
+ * @file lcd_transport_i2c.c
+ * @author Auska Wang
+ * @brief LCD transport through a PCF8574 I2C expander wired to the HD44780 in 4-bit mode.
+ *        Expander bit layout: P0 = RS, P2 = E, P3 = backlight, P4 - P7 = D4 - D7.
+ *
+ *        Expander bytes are appended to a FIFO and sent by one queued bus transaction
+ *        at a time, which resubmits itself from its completion callback until the FIFO
+ *        is empty. Writers only wait when the FIFO itself is full.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "lcd_transport.h"
+#include "main.h"
+#include "general.h"
+#include "i2c_bus.h"
+
+/* Defines */
+#define PCF8574_ADDR 0x27 << 1
+#define UPPER_BITS_MASK 0xF0
+#define INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_ON 0x0C
+#define INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_ON 0x08
+#define DATA_REGISTER_ENABLE_ON_LIGHT_ON 0x0D
+#define DATA_REGISTER_ENABLE_OFF_LIGHT_ON 0x09
+#define INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_OFF 0x04
+#define INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_OFF 0x01
+#define DATA_REGISTER_ENABLE_ON_LIGHT_OFF 0x05
+#define DATA_REGISTER_ENABLE_OFF_LIGHT_OFF 0x01
+#define BIT_MODE_4 4
+#define LCD_FIFO_SIZE 256			//power of 2, a full 2 line refresh is ~140 bytes
+
+/* Variables */
+static uint8_t fifo[LCD_FIFO_SIZE];
+static volatile uint16_t fifo_head = 0;		//free running, written by the main loop
+static volatile uint16_t fifo_tail = 0;		//free running, advanced from the bus callback
+static volatile uint8_t hold_pending = 0;
+static uint16_t hold_mark;					//fifo_head when the hold was requested
+static uint16_t hold_us;
+static I2C_Transaction txn;
+static uint8_t device_registered = 0;
+
+static void kick(void);
+
+/**
+ * @brief Transaction callback: releases the sent bytes and sends the rest.
+ *        On error the FIFO is dropped, the display is replayed after bus recovery.
+ *
+ * @param t Finished transaction, error HAL_I2C_ERROR_NONE on success
+ * @return None
+ */
+static void txn_done(I2C_Transaction* t, uint32_t error)
+{
+	if (error != HAL_I2C_ERROR_NONE)
+	{
+		fifo_tail = fifo_head;
+		hold_pending = 0;
+		return;
+	}
+
+	fifo_tail += t->size;
+	if (t->hold_us)
+		hold_pending = 0;
+	kick();
+}
+
+/**
+ * @brief Submits the bytes waiting in the FIFO, up to the wrap point or a pending hold,
+ *        unless a transaction is already in flight.
+ *
+ * @return None
+ */
+static void kick(void)
+{
+	uint16_t tail, len;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	tail = fifo_tail;
+	len = fifo_head - tail;
+	if (!txn.pending && hold_pending && hold_mark == tail)
+	{
+		i2c_bus_hold(txn.device, hold_us);	//the slow instruction went out already, no empty transfer to end on it
+		hold_pending = 0;
+	}
+	if (txn.pending || len == 0)
+	{
+		__set_PRIMASK(primask);
+		return;
+	}
+
+	if (len > LCD_FIFO_SIZE - (tail & (LCD_FIFO_SIZE - 1)))
+		len = LCD_FIFO_SIZE - (tail & (LCD_FIFO_SIZE - 1));
+
+	txn.hold_us = 0;
+	if (hold_pending && (uint16_t)(hold_mark - tail) <= len)
+	{
+		len = hold_mark - tail;	//end on the slow instruction, the bus waits out its hold
+		txn.hold_us = hold_us;
+	}
+
+	txn.data = &fifo[tail & (LCD_FIFO_SIZE - 1)];
+	txn.size = len;
+	if (i2c_bus_submit(&txn) != HAL_OK)
+	{
+		fifo_tail = fifo_head;
+		hold_pending = 0;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Appends expander bytes to the FIFO and starts sending them.
+ *        Dropped while the bus is offline, the display is replayed after recovery.
+ *
+ * @param bytes Expander bytes, n Count
+ * @return None
+ */
+static void push(const uint8_t* bytes, uint16_t n)
+{
+	while ((uint16_t)(LCD_FIFO_SIZE - (uint16_t)(fifo_head - fifo_tail)) < n)
+	{
+		if (!i2c_bus_online())
+			return;
+		i2c_bus_run();	//a held back transaction may be due
+	}
+	if (!i2c_bus_online())
+		return;
+
+	for (uint16_t i = 0; i < n; i++)
+		fifo[(uint16_t)(fifo_head + i) & (LCD_FIFO_SIZE - 1)] = bytes[i];
+	fifo_head += n;
+	kick();
+}
+
+/**
+ * @brief Registers the expander on the bus, hi2c1 is brought up by hardware_init().
+ *
+ * @return None
+ */
+static void i2c_transport_init(void)
+{
+	if (!device_registered)
+	{
+		txn.device = i2c_bus_register("lcd");
+		txn.address = PCF8574_ADDR;
+		txn.op = I2C_OP_WRITE;
+		txn.priority = I2C_PRIORITY_DISPLAY;
+		txn.done = txn_done;
+		device_registered = 1;
+	}
+}
+
+/**
+ * @brief Sends a single nibble while the LCD is still in 8-bit mode (init handshake).
+ *
+ * @param cmd Instruction whose upper nibble is latched
+ * @return None
+ */
+static void i2c_transport_write_wakeup(uint8_t cmd)
+{
+	uint8_t t[2];
+
+	t[0] = (cmd & UPPER_BITS_MASK) | INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_ON;	//rs = 0, e = 1
+	t[1] = (cmd & UPPER_BITS_MASK) | INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_ON;	//rs = 0, e = 0
+
+	push(t, sizeof(t));
+}
+
+/**
+ * @brief Sends a byte to the LCD as two nibbles, each latched by a falling edge of E.
+ *
+ * @param byte Byte to be sent, reg Instruction or data register, light_mode Backlight on or off
+ * @return None
+ */
+static void i2c_transport_write(uint8_t byte, LCD_Register reg, uint8_t light_mode)
+{
+	uint8_t t[BIT_MODE_4];
+	uint8_t u, l, e_on, e_off;
+
+	if (reg == LCD_REGISTER_DATA)
+	{
+		e_on = light_mode ? DATA_REGISTER_ENABLE_ON_LIGHT_ON : DATA_REGISTER_ENABLE_ON_LIGHT_OFF;
+		e_off = light_mode ? DATA_REGISTER_ENABLE_OFF_LIGHT_ON : DATA_REGISTER_ENABLE_OFF_LIGHT_OFF;
+	}
+	else
+	{
+		e_on = light_mode ? INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_ON : INSTRUCTION_REGISTER_ENABLE_ON_LIGHT_OFF;
+		e_off = light_mode ? INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_ON : INSTRUCTION_REGISTER_ENABLE_OFF_LIGHT_OFF;
+	}
+
+	u = byte & UPPER_BITS_MASK;
+	l = (byte << 4) & UPPER_BITS_MASK;
+	t[0] = u | e_on;	//e = 1
+	t[1] = u | e_off;	//e = 0
+	t[2] = l | e_on;	//e = 1
+	t[3] = l | e_off;	//e = 0
+
+	push(t, sizeof(t));
+}
+
+/**
+ * @brief Makes the bus wait after the bytes written so far before sending more to the LCD.
+ *        Other devices on the bus are not held up.
+ *
+ * @param us Execution time of the last written instruction
+ * @return None
+ */
+static void i2c_transport_hold(uint16_t us)
+{
+	while (hold_pending)	//one hold at a time, an earlier one is still queued
+	{
+		if (!i2c_bus_online())
+			return;
+		i2c_bus_run();
+	}
+
+	hold_mark = fifo_head;
+	hold_us = us;
+	hold_pending = 1;
+	kick();
+}
+
+/**
+ * @brief Tells whether written bytes have not reached the LCD yet.
+ *
+ * @return 1 while the FIFO or its transaction is not done
+ */
+static uint8_t i2c_transport_busy(void)
+{
+	return fifo_head != fifo_tail || txn.pending;
+}
+
+const LCD_Transport lcd_transport_i2c = {
+	.init = i2c_transport_init,
+	.write_wakeup = i2c_transport_write_wakeup,
+	.write = i2c_transport_write,
+	.hold = i2c_transport_hold,
+	.busy = i2c_transport_busy,
+	.interface_cmd = 0x20,	//4-bit interface
+	.function_set = 0x28	//4-bit, 2 lines, 5x8 font
+};
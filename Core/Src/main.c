@@ -19,6 +19,17 @@
 #include "main.h"
 #include "general.h"
 #include "lcd_data_display.h"
+#include "config.h"
+#include "i2clcd.h"
+#include "boot.h"
+#include "fixed_format.h"
+#include "mem_usage.h"
+#include "rolling_stats.h"
+#include "flash_log.h"
+#include "console.h"
+#include "modbus.h"
+#include "network.h"
+#include "diag.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -32,10 +43,47 @@
  */
 int main(void)
 {
+	mem_usage_paint_stack();
 	hardware_init();
+#if DIAG_PRINT
+	diag_init();
+#endif
+	rolling_stats_init();
+#if FLASH_LOG
+	flash_log_init();
+#endif
+	display_load_settings();
+	boot_run();
+#if LCD_TRANSPORT_BENCHMARK
+	lcd_benchmark_transports();
 	print_temp_and_humidity_data();
+#endif
+#if FORMAT_BENCHMARK
+	format_benchmark();
+#endif
+#if CONSOLE
+	console_init();
+#endif
+#if MODBUS
+	modbus_init();
+#endif
+#if NETWORK
+	network_init();
+#endif
+	mem_usage_update();	//static and boot time use, refresh later for the running peak
     while (1)
     {
+    	display_task();
+#if CONSOLE
+    	console_task();		//after the sensor work, a command never delays a frame
+#endif
+#if MODBUS
+    	modbus_task();
+#endif
+#if NETWORK
+    	network_task();		//often, the beacon's lead covers one pass of this loop
+#endif
+    	mem_usage_check();
     }
 }
 
@@ -0,0 +1,77 @@
+/**
+ * @file mem_usage.c
+ * @author Auska Wang
+ * @brief RAM accounting: static sections from the linker symbols, heap from the
+ *        instrumented _sbrk and the stack high water mark from a painted stack.
+ *
+ *        Every buffer of the application is a static array sized by a #define, so
+ *        static use is fixed at link time and the linker fails the build if statics
+ *        plus _Min_Stack_Size no longer fit. With HEAP_FREE set, _sbrk refuses every
+ *        request and mem_usage_check() stops the firmware if anything asked.
+ */
+
+/* Includes */
+#include "mem_usage.h"
+#include "config.h"
+#include "general.h"
+
+/* Defines */
+#define STACK_PAINT 0xA5A5A5A5U
+#define STACK_PAINT_MARGIN 64	//bytes below SP left alone while painting, the painting frame itself
+
+/* Variables */
+extern uint8_t _sdata, _edata, _sbss, _ebss, _end, _estack;
+extern uint32_t _Min_Stack_Size;
+
+Memory_Report memory_report;
+
+/**
+ * @brief Fills the free RAM between the heap and the stack with a known pattern.
+ *        Called first thing in main(), before anything allocates or calls deep.
+ *
+ * @return None
+ */
+void mem_usage_paint_stack(void)
+{
+	uint32_t* word = (uint32_t*)(&_end + sbrk_stats.heap_bytes);
+	uint32_t limit = __get_MSP() - STACK_PAINT_MARGIN;
+
+	for (; (uint32_t)word < limit; word++)
+		*word = STACK_PAINT;
+}
+
+/**
+ * @brief Refreshes memory_report. The stack scan walks the free RAM, a few thousand
+ *        cycles, so this runs on request rather than every loop.
+ *
+ * @return None
+ */
+void mem_usage_update(void)
+{
+	uint32_t* word = (uint32_t*)(&_end + sbrk_stats.heap_bytes);	//the heap grows over the paint
+
+	while ((uint32_t)word < (uint32_t)&_estack && *word == STACK_PAINT)
+		word++;
+
+	memory_report.data_bytes = &_edata - &_sdata;
+	memory_report.bss_bytes = &_ebss - &_sbss;
+	memory_report.heap_bytes = sbrk_stats.heap_bytes;
+	memory_report.stack_reserved_bytes = (uint32_t)&_Min_Stack_Size;
+	memory_report.stack_peak_bytes = (uint32_t)&_estack - (uint32_t)word;
+	memory_report.free_bytes = (uint32_t)word - (uint32_t)(&_end + sbrk_stats.heap_bytes);
+}
+
+/**
+ * @brief Runtime check of the heap-free build, called from the main loop.
+ *        Halts in Error_Handler() once anything asked _sbrk for memory;
+ *        sbrk_stats.first_caller tells who.
+ *
+ * @return None
+ */
+void mem_usage_check(void)
+{
+#if HEAP_FREE
+	if (sbrk_stats.calls)
+		Error_Handler();
+#endif
+}
@@ -0,0 +1,541 @@
+/**
+ * @file modbus.c
+ * @author Auska Wang
+ * @brief Modbus RTU slave on USART2 exposing the readings, statistics, alarms and settings.
+ *
+ *        Requests are received by circular DMA, with no interrupt per byte. An RTU frame
+ *        ends with 3.5 characters of silence: the UART's idle line interrupt fires after
+ *        one, and starts TIM17 in one pulse mode for the rest. When it expires with no
+ *        byte received since, the bytes since the previous frame are queued as a frame.
+ *        The 1.5 character limit within a frame is not checked; such a frame is caught
+ *        by its CRC.
+ *
+ *        modbus_task() answers from the main loop. The response is built in place in
+ *        response[], each register read from the module that owns it when the response
+ *        is assembled, so no register image is kept or refreshed. The response is then
+ *        queued on the transmit ring. Broadcasts (address 0) are executed, not answered.
+ *
+ *        Functions: 03 read holding, 04 read input, 06 write single, 16 write multiple
+ *        registers. See modbus.h for the map.
+ */
+
+/* Includes */
+#include <string.h>
+#include "modbus.h"
+#include "general.h"
+#include "dht22.h"
+#include "crc.h"
+#include "uart_tx.h"
+#include "lcd_data_display.h"
+#include "comfort.h"
+#include "alarm.h"
+#include "filter.h"
+#include "scheduler.h"
+
+/* Defines */
+#if MODBUS && (TELEMETRY || CONSOLE)
+#error "USART2 carries one protocol, set TELEMETRY and CONSOLE to 0 for MODBUS"
+#endif
+#if MODBUS_ADDRESS < 1 || MODBUS_ADDRESS > 247
+#error "MODBUS_ADDRESS must be 1 to 247"
+#endif
+
+#define FRAMES_QUEUED 4				//frames waiting for modbus_task()
+#define BROADCAST 0
+
+#define READ_HOLDING 0x03
+#define READ_INPUT 0x04
+#define WRITE_SINGLE 0x06
+#define WRITE_MULTIPLE 0x10
+#define EXCEPTION 0x80				//or'ed into the function code of an exception response
+
+#define ILLEGAL_FUNCTION 0x01
+#define ILLEGAL_ADDRESS 0x02
+#define ILLEGAL_VALUE 0x03
+
+#define MAX_READ 125				//registers per read, the response fits 256 bytes
+#define MAX_WRITE 123
+#define STATS_FIELDS 5				//min, mean, max, deviation, count
+#define CALIBRATION_BLOCK (1 + 2 * CALIBRATION_MAX_POINTS)
+
+_Static_assert(MODBUS_HOLD_ALARM_THRESHOLDS + ALARM_RULES <= MODBUS_HOLD_CAL_TEMPERATURE, "Alarm thresholds overlap the calibration block");
+
+/**
+ * @brief A received frame, positions in rx[].
+ */
+typedef struct {
+	uint16_t start;
+	uint16_t end;
+	uint32_t gap_cycle;				//cycle count when the gap ended it
+} Modbus_Frame;
+
+/* Variables */
+extern UART_HandleTypeDef huart2;
+extern TIM_HandleTypeDef htim17;
+extern TEMP_UNITS temp_units;
+extern uint8_t light_mode;
+
+Modbus_Stats modbus_stats;
+
+static uint8_t rx[MODBUS_RX_BYTES];
+static volatile uint16_t idle_position = 0;		//DMA position at the last idle line
+static uint16_t frame_start = 0;				//first byte of the next frame, TIM17 interrupt only
+static Modbus_Frame frames[FRAMES_QUEUED];
+static volatile uint8_t frames_head = 0;		//written by the TIM17 interrupt
+static volatile uint8_t frames_tail = 0;		//written by modbus_task()
+
+static uint8_t request[MODBUS_MAX_FRAME];
+static uint8_t response[MODBUS_MAX_FRAME];
+
+static Stats_Summary summary;		//statistics group read last, a read of its 5 registers queries once
+static int8_t summary_group = -1;
+#if !SCHEDULER
+static uint16_t interval_s = DHT22_MIN_INTERVAL_MS / 1000U;
+#endif
+
+/**
+ * @brief Reads a register value, big endian as on the wire.
+ *
+ * @param bytes Two bytes
+ * @return Value
+ */
+static uint16_t get16(const uint8_t* bytes)
+{
+	return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+/**
+ * @brief Writes a register value, big endian as on the wire.
+ *
+ * @param bytes Two bytes, value Value
+ * @return None
+ */
+static void put16(uint8_t* bytes, uint16_t value)
+{
+	bytes[0] = (uint8_t)(value >> 8);
+	bytes[1] = (uint8_t)value;
+}
+
+/**
+ * @brief Converts a latency to a register value.
+ *
+ * @param cycles Latency from modbus_stats
+ * @return Microseconds, 0xFFFF if longer
+ */
+static uint16_t latency_us(uint32_t cycles)
+{
+	uint32_t us = CYCLES_TO_US(cycles);
+
+	return us > 0xFFFF ? 0xFFFF : (uint16_t)us;
+}
+
+/**
+ * @brief Reads an input register from the live data.
+ *
+ * @param address Register, below MODBUS_IN_REGISTERS
+ * @return Value
+ */
+static uint16_t read_input(uint16_t address)
+{
+	int16_t values[STATS_CHANNELS];
+	uint8_t have_reading = display_reading(values);
+
+	if (address >= MODBUS_IN_STATS)
+	{
+		uint16_t index = address - MODBUS_IN_STATS;
+		int8_t group = (int8_t)(index / STATS_FIELDS);		//window * STATS_CHANNELS + channel
+
+		if (group != summary_group)
+		{
+			if (!rolling_stats_get((STATS_CHANNEL)(group % STATS_CHANNELS), (STATS_WINDOW)(group / STATS_CHANNELS), &summary))
+				memset(&summary, 0, sizeof(summary));
+			summary_group = group;
+		}
+		switch (index % STATS_FIELDS)
+		{
+		case 0:
+			return (uint16_t)summary.min;
+		case 1:
+			return (uint16_t)summary.mean;
+		case 2:
+			return (uint16_t)summary.max;
+		case 3:
+			return (uint16_t)summary.stddev;
+		default:
+			return summary.count > 0xFFFF ? 0xFFFF : (uint16_t)summary.count;
+		}
+	}
+
+	switch (address)
+	{
+	case MODBUS_IN_TEMPERATURE:
+		return (uint16_t)values[STATS_TEMPERATURE];
+	case MODBUS_IN_HUMIDITY:
+		return (uint16_t)values[STATS_HUMIDITY];
+	case MODBUS_IN_DEW_POINT:
+		return have_reading ? (uint16_t)comfort_dew_point(values[STATS_TEMPERATURE], values[STATS_HUMIDITY]) : 0;
+	case MODBUS_IN_STATUS:
+		return (have_reading ? MODBUS_STATUS_READING : 0) | (alarm_latched() ? MODBUS_STATUS_ALARM_LATCHED : 0)
+				| (alarm_near() ? MODBUS_STATUS_ALARM_NEAR : 0);
+	case MODBUS_IN_UPTIME_HIGH:
+		return (uint16_t)((HAL_GetTick() / 1000U) >> 16);
+	case MODBUS_IN_UPTIME_LOW:
+		return (uint16_t)(HAL_GetTick() / 1000U);
+	case MODBUS_IN_ALARMS_RAISED:
+		return (uint16_t)alarm_stats.raised;
+	case MODBUS_IN_REJECTED:
+		return (uint16_t)filter_stats.rejected;
+	case MODBUS_IN_LATENCY_LAST:
+		return latency_us(modbus_stats.last_latency_cycles);
+	case MODBUS_IN_LATENCY_MAX:
+		return latency_us(modbus_stats.max_latency_cycles);
+	default:
+		return 0;	//unassigned
+	}
+}
+
+/**
+ * @brief Reads a holding register from the live settings.
+ *
+ * @param address Register, below MODBUS_HOLD_REGISTERS
+ * @return Value
+ */
+static uint16_t read_holding(uint16_t address)
+{
+	if (address >= MODBUS_HOLD_CAL_TEMPERATURE)
+	{
+		HISTORY_CHANNEL channel = address >= MODBUS_HOLD_CAL_HUMIDITY ? HISTORY_HUMIDITY : HISTORY_TEMPERATURE;
+		uint16_t offset = address - (channel == HISTORY_HUMIDITY ? MODBUS_HOLD_CAL_HUMIDITY : MODBUS_HOLD_CAL_TEMPERATURE);
+		Calibration_Point points[CALIBRATION_MAX_POINTS];
+		uint8_t count = calibration_points(channel, points);
+
+		if (offset == 0)
+			return count;
+		if (offset >= CALIBRATION_BLOCK || (offset - 1) / 2 >= count)
+			return 0;
+		return (uint16_t)((offset - 1) % 2 ? points[(offset - 1) / 2].corrected : points[(offset - 1) / 2].raw);
+	}
+
+	if (address >= MODBUS_HOLD_ALARM_THRESHOLDS && address < MODBUS_HOLD_ALARM_THRESHOLDS + ALARM_RULES)
+		return (uint16_t)alarm_threshold(address - MODBUS_HOLD_ALARM_THRESHOLDS, NULL, NULL);
+
+	switch (address)
+	{
+	case MODBUS_HOLD_UNITS:
+		return temp_units == CELSIUS;
+	case MODBUS_HOLD_LIGHT:
+		return light_mode;
+	case MODBUS_HOLD_INTERVAL:
+#if SCHEDULER
+		return (uint16_t)(scheduler_fixed() / 1000U);
+#else
+		return interval_s;
+#endif
+	case MODBUS_HOLD_ALARM_ACK:
+		return alarm_latched();
+	default:
+		return 0;	//unassigned
+	}
+}
+
+/**
+ * @brief Checks, and if asked applies, a write to a holding register outside the
+ *        calibration blocks.
+ *
+ * @param address Register, value Value, apply 0 to check only
+ * @return 0 if valid, else the exception code
+ */
+static uint8_t write_holding(uint16_t address, uint16_t value, uint8_t apply)
+{
+	if (address >= MODBUS_HOLD_ALARM_THRESHOLDS && address < MODBUS_HOLD_ALARM_THRESHOLDS + ALARM_RULES)
+	{
+		if (!alarm_threshold_valid(address - MODBUS_HOLD_ALARM_THRESHOLDS, (int16_t)value))
+			return ILLEGAL_VALUE;
+		if (apply)
+			alarm_set_threshold(address - MODBUS_HOLD_ALARM_THRESHOLDS, (int16_t)value);
+		return 0;
+	}
+
+	switch (address)
+	{
+	case MODBUS_HOLD_UNITS:
+		if (value > 1)
+			return ILLEGAL_VALUE;
+		if (apply)
+			display_set_units(value ? CELSIUS : FAHRENHEIT);
+		return 0;
+	case MODBUS_HOLD_LIGHT:
+		if (value > 1)
+			return ILLEGAL_VALUE;
+		if (apply)
+			display_set_light((uint8_t)value);
+		return 0;
+	case MODBUS_HOLD_INTERVAL:
+#if SCHEDULER
+		if (value != 0 && (value * 1000U < DHT22_MIN_INTERVAL_MS || value > 81))
+			return ILLEGAL_VALUE;
+		if (apply)
+			scheduler_set_fixed(value * 1000U);		//applied after the next sample
+#else
+		if (value * 1000U < DHT22_MIN_INTERVAL_MS || value > 81)
+			return ILLEGAL_VALUE;
+		if (apply)
+		{
+			interval_s = value;
+			sampling_set_interval(value * 1000U);
+		}
+#endif
+		return 0;
+	case MODBUS_HOLD_ALARM_ACK:
+		if (value > 1)
+			return ILLEGAL_VALUE;
+		if (apply && value)
+			alarm_acknowledge();
+		return 0;
+	default:
+		return ILLEGAL_ADDRESS;
+	}
+}
+
+/**
+ * @brief Writes a calibration block: point count, then raw and corrected values.
+ *
+ * @param channel Channel, data Register values, big endian, quantity Number of registers
+ * @return 0 if stored, else the exception code
+ */
+static uint8_t write_calibration(HISTORY_CHANNEL channel, const uint8_t* data, uint16_t quantity)
+{
+	Calibration_Point points[CALIBRATION_MAX_POINTS];
+	uint16_t count = get16(data);
+
+	if (count > CALIBRATION_MAX_POINTS || quantity < 1 + 2 * count || quantity > CALIBRATION_BLOCK)
+		return ILLEGAL_VALUE;
+	for (uint16_t i = 0; i < count; i++)
+	{
+		points[i].raw = (int16_t)get16(&data[2 + 4 * i]);
+		points[i].corrected = (int16_t)get16(&data[4 + 4 * i]);
+	}
+	return calibration_load(channel, points, (uint8_t)count) == CALIBRATION_OK ? 0 : ILLEGAL_VALUE;
+}
+
+/**
+ * @brief Writes consecutive holding registers: a calibration block from its start, or
+ *        settings that are all checked before any is applied.
+ *
+ * @param first First register, quantity Number of registers, data Values, big endian
+ * @return 0 if written, else the exception code
+ */
+static uint8_t write_multiple(uint16_t first, uint16_t quantity, const uint8_t* data)
+{
+	if (first == MODBUS_HOLD_CAL_TEMPERATURE)
+		return write_calibration(HISTORY_TEMPERATURE, data, quantity);
+	if (first == MODBUS_HOLD_CAL_HUMIDITY)
+		return write_calibration(HISTORY_HUMIDITY, data, quantity);
+
+	for (uint16_t i = 0; i < quantity; i++)
+	{
+		uint8_t exception = write_holding(first + i, get16(&data[2 * i]), 0);
+
+		if (exception)
+			return exception;
+	}
+	for (uint16_t i = 0; i < quantity; i++)
+		write_holding(first + i, get16(&data[2 * i]), 1);
+	return 0;
+}
+
+/**
+ * @brief Answers one frame. Independent of the UART, so requests can be replayed on a host.
+ *
+ * @param request Frame, CRC included, length Its length,
+ *        response At least MODBUS_MAX_FRAME bytes, filled with the response, CRC included
+ * @return Response length, 0 if not answered (bad CRC, other slave, broadcast)
+ */
+uint16_t modbus_process(const uint8_t* request, uint16_t length, uint8_t* response)
+{
+	uint8_t address = request[0], function = request[1];
+	uint16_t first = get16(&request[2]), quantity = get16(&request[4]);
+	uint16_t size = 0;
+	uint8_t exception = 0;
+
+	if (length < 4 || crc16_modbus(request, length) != 0)	//the CRC over a frame and its CRC is 0
+	{
+		modbus_stats.crc_errors++;
+		return 0;
+	}
+	if (address != MODBUS_ADDRESS && address != BROADCAST)
+		return 0;
+	modbus_stats.requests++;
+	summary_group = -1;
+
+	response[0] = MODBUS_ADDRESS;
+	response[1] = function;
+	switch (function)
+	{
+	case READ_HOLDING:
+	case READ_INPUT:
+		if (length != 8 || quantity < 1 || quantity > MAX_READ)
+			exception = ILLEGAL_VALUE;
+		else if ((uint32_t)first + quantity > (function == READ_INPUT ? MODBUS_IN_REGISTERS : MODBUS_HOLD_REGISTERS))
+			exception = ILLEGAL_ADDRESS;
+		else
+		{
+			response[2] = (uint8_t)(2 * quantity);
+			for (uint16_t i = 0; i < quantity; i++)
+				put16(&response[3 + 2 * i], function == READ_INPUT ? read_input(first + i) : read_holding(first + i));
+			size = 3 + 2 * quantity;
+		}
+		break;
+	case WRITE_SINGLE:
+		if (length != 8)
+			exception = ILLEGAL_VALUE;
+		else if (!(exception = write_holding(first, quantity, 0)))
+		{
+			write_holding(first, quantity, 1);
+			memcpy(&response[2], &request[2], 4);		//echo of address and value
+			size = 6;
+		}
+		break;
+	case WRITE_MULTIPLE:
+		if (length < 9 || length != 9 + request[6] || request[6] != 2 * quantity || quantity < 1 || quantity > MAX_WRITE)
+			exception = ILLEGAL_VALUE;
+		else if (!(exception = write_multiple(first, quantity, &request[7])))
+		{
+			memcpy(&response[2], &request[2], 4);		//echo of address and quantity
+			size = 6;
+		}
+		break;
+	default:
+		exception = ILLEGAL_FUNCTION;
+		break;
+	}
+
+	if (address == BROADCAST)
+		return 0;
+	if (exception)
+	{
+		modbus_stats.exceptions++;
+		response[1] = function | EXCEPTION;
+		response[2] = exception;
+		size = 3;
+	}
+
+	uint16_t crc = crc16_modbus(response, size);
+	response[size++] = (uint8_t)crc;		//low byte first
+	response[size++] = (uint8_t)(crc >> 8);
+	return size;
+}
+
+/**
+ * @brief Starts the circular reception from the start of rx[].
+ *
+ * @param None
+ * @return None
+ */
+static void start_reception(void)
+{
+	idle_position = 0;
+	frame_start = 0;
+	frames_tail = frames_head;
+	HAL_UARTEx_ReceiveToIdle_DMA(&huart2, rx, MODBUS_RX_BYTES);	//retried by modbus_task() if refused
+}
+
+/**
+ * @brief Starts listening for requests. Called once USART2 and TIM17 are initialized.
+ *
+ * @param None
+ * @return None
+ */
+void modbus_init(void)
+{
+	start_reception();
+}
+
+/**
+ * @brief Answers the frames received since the last call. Called from the main loop.
+ *
+ * @param None
+ * @return None
+ */
+void modbus_task(void)
+{
+	if (huart2.RxState == HAL_UART_STATE_READY)		//stopped by an overrun or framing error
+	{
+		modbus_stats.rx_restarts++;
+		start_reception();
+		return;
+	}
+
+	while (frames_tail != frames_head)
+	{
+		Modbus_Frame frame = frames[frames_tail];
+		uint16_t length = (uint16_t)((frame.end + MODBUS_RX_BYTES - frame.start) % MODBUS_RX_BYTES);
+		uint16_t first = MODBUS_RX_BYTES - frame.start;
+
+		frames_tail = (frames_tail + 1) % FRAMES_QUEUED;
+		if (first > length)
+			first = length;
+		memcpy(request, &rx[frame.start], first);		//in one piece, the frame may wrap around rx[]
+		memcpy(request + first, rx, length - first);
+
+		uint16_t size = modbus_process(request, length, response);
+
+		if (size == 0)
+			continue;
+		uart_tx_write(response, size);
+		modbus_stats.last_latency_cycles = get_cycle_count() - frame.gap_cycle;
+		if (modbus_stats.last_latency_cycles > modbus_stats.max_latency_cycles)
+			modbus_stats.max_latency_cycles = modbus_stats.last_latency_cycles;
+	}
+}
+
+/**
+ * @brief Called from the TIM17 interrupt once the line was silent for 3.5 characters after
+ *        an idle line. Queues the bytes since the previous frame, unless more arrived.
+ *
+ * @param None
+ * @return None
+ */
+void modbus_gap_elapsed(void)
+{
+	uint16_t idle = idle_position;
+	uint16_t position = MODBUS_RX_BYTES - __HAL_DMA_GET_COUNTER(huart2.hdmarx);
+
+	if (position == MODBUS_RX_BYTES)
+		position = 0;
+	if (position != idle || position == frame_start)
+		return;		//more bytes since the idle line, its own idle line restarts the timer
+
+	uint8_t next = (frames_head + 1) % FRAMES_QUEUED;
+
+	modbus_stats.frames++;
+	if (next == frames_tail)
+		modbus_stats.overruns++;
+	else
+	{
+		frames[frames_head].start = frame_start;
+		frames[frames_head].end = position;
+		frames[frames_head].gap_cycle = get_cycle_count();
+		frames_head = next;
+	}
+	frame_start = position;
+}
+
+#if MODBUS
+/**
+ * @brief HAL callback, the line went idle or the DMA passed half or all of rx[]. Times the
+ *        rest of the gap from here.
+ *
+ * @param huart UART handle, size Bytes the DMA has written into rx[]
+ * @return None
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t size)
+{
+	if (huart != &huart2)
+		return;
+
+	idle_position = (size < MODBUS_RX_BYTES) ? size : 0;
+	__HAL_TIM_SET_COUNTER(&htim17, 0);
+	__HAL_TIM_ENABLE(&htim17);		//one pulse, stops itself after MODBUS_TIMER_US
+}
+#endif
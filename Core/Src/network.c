@@ -0,0 +1,386 @@
+/**
+ * @file network.c
+ * @author Auska Wang
+ * @brief Node of a multi-drop RS-485 network on USART2, sending its readings in the time
+ *        slot a concentrator assigns, without collisions and without being polled.
+ *
+ *        The concentrator sends a beacon every period: the cycle number, the slot length
+ *        and the address owning each slot (network.h). A node finds its own slot and
+ *        sends one reading frame in it; a node the table does not list asks for a slot
+ *        with a join frame in an open one, now and then so joining nodes rarely collide.
+ *        The transceiver's driver enable is the USART's DE output on PA1, raised by the
+ *        hardware around each transmission, so the bus is released right after the stop
+ *        bit.
+ *
+ *        Reception is by circular DMA as for the console. The idle line interrupt records
+ *        the cycle count, so the end of a beacon is known to a few us whenever
+ *        network_task() gets to it; slot times are counted from there. network_task()
+ *        decodes the frames, builds the reading and starts TIM17 (10 us ticks, one pulse)
+ *        for the slot; its interrupt only queues the prepared frame on the transmit ring.
+ *        The beacon's lead must cover the longest main loop pass (max_handling_us);
+ *        a beacon handled later than that skips its slot instead of colliding.
+ *
+ *        Clocks: the HSI is only trimmed to about 1 %, which over 100 ms is a whole slot.
+ *        The node measures each beacon period in its own cycles and scales slot times
+ *        by it, so only the drift from one period to the next is left, and transmits in
+ *        the middle of its slot. A period that differs from the last one by more than
+ *        a quarter of the slot's spare time means a late interrupt (a flash erase stalls
+ *        the CPU) or a lost beacon; slots are skipped until two periods agree again.
+ */
+
+/* Includes */
+#include <string.h>
+#include "network.h"
+#include "general.h"
+#include "telemetry.h"
+#include "uart_tx.h"
+#include "lcd_data_display.h"
+#include "alarm.h"
+
+/* Defines */
+#if NETWORK && (TELEMETRY || CONSOLE || MODBUS || DIAG_PRINT)
+#error "USART2 carries one protocol, set TELEMETRY, CONSOLE, MODBUS and DIAG_PRINT to 0 for NETWORK"
+#endif
+#if NETWORK_ADDRESS < 1 || NETWORK_ADDRESS > 255
+#error "NETWORK_ADDRESS must be 1 to 255, 0 marks an open slot"
+#endif
+
+#define CYCLES_PER_US 48
+#define CYCLES_PER_TICK 480			//TIM17 tick, 10 us
+#define CLOCK_TOLERANCE 50			//1 / 50: 2 %, worse than the HSI ever is
+
+/* Variables */
+extern UART_HandleTypeDef huart2;
+extern TIM_HandleTypeDef htim17;
+
+Network_Stats network_stats;
+
+static uint8_t rx[NETWORK_RX_BYTES];
+static volatile uint16_t event_position = 0;	//DMA position at the last reception event
+static volatile uint32_t event_cycles;			//cycle count of that event
+static uint16_t rx_tail = 0;					//parsed up to here
+
+static uint8_t frame[TELEMETRY_FRAME_BYTES];	//received frame, up to its delimiter
+static uint16_t frame_length = 0;
+static uint8_t overlong = 0;					//frame dropped, waiting for its delimiter
+
+static uint8_t tx[TELEMETRY_FRAME_BYTES];		//frame for the armed slot
+static volatile uint16_t tx_length = 0;			//0 once sent, the next slot may be armed
+static uint8_t tx_join = 0;						//tx[] holds a join request
+
+static uint8_t synced = 0;						//the last two periods agree, slots may be used
+static uint8_t have_last = 0;					//the previous beacon's end is known
+static uint8_t have_period = 0;					//period_cycles is plausible
+static uint16_t last_cycle;
+static uint32_t last_start;						//cycle count of the previous beacon's end
+static uint32_t last_period_us;					//period the previous beacon announced
+static uint32_t period_cycles;					//last period measured, in local cycles
+static uint32_t scale_us;						//the same period in the concentrator's us
+static uint32_t join_seed = NETWORK_ADDRESS;
+
+/**
+ * @brief Reads a little endian half word.
+ *
+ * @param bytes 2 bytes
+ * @return Value
+ */
+static uint16_t get16(const uint8_t* bytes)
+{
+	return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+/**
+ * @brief Stores a little endian half word.
+ *
+ * @param bytes 2 bytes, value Value
+ * @return None
+ */
+static void put16(uint8_t* bytes, uint16_t value)
+{
+	bytes[0] = (uint8_t)value;
+	bytes[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Reads a beacon and finds this node's slot in it. No hardware involved, so beacons
+ *        can be checked on a host.
+ *
+ * @param payload Decoded beacon, length Payload bytes, address Node address,
+ *        schedule Filled in
+ * @return 1 if a valid beacon whose slots fit its period, 0 otherwise
+ */
+uint8_t network_schedule(const uint8_t* payload, uint8_t length, uint8_t address, Network_Schedule* schedule)
+{
+	if (length < NETWORK_BEACON_BYTES || payload[0] != NETWORK_FRAME_BEACON)
+		return 0;
+
+	schedule->cycle = get16(&payload[1]);
+	schedule->period_us = get16(&payload[3]) | ((uint32_t)get16(&payload[5]) << 16);
+	schedule->lead_us = get16(&payload[7]);
+	schedule->slot_us = get16(&payload[9]);
+	schedule->slots = payload[11];
+	schedule->slot = -1;
+	schedule->open_slot = -1;
+
+	if (schedule->slots > NETWORK_MAX_SLOTS || length != NETWORK_BEACON_BYTES + schedule->slots
+		|| schedule->slot_us < NETWORK_READING_US || schedule->period_us > NETWORK_MAX_PERIOD_US
+		|| schedule->lead_us + (uint32_t)schedule->slots * schedule->slot_us > schedule->period_us)
+		return 0;
+
+	for (uint8_t i = 0; i < schedule->slots; i++)
+	{
+		uint8_t owner = payload[NETWORK_BEACON_BYTES + i];
+
+		if (owner == address && schedule->slot < 0)
+			schedule->slot = i;
+		else if (owner == 0 && schedule->open_slot < 0)
+			schedule->open_slot = i;
+	}
+	return 1;
+}
+
+/**
+ * @brief Builds the frame for the slot: the latest reading, or a join request.
+ *
+ * @param schedule Beacon being answered, join 1 for a join request, age_ms Age of the
+ *        reading at the slot
+ * @return None
+ */
+static void prepare(const Network_Schedule* schedule, uint8_t join, uint32_t age_ms)
+{
+	uint8_t payload[NETWORK_READING_BYTES];
+	int16_t values[2];
+	uint8_t status = 0;
+
+	payload[1] = NETWORK_ADDRESS;
+	if (join)
+	{
+		payload[0] = NETWORK_FRAME_JOIN;
+		tx_join = 1;
+		tx_length = telemetry_encode(payload, 2, tx);
+		return;
+	}
+
+	if (display_reading(values))
+		status |= NETWORK_STATUS_READING;
+	if (alarm_latched())
+		status |= NETWORK_STATUS_ALARM_LATCHED;
+	if (alarm_near())
+		status |= NETWORK_STATUS_ALARM_NEAR;
+
+	payload[0] = NETWORK_FRAME_READING;
+	put16(&payload[2], schedule->cycle);
+	put16(&payload[4], (uint16_t)(age_ms > 0xFFFF ? 0xFFFF : age_ms));
+	put16(&payload[6], (uint16_t)values[0]);
+	put16(&payload[8], (uint16_t)values[1]);
+	payload[10] = status;
+	tx_join = 0;
+	tx_length = telemetry_encode(payload, NETWORK_READING_BYTES, tx);
+}
+
+/**
+ * @brief Checks a beacon's timing against the previous one and arms TIM17 for this node's
+ *        slot, or an open one to join. Slots are only used once two consecutive periods
+ *        agree, so one late timestamp never sets the scale.
+ *
+ * @param schedule Decoded beacon, end Cycle count of its last byte
+ * @return None
+ */
+static void follow_beacon(const Network_Schedule* schedule, uint32_t end)
+{
+	uint32_t nominal = last_period_us * CYCLES_PER_US;
+	uint32_t measured = end - last_start;
+	uint32_t spare = (uint32_t)(schedule->slot_us - NETWORK_READING_US) / 2;	//each side of the frame
+	uint8_t plausible = have_last && schedule->cycle == (uint16_t)(last_cycle + 1)
+		&& measured > nominal - nominal / CLOCK_TOLERANCE && measured < nominal + nominal / CLOCK_TOLERANCE;
+	int32_t change = (int32_t)(measured - period_cycles);
+
+	synced = plausible && have_period && (change < 0 ? -change : change) <= (int32_t)(spare * CYCLES_PER_US / 2);
+	if (synced)
+		network_stats.clock_ppm = (int32_t)(((int64_t)measured - nominal) * 1000000 / nominal);
+	have_period = plausible;
+	period_cycles = measured;
+	scale_us = last_period_us;
+	have_last = 1;
+	last_cycle = schedule->cycle;
+	last_start = end;
+	last_period_us = schedule->period_us;
+
+	int16_t slot = schedule->slot;
+	uint8_t join = 0;
+
+	if (slot < 0)
+	{
+		join_seed = join_seed * 1103515245U + 12345U;
+		if (schedule->open_slot < 0 || (join_seed >> 16) % NETWORK_JOIN_CHANCE != 0)
+			return;
+		slot = schedule->open_slot;
+		join = 1;
+	}
+	if (!synced)
+	{
+		network_stats.unsynced++;
+		return;
+	}
+
+	//middle of the slot, in local cycles
+	uint32_t offset_us = schedule->lead_us + (uint32_t)slot * schedule->slot_us + spare;
+	uint32_t offset = (uint32_t)((uint64_t)offset_us * period_cycles / scale_us);
+	uint32_t now = get_cycle_count();
+	int32_t remaining = (int32_t)(end + offset - now);
+
+	if ((now - end) / CYCLES_PER_US > network_stats.max_handling_us)
+		network_stats.max_handling_us = (now - end) / CYCLES_PER_US;
+	if (tx_length || remaining < (int32_t)(NETWORK_MIN_LEAD_US * CYCLES_PER_US) || remaining / CYCLES_PER_TICK > 0xFFFF)
+	{
+		network_stats.late++;
+		return;
+	}
+
+	prepare(schedule, join, HAL_GetTick() - display_reading_ms() + (uint32_t)remaining / (CYCLES_PER_US * 1000));
+	__HAL_TIM_SET_AUTORELOAD(&htim17, remaining / CYCLES_PER_TICK - 1);
+	__HAL_TIM_SET_COUNTER(&htim17, 0);
+	__HAL_TIM_ENABLE(&htim17);		//one pulse, network_slot_elapsed() sends the frame
+}
+
+/**
+ * @brief Handles a frame ended by a delimiter. Only beacons concern a node.
+ *
+ * @param timed 1 if the frame was the last bytes before the reception event,
+ *        end Cycle count of that event
+ * @return None
+ */
+static void frame_received(uint8_t timed, uint32_t end)
+{
+	Network_Schedule schedule;
+	uint8_t length = telemetry_decode(frame, frame_length);
+
+	if (length == 0)
+	{
+		network_stats.bad_frames++;
+		return;
+	}
+	network_stats.frames++;
+	if (!network_schedule(frame, length, NETWORK_ADDRESS, &schedule))
+		return;
+
+	network_stats.beacons++;
+	if (!timed)
+	{
+		have_last = 0;		//more bytes came before the idle line, the beacon's end is unknown
+		network_stats.unsynced++;
+		return;
+	}
+	follow_beacon(&schedule, end - NETWORK_CHAR_US * CYCLES_PER_US);	//the idle line came a character after the last byte
+}
+
+/**
+ * @brief Starts the circular reception from the start of rx[].
+ *
+ * @param None
+ * @return None
+ */
+static void start_reception(void)
+{
+	event_position = 0;
+	rx_tail = 0;
+	frame_length = 0;
+	overlong = 0;
+	HAL_UARTEx_ReceiveToIdle_DMA(&huart2, rx, NETWORK_RX_BYTES);	//retried by network_task() if refused
+}
+
+/**
+ * @brief Starts listening for beacons. Called once USART2 is initialized.
+ *
+ * @param None
+ * @return None
+ */
+void network_init(void)
+{
+	start_reception();
+}
+
+/**
+ * @brief Splits the bytes received up to the last event into frames and follows the
+ *        beacons among them. Called from the main loop.
+ *
+ * @param None
+ * @return None
+ */
+void network_task(void)
+{
+	if (huart2.RxState == HAL_UART_STATE_READY)		//stopped by an overrun or framing error
+	{
+		network_stats.rx_restarts++;
+		have_last = 0;
+		start_reception();
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint16_t head = event_position;
+	uint32_t cycles = event_cycles;
+	__set_PRIMASK(primask);
+
+	while (rx_tail != head)
+	{
+		uint8_t byte = rx[rx_tail];
+
+		rx_tail = (rx_tail + 1) % NETWORK_RX_BYTES;
+		if (byte != 0x00)
+		{
+			if (frame_length < sizeof(frame))
+				frame[frame_length++] = byte;
+			else
+				overlong = 1;
+			continue;
+		}
+
+		if (frame_length > 0 && !overlong)
+			frame_received(rx_tail == head, cycles);
+		else if (overlong)
+			network_stats.bad_frames++;
+		frame_length = 0;
+		overlong = 0;
+	}
+}
+
+/**
+ * @brief Called from the TIM17 interrupt at the middle of the armed slot. Sends its frame.
+ *
+ * @param None
+ * @return None
+ */
+void network_slot_elapsed(void)
+{
+	if (tx_length == 0)
+		return;
+
+	if (uart_tx_write(tx, tx_length))
+	{
+		if (tx_join)
+			network_stats.joins++;
+		else
+			network_stats.sent++;
+	}
+	tx_length = 0;
+}
+
+#if NETWORK
+/**
+ * @brief HAL callback, the line went idle or the DMA passed half or all of rx[]. Records
+ *        when, the end of a beacon for the slot times.
+ *
+ * @param huart UART handle, size Bytes the DMA has written into rx[]
+ * @return None
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t size)
+{
+	if (huart != &huart2)
+		return;
+
+	event_cycles = get_cycle_count();
+	event_position = (size < NETWORK_RX_BYTES) ? size : 0;
+}
+#endif
@@ -0,0 +1,324 @@
+/**
+ * @file packed_history.c
+ * @author Auska Wang
+ * @brief Compressed history of every sample, in a ring of delta encoded blocks.
+ *
+ *        Readings change by a tenth or two between samples and the interval is set by
+ *        TIM14, so a sample is stored as the change from the one before: the change
+ *        of the interval and of each channel, zigzag mapped so small negative numbers
+ *        stay small, each written as a varint of 7 bits per byte. A typical sample
+ *        takes 3 bytes instead of the 8 of a tick and two int16_t.
+ *
+ *        Each block restarts from a full sample, so decoding can begin at any block.
+ *        Block start times are in increasing order around the ring and serve as the
+ *        index: a seek is a binary search over the blocks and a decode of at most one
+ *        block. When the ring is full the oldest block is overwritten.
+ */
+
+/* Includes */
+#include <string.h>
+#include "packed_history.h"
+#include "general.h"
+#include "config.h"
+
+/* Defines */
+#define MAX_VARINT_BYTES 5			//32 bits at 7 per byte
+#define MAX_SAMPLE_BYTES (MAX_VARINT_BYTES * (1 + HISTORY_CHANNELS))
+#define MAX_BLOCK_SAMPLES 255		//count is a uint8_t
+
+/* Variables */
+Packed_History_Stats packed_history_stats;
+
+static Packed_Block blocks[PACKED_HISTORY_BLOCKS];
+static uint8_t first_block = 0;		//oldest block
+static uint8_t block_count = 0;		//blocks in use, the last one is being filled
+static uint32_t last_time_ms;		//encoder state, the last sample added
+static uint32_t last_interval_ms;
+static int16_t last_values[HISTORY_CHANNELS];
+
+_Static_assert(sizeof(Packed_Block) == PACKED_BLOCK_BYTES, "Packed_Block header is not packed");
+
+/**
+ * @brief Maps a signed number to an unsigned one, alternating 0, -1, 1, -2, ...
+ *
+ * @param n Signed number
+ * @return Zigzag mapped n
+ */
+static inline uint32_t zigzag_encode(int32_t n)
+{
+	return ((uint32_t)n << 1) ^ (uint32_t)(n >> 31);
+}
+
+/**
+ * @brief Inverse of zigzag_encode().
+ *
+ * @param n Zigzag mapped number
+ * @return Signed number
+ */
+static inline int32_t zigzag_decode(uint32_t n)
+{
+	return (int32_t)(n >> 1) ^ -(int32_t)(n & 1);
+}
+
+/**
+ * @brief Writes a number 7 bits per byte, low bits first, the top bit set on all but the last byte.
+ *
+ * @param buffer Output, n Number
+ * @return Bytes written
+ */
+static uint8_t varint_write(uint8_t* buffer, uint32_t n)
+{
+	uint8_t length = 0;
+
+	while (n >= 0x80)
+	{
+		buffer[length++] = (uint8_t)n | 0x80;
+		n >>= 7;
+	}
+	buffer[length++] = (uint8_t)n;
+	return length;
+}
+
+/**
+ * @brief Reads a number written by varint_write().
+ *
+ * @param buffer Input, offset Position, advanced past the number
+ * @return Number
+ */
+static uint32_t varint_read(const uint8_t* buffer, uint8_t* offset)
+{
+	uint32_t n = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+
+	do
+	{
+		byte = buffer[(*offset)++];
+		n |= (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return n;
+}
+
+/**
+ * @brief Ring position of the n-th block in use, 0 being the oldest.
+ *
+ * @param n Block in time order
+ * @return Ring position
+ */
+static inline uint8_t block_at(uint8_t n)
+{
+	return (first_block + n) % PACKED_HISTORY_BLOCKS;
+}
+
+/**
+ * @brief Starts a new block holding the sample in full, dropping the oldest block when the ring is full.
+ *
+ * @param values Sample in tenths, now_ms Time of the sample
+ * @return None
+ */
+static void block_start(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms)
+{
+	Packed_Block* block;
+
+	if (block_count == PACKED_HISTORY_BLOCKS)
+	{
+		packed_history_stats.samples -= blocks[first_block].count;
+		first_block = block_at(1);
+		block_count--;
+	}
+
+	block = &blocks[block_at(block_count)];
+	block_count++;
+	block->start_ms = now_ms;
+	memcpy(block->base, values, sizeof(block->base));
+	block->count = 1;
+	block->used = 0;
+	last_interval_ms = 0;
+}
+
+/**
+ * @brief Empties the history.
+ *
+ * @return None
+ */
+void packed_history_clear(void)
+{
+	first_block = 0;
+	block_count = 0;
+	packed_history_stats.samples = 0;
+}
+
+/**
+ * @brief Appends a sample, encoded against the one before.
+ *
+ * @param values Sample of each channel in tenths, now_ms Time of the sample (HAL tick)
+ * @return None
+ */
+void packed_history_add(const int16_t values[HISTORY_CHANNELS], uint32_t now_ms)
+{
+	uint32_t start = get_cycle_count();
+	Packed_Block* block = &blocks[block_at(block_count - 1)];
+	uint8_t encoded[MAX_SAMPLE_BYTES];
+	uint8_t length = 0;
+	uint32_t interval_ms = now_ms - last_time_ms;
+
+	if (block_count)
+	{
+		length += varint_write(&encoded[length], zigzag_encode((int32_t)(interval_ms - last_interval_ms)));
+		for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+			length += varint_write(&encoded[length], zigzag_encode(values[ch] - last_values[ch]));
+	}
+
+	if (block_count && block->count < MAX_BLOCK_SAMPLES && block->used + length <= PACKED_BLOCK_PAYLOAD)
+	{
+		memcpy(&block->data[block->used], encoded, length);
+		block->used += length;
+		block->count++;
+		last_interval_ms = interval_ms;
+	}
+	else
+		block_start(values, now_ms);
+
+	last_time_ms = now_ms;
+	memcpy(last_values, values, sizeof(last_values));
+	packed_history_stats.samples++;
+
+	packed_history_stats.last_encode_cycles = get_cycle_count() - start;
+	if (packed_history_stats.last_encode_cycles > packed_history_stats.max_encode_cycles)
+		packed_history_stats.max_encode_cycles = packed_history_stats.last_encode_cycles;
+}
+
+/**
+ * @brief Points a cursor at the start of the n-th block in use.
+ *
+ * @param cursor Cursor, n Block in time order, below block_count
+ * @return None
+ */
+static void cursor_at_block(Packed_Cursor* cursor, uint8_t n)
+{
+	cursor->block = block_at(n);
+	cursor->blocks_left = block_count - 1 - n;
+	cursor->index = 0;
+	cursor->offset = 0;
+}
+
+/**
+ * @brief Returns the sample under a cursor and advances it. A cursor at the end of the
+ *        history picks up samples added later; it is invalid once its block is overwritten.
+ *
+ * @param cursor Cursor from packed_history_seek(), time_ms/values Filled with the sample
+ * @return 1 if a sample was returned, 0 at the end of the history
+ */
+uint8_t packed_history_next(Packed_Cursor* cursor, uint32_t* time_ms, int16_t values[HISTORY_CHANNELS])
+{
+	const Packed_Block* block = &blocks[cursor->block];
+
+	while (cursor->index >= block->count)
+	{
+		if (cursor->blocks_left == 0)
+			return 0;
+		cursor->blocks_left--;
+		cursor->block = (cursor->block + 1) % PACKED_HISTORY_BLOCKS;
+		cursor->index = 0;
+		cursor->offset = 0;
+		block = &blocks[cursor->block];
+	}
+
+	if (cursor->index == 0)
+	{
+		cursor->time_ms = block->start_ms;
+		cursor->interval_ms = 0;
+		memcpy(cursor->values, block->base, sizeof(cursor->values));
+	}
+	else
+	{
+		cursor->interval_ms += zigzag_decode(varint_read(block->data, &cursor->offset));
+		cursor->time_ms += cursor->interval_ms;
+		for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+			cursor->values[ch] += zigzag_decode(varint_read(block->data, &cursor->offset));
+	}
+	cursor->index++;
+
+	*time_ms = cursor->time_ms;
+	memcpy(values, cursor->values, sizeof(cursor->values));
+	return 1;
+}
+
+/**
+ * @brief Positions a cursor on the first sample at or after a time. Finds the block by
+ *        binary search over the block start times, then decodes within it.
+ *
+ * @param cursor Cursor to set, from_ms HAL tick to start at
+ * @return 1 if a sample at or after from_ms exists, 0 otherwise
+ */
+uint8_t packed_history_seek(Packed_Cursor* cursor, uint32_t from_ms)
+{
+	uint8_t low = 0, high;
+	Packed_Cursor probe;
+	uint32_t time_ms;
+	int16_t values[HISTORY_CHANNELS];
+
+	if (block_count == 0)
+		return 0;
+
+	high = block_count - 1;
+	while (low < high)		//last block starting at or before from_ms, else the oldest
+	{
+		uint8_t middle = (low + high + 1) / 2;
+
+		if ((int32_t)(blocks[block_at(middle)].start_ms - from_ms) <= 0)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	cursor_at_block(cursor, low);
+
+	for (probe = *cursor; packed_history_next(&probe, &time_ms, values); *cursor = probe)
+	{
+		if ((int32_t)(time_ms - from_ms) >= 0)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Time of the oldest sample held, where a full read starts.
+ *
+ * @param time_ms Filled with the HAL tick of the oldest sample
+ * @return 1 if a sample is held, 0 if the history is empty
+ */
+uint8_t packed_history_oldest(uint32_t* time_ms)
+{
+	if (block_count == 0)
+		return 0;
+	*time_ms = blocks[first_block].start_ms;
+	return 1;
+}
+
+/**
+ * @brief Refreshes the density figures of packed_history_stats and times a decode of
+ *        the whole history. Takes a few ms with full blocks, run it from diagnostics only.
+ *
+ * @return None
+ */
+void packed_history_report(void)
+{
+	Packed_Cursor cursor;
+	uint32_t time_ms;
+	int16_t values[HISTORY_CHANNELS];
+	uint32_t decoded = 0;
+	uint32_t start;
+
+	packed_history_stats.bytes = block_count * sizeof(Packed_Block);
+	packed_history_stats.samples_per_kb = packed_history_stats.bytes ?
+			packed_history_stats.samples * 1024 / packed_history_stats.bytes : 0;
+
+	if (block_count == 0)
+		return;
+	start = get_cycle_count();
+	cursor_at_block(&cursor, 0);
+	while (packed_history_next(&cursor, &time_ms, values))
+		decoded++;
+	packed_history_stats.decode_cycles_per_sample = (get_cycle_count() - start) / decoded;
+}
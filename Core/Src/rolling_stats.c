@@ -0,0 +1,359 @@
+/**
+ * @file rolling_stats.c
+ * @author Auska Wang
+ * @brief Incremental min, max, mean and standard deviation over sliding windows.
+ *
+ *        The samples live in the tiers of history.c: a ring of raw samples covering the
+ *        last minute, a ring of closed minute buckets and a ring of closed hour buckets.
+ *        This module observes the rings. For every tier it keeps running sums that are
+ *        adjusted as entries enter and leave, and a pair of monotonic deques per channel
+ *        holding ring positions whose minimum / maximum is still reachable, so the
+ *        window extremes are the deque fronts.
+ *
+ *        Sums are exact integers of tenths and squared tenths instead of Welford's
+ *        running mean: a sliding window has to remove samples again, which integer
+ *        sums do without drift. A day of samples fits an int32 sum and a uint64 sum of
+ *        squares. Every update is O(1) amortized; the divisions and square root needed
+ *        for mean and deviation only run when a window is queried.
+ */
+
+/* Includes */
+#include <string.h>
+#include "rolling_stats.h"
+#include "general.h"
+
+/**
+ * @brief Ring positions, oldest first, whose value is a candidate minimum (or maximum).
+ */
+typedef struct {
+	uint8_t* positions;		//capacity of the ring it indexes
+	uint8_t head;
+	uint8_t length;
+} Mono_Deque;
+
+/**
+ * @brief Running totals of a tier's ring, and the deques over it.
+ */
+typedef struct {
+	uint8_t capacity;
+	uint32_t count;			//samples in all held entries
+	int32_t sum[STATS_CHANNELS];
+	uint64_t sum_squares[STATS_CHANNELS];
+	Mono_Deque min_deque[STATS_CHANNELS];
+	Mono_Deque max_deque[STATS_CHANNELS];
+} Stats_Tier;
+
+/* Variables */
+Rolling_Stats_Cost rolling_stats_cost;
+
+static uint8_t raw_deque_positions[STATS_CHANNELS][2][HISTORY_RAW_SAMPLES];
+static uint8_t minute_deque_positions[STATS_CHANNELS][2][HISTORY_MINUTES];
+static uint8_t hour_deque_positions[STATS_CHANNELS][2][HISTORY_HOURS];
+static Stats_Tier tiers[HISTORY_TIERS];
+
+/**
+ * @brief Appends a position, first dropping the entries it makes unreachable.
+ *
+ * @param d Deque, capacity Ring size, values Value of position 0, stride Distance
+ *        between positions in int16_t, position New entry, is_max 1 for a max deque
+ * @return None
+ */
+static void deque_push(Mono_Deque* d, uint8_t capacity, const int16_t* values, uint8_t stride, uint8_t position, uint8_t is_max)
+{
+	int16_t value = values[position * stride];
+
+	while (d->length)
+	{
+		uint8_t back = d->positions[(d->head + d->length - 1) % capacity];
+		int16_t back_value = values[back * stride];
+
+		if (is_max ? back_value > value : back_value < value)
+			break;
+		d->length--;
+	}
+	d->positions[(d->head + d->length) % capacity] = position;
+	d->length++;
+}
+
+/**
+ * @brief Drops the front if it is the ring position leaving the window.
+ *
+ * @param d Deque, capacity Ring size, position Oldest ring entry, being removed
+ * @return None
+ */
+static void deque_expire(Mono_Deque* d, uint8_t capacity, uint8_t position)
+{
+	if (d->length && d->positions[d->head] == position)
+	{
+		d->head = (d->head + 1) % capacity;
+		d->length--;
+	}
+}
+
+/**
+ * @brief Sets up a tier on its deque storage.
+ *
+ * @param tier Tier, positions Deque storage of STATS_CHANNELS * 2 * capacity,
+ *        capacity Entries in the history ring
+ * @return None
+ */
+static void tier_init(Stats_Tier* tier, uint8_t* positions, uint8_t capacity)
+{
+	memset(tier, 0, sizeof(*tier));
+	tier->capacity = capacity;
+	for (int ch = 0; ch < STATS_CHANNELS; ch++)
+	{
+		tier->min_deque[ch].positions = positions + (ch * 2) * capacity;
+		tier->max_deque[ch].positions = positions + (ch * 2 + 1) * capacity;
+	}
+}
+
+/**
+ * @brief Clears every tier, history_clear() emptied the rings.
+ *
+ * @return None
+ */
+static void history_cleared(void)
+{
+	tier_init(&tiers[HISTORY_RAW], &raw_deque_positions[0][0][0], HISTORY_RAW_SAMPLES);
+	tier_init(&tiers[HISTORY_MINUTE], &minute_deque_positions[0][0][0], HISTORY_MINUTES);
+	tier_init(&tiers[HISTORY_HOUR], &hour_deque_positions[0][0][0], HISTORY_HOURS);
+}
+
+/**
+ * @brief Adds a new ring entry to its tier's totals and deques.
+ *        Empty buckets keep the ring aligned with time but never enter the deques.
+ *
+ * @param tier History tier, position Ring position just written
+ * @return None
+ */
+static void history_entered(HISTORY_TIER tier, uint8_t position)
+{
+	const uint8_t stride = sizeof(History_Bucket) * STATS_CHANNELS / sizeof(int16_t);
+	Stats_Tier* t = &tiers[tier];
+
+	if (tier == HISTORY_RAW)
+	{
+		const int16_t* values = history_raw(position);
+
+		t->count++;
+		for (int ch = 0; ch < STATS_CHANNELS; ch++)
+		{
+			t->sum[ch] += values[ch];
+			t->sum_squares[ch] += (uint32_t)((int32_t)values[ch] * values[ch]);
+			deque_push(&t->min_deque[ch], t->capacity, history_raw(0) + ch, STATS_CHANNELS, position, 0);
+			deque_push(&t->max_deque[ch], t->capacity, history_raw(0) + ch, STATS_CHANNELS, position, 1);
+		}
+		return;
+	}
+
+	if (history_count(tier, position) == 0)
+		return;
+	t->count += history_count(tier, position);
+	for (int ch = 0; ch < STATS_CHANNELS; ch++)
+	{
+		const History_Bucket* bucket = &history_bucket(tier, position)[ch];
+
+		t->sum[ch] += bucket->sum;
+		t->sum_squares[ch] += bucket->sum_squares;
+		deque_push(&t->min_deque[ch], t->capacity, &history_bucket(tier, 0)[ch].min, stride, position, 0);
+		deque_push(&t->max_deque[ch], t->capacity, &history_bucket(tier, 0)[ch].max, stride, position, 1);
+	}
+}
+
+/**
+ * @brief Removes the oldest ring entry, about to be dropped, from its tier.
+ *
+ * @param tier History tier, position Oldest ring position
+ * @return None
+ */
+static void history_leaving(HISTORY_TIER tier, uint8_t position)
+{
+	Stats_Tier* t = &tiers[tier];
+
+	if (tier == HISTORY_RAW)
+	{
+		const int16_t* values = history_raw(position);
+
+		t->count--;
+		for (int ch = 0; ch < STATS_CHANNELS; ch++)
+		{
+			t->sum[ch] -= values[ch];
+			t->sum_squares[ch] -= (uint32_t)((int32_t)values[ch] * values[ch]);
+		}
+	}
+	else
+	{
+		if (history_count(tier, position) == 0)
+			return;
+		t->count -= history_count(tier, position);
+		for (int ch = 0; ch < STATS_CHANNELS; ch++)
+		{
+			t->sum[ch] -= history_bucket(tier, position)[ch].sum;
+			t->sum_squares[ch] -= history_bucket(tier, position)[ch].sum_squares;
+		}
+	}
+
+	for (int ch = 0; ch < STATS_CHANNELS; ch++)
+	{
+		deque_expire(&t->min_deque[ch], t->capacity, position);
+		deque_expire(&t->max_deque[ch], t->capacity, position);
+	}
+}
+
+static const History_Observer history_observer = {history_entered, history_leaving, history_cleared};
+
+/**
+ * @brief Starts following the history tiers. Call once before the first sample.
+ *
+ * @return None
+ */
+void rolling_stats_init(void)
+{
+	history_cleared();
+	history_set_observer(&history_observer);
+}
+
+/**
+ * @brief Clears every window, and the history they are computed over.
+ *
+ * @return None
+ */
+void rolling_stats_reset(void)
+{
+	history_clear();
+}
+
+/**
+ * @brief Adds a sample of every channel to the history, which updates every window.
+ *
+ * @param values Sample of each channel in tenths, now_ms Time of the sample (HAL tick)
+ * @return None
+ */
+void rolling_stats_add(const int16_t values[STATS_CHANNELS], uint32_t now_ms)
+{
+	uint32_t start = get_cycle_count();
+
+	history_add(values, now_ms);
+
+	rolling_stats_cost.last_add_cycles = get_cycle_count() - start;
+	if (rolling_stats_cost.last_add_cycles > rolling_stats_cost.max_add_cycles)
+		rolling_stats_cost.max_add_cycles = rolling_stats_cost.last_add_cycles;
+}
+
+/**
+ * @brief Integer square root.
+ *
+ * @param n Radicand
+ * @return floor(sqrt(n))
+ */
+static uint32_t isqrt(uint32_t n)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > n)
+		bit >>= 2;
+	while (bit)
+	{
+		if (n >= root + bit)
+		{
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return root;
+}
+
+/**
+ * @brief Widens a min/max pair with a bucket.
+ *
+ * @param min/max Pair so far, any 0 while the pair is unset, bucket_min/bucket_max Bucket extremes
+ * @return None
+ */
+static inline void extend(int16_t* min, int16_t* max, uint8_t* any, int16_t bucket_min, int16_t bucket_max)
+{
+	if (!*any || bucket_min < *min)
+		*min = bucket_min;
+	if (!*any || bucket_max > *max)
+		*max = bucket_max;
+	*any = 1;
+}
+
+/**
+ * @brief Statistics of a channel over a window.
+ *
+ * @param channel Channel, window Window, summary Filled in, in hundredths
+ * @return 1 if the window holds samples, 0 otherwise (summary untouched)
+ */
+uint8_t rolling_stats_get(STATS_CHANNEL channel, STATS_WINDOW window, Stats_Summary* summary)
+{
+	uint32_t start = get_cycle_count();
+	int64_t sum;
+	uint64_t sum_squares;
+	uint32_t count;
+	int16_t min = 0, max = 0;
+	uint8_t any = 0;
+	uint64_t spread;
+	int64_t rounded;
+
+	if (window == STATS_MINUTE)
+	{
+		Stats_Tier* t = &tiers[HISTORY_RAW];
+
+		if (t->count == 0)
+			return 0;
+		sum = t->sum[channel];
+		sum_squares = t->sum_squares[channel];
+		count = t->count;
+		min = history_raw(t->min_deque[channel].positions[t->min_deque[channel].head])[channel];
+		max = history_raw(t->max_deque[channel].positions[t->max_deque[channel].head])[channel];
+		any = 1;
+	}
+	else
+	{
+		HISTORY_TIER tier = (window == STATS_HOUR) ? HISTORY_MINUTE : HISTORY_HOUR;
+		Stats_Tier* t = &tiers[tier];
+		const History_Bucket* open;
+		uint16_t open_count;
+
+		sum = t->sum[channel];
+		sum_squares = t->sum_squares[channel];
+		count = t->count;
+		if (t->count)
+			extend(&min, &max, &any,
+					history_bucket(tier, t->min_deque[channel].positions[t->min_deque[channel].head])[channel].min,
+					history_bucket(tier, t->max_deque[channel].positions[t->max_deque[channel].head])[channel].max);
+
+		for (HISTORY_TIER open_tier = tier; open_tier >= HISTORY_MINUTE; open_tier--)	//open hour, then open minute
+		{
+			open = history_open(open_tier, &open_count);
+			if (open_count == 0)
+				continue;
+			sum += open[channel].sum;
+			sum_squares += open[channel].sum_squares;
+			count += open_count;
+			extend(&min, &max, &any, open[channel].min, open[channel].max);
+		}
+		if (!any)
+			return 0;
+	}
+
+	//variance * count^2 = count * sum_squares - sum^2, in tenths^2; * 100 for hundredths
+	spread = (uint64_t)count * sum_squares - (uint64_t)(sum * sum);
+	rounded = (sum * 20 + (sum < 0 ? -(int64_t)count : (int64_t)count)) / (2 * (int64_t)count);
+
+	summary->min = min * 10;
+	summary->max = max * 10;
+	summary->mean = (int32_t)rounded;
+	summary->stddev = isqrt((uint32_t)(spread * 100 / ((uint64_t)count * count)));
+	summary->count = count;
+
+	start = get_cycle_count() - start;
+	if (start > rolling_stats_cost.max_query_cycles)
+		rolling_stats_cost.max_query_cycles = start;
+	return 1;
+}
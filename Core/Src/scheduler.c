@@ -0,0 +1,112 @@
+/**
+ * @file scheduler.c
+ * @author Auska Wang
+ * @brief Adaptive sensor sampling: as fast as the DHT22 allows while the readings move or
+ *        an alarm threshold is near, slower while they are steady.
+ *
+ *        A frame that moved a channel by SCHEDULER_ACTIVE_DELTA or more since the previous
+ *        one, a failed read or a nearby alarm threshold return to the 2 s minimum and hold
+ *        it for SCHEDULER_FAST_HOLD frames. After that every steady frame doubles the
+ *        interval, up to SCHEDULER_SLOW_S, so about a minute after the room settles it
+ *        is read every SCHEDULER_SLOW_S, and a change is seen at most that late.
+ *        scheduler_set_fixed() replaces the adaptation with a fixed interval.
+ */
+
+/* Includes */
+#include "scheduler.h"
+#include "general.h"
+#include "dht22.h"
+#include "history.h"
+#include "config.h"
+
+/* Defines */
+#define SLOW_INTERVAL_MS (SCHEDULER_SLOW_S * 1000U)
+
+#if SCHEDULER_SLOW_S * 1000U < DHT22_MIN_INTERVAL_MS || SCHEDULER_SLOW_S > 81
+#error "SCHEDULER_SLOW_S must be 2 to 81 s, the range of TIM14"
+#endif
+
+/* Variables */
+Scheduler_Stats scheduler_stats = {.interval_ms = DHT22_MIN_INTERVAL_MS};
+
+static int16_t previous[HISTORY_CHANNELS];
+static uint8_t have_previous = 0;
+static uint8_t fast_left = SCHEDULER_FAST_HOLD;		//frames left at the fastest rate
+static uint32_t last_ms;
+static uint32_t fixed_interval_ms = 0;			//set from the console, 0 while adaptive
+
+/**
+ * @brief Chooses the interval to the next sample after a sampling attempt and sets TIM14
+ *        to it. Called right after each attempt.
+ *
+ * @param sampled 1 if a frame was read and accepted, values Its HISTORY_CHANNELS values,
+ *        alarm_near 1 if a value is close to an alarm threshold, now_ms Time of the attempt
+ * @return None
+ */
+void scheduler_update(uint8_t sampled, const int16_t* values, uint8_t alarm_near, uint32_t now_ms)
+{
+	uint8_t active = !sampled || alarm_near || !have_previous;
+	uint32_t interval_ms = scheduler_stats.interval_ms;
+
+	if (scheduler_stats.frames > 0)
+		scheduler_stats.elapsed_ms += now_ms - last_ms;
+	last_ms = now_ms;
+	scheduler_stats.frames++;
+	if (interval_ms == DHT22_MIN_INTERVAL_MS)
+		scheduler_stats.fast_frames++;
+
+	if (sampled)
+	{
+		for (int ch = 0; ch < HISTORY_CHANNELS; ch++)
+		{
+			int32_t change = values[ch] - previous[ch];
+
+			if (change >= SCHEDULER_ACTIVE_DELTA || change <= -SCHEDULER_ACTIVE_DELTA)
+				active = 1;
+			previous[ch] = values[ch];
+		}
+		have_previous = 1;
+	}
+
+	if (active)
+		fast_left = SCHEDULER_FAST_HOLD;
+
+	if (fixed_interval_ms)
+		interval_ms = fixed_interval_ms;
+	else if (fast_left > 0)
+	{
+		fast_left--;
+		interval_ms = DHT22_MIN_INTERVAL_MS;
+	}
+	else
+		interval_ms = (interval_ms * 2 < SLOW_INTERVAL_MS) ? interval_ms * 2 : SLOW_INTERVAL_MS;
+
+	if (interval_ms != scheduler_stats.interval_ms)
+	{
+		sampling_set_interval(interval_ms);
+		scheduler_stats.interval_ms = interval_ms;
+	}
+}
+
+/**
+ * @brief Samples at a fixed interval instead of adapting it, from the next sample on.
+ *
+ * @param interval_ms Interval, DHT22_MIN_INTERVAL_MS to 81000, or 0 to adapt again
+ * @return None
+ */
+void scheduler_set_fixed(uint32_t interval_ms)
+{
+	fixed_interval_ms = interval_ms;
+	fast_left = SCHEDULER_FAST_HOLD;
+}
+
+/**
+ * @brief The fixed interval in use.
+ *
+ * @param None
+ * @return Interval set by scheduler_set_fixed(), 0 while adaptive
+ */
+uint32_t scheduler_fixed(void)
+{
+	return fixed_interval_ms;
+}
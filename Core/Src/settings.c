@@ -0,0 +1,315 @@
+/**
+ * @file settings.c
+ * @author Auska Wang
+ * @brief Settings kept across resets in the last two flash pages, emulating an EEPROM.
+ *
+ *        Every change appends a record of one double word, key and value, after the
+ *        last one in the active page; the newest record of a key wins. The values live
+ *        in RAM, so reads never touch flash. At boot a binary search finds the end of
+ *        the records (slots are only programmed in order) and one pass replays them,
+ *        under 0.2 ms for a full page.
+ *
+ *        The two pages take turns. Slot 0 of a page is a header record holding a
+ *        generation number; the valid page with the newest generation is active. When
+ *        the active page is full, the other one is erased, the current value of every
+ *        key is written into it from slot 1 on, and only then its header, which makes
+ *        it the active page; the old page is erased last. A reset at any point leaves
+ *        one complete page with a valid header, so the stored values are never lost.
+ *        Without a header on either page, the last page is read from slot 0, which is
+ *        where earlier firmware kept its single settings page.
+ *
+ *        Changes come from button presses, often several in a row, so they are only
+ *        written once SETTINGS_QUIET_MS passed without another change.
+ */
+
+/* Includes */
+#include <string.h>
+#include "settings.h"
+#include "general.h"
+#include "i2c_bus.h"
+
+/* Defines */
+#define RECORD_BYTES 8
+#define SLOTS (FLASH_PAGE_SIZE / RECORD_BYTES)	//256
+#define PAGES 2
+#define HEADER_KEY 0x8000U		//slot 0 of a page written by a compaction, value is the generation
+
+/**
+ * @brief One setting in flash, a double word. check covers key and value, so a
+ *        torn or foreign double word is ignored.
+ */
+typedef struct {
+	uint16_t key;
+	uint16_t check;
+	int32_t value;
+} Setting_Record;
+
+/* Variables */
+extern uint8_t _settings_start; /* Symbol defined in the linker script */
+
+Settings_Stats settings_stats;
+
+static const int32_t defaults[SETTINGS] = {
+	[SETTING_TEMP_UNITS] = 0,				//FAHRENHEIT
+	[SETTING_LIGHT_MODE] = 1,
+	[SETTING_ALARM_THRESHOLD(0) ... SETTING_ALARM_THRESHOLD(ALARM_RULES - 1)] = SETTING_UNSET	//alarm.c then uses its rules
+};	//calibration tables default to no points, calibration.c then uses its built-in tables
+
+static volatile int32_t values[SETTINGS];	//current values, set from the button interrupts
+static int32_t stored[SETTINGS];			//values the page holds
+static volatile uint32_t changed_ms;		//last settings_set() that changed a value
+static uint16_t next_slot;					//first erased slot of the active page, SLOTS when full
+static uint8_t active_page;					//page the records are appended to
+static uint32_t generation;					//header of the active page, 0 without one
+
+_Static_assert(sizeof(Setting_Record) == RECORD_BYTES, "Setting_Record is not a double word");
+
+/**
+ * @brief Check word of a record.
+ *
+ * @param key Key, value Value
+ * @return Check word
+ */
+static inline uint16_t record_check(uint16_t key, int32_t value)
+{
+	return ~(key + (uint16_t)value + (uint16_t)((uint32_t)value >> 16));
+}
+
+/**
+ * @brief A slot of a settings page, in place in flash.
+ *
+ * @param page Page, slot Slot
+ * @return Record, possibly erased or torn
+ */
+static inline const Setting_Record* slot_record(uint8_t page, uint16_t slot)
+{
+	return (const Setting_Record*)(&_settings_start + page * FLASH_PAGE_SIZE) + slot;
+}
+
+/**
+ * @brief Tells whether a slot was never programmed since the page was erased.
+ *
+ * @param page Page, slot Slot
+ * @return 1 if the double word reads all ones
+ */
+static inline uint8_t slot_erased(uint8_t page, uint16_t slot)
+{
+	const uint32_t* word = (const uint32_t*)slot_record(page, slot);
+
+	return word[0] == 0xFFFFFFFFU && word[1] == 0xFFFFFFFFU;
+}
+
+/**
+ * @brief Reads the header of a page.
+ *
+ * @param page Page, generation Set to the page's generation when it has a header
+ * @return 1 if slot 0 holds an intact header
+ */
+static uint8_t page_header(uint8_t page, uint32_t* generation)
+{
+	const Setting_Record* header = slot_record(page, 0);
+
+	if (header->key != HEADER_KEY || header->check != record_check(header->key, header->value))
+		return 0;
+	*generation = (uint32_t)header->value;
+	return 1;
+}
+
+/**
+ * @brief Loads the settings: defaults, then every record of the active page in order.
+ *
+ * @return None
+ */
+void settings_init(void)
+{
+	uint32_t start = get_cycle_count();
+	uint32_t generations[PAGES];
+	uint8_t valid[PAGES];
+	uint16_t low = 0, high = SLOTS;
+
+	for (uint8_t page = 0; page < PAGES; page++)
+		valid[page] = page_header(page, &generations[page]);
+
+	if (valid[0] && valid[1])	//reset before the old page was erased, the newer one is complete
+		active_page = (int32_t)(generations[1] - generations[0]) > 0;
+	else if (valid[0] || valid[1])
+		active_page = valid[1];
+	else
+		active_page = PAGES - 1;	//never compacted, or written by the single page firmware
+	generation = valid[active_page] ? generations[active_page] : 0;
+
+	while (low < high)
+	{
+		uint16_t middle = (low + high) / 2;
+
+		if (slot_erased(active_page, middle))
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	next_slot = low;
+
+	for (int key = 0; key < SETTINGS; key++)
+		values[key] = stored[key] = defaults[key];
+	for (uint16_t slot = 0; slot < next_slot; slot++)
+	{
+		const Setting_Record* record = slot_record(active_page, slot);
+
+		if (record->key < SETTINGS && record->check == record_check(record->key, record->value))
+			values[record->key] = stored[record->key] = record->value;
+	}
+
+	settings_stats.records = next_slot;
+	settings_stats.load_us = CYCLES_TO_US(get_cycle_count() - start);
+}
+
+/**
+ * @brief Current value of a setting, from RAM.
+ *
+ * @param key Setting
+ * @return Value
+ */
+int32_t settings_get(SETTING_KEY key)
+{
+	return values[key];
+}
+
+/**
+ * @brief Changes a setting. It is written to flash by settings_task() once the settings
+ *        stayed unchanged for SETTINGS_QUIET_MS. May be called from an interrupt.
+ *
+ * @param key Setting, value New value
+ * @return None
+ */
+void settings_set(SETTING_KEY key, int32_t value)
+{
+	if (values[key] == value)
+		return;
+	values[key] = value;
+	changed_ms = HAL_GetTick();
+}
+
+/**
+ * @brief Programs a record into a slot.
+ *
+ * @param page Page, slot Slot, key Key, value Value
+ * @return HAL_OK on success
+ */
+static HAL_StatusTypeDef program(uint8_t page, uint16_t slot, uint16_t key, int32_t value)
+{
+	Setting_Record record = {key, record_check(key, value), value};
+	uint64_t double_word;
+
+	memcpy(&double_word, &record, sizeof(double_word));
+	return HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, (uint32_t)slot_record(page, slot), double_word);
+}
+
+/**
+ * @brief Programs a record into the next slot of the active page.
+ *
+ * @param key Key, value Value
+ * @return HAL_OK on success
+ */
+static HAL_StatusTypeDef append(uint16_t key, int32_t value)
+{
+	HAL_StatusTypeDef status = program(active_page, next_slot, key, value);
+
+	next_slot++;	//a failed slot is never reused, it fails its check
+	if (status == HAL_OK)
+		stored[key] = value;
+	return status;
+}
+
+/**
+ * @brief Erases a settings page.
+ *
+ * @param page Page
+ * @return HAL_OK on success
+ */
+static HAL_StatusTypeDef erase_page(uint8_t page)
+{
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_PAGES,
+		.Page = ((uint32_t)&_settings_start - FLASH_BASE) / FLASH_PAGE_SIZE + page,
+		.NbPages = 1
+	};
+	uint32_t page_error;
+
+	return HAL_FLASHEx_Erase(&erase, &page_error);
+}
+
+/**
+ * @brief Copies the stored values into the other page, makes it the active page with
+ *        its header, then erases the full one. On failure the active page is kept.
+ *
+ * @return HAL_OK on success
+ */
+static HAL_StatusTypeDef compact(void)
+{
+	uint8_t spare = !active_page;
+	uint16_t slot = 1;		//slot 0 takes the header once the copy is complete
+
+	if (erase_page(spare) != HAL_OK)
+		return HAL_ERROR;
+	for (int key = 0; key < SETTINGS; key++)
+	{
+		if (stored[key] == defaults[key])
+			continue;
+		if (program(spare, slot++, key, stored[key]) != HAL_OK)
+			return HAL_ERROR;
+	}
+	if (program(spare, 0, HEADER_KEY, (int32_t)(generation + 1)) != HAL_OK)
+		return HAL_ERROR;
+
+	if (erase_page(active_page) != HAL_OK)
+		settings_stats.errors++;	//the newer generation still wins at boot, the old page is erased before its next use
+	active_page = spare;
+	generation++;
+	next_slot = slot;
+	settings_stats.compactions++;
+	return HAL_OK;
+}
+
+/**
+ * @brief Writes the changed settings once they stayed unchanged for SETTINGS_QUIET_MS.
+ *        Called from the main loop; waits for an idle I2C bus, programming stalls the CPU.
+ *
+ * @return None
+ */
+void settings_task(void)
+{
+	uint8_t unlocked = 0;
+	int32_t value;
+
+	if (HAL_GetTick() - changed_ms < SETTINGS_QUIET_MS || !i2c_bus_idle())
+		return;
+
+	for (int key = 0; key < SETTINGS; key++)
+	{
+		value = values[key];
+		if (value == stored[key])
+			continue;
+		if (!unlocked)
+		{
+			HAL_FLASH_Unlock();
+			unlocked = 1;
+		}
+		if (next_slot == SLOTS)
+		{
+			if (compact() != HAL_OK)
+			{
+				settings_stats.errors++;
+				break;
+			}
+			key--;		//the compacted page has room, append this key again
+			continue;
+		}
+		if (append(key, value) == HAL_OK)
+			settings_stats.writes++;
+		else
+			settings_stats.errors++;
+	}
+	if (unlocked)
+		HAL_FLASH_Lock();
+	settings_stats.records = next_slot;
+}
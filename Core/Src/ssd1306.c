@@ -0,0 +1,417 @@
+/**
+ * @file ssd1306.c
+ * @author Auska Wang
+ * @brief Driver for a 128x64 SSD1306 OLED on hi2c1.
+ *
+ *        Drawing only touches the 1 KB framebuffer. Every byte that actually changes widens
+ *        the dirty column range of its 8-row page, and ssd1306_flush() sends just those
+ *        windows: a command transaction setting the column/page window followed by a
+ *        transaction straight out of the framebuffer, both queued on the shared bus.
+ *        The next window is queued from the data transaction's callback, so a flush
+ *        never blocks the caller.
+ */
+
+/* Includes */
+#include <string.h>
+#include "ssd1306.h"
+#include "display.h"
+#include "font5x7.h"
+#include "general.h"
+#include "i2c_bus.h"
+
+/* Defines */
+#define SSD1306_ADDR (0x3C << 1)
+#define SSD1306_CONTROL_CMD 0x00		//control byte, command stream follows
+#define SSD1306_CONTROL_DATA 0x40		//control byte, GDDRAM data follows
+#define CELL_WIDTH (SSD1306_WIDTH / DISPLAY_COLUMNS)	//8 px per character cell
+#define TEXT_PAGE(row) (2 + (row) * 3)	//text rows on pages 2 and 5
+#define CONTRAST_LIGHT_ON 0xCF
+#define CONTRAST_LIGHT_OFF 0x10
+
+/**
+ * @brief Step of the flush state machine.
+ */
+typedef enum {
+	FLUSH_IDLE 		= 0,
+	FLUSH_WINDOW 	= 1,	//column/page window command queued or in flight
+	FLUSH_DATA 		= 2		//framebuffer bytes in flight
+} Flush_State;
+
+/* Variables */
+SSD1306_Stats ssd1306_stats;
+
+static uint8_t framebuffer[SSD1306_PAGES][SSD1306_WIDTH];
+static uint8_t user_glyphs[DISPLAY_GLYPHS][DISPLAY_GLYPH_WIDTH];	//column bytes, like the font
+static uint8_t dirty_start[SSD1306_PAGES];	//first dirty column, dirty_start >= dirty_end means clean
+static uint8_t dirty_end[SSD1306_PAGES];	//one past the last dirty column
+static uint8_t window_cmd[6];
+static volatile Flush_State flush_state = FLUSH_IDLE;
+static volatile uint8_t flush_requested = 0;
+static uint8_t flush_page;					//page currently being sent
+static uint8_t flush_start;
+static uint8_t flush_length;
+static uint16_t flush_bytes;
+static uint8_t contrast_cmd[2];
+static I2C_Transaction init_txn;
+static I2C_Transaction contrast_txn;
+static I2C_Transaction window_txn;
+static I2C_Transaction data_txn;
+static uint8_t device_registered = 0;
+
+static const uint8_t init_sequence[] = {
+	0xAE,			//display off
+	0xD5, 0x80,		//clock divide ratio
+	0xA8, 0x3F,		//multiplex ratio, 64 rows
+	0xD3, 0x00,		//display offset
+	0x40,			//start line 0
+	0x8D, 0x14,		//charge pump on
+	0x20, 0x00,		//horizontal addressing, windows wrap column then page
+	0xA1,			//segment remap
+	0xC8,			//COM scan direction remapped
+	0xDA, 0x12,		//COM pins configuration
+	0x81, CONTRAST_LIGHT_ON,
+	0xD9, 0xF1,		//pre-charge period
+	0xDB, 0x40,		//VCOMH deselect level
+	0xA4,			//display follows RAM
+	0xA6,			//normal, not inverted
+	0xAF			//display on
+};
+
+/**
+ * @brief Widens the dirty window of a page to include a column.
+ *
+ * @param page Page 0 - 7, x Column 0 - 127
+ * @return None
+ */
+static inline void mark_dirty(uint8_t page, uint8_t x)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();	//the flush callback clears windows from interrupt context
+
+	if (dirty_start[page] >= dirty_end[page])
+	{
+		dirty_start[page] = x;
+		dirty_end[page] = x + 1;
+	}
+	else if (x < dirty_start[page])
+		dirty_start[page] = x;
+	else if (x >= dirty_end[page])
+		dirty_end[page] = x + 1;
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Writes one framebuffer byte, marking it dirty only if it changes.
+ *
+ * @param page Page 0 - 7, x Column 0 - 127, value 8 vertical pixels, bit 0 on top
+ * @return None
+ */
+static inline void put_column(uint8_t page, uint8_t x, uint8_t value)
+{
+	if (framebuffer[page][x] != value)
+	{
+		framebuffer[page][x] = value;
+		mark_dirty(page, x);
+	}
+}
+
+/**
+ * @brief Starts the transfer of the next dirty page window, or finishes the flush.
+ *
+ * Called from thread context to start a flush and from the I2C completion callback
+ * to chain the following page. The dirty window is cleared when its transfer starts,
+ * so drawing during a flush simply marks it dirty again for the next one.
+ *
+ * @return None
+ */
+static void start_next_window(void)
+{
+	while (flush_page < SSD1306_PAGES && dirty_start[flush_page] >= dirty_end[flush_page])
+		flush_page++;
+
+	if (flush_page >= SSD1306_PAGES)
+	{
+		ssd1306_stats.flushes++;
+		ssd1306_stats.last_flush_bytes = flush_bytes;
+		flush_state = FLUSH_IDLE;
+		if (flush_requested)
+			ssd1306_flush();
+		return;
+	}
+
+	flush_start = dirty_start[flush_page];
+	flush_length = dirty_end[flush_page] - flush_start;
+	dirty_start[flush_page] = dirty_end[flush_page] = 0;
+
+	window_cmd[0] = 0x21;							//column address
+	window_cmd[1] = flush_start;
+	window_cmd[2] = flush_start + flush_length - 1;
+	window_cmd[3] = 0x22;							//page address
+	window_cmd[4] = flush_page;
+	window_cmd[5] = flush_page;
+
+	data_txn.data = &framebuffer[flush_page][flush_start];
+	data_txn.size = flush_length;
+
+	flush_state = FLUSH_WINDOW;
+	if (i2c_bus_submit(&window_txn) != HAL_OK || i2c_bus_submit(&data_txn) != HAL_OK)
+	{
+		mark_dirty(flush_page, flush_start);
+		mark_dirty(flush_page, flush_start + flush_length - 1);
+		flush_state = FLUSH_IDLE;
+	}
+}
+
+/**
+ * @brief Window transaction callback, the framebuffer bytes are next in the queue.
+ *
+ * @param t Finished transaction, error HAL_I2C_ERROR_NONE on success
+ * @return None
+ */
+static void window_done(I2C_Transaction* t, uint32_t error)
+{
+	if (error == HAL_I2C_ERROR_NONE && flush_state == FLUSH_WINDOW)
+		flush_state = FLUSH_DATA;
+}
+
+/**
+ * @brief Data transaction callback, chains the next window. On error the window is marked
+ *        dirty again; it is sent once the bus has recovered.
+ *
+ * @param t Finished transaction, error HAL_I2C_ERROR_NONE on success
+ * @return None
+ */
+static void data_done(I2C_Transaction* t, uint32_t error)
+{
+	if (error != HAL_I2C_ERROR_NONE)
+	{
+		mark_dirty(flush_page, flush_start);
+		mark_dirty(flush_page, flush_start + flush_length - 1);
+		flush_state = FLUSH_IDLE;
+		return;
+	}
+
+	ssd1306_stats.page_transfers++;
+	ssd1306_stats.bytes_sent += flush_length;
+	flush_bytes += flush_length;
+	flush_page++;
+	start_next_window();
+}
+
+/**
+ * @brief Registers the panel on the bus and fills in the fixed transaction fields.
+ *
+ * @return None
+ */
+static void register_device(void)
+{
+	I2C_Transaction* txns[] = {&init_txn, &contrast_txn, &window_txn, &data_txn};
+	uint8_t device = i2c_bus_register("oled");
+
+	for (int i = 0; i < 4; i++)
+	{
+		txns[i]->device = device;
+		txns[i]->address = SSD1306_ADDR;
+		txns[i]->op = I2C_OP_MEM_WRITE;
+		txns[i]->mem_address = SSD1306_CONTROL_CMD;
+		txns[i]->priority = I2C_PRIORITY_DISPLAY;
+	}
+	data_txn.mem_address = SSD1306_CONTROL_DATA;
+
+	init_txn.data = (uint8_t*)init_sequence;	//only read by the transfer
+	init_txn.size = sizeof(init_sequence);
+	contrast_txn.data = contrast_cmd;
+	contrast_txn.size = sizeof(contrast_cmd);
+	window_txn.data = window_cmd;
+	window_txn.size = sizeof(window_cmd);
+	window_txn.done = window_done;
+	data_txn.done = data_done;
+
+	device_registered = 1;
+}
+
+/**
+ * @brief Queues the init sequence and a full frame clearing the panel.
+ *
+ * @return None
+ */
+void ssd1306_init(void)
+{
+	if (!device_registered)
+		register_device();
+	i2c_bus_submit(&init_txn);	//a failure is recovered by the bus and the init replayed
+
+	//GDDRAM content is undefined after power up, send the whole frame once
+	memset(framebuffer, 0, sizeof(framebuffer));
+	for (int page = 0; page < SSD1306_PAGES; page++)
+	{
+		dirty_start[page] = 0;
+		dirty_end[page] = SSD1306_WIDTH;
+	}
+	ssd1306_flush();
+}
+
+/**
+ * @brief Clears the framebuffer, only pages that held pixels become dirty.
+ *
+ * @return None
+ */
+void ssd1306_clear(void)
+{
+	for (int page = 0; page < SSD1306_PAGES; page++)
+		for (int x = 0; x < SSD1306_WIDTH; x++)
+			put_column(page, x, 0);
+}
+
+/**
+ * @brief Draws a character into an 8 px wide cell.
+ *
+ * @param x Left column of the cell, page Page holding the cell, c Character
+ * @return None
+ */
+void ssd1306_draw_char(uint8_t x, uint8_t page, char c)
+{
+	const uint8_t* glyph;
+
+	if ((uint8_t)c >= (uint8_t)DISPLAY_GLYPH_CHAR(0) && (uint8_t)c < (uint8_t)DISPLAY_GLYPH_CHAR(DISPLAY_GLYPHS))
+		glyph = user_glyphs[c - DISPLAY_GLYPH_CHAR(0)];
+	else
+		glyph = font5x7_glyph(c);
+
+	if (x > SSD1306_WIDTH - CELL_WIDTH || page >= SSD1306_PAGES)
+		return;
+
+	put_column(page, x, 0);
+	for (int i = 0; i < FONT5X7_WIDTH; i++)
+		put_column(page, x + 1 + i, glyph[i]);
+	for (int i = 1 + FONT5X7_WIDTH; i < CELL_WIDTH; i++)
+		put_column(page, x + i, 0);
+}
+
+/**
+ * @brief Draws a string, padded with spaces to a number of cells.
+ *
+ * @param x Left column, page Page to draw on, str String, width Number of cells
+ * @return None
+ */
+void ssd1306_draw_string(uint8_t x, uint8_t page, const char* str, uint8_t width)
+{
+	uint8_t end_of_string = 0;
+
+	for (int i = 0; i < width; i++)
+	{
+		if (str[i] == '\0')
+			end_of_string = 1;
+		ssd1306_draw_char(x + i * CELL_WIDTH, page, end_of_string ? ' ' : str[i]);
+	}
+}
+
+/**
+ * @brief Starts sending all dirty windows. Returns immediately; if a flush is already
+ *        running, another one follows it.
+ *
+ * @return None
+ */
+void ssd1306_flush(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (flush_state != FLUSH_IDLE)
+	{
+		flush_requested = 1;
+		__set_PRIMASK(primask);
+		return;
+	}
+	flush_requested = 0;
+	flush_state = FLUSH_WINDOW;
+	__set_PRIMASK(primask);
+
+	flush_page = 0;
+	flush_bytes = 0;
+	start_next_window();
+}
+
+/**
+ * @brief Tells whether a flush is in progress.
+ *
+ * @return 1 if transfers are in flight, 0 otherwise
+ */
+uint8_t ssd1306_busy(void)
+{
+	return flush_state != FLUSH_IDLE;
+}
+
+/**
+ * @brief Queues a contrast change, behind the windows of a running flush.
+ *
+ * @param contrast 0 - 255
+ * @return None
+ */
+void ssd1306_set_contrast(uint8_t contrast)
+{
+	while (contrast_txn.pending && i2c_bus_online())	//previous change still queued
+		i2c_bus_run();
+
+	contrast_cmd[0] = 0x81;
+	contrast_cmd[1] = contrast;
+	i2c_bus_submit(&contrast_txn);
+}
+
+/**
+ * @brief Display backend init start, nothing to reset since the init is a single step.
+ *
+ * @return None
+ */
+static void ssd1306_init_start(void)
+{
+}
+
+/**
+ * @brief Display backend init, the panel needs no waits so it completes in one step.
+ *
+ * @return 1, the panel is ready
+ */
+static uint8_t ssd1306_init_step(void)
+{
+	ssd1306_init();
+	return 1;
+}
+
+/* Display backend -----------------------------------------------------------*/
+static void oled_write_line(uint8_t row, const char* text)
+{
+	ssd1306_draw_string(0, TEXT_PAGE(row), text, DISPLAY_COLUMNS);
+}
+
+static void oled_set_light(uint8_t light_mode)
+{
+	ssd1306_set_contrast(light_mode ? CONTRAST_LIGHT_ON : CONTRAST_LIGHT_OFF);
+}
+
+static void oled_write_glyph_rows(uint8_t glyph, uint8_t first_row, const uint8_t* rows, uint8_t count)
+{
+	//rows arrive HD44780 style (one byte per row, bit 4 = left pixel), the panel wants column bytes
+	for (int i = 0; i < count; i++)
+	{
+		uint8_t row_bit = 1 << (first_row + i);
+		for (int column = 0; column < DISPLAY_GLYPH_WIDTH; column++)
+		{
+			if (rows[i] & (1 << (DISPLAY_GLYPH_WIDTH - 1 - column)))
+				user_glyphs[glyph][column] |= row_bit;
+			else
+				user_glyphs[glyph][column] &= ~row_bit;
+		}
+	}
+}
+
+const Display_Driver display_oled = {
+	.init_start = ssd1306_init_start,
+	.init_step = ssd1306_init_step,
+	.clear = ssd1306_clear,
+	.write_line = oled_write_line,
+	.flush = ssd1306_flush,
+	.set_light = oled_set_light,
+	.write_glyph_rows = oled_write_glyph_rows
+};
@@ -22,6 +22,8 @@
 #include "general.h"
 #include "lcd_data_display.h"
 #include "stm32c0xx_it.h"
+#include "modbus.h"
+#include "network.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 /* USER CODE END Includes */
@@ -57,6 +59,13 @@
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
+extern DMA_HandleTypeDef hdma_i2c1_tx;
+extern DMA_HandleTypeDef hdma_i2c1_rx;
+extern I2C_HandleTypeDef hi2c1;
+extern DMA_HandleTypeDef hdma_usart2_tx;
+extern DMA_HandleTypeDef hdma_usart2_rx;
+extern UART_HandleTypeDef huart2;
+extern TIM_HandleTypeDef htim17;
 
 /* USER CODE BEGIN EV */
 
@@ -153,6 +162,67 @@ void TIM14_IRQHandler(void)
 /* For the available peripheral interrupt handler names,                      */
 /* please refer to the startup file (startup_stm32c0xx.s).                    */
 /******************************************************************************/
+/**
+  * @brief This function handles DMA1 channel 1 interrupt.
+  */
+void DMA1_Channel1_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_i2c1_tx);
+}
+
+/**
+  * @brief This function handles DMA1 channel 2 and channel 3 interrupts.
+  */
+void DMA1_Channel2_3_IRQHandler(void)
+{
+#if CONSOLE || MODBUS || NETWORK
+  HAL_DMA_IRQHandler(&hdma_usart2_rx);
+#else
+  HAL_DMA_IRQHandler(&hdma_i2c1_rx);
+#endif
+  if (hdma_usart2_tx.Instance != NULL)	//set up only with TELEMETRY
+    HAL_DMA_IRQHandler(&hdma_usart2_tx);
+}
+
+/**
+  * @brief This function handles USART2 interrupt.
+  */
+void USART2_IRQHandler(void)
+{
+#if TELEMETRY || CONSOLE || MODBUS || DIAG_PRINT || NETWORK	/* as MX_USART2_UART_Init(), without them the UART driver is left out */
+  HAL_UART_IRQHandler(&huart2);
+#endif
+}
+
+/**
+  * @brief This function handles TIM17 global interrupt, the end of a Modbus frame gap or
+  *        the network slot.
+  */
+void TIM17_IRQHandler(void)
+{
+  __HAL_TIM_CLEAR_IT(&htim17, TIM_IT_UPDATE);
+#if NETWORK
+  network_slot_elapsed();
+#else
+  modbus_gap_elapsed();
+#endif
+}
+
+/**
+  * @brief This function handles I2C1 interrupt.
+  */
+void I2C1_IRQHandler(void)
+{
+  if (hi2c1.Instance->ISR & (I2C_FLAG_BERR | I2C_FLAG_ARLO | I2C_FLAG_OVR))
+  {
+    HAL_I2C_ER_IRQHandler(&hi2c1);
+  }
+  else
+  {
+    HAL_I2C_EV_IRQHandler(&hi2c1);
+  }
+}
+
 /**
   * @brief This function handles EXTI line 2 to 3 interrupts.
   */
@@ -160,6 +230,13 @@ void EXTI2_3_IRQHandler(void)
 {
 	EXTI2_3_IRQHandler_Extended();
 }
+/**
+  * @brief This function handles EXTI line 0 to 1 interrupts.
+  */
+void EXTI0_1_IRQHandler(void)
+{
+	EXTI0_1_IRQHandler_Extended();
+}
 /**
   * @brief This function handles EXTI line 4 to 15 interrupts.
   */
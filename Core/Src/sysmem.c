@@ -23,6 +23,13 @@
 /* Includes */
 #include <errno.h>
 #include <stdint.h>
+#include "config.h"
+#include "mem_usage.h"
+
+/**
+ * Count of every heap request, see mem_usage.c
+ */
+Sbrk_Stats sbrk_stats;
 
 /**
  * Pointer to the current high watermark of the heap usage
@@ -47,6 +54,9 @@ static uint8_t *__sbrk_heap_end = NULL;
  * NOTE: If the MSP stack, at any point during execution, grows larger than the
  * reserved size, please increase the '_Min_Stack_Size'.
  *
+ * Every call is counted in sbrk_stats. With HEAP_FREE set every request is
+ * refused, the firmware is meant to run without a heap.
+ *
  * @param incr Memory size
  * @return Pointer to allocated memory
  */
@@ -59,6 +69,19 @@ void *_sbrk(ptrdiff_t incr)
   const uint8_t *max_heap = (uint8_t *)stack_limit;
   uint8_t *prev_heap_end;
 
+  if (0 == sbrk_stats.calls)
+  {
+    sbrk_stats.first_caller = __builtin_return_address(0);
+  }
+  sbrk_stats.calls++;
+
+#if HEAP_FREE
+  (void)max_heap;
+  sbrk_stats.refused++;
+  errno = ENOMEM;
+  return (void *)-1;
+#endif
+
   /* Initialize heap end at first call */
   if (NULL == __sbrk_heap_end)
   {
@@ -68,12 +91,14 @@ void *_sbrk(ptrdiff_t incr)
   /* Protect heap from growing into the reserved MSP stack */
   if (__sbrk_heap_end + incr > max_heap)
   {
+    sbrk_stats.refused++;
     errno = ENOMEM;
     return (void *)-1;
   }
 
   prev_heap_end = __sbrk_heap_end;
   __sbrk_heap_end += incr;
+  sbrk_stats.heap_bytes += incr;
 
   return (void *)prev_heap_end;
 }
@@ -0,0 +1,214 @@
+/**
+ * @file telemetry.c
+ * @author Auska Wang
+ * @brief Binary frames on USART2, the ST-Link virtual COM port.
+ *
+ *        A frame is its payload, a CRC-16/CCITT of the payload (little endian, from the
+ *        CRC unit), COBS encoded so the only zero byte is the 0x00 that ends it. A
+ *        receiver splits the stream at zeros, decodes and checks the CRC, and can join
+ *        at any point or lose bytes without losing sync.
+ *
+ *        Reading frame, 17 payload bytes, little endian:
+ *        type 0x01, sequence (2), time in ms (4), the 5 bytes from the DHT22,
+ *        temperature and humidity in tenths as displayed (2 + 2), status bits.
+ *        On the wire that is 21 bytes, 210 bit times: up to 4388 frames/s at 921600 baud.
+ *        The firmware sends one per sensor read, at most 0.5 per second, so the link is
+ *        nearly idle and carries the blocks of a log export between them (export.c).
+ *
+ *        Building a frame, about 400 cycles (8 us) for a reading, is the only CPU cost:
+ *        the bytes are moved by the DMA, with one interrupt per transfer. The frame is
+ *        COBS encoded in place, one byte behind its payload, so a frame needs one buffer.
+ *        Frames are queued whole or dropped and counted, never waited for.
+ *
+ *        With CONSOLE built in, reading frames start off, so a terminal opened on the port
+ *        shows the command replies only; "stream on" starts them.
+ */
+
+/* Includes */
+#include "telemetry.h"
+#include "general.h"
+#include "crc.h"
+#include "uart_tx.h"
+#include "config.h"
+
+/* Defines */
+#if TELEMETRY_MAX_PAYLOAD + 2 > 253
+#error "TELEMETRY_MAX_PAYLOAD must leave payload and CRC under 254 bytes, one COBS block"
+#endif
+
+/* Variables */
+Telemetry_Stats telemetry_stats;
+
+static uint16_t sequence = 0;
+static uint8_t streaming = !CONSOLE;	//reading frames sent; with a console, off until "stream on"
+
+/**
+ * @brief COBS encodes a block: every zero is replaced by the distance to the next one,
+ *        the first byte holds the distance to the first. Blocks under 254 bytes only.
+ *        out may be data - 1: byte i is read before out[i + 1] is written.
+ *
+ * @param data Bytes, length Number of bytes, out At least length + 1 bytes
+ * @return Encoded length
+ */
+static uint16_t cobs_encode(const uint8_t* data, uint16_t length, uint8_t* out)
+{
+	uint16_t code_index = 0, out_index = 1;
+	uint8_t code = 1;
+
+	for (uint16_t i = 0; i < length; i++)
+	{
+		if (data[i] == 0)
+		{
+			out[code_index] = code;
+			code_index = out_index++;
+			code = 1;
+		}
+		else
+		{
+			out[out_index++] = data[i];
+			code++;
+		}
+	}
+	out[code_index] = code;
+	return out_index;
+}
+
+/**
+ * @brief Builds a frame: payload, CRC, COBS and delimiter.
+ *
+ * @param payload Bytes, type first, length Number of bytes, up to TELEMETRY_MAX_PAYLOAD,
+ *        frame TELEMETRY_FRAME_BYTES
+ * @return Frame length, delimiter included
+ */
+uint16_t telemetry_encode(const uint8_t* payload, uint8_t length, uint8_t* frame)
+{
+	uint8_t* block = &frame[1];		//payload and CRC, encoded in place
+
+	if (length > TELEMETRY_MAX_PAYLOAD)
+		length = TELEMETRY_MAX_PAYLOAD;
+
+	for (uint8_t i = 0; i < length; i++)
+		block[i] = payload[i];
+	uint16_t crc = crc16_ccitt(payload, length);
+	block[length] = (uint8_t)crc;
+	block[length + 1] = (uint8_t)(crc >> 8);
+
+	uint16_t size = cobs_encode(block, length + 2, frame);
+	frame[size++] = 0x00;
+	return size;
+}
+
+/**
+ * @brief Decodes a received frame in place and checks its CRC.
+ *
+ * @param frame Bytes between two delimiters, overwritten by the payload, length Number of bytes
+ * @return Payload length, 0 if the frame is malformed, too long or fails its CRC
+ */
+uint8_t telemetry_decode(uint8_t* frame, uint16_t length)
+{
+	uint16_t in = 0, out = 0;
+
+	if (length < 3 || length > TELEMETRY_FRAME_BYTES - 1)
+		return 0;
+
+	while (in < length)
+	{
+		uint8_t code = frame[in++];
+
+		if (code == 0 || in + code - 1 > length)
+			return 0;
+		for (uint8_t i = 1; i < code; i++)
+			frame[out++] = frame[in++];
+		if (code < 0xFF && in < length)
+			frame[out++] = 0x00;		//the zero the code stood for, none after the last block
+	}
+	if (out < 3)
+		return 0;
+
+	uint16_t crc = crc16_ccitt(frame, out - 2);
+	if (frame[out - 2] != (uint8_t)crc || frame[out - 1] != (uint8_t)(crc >> 8))
+		return 0;
+	return (uint8_t)(out - 2);
+}
+
+/**
+ * @brief Sends a frame: payload, CRC, COBS and delimiter. Never waits.
+ *
+ * @param payload Bytes, type first, length Number of bytes, up to TELEMETRY_MAX_PAYLOAD
+ * @return 1 if queued, 0 if dropped
+ */
+uint8_t telemetry_send(const uint8_t* payload, uint8_t length)
+{
+	uint32_t start = get_cycle_count();
+	uint8_t frame[TELEMETRY_FRAME_BYTES];
+	uint16_t size = telemetry_encode(payload, length, frame);
+
+	uint8_t queued = uart_tx_write(frame, size);
+	if (queued)
+		telemetry_stats.frames++;
+	else
+		telemetry_stats.dropped++;
+
+	telemetry_stats.last_cycles = get_cycle_count() - start;
+	if (telemetry_stats.last_cycles > telemetry_stats.max_cycles)
+		telemetry_stats.max_cycles = telemetry_stats.last_cycles;
+	return queued;
+}
+
+/**
+ * @brief Sends the frame of a sensor read, successful or not, while streaming is on.
+ *
+ * @param raw Bytes from the DHT22, status TELEMETRY_STATUS_* bits,
+ *        values Temperature and humidity in tenths, now_ms Time of the read
+ * @return None
+ */
+void telemetry_send_reading(const DHT22_Data* raw, uint8_t status, const int16_t* values, uint32_t now_ms)
+{
+	uint8_t payload[17];
+
+	if (!streaming)
+		return;
+
+	payload[0] = TELEMETRY_FRAME_READING;
+	payload[1] = (uint8_t)sequence;
+	payload[2] = (uint8_t)(sequence >> 8);
+	payload[3] = (uint8_t)now_ms;
+	payload[4] = (uint8_t)(now_ms >> 8);
+	payload[5] = (uint8_t)(now_ms >> 16);
+	payload[6] = (uint8_t)(now_ms >> 24);
+	payload[7] = raw->humidity_first_byte;		//in the order the sensor sends them
+	payload[8] = raw->humidity_second_byte;
+	payload[9] = raw->temp_first_byte;
+	payload[10] = raw->temp_second_byte;
+	payload[11] = raw->check_byte;
+	payload[12] = (uint8_t)values[0];
+	payload[13] = (uint8_t)((uint16_t)values[0] >> 8);
+	payload[14] = (uint8_t)values[1];
+	payload[15] = (uint8_t)((uint16_t)values[1] >> 8);
+	payload[16] = status;
+
+	sequence++;		//counted even if dropped, the receiver sees the gap
+	telemetry_send(payload, sizeof(payload));
+}
+
+/**
+ * @brief Turns the reading frames on or off, for instance while a terminal uses the port.
+ *
+ * @param on 1 to send a frame per read, 0 to stop
+ * @return None
+ */
+void telemetry_stream(uint8_t on)
+{
+	streaming = on;
+}
+
+/**
+ * @brief Whether reading frames are sent.
+ *
+ * @param None
+ * @return 1 if on, 0 if off
+ */
+uint8_t telemetry_streaming(void)
+{
+	return streaming;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file trend_graph.c
+ * @author Auska Wang
+ * @brief Draws the recent history of each channel as a sparkline or bar graph
+ *        in the display's 8 user glyphs (HD44780 CGRAM).
+ *
+ *        Samples are averaged into pixel columns of TREND_SAMPLES_PER_COLUMN samples.
+ *        The graph only changes when a column closes, and then only glyph rows that
+ *        differ from what the display already holds are uploaded, so most refreshes
+ *        cost no extra display traffic at all.
+ */
+
+/* Includes */
+#include <string.h>
+#include "trend_graph.h"
+
+/* Defines */
+#define TREND_COLUMNS (TREND_GLYPHS_PER_CHANNEL * DISPLAY_GLYPH_WIDTH)	//pixel columns per channel
+#define TREND_MIN_SPAN 10	//smallest vertical range in 0.1 units, keeps sensor noise from filling the full height
+
+#if TREND_CHANNELS * TREND_GLYPHS_PER_CHANNEL > DISPLAY_GLYPHS
+#error "Trend graphs need more user glyphs than the display provides"
+#endif
+
+/**
+ * @brief Closed pixel columns of one channel plus the column being averaged.
+ */
+typedef struct {
+	int16_t columns[TREND_COLUMNS];	//ring of column averages, head is the oldest once full
+	uint8_t head;					//slot the next column goes to
+	uint8_t count;					//number of valid columns
+	int32_t sum;					//sum of samples of the open column
+	uint8_t samples;				//samples in the open column
+	uint8_t changed;				//a column closed since the last render
+} Trend_History;
+
+/* Variables */
+Trend_Stats trend_stats;
+
+static Trend_History history[TREND_CHANNELS];
+static uint8_t glyph_shadow[TREND_CHANNELS * TREND_GLYPHS_PER_CHANNEL][DISPLAY_GLYPH_HEIGHT];	//rows the display holds
+static uint8_t shadow_valid = 0;
+static TREND_STYLE shadow_style = TREND_SPARKLINE;
+
+/**
+ * @brief Adds a sample to a channel, closing a pixel column every TREND_SAMPLES_PER_COLUMN samples.
+ *
+ * @param channel Channel the sample belongs to, value Sample in 0.1 units
+ * @return None
+ */
+void trend_graph_add(TREND_CHANNEL channel, int16_t value)
+{
+	Trend_History* h = &history[channel];
+
+	h->sum += value;
+	if (++h->samples < TREND_SAMPLES_PER_COLUMN)
+		return;
+
+	h->columns[h->head] = (h->sum + (h->sum >= 0 ? TREND_SAMPLES_PER_COLUMN / 2 : -TREND_SAMPLES_PER_COLUMN / 2)) / TREND_SAMPLES_PER_COLUMN;
+	h->head = (h->head + 1) % TREND_COLUMNS;
+	if (h->count < TREND_COLUMNS)
+		h->count++;
+	h->sum = 0;
+	h->samples = 0;
+	h->changed = 1;
+}
+
+/**
+ * @brief Sets a pixel in the glyph rows of a channel.
+ *
+ * @param rows Glyph rows of the channel, x Pixel column 0 - TREND_COLUMNS - 1, y Pixel row, 0 on top
+ * @return None
+ */
+static inline void set_pixel(uint8_t rows[TREND_GLYPHS_PER_CHANNEL][DISPLAY_GLYPH_HEIGHT], uint8_t x, uint8_t y)
+{
+	rows[x / DISPLAY_GLYPH_WIDTH][y] |= 1 << (DISPLAY_GLYPH_WIDTH - 1 - x % DISPLAY_GLYPH_WIDTH);
+}
+
+/**
+ * @brief Draws the closed columns of a channel, newest on the right, scaled to its own min/max.
+ *
+ * @param h History to draw, style Sparkline or bar graph, rows Glyph rows to fill
+ * @return None
+ */
+static void draw_channel(const Trend_History* h, TREND_STYLE style, uint8_t rows[TREND_GLYPHS_PER_CHANNEL][DISPLAY_GLYPH_HEIGHT])
+{
+	int16_t min, max;
+	int32_t span;
+	int8_t previous_y = -1;
+
+	memset(rows, 0, TREND_GLYPHS_PER_CHANNEL * DISPLAY_GLYPH_HEIGHT);
+	if (h->count == 0)
+		return;
+
+	min = max = h->columns[(h->head + TREND_COLUMNS - h->count) % TREND_COLUMNS];
+	for (int i = 1; i < h->count; i++)
+	{
+		int16_t v = h->columns[(h->head + TREND_COLUMNS - h->count + i) % TREND_COLUMNS];
+		if (v < min)
+			min = v;
+		if (v > max)
+			max = v;
+	}
+	span = max - min;
+	if (span < TREND_MIN_SPAN)
+	{
+		min -= (TREND_MIN_SPAN - span) / 2;
+		span = TREND_MIN_SPAN;
+	}
+
+	for (int i = 0; i < h->count; i++)
+	{
+		int16_t v = h->columns[(h->head + TREND_COLUMNS - h->count + i) % TREND_COLUMNS];
+		uint8_t x = TREND_COLUMNS - h->count + i;
+		int8_t y = DISPLAY_GLYPH_HEIGHT - 1 - (int8_t)(((int32_t)(v - min) * (DISPLAY_GLYPH_HEIGHT - 1) + span / 2) / span);
+
+		if (style == TREND_BAR)
+		{
+			for (int row = y; row < DISPLAY_GLYPH_HEIGHT; row++)
+				set_pixel(rows, x, row);
+		}
+		else
+		{
+			//connect to the previous point so steep changes stay visible
+			int8_t from = (previous_y < 0) ? y : previous_y;
+			int8_t low = (from < y) ? from : y;
+			int8_t high = (from < y) ? y : from;
+			for (int row = low; row <= high; row++)
+				set_pixel(rows, x, row);
+			previous_y = y;
+		}
+	}
+}
+
+/**
+ * @brief Redraws channels that gained a column and uploads the glyph rows that changed.
+ *
+ * Must run before the text lines are written: on the HD44780 a glyph upload leaves the
+ * address counter in CGRAM, and every line write starts by setting a DDRAM address.
+ *
+ * @param display Display holding the glyphs, style Sparkline or bar graph
+ * @return None
+ */
+void trend_graph_render(const Display_Driver* display, TREND_STYLE style)
+{
+	uint8_t rows[TREND_GLYPHS_PER_CHANNEL][DISPLAY_GLYPH_HEIGHT];
+	uint16_t uploaded = 0;
+
+	if (style != shadow_style)
+	{
+		shadow_style = style;
+		shadow_valid = 0;
+	}
+
+	for (int channel = 0; channel < TREND_CHANNELS; channel++)
+	{
+		if (!history[channel].changed && shadow_valid)
+			continue;
+		history[channel].changed = 0;
+
+		draw_channel(&history[channel], style, rows);
+
+		for (int g = 0; g < TREND_GLYPHS_PER_CHANNEL; g++)
+		{
+			uint8_t slot = channel * TREND_GLYPHS_PER_CHANNEL + g;
+			int first = -1, last = -1;
+
+			for (int row = 0; row < DISPLAY_GLYPH_HEIGHT; row++)
+			{
+				if (!shadow_valid || rows[g][row] != glyph_shadow[slot][row])
+				{
+					if (first < 0)
+						first = row;
+					last = row;
+				}
+			}
+			if (first < 0)
+				continue;
+
+			display->write_glyph_rows(slot, first, &rows[g][first], last - first + 1);
+			memcpy(&glyph_shadow[slot][first], &rows[g][first], last - first + 1);
+			uploaded += last - first + 1;
+		}
+	}
+
+	if (uploaded)
+	{
+		trend_stats.renders++;
+		trend_stats.rows_uploaded += uploaded;
+		trend_stats.last_rows_uploaded = uploaded;
+	}
+	shadow_valid = 1;
+}
+
+/**
+ * @brief Forgets what the display holds, the next render uploads every glyph.
+ *        Call after the display was reinitialized.
+ *
+ * @return None
+ */
+void trend_graph_invalidate(void)
+{
+	shadow_valid = 0;
+}
+
+/**
+ * @brief Character code that draws one glyph of a channel's graph.
+ *
+ * @param channel Channel, index Glyph 0 - TREND_GLYPHS_PER_CHANNEL - 1, left to right
+ * @return Character to put in a display line
+ */
+char trend_graph_char(TREND_CHANNEL channel, uint8_t index)
+{
+	return DISPLAY_GLYPH_CHAR(channel * TREND_GLYPHS_PER_CHANNEL + index);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file uart_tx.c
+ * @author Auska Wang
+ * @brief Transmit ring for USART2, drained by DMA.
+ *
+ *        uart_tx_write() copies bytes into the ring and returns at once; a write that
+ *        does not fit is refused whole, so a slow or unplugged host costs dropped data,
+ *        never a wait in the main loop. The DMA sends the bytes from the ring itself,
+ *        one contiguous run at a time: up to the write position, or up to the end of
+ *        the ring when the data wraps, the rest following from the completion callback.
+ *
+ *        Writes may come from any context, interrupts included: the network slot timer
+ *        queues its frame from TIM17's interrupt while the main loop may be writing. The
+ *        Cortex-M0+ has no exclusive load and store, so a write masks interrupts only to
+ *        reserve its room, a handful of cycles, and copies with them enabled. A write
+ *        interrupted by another one finishes after it, and the last writer to finish
+ *        publishes every reserved byte to the DMA, so the bytes of each write stay
+ *        together and in reservation order. uart_tx_write_delimited() reserves a 0x00
+ *        with the bytes, so no other write can come between them. The callback runs in
+ *        the USART2 interrupt and only moves the read position.
+ */
+
+/* Includes */
+#include <string.h>
+#include "uart_tx.h"
+#include "general.h"
+
+/* Variables */
+extern UART_HandleTypeDef huart2;
+
+Uart_Tx_Stats uart_tx_stats;
+
+static uint8_t ring[UART_TX_RING_BYTES];
+static volatile uint16_t head = 0;			//end of the bytes written whole, the DMA may send up to here
+static volatile uint16_t reserved = 0;		//end of the room handed to writers
+static volatile uint8_t writers = 0;		//writes copying into their room
+static volatile uint16_t tail = 0;			//next byte to send, moved by the callback
+static volatile uint16_t in_flight = 0;		//bytes handed to the DMA, 0 while idle
+
+/**
+ * @brief Bytes queued or reserved, including those being sent.
+ *
+ * @param None
+ * @return Bytes in the ring
+ */
+static uint16_t queued(void)
+{
+	return (uint16_t)((reserved + UART_TX_RING_BYTES - tail) % UART_TX_RING_BYTES);
+}
+
+/**
+ * @brief Hands the next contiguous run of queued bytes to the DMA if it is idle.
+ *        Called with USART2's interrupt unable to run, from the callback or masked.
+ *
+ * @param None
+ * @return None
+ */
+static void start_next(void)
+{
+	uint16_t start = tail, end = head;
+
+	if (in_flight || start == end)
+		return;
+
+	uint16_t length = (end > start) ? end - start : UART_TX_RING_BYTES - start;
+
+	in_flight = length;
+	if (HAL_UART_Transmit_DMA(&huart2, &ring[start], length) != HAL_OK)
+	{
+		in_flight = 0;
+		uart_tx_stats.dma_errors++;
+		return;
+	}
+	uart_tx_stats.dma_starts++;
+}
+
+/**
+ * @brief Room left in the ring.
+ *
+ * @param None
+ * @return Bytes that a write can take
+ */
+uint16_t uart_tx_free(void)
+{
+	return UART_TX_RING_BYTES - 1 - queued();
+}
+
+/**
+ * @brief Reserves room for bytes and an optional 0x00 after them, copies them and
+ *        starts the DMA if it is idle.
+ *
+ * @param data Bytes, length Number of bytes, delimit 1 to end them with a 0x00
+ * @return 1 if queued, 0 if the ring had no room and nothing was queued
+ */
+static uint8_t queue(const uint8_t* data, uint16_t length, uint8_t delimit)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint16_t total = length + delimit;
+
+	__disable_irq();
+	if (total > uart_tx_free())
+	{
+		uart_tx_stats.dropped_writes++;
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	uint16_t position = reserved;
+	reserved = (uint16_t)((position + total) % UART_TX_RING_BYTES);
+	writers++;
+	uart_tx_stats.bytes += total;
+	if (queued() > uart_tx_stats.max_queued)
+		uart_tx_stats.max_queued = queued();
+	__set_PRIMASK(primask);
+
+	uint16_t first = UART_TX_RING_BYTES - position;
+
+	if (first > length)
+		first = length;
+	memcpy(&ring[position], data, first);
+	memcpy(ring, data + first, length - first);
+	if (delimit)
+		ring[(position + length) % UART_TX_RING_BYTES] = 0x00;
+
+	__disable_irq();
+	if (--writers == 0)		//no write it interrupted is still copying
+	{
+		head = reserved;
+		start_next();
+	}
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+/**
+ * @brief Queues bytes for USART2 and starts the DMA if it is idle. Never waits.
+ *        Safe from any context.
+ *
+ * @param data Bytes, length Number of bytes
+ * @return 1 if queued, 0 if the ring had no room and nothing was queued
+ */
+uint8_t uart_tx_write(const uint8_t* data, uint16_t length)
+{
+	return queue(data, length, 0);
+}
+
+/**
+ * @brief Queues bytes followed by a 0x00 as one write, so no frame lands between them.
+ *        Safe from any context.
+ *
+ * @param data Bytes, length Number of bytes, the 0x00 not included
+ * @return 1 if queued, 0 if the ring had no room for both and nothing was queued
+ */
+uint8_t uart_tx_write_delimited(const uint8_t* data, uint16_t length)
+{
+	return queue(data, length, 1);
+}
+
+/**
+ * @brief HAL callback, a DMA transfer left the UART. Sends the next run.
+ *
+ * @param huart UART handle
+ * @return None
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
+{
+	if (huart != &huart2)
+		return;
+
+	tail = (uint16_t)((tail + in_flight) % UART_TX_RING_BYTES);
+	in_flight = 0;
+	start_next();
+}
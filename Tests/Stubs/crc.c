@@ -0,0 +1,40 @@
+/**
+ * @file crc.c
+ * @author Auska Wang
+ * @brief Bit by bit stand-in for Core/Src/crc.c, which drives the CRC unit. Same
+ *        polynomials, initial value and reflection, so frames and records built on the
+ *        host carry the CRC the firmware computes.
+ */
+
+/* Includes */
+#include "crc.h"
+
+void crc_init(void)
+{
+}
+
+uint16_t crc16_ccitt(const uint8_t* data, uint16_t length)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (length--)
+	{
+		crc ^= (uint16_t)*data++ << 8;
+		for (int bit = 0; bit < 8; bit++)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+uint16_t crc16_modbus(const uint8_t* data, uint16_t length)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (length--)
+	{
+		crc ^= *data++;
+		for (int bit = 0; bit < 8; bit++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
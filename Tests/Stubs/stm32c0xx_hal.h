@@ -0,0 +1,102 @@
+/**
+ * @file stm32c0xx_hal.h
+ * @author Auska Wang
+ *
+ * @brief Stand-in for the HAL on a host build of the tests.
+ *        This file contains
+ *        - the HAL types and constants the modules under test refer to
+ *        - prototypes of the HAL functions, which each test defines as it needs them
+ *        Registers do not exist on the host, so nothing here touches hardware.
+ */
+
+#ifndef TESTS_STUBS_STM32C0XX_HAL_H_
+#define TESTS_STUBS_STM32C0XX_HAL_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+	HAL_OK 		= 0,
+	HAL_ERROR 	= 1,
+	HAL_BUSY 	= 2,
+	HAL_TIMEOUT = 3
+} HAL_StatusTypeDef;
+
+typedef struct {
+	uint32_t ODR;
+	uint32_t BSRR;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef stub_gpioa, stub_gpiob;
+#define GPIOA (&stub_gpioa)
+#define GPIOB (&stub_gpiob)
+#define GPIO_PIN_0 0x0001U
+#define GPIO_PIN_1 0x0002U
+#define GPIO_PIN_2 0x0004U
+#define GPIO_PIN_3 0x0008U
+#define GPIO_PIN_4 0x0010U
+#define GPIO_PIN_5 0x0020U
+#define GPIO_PIN_6 0x0040U
+#define GPIO_PIN_7 0x0080U
+#define GPIO_PIN_8 0x0100U
+#define GPIO_PIN_9 0x0200U
+#define GPIO_PIN_10 0x0400U
+
+#define SystemCoreClock 48000000U
+
+/* Flash: each test places the pages it needs in a RAM array, stub_flash */
+extern uint8_t stub_flash[];
+#define FLASH_BASE ((uint32_t)(uintptr_t)stub_flash)
+#define FLASH_PAGE_SIZE 2048U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0x01U
+#define FLASH_TYPEERASE_PAGES 0x02U
+
+typedef struct {
+	uint32_t TypeErase;
+	uint32_t Page;
+	uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+/* USART, DMA and timers: the fields the modules read, which each test sets */
+typedef struct {
+	volatile uint32_t CNDTR;			//bytes the DMA has left to write
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	DMA_Channel_TypeDef* Instance;
+} DMA_HandleTypeDef;
+
+#define HAL_UART_STATE_READY 0x20U
+#define HAL_UART_STATE_BUSY_RX 0x22U
+
+typedef struct {
+	volatile uint32_t RxState;
+	DMA_HandleTypeDef* hdmarx;
+} UART_HandleTypeDef;
+
+typedef struct {
+	uint32_t autoreload;
+	uint32_t counter;
+	uint32_t enabled;
+} TIM_HandleTypeDef;
+
+#define __HAL_DMA_GET_COUNTER(handle) ((handle)->Instance->CNDTR)
+#define __HAL_TIM_SET_AUTORELOAD(handle, value) ((handle)->autoreload = (value))
+#define __HAL_TIM_SET_COUNTER(handle, value) ((handle)->counter = (value))
+#define __HAL_TIM_ENABLE(handle) ((handle)->enabled = 1)
+
+/* Core: nothing interrupts a host test, masking is a no-op */
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __disable_irq(void) { }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+
+/* Function prototypes ------------------------------------------------------------------*/
+uint32_t HAL_GetTick(void);
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size);
+
+#endif /* TESTS_STUBS_STM32C0XX_HAL_H_ */
@@ -0,0 +1,377 @@
+/**
+ * @file network_sim.c
+ * @author Auska Wang
+ * @brief Runs a concentrator and N simulated nodes over pseudo terminals and reports the
+ *        readings per second and the delay of each reading after its beacon.
+ *
+ *        Each node is a process on the slave side of its own pty, in raw mode, the
+ *        concentrator holds every master side; a pty joins two ends only, so the bus is
+ *        a star here, and since nodes answer only in their slots nothing would collide
+ *        on a shared line either. The concentrator writes a beacon to every node each
+ *        period, slots of 1.6 ms after a 15 ms lead as in the README, node i owning slot
+ *        i. A node reads up to the delimiter, decodes the frame with telemetry_decode(),
+ *        reads it with network_schedule() and sleeps until the middle of its slot, as
+ *        network_slot_elapsed() would send, then writes a reading frame built with
+ *        telemetry_encode(). The concentrator timestamps each reading when its delimiter
+ *        comes in and checks the frame, its cycle and that it arrived inside its slot;
+ *        a reading coming after the next beacon counts as outside. The first
+ *        WARMUP_CYCLES are not counted, a node on the bus syncs over two beacons.
+ *        A node count fails with a bad frame, under 99 % of the readings received, or
+ *        over MAX_OUTSIDE_PERCENT of them outside their slot; it runs up to
+ *        NETWORK_MAX_SLOTS nodes, the most a beacon may list.
+ *        A pty has no baud rate: bytes pass in microseconds, so the timings are the
+ *        slot sizes chosen for NETWORK_BAUD plus the host's wake up jitter, which a
+ *        node's idle line interrupt and TIM17 do not have. Waits end in a spin on the
+ *        clock, which keeps most of that jitter out. Nodes share the host's clock.
+ *        Host dependent, so not part of the tests make runs:
+ *          make -C Tests network_sim
+ */
+
+/* Includes */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "general.h"
+#include "network.h"
+#include "telemetry.h"
+#include "uart_tx.h"
+
+/* Defines */
+#define LEAD_US 15000U
+#define SLOT_US 1600U
+#define RUN_US 3000000U				//per node count
+#define MIN_CYCLES 30
+#define WARMUP_CYCLES 2			//a node follows slots from its second beacon
+#define MAX_OUTSIDE_PERCENT 5		//readings the host's wake up jitter may push out of their slot
+#define WAKE_EARLY_US 500U			//a sleep ends this early and the rest is spun, as a timer would
+#define CONCENTRATOR 0				//address of the concentrator
+
+/**
+ * @brief What the concentrator received from one node count.
+ */
+typedef struct {
+	uint32_t cycles;
+	uint32_t expected;
+	uint32_t readings;
+	uint32_t bad;					//bad CRC, wrong type, node or cycle
+	uint32_t outside;				//arrived outside its slot
+	double delay_sum_us;
+	double delay_max_us;
+	double overrun_max_us;			//furthest past its slot's end
+} Result;
+
+/* Variables */
+UART_HandleTypeDef huart2;
+TIM_HandleTypeDef htim17;
+
+//network.c is linked for network_schedule(); its other paths are not run
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+uint8_t alarm_latched(void) { return 0; }
+uint8_t alarm_near(void) { return 0; }
+uint32_t display_reading_ms(void) { return 0; }
+uint8_t display_reading(int16_t* values) { return 0; }
+uint8_t uart_tx_write(const uint8_t* data, uint16_t length) { return 0; }
+uint16_t uart_tx_free(void) { return 0; }
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) { return HAL_OK; }
+
+/**
+ * @brief The host's monotonic time.
+ *
+ * @return Microseconds
+ */
+static double now_us(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Waits until a point of the monotonic clock: sleeps until WAKE_EARLY_US before
+ *        it, then reads the clock, so a late wake up within that margin costs nothing.
+ *
+ * @param us Microseconds
+ * @return None
+ */
+static void sleep_until(double us)
+{
+	double wake_us = us - WAKE_EARLY_US;
+	struct timespec time = {(time_t)(wake_us / 1e6), (long)((wake_us - (time_t)(wake_us / 1e6) * 1e6) * 1000)};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) != 0)
+		;
+	while (now_us() < us)
+		;
+}
+
+/**
+ * @brief Writes a little endian half word.
+ *
+ * @param bytes 2 bytes, value Value
+ * @return None
+ */
+static void put16(uint8_t* bytes, uint16_t value)
+{
+	bytes[0] = (uint8_t)value;
+	bytes[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Writes all of a buffer.
+ *
+ * @param fd Descriptor, data Bytes, length Number of bytes
+ * @return None
+ */
+static void write_all(int fd, const uint8_t* data, uint16_t length)
+{
+	while (length)
+	{
+		ssize_t n = write(fd, data, length);
+
+		if (n <= 0)
+			exit(1);
+		data += n;
+		length -= (uint16_t)n;
+	}
+}
+
+/**
+ * @brief A node: answers each beacon with a reading in its slot until killed.
+ *
+ * @param fd Slave side of its pty, address Node address
+ * @return None
+ */
+static void node(int fd, uint8_t address)
+{
+	uint8_t frame[TELEMETRY_FRAME_BYTES], bytes[64];
+	uint16_t length = 0;
+
+	for (;;)
+	{
+		ssize_t n = read(fd, bytes, sizeof(bytes));
+
+		if (n <= 0)
+			exit(0);
+		for (ssize_t i = 0; i < n; i++)
+		{
+			if (bytes[i] != 0)
+			{
+				if (length < sizeof(frame))
+					frame[length] = bytes[i];
+				length++;
+				continue;
+			}
+
+			//the delimiter, as the idle line interrupt would time it
+			double end_us = now_us();
+			Network_Schedule schedule;
+			uint8_t size = length <= sizeof(frame) ? telemetry_decode(frame, length) : 0;
+
+			length = 0;
+			if (size == 0 || !network_schedule(frame, size, address, &schedule) || schedule.slot < 0)
+				continue;
+
+			uint8_t payload[NETWORK_READING_BYTES] = {NETWORK_FRAME_READING, address};
+			uint8_t reply[TELEMETRY_FRAME_BYTES];
+
+			put16(&payload[2], schedule.cycle);
+			put16(&payload[4], 500);
+			put16(&payload[6], (uint16_t)(200 + address));
+			put16(&payload[8], 450);
+			payload[10] = NETWORK_STATUS_READING;
+			uint16_t reply_length = telemetry_encode(payload, sizeof(payload), reply);
+
+			sleep_until(end_us + schedule.lead_us + schedule.slot * schedule.slot_us
+					+ (schedule.slot_us - NETWORK_READING_US) / 2);
+			write_all(fd, reply, reply_length);
+		}
+	}
+}
+
+/**
+ * @brief Opens a pty in raw mode and forks a node on its slave side.
+ *
+ * @param address Node address, pid Filled in
+ * @return Master side, -1 on error
+ */
+static int start_node(uint8_t address, pid_t* pid)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	struct termios settings;
+
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+		return -1;
+	int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+
+	if (slave < 0 || tcgetattr(slave, &settings) != 0)
+		return -1;
+	cfmakeraw(&settings);
+	tcsetattr(slave, TCSANOW, &settings);
+
+	*pid = fork();
+	if (*pid == 0)
+	{
+		close(master);
+		node(slave, address);
+	}
+	close(slave);
+	return *pid < 0 ? -1 : master;
+}
+
+/**
+ * @brief Runs the concentrator with a number of nodes.
+ *
+ * @param nodes Node count
+ * @return What was received
+ */
+static Result run(uint8_t nodes)
+{
+	int masters[NETWORK_MAX_SLOTS];
+	pid_t pids[NETWORK_MAX_SLOTS];
+	struct pollfd fds[NETWORK_MAX_SLOTS];
+	uint8_t frames[NETWORK_MAX_SLOTS][TELEMETRY_FRAME_BYTES];
+	uint16_t lengths[NETWORK_MAX_SLOTS] = {0};
+	uint8_t payload[NETWORK_BEACON_BYTES + NETWORK_MAX_SLOTS], beacon[TELEMETRY_FRAME_BYTES];
+	uint32_t beacon_chars = (uint32_t)(NETWORK_BEACON_BYTES + nodes + 4) * NETWORK_CHAR_US;
+	uint32_t period_us = beacon_chars + LEAD_US + nodes * SLOT_US;
+	double sent_us[2][NETWORK_MAX_SLOTS];		//beacon written to each node, last two cycles
+	Result result = {0};
+
+	for (uint8_t i = 0; i < nodes; i++)
+	{
+		masters[i] = start_node((uint8_t)(CONCENTRATOR + 1 + i), &pids[i]);
+		if (masters[i] < 0)
+		{
+			perror("pty");
+			exit(1);
+		}
+		fds[i].fd = masters[i];
+		fds[i].events = POLLIN;
+	}
+	result.cycles = RUN_US / period_us < MIN_CYCLES ? MIN_CYCLES : RUN_US / period_us;
+
+	payload[0] = NETWORK_FRAME_BEACON;
+	put16(&payload[3], (uint16_t)period_us);
+	put16(&payload[5], (uint16_t)(period_us >> 16));
+	put16(&payload[7], LEAD_US);
+	put16(&payload[9], SLOT_US);
+	payload[11] = nodes;
+	for (uint8_t i = 0; i < nodes; i++)
+		payload[NETWORK_BEACON_BYTES + i] = (uint8_t)(CONCENTRATOR + 1 + i);
+
+	double start_us = now_us() + 10000;		//the nodes start meanwhile
+
+	for (uint32_t cycle = 0; cycle <= WARMUP_CYCLES + result.cycles; cycle++)
+	{
+		double beacon_us = start_us + (double)cycle * period_us;
+
+		//readings of the previous cycle come in until this beacon is due
+		while (now_us() < beacon_us)
+		{
+			int timeout_ms = (int)((beacon_us - now_us()) / 1000);
+
+			if (poll(fds, nodes, timeout_ms) <= 0)
+				continue;
+			for (uint8_t i = 0; i < nodes; i++)
+			{
+				uint8_t bytes[64];
+				ssize_t n;
+
+				if (!(fds[i].revents & POLLIN) || (n = read(masters[i], bytes, sizeof(bytes))) <= 0)
+					continue;
+				for (ssize_t j = 0; j < n; j++)
+				{
+					if (bytes[j] != 0)
+					{
+						if (lengths[i] < TELEMETRY_FRAME_BYTES)
+							frames[i][lengths[i]] = bytes[j];
+						lengths[i]++;
+						continue;
+					}
+
+					double arrival_us = now_us();
+					double slot_start = LEAD_US + i * SLOT_US;
+					uint8_t size = lengths[i] <= TELEMETRY_FRAME_BYTES ? telemetry_decode(frames[i], lengths[i]) : 0;
+					uint16_t answered = (uint16_t)(frames[i][2] | frames[i][3] << 8);
+
+					lengths[i] = 0;
+					if (size != NETWORK_READING_BYTES || frames[i][0] != NETWORK_FRAME_READING
+							|| frames[i][1] != CONCENTRATOR + 1 + i
+							|| (answered != (uint16_t)(cycle - 1) && answered != (uint16_t)(cycle - 2)))
+					{
+						result.bad++;
+						continue;
+					}
+					if (answered < WARMUP_CYCLES)
+						continue;
+
+					double delay_us = arrival_us - sent_us[answered % 2][i];
+
+					result.readings++;
+					result.outside += delay_us < slot_start || delay_us > slot_start + SLOT_US;
+					result.delay_sum_us += delay_us;
+					if (delay_us - slot_start - SLOT_US > result.overrun_max_us)
+						result.overrun_max_us = delay_us - slot_start - SLOT_US;
+					if (delay_us > result.delay_max_us)
+						result.delay_max_us = delay_us;
+				}
+			}
+		}
+		if (cycle == WARMUP_CYCLES + result.cycles)
+			break;
+
+		put16(&payload[1], (uint16_t)cycle);
+		uint16_t size = telemetry_encode(payload, (uint8_t)(NETWORK_BEACON_BYTES + nodes), beacon);
+
+		sleep_until(beacon_us);
+		for (uint8_t i = 0; i < nodes; i++)
+		{
+			write_all(masters[i], beacon, size);
+			sent_us[cycle % 2][i] = now_us();
+		}
+	}
+	result.expected = result.cycles * nodes;
+
+	for (uint8_t i = 0; i < nodes; i++)
+	{
+		kill(pids[i], SIGTERM);
+		close(masters[i]);
+		waitpid(pids[i], NULL, 0);
+	}
+	return result;
+}
+
+int main(void)
+{
+	static const uint8_t counts[] = {1, 4, 16, 32, NETWORK_MAX_SLOTS};
+	int failures = 0;
+
+	printf("slots of %u us after a %u us lead, sized for %u baud; a pty passes bytes without a baud rate\n",
+			SLOT_US, LEAD_US, NETWORK_BAUD);
+	printf("nodes  period      readings/s  received       outside slot  past slot end  mean delay  max delay\n");
+	for (size_t i = 0; i < sizeof(counts); i++)
+	{
+		Result result = run(counts[i]);
+		uint32_t period_us = (NETWORK_BEACON_BYTES + counts[i] + 4) * NETWORK_CHAR_US + LEAD_US + counts[i] * SLOT_US;
+
+		printf("%5u  %6.1f ms  %10.0f  %6u/%-6u  %12u  %10.1f ms  %7.1f ms  %6.1f ms\n", counts[i], period_us / 1000.0,
+				result.readings / (result.cycles * (double)period_us / 1e6), result.readings, result.expected,
+				result.outside, result.overrun_max_us / 1000, result.readings ? result.delay_sum_us / result.readings / 1000 : 0,
+				result.delay_max_us / 1000);
+		failures += result.bad != 0 || result.readings < result.expected * 99 / 100
+				|| result.outside > result.readings * MAX_OUTSIDE_PERCENT / 100;
+	}
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
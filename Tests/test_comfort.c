@@ -0,0 +1,186 @@
+/**
+ * @file test_comfort.c
+ * @author Auska Wang
+ * @brief Checks comfort.c against the same formulas in double precision and times both.
+ *
+ *        Every reading from -40.0 to 80.0 C and 1.0 to 100.0 %RH, in tenths, is
+ *        compared with the Magnus dew point (b = 17.62, c = 243.12 C), the NWS heat
+ *        index (Steadman below 80 F, Rothfusz with both adjustments above) and the
+ *        Magnus absolute humidity. The limits are the ones comfort.c states: 0.07 C,
+ *        0.06 C and 0.5 % of the absolute humidity from 5 g/m^3 on. Dew points below
+ *        the -64 C end of the table are skipped.
+ *
+ *        The times are on the host, which has a floating point unit, so they only show
+ *        that the integer code is not slower there; the M0+ has none, and its cost is
+ *        what comfort_cost measures on target.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "comfort.h"
+
+/* Defines */
+#define DEW_LIMIT 0.07
+#define HEAT_INDEX_LIMIT 0.06
+#define AH_LIMIT 0.005
+#define AH_CHECKED_FROM 5.0		//g/m^3, relative errors below mean little
+#define TIMING_PASSES 5
+
+/* Variables */
+static volatile double sink;
+
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+
+/**
+ * @brief Magnus dew point.
+ *
+ * @param t Temperature in C, rh Relative humidity in %
+ * @return Dew point in C
+ */
+static double reference_dew_point(double t, double rh)
+{
+	double gamma = log(rh / 100) + 17.62 * t / (243.12 + t);
+
+	return 243.12 * gamma / (17.62 - gamma);
+}
+
+/**
+ * @brief NWS heat index.
+ *
+ * @param t Temperature in C, rh Relative humidity in %
+ * @return Heat index in C
+ */
+static double reference_heat_index(double t, double rh)
+{
+	double f = t * 9 / 5 + 32;
+	double index = 0.5 * (f + 61 + (f - 68) * 1.2 + rh * 0.094);
+
+	if ((index + f) / 2 >= 80)
+	{
+		if (f > 150)
+			f = 150;
+		index = -42.379 + 2.04901523 * f + 10.14333127 * rh - 0.22475541 * f * rh - 0.00683783 * f * f
+				- 0.05481717 * rh * rh + 0.00122874 * f * f * rh + 0.00085282 * f * rh * rh - 0.00000199 * f * f * rh * rh;
+		if (rh < 13 && f >= 80 && f <= 112)
+			index -= (13 - rh) / 4 * sqrt((17 - fabs(f - 95)) / 17);
+		else if (rh > 85 && f >= 80 && f <= 87)
+			index += (rh - 85) / 10 * (87 - f) / 5;
+	}
+	return (index - 32) * 5 / 9;
+}
+
+/**
+ * @brief Absolute humidity from the Magnus saturation pressure.
+ *
+ * @param t Temperature in C, rh Relative humidity in %
+ * @return g/m^3
+ */
+static double reference_absolute_humidity(double t, double rh)
+{
+	return 216.7 * rh / 100 * 6.112 * exp(17.62 * t / (243.12 + t)) / (273.15 + t);
+}
+
+/**
+ * @brief Nanoseconds since an arbitrary start.
+ *
+ * @return Time
+ */
+static double now_ns(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+int main(void)
+{
+	double dew_error = 0, heat_index_error = 0, ah_error = 0;
+	int dew_at[2] = {0}, heat_index_at[2] = {0}, ah_at[2] = {0};
+	double start, fixed_ns, double_ns;
+	long readings = 0;
+	int failures = 0;
+
+	for (int t = -400; t <= 800; t++)
+	{
+		for (int rh = 10; rh <= 1000; rh++)
+		{
+			Comfort_Metrics metrics;
+			double reference, error;
+
+			comfort_compute(t, rh, &metrics);
+
+			reference = reference_dew_point(t / 10.0, rh / 10.0);
+			error = fabs(metrics.dew_point / 10.0 - reference);
+			if (reference > -64 && error > dew_error)
+			{
+				dew_error = error;
+				dew_at[0] = t;
+				dew_at[1] = rh;
+			}
+			error = fabs(metrics.heat_index / 10.0 - reference_heat_index(t / 10.0, rh / 10.0));
+			if (error > heat_index_error)
+			{
+				heat_index_error = error;
+				heat_index_at[0] = t;
+				heat_index_at[1] = rh;
+			}
+			reference = reference_absolute_humidity(t / 10.0, rh / 10.0);
+			error = fabs(metrics.absolute_humidity / 100.0 - reference) / reference;
+			if (reference >= AH_CHECKED_FROM && error > ah_error)
+			{
+				ah_error = error;
+				ah_at[0] = t;
+				ah_at[1] = rh;
+			}
+			readings++;
+		}
+	}
+	printf("%ld readings\n", readings);
+	printf("dew point: max error %.3f C at %d, %d tenths\n", dew_error, dew_at[0], dew_at[1]);
+	printf("heat index: max error %.3f C at %d, %d tenths\n", heat_index_error, heat_index_at[0], heat_index_at[1]);
+	printf("absolute humidity: max error %.2f %% at %d, %d tenths\n", ah_error * 100, ah_at[0], ah_at[1]);
+	failures += dew_error > DEW_LIMIT;
+	failures += heat_index_error > HEAT_INDEX_LIMIT;
+	failures += ah_error > AH_LIMIT;
+
+	readings = 0;
+	start = now_ns();
+	for (int pass = 0; pass < TIMING_PASSES; pass++)
+	{
+		for (int t = -400; t <= 800; t += 7)
+		{
+			for (int rh = 10; rh <= 1000; rh += 3)
+			{
+				Comfort_Metrics metrics;
+
+				comfort_compute(t, rh, &metrics);
+				sink += metrics.dew_point + metrics.heat_index + metrics.absolute_humidity;
+				readings++;
+			}
+		}
+	}
+	fixed_ns = (now_ns() - start) / readings;
+	start = now_ns();
+	for (int pass = 0; pass < TIMING_PASSES; pass++)
+	{
+		for (int t = -400; t <= 800; t += 7)
+		{
+			for (int rh = 10; rh <= 1000; rh += 3)
+			{
+				volatile double temperature = t / 10.0, humidity = rh / 10.0;
+
+				sink += reference_dew_point(temperature, humidity) + reference_heat_index(temperature, humidity)
+						+ reference_absolute_humidity(temperature, humidity);
+			}
+		}
+	}
+	double_ns = (now_ns() - start) / readings;
+	printf("host time per reading: %.1f ns integer, %.1f ns double\n", fixed_ns, double_ns);
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
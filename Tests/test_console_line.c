@@ -0,0 +1,167 @@
+/**
+ * @file test_console_line.c
+ * @author Auska Wang
+ * @brief Feeds byte streams to console_line.c and checks the lines it ends.
+ *
+ *        Each case is a stream of commands as a terminal or a script would send them. The
+ *        stream is fed whole, then again cut into chunks of 1 to 7 bytes the way the DMA
+ *        events split it, and both must give the same lines, written out as the
+ *        arguments separated by '|', and "overlong" for a dropped line:
+ *        - CR, LF and CRLF endings, empty lines, spaces and tabs around arguments;
+ *        - backspace and DEL, within an argument and across the space before it;
+ *        - control bytes other than those, which are ignored;
+ *        - the longest line, CONSOLE_LINE_BYTES - 1 characters, and the argument limit
+ *          pass; one character or one argument more drops the line whole, and the line
+ *          after it is still parsed.
+ *        The rate is the host's, for a captured mix of commands.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "console_line.h"
+
+/* Defines */
+#define RESULT_BYTES 1024
+#define RATE_BYTES (1 << 20)
+#define RATE_PASSES 20
+#define CASE(name, stream, expected) {name, stream, sizeof(stream) - 1, expected}
+
+/**
+ * @brief A byte stream and the lines it must end.
+ */
+typedef struct {
+	const char* name;
+	const char* stream;
+	size_t length;					//bytes of stream, which may hold zeros
+	const char* expected;
+} Case;
+
+/* Variables */
+static Console_Line line;
+static int failures = 0;
+
+static const Case cases[] = {
+	CASE("endings", "units\r\nunits c\rlight off\n\r\n\n", "units\nunits|c\nlight|off\n"),
+	CASE("spacing", "  cal \t t  -4:-4.2\t50:50.3  \r\n", "cal|t|-4:-4.2|50:50.3\n"),
+	CASE("backspace", "unitz\bs  c\r\nunits x\b\b\bf\n\b\bstats\x7F\x7Fts 1h\n", "units|c\nunitf\nstats|1h\n"),
+	CASE("control bytes", "ra\x01te\x1B 10\x00\x05\n", "rate|10\n"),
+	CASE("too many arguments", "a b c d e f g h i j k\nhelp\n", "overlong\nhelp\n"),
+	CASE("argument limit", "a b c d e f g h i j\n", "a|b|c|d|e|f|g|h|i|j\n"),
+	CASE("empty", "\r\n \t \r\n\b\n", ""),
+};
+
+/**
+ * @brief Feeds a stream in chunks and writes out the lines it ended.
+ *
+ * @param stream Bytes, length Number of bytes, chunk Largest chunk, 0 for whole,
+ *        result Filled in with the lines
+ * @return None
+ */
+static void feed(const char* stream, size_t length, int chunk, char* result)
+{
+	size_t at = 0;
+
+	result[0] = '\0';
+	console_line_clear(&line);
+	while (at < length)
+	{
+		size_t end = chunk ? at + 1 + (at * 7 + 3) % chunk : length;
+
+		if (end > length)
+			end = length;
+		for (; at < end; at++)
+		{
+			CONSOLE_LINE_EVENT event = console_line_put(&line, stream[at]);
+
+			if (event == CONSOLE_LINE_OVERLONG)
+				strcat(result, "overlong");
+			else if (event == CONSOLE_LINE_READY)
+			{
+				for (uint8_t i = 0; i < line.count; i++)
+				{
+					if (i)
+						strcat(result, "|");
+					strcat(result, line.args[i]);
+				}
+			}
+			else
+				continue;
+			strcat(result, "\n");
+			console_line_clear(&line);
+		}
+	}
+}
+
+/**
+ * @brief Checks a stream fed whole and in chunks.
+ *
+ * @param name Case, stream Bytes, length Number of bytes, expected Lines
+ * @return None
+ */
+static void check(const char* name, const char* stream, size_t length, const char* expected)
+{
+	char result[RESULT_BYTES];
+
+	for (int chunk = 0; chunk <= 7; chunk++)
+	{
+		feed(stream, length, chunk, result);
+		if (strcmp(result, expected) != 0)
+		{
+			printf("%s, chunks of up to %d: got \"%s\"\n", name, chunk, result);
+			failures++;
+			return;
+		}
+	}
+}
+
+int main(void)
+{
+	static char stream[RATE_BYTES];
+	static const char* mix[] = {"units c\r\n", "rate 10\n", "stats 1h\r\n", "cal t -4:-4.2 10.5:10.0 50:50.3\n", "x y z\n"};
+	char long_line[CONSOLE_LINE_BYTES + 8], expected[CONSOLE_LINE_BYTES + 8];
+	size_t length = 0;
+	uint32_t lines = 0;
+	clock_t start;
+	double seconds;
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+		check(cases[i].name, cases[i].stream, cases[i].length, cases[i].expected);
+
+	memset(long_line, 'x', CONSOLE_LINE_BYTES - 1);
+	strcpy(long_line + CONSOLE_LINE_BYTES - 1, "\n");
+	strcpy(expected, long_line);
+	check("longest line", long_line, strlen(long_line), expected);
+	memset(long_line, 'x', CONSOLE_LINE_BYTES);
+	strcpy(long_line + CONSOLE_LINE_BYTES, "\nhelp\n");
+	check("line too long", long_line, strlen(long_line), "overlong\nhelp\n");
+	printf("%d cases, fed whole and in chunks of 1 to 7 bytes\n", (int)(sizeof(cases) / sizeof(cases[0])) + 2);
+
+	while (length + 40 < sizeof(stream))
+	{
+		const char* command = mix[lines++ % 5];
+
+		memcpy(stream + length, command, strlen(command));
+		length += strlen(command);
+	}
+	lines = 0;
+	start = clock();
+	for (int pass = 0; pass < RATE_PASSES; pass++)
+	{
+		console_line_clear(&line);
+		for (size_t i = 0; i < length; i++)
+		{
+			if (console_line_put(&line, stream[i]) != CONSOLE_LINE_PENDING)
+			{
+				lines++;
+				console_line_clear(&line);
+			}
+		}
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("host: %.0f MB/s, %.1f M lines/s\n", RATE_PASSES * length / seconds / 1e6, lines / seconds / 1e6);
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
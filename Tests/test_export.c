@@ -0,0 +1,340 @@
+/**
+ * @file test_export.c
+ * @author Auska Wang
+ * @brief Runs exports of the three sources over a simulated serial line, decodes every
+ *        frame as a receiver would and times the transfer on the line.
+ *
+ *        30 synthetic hours of samples every 2 s are fed to the flash log (3 pages held
+ *        in RAM, so the ring has lapped), the history and the packed history. Each
+ *        export then runs from its oldest offset in a simulated main loop: a pass calls
+ *        export_task() and takes LOOP_US, while the transmit ring drains at
+ *        TELEMETRY_BAUD, 10 bit times a byte. The decoder splits the captured bytes at
+ *        zeros, undoes COBS and checks the CRC of every frame, then checks:
+ *        - blocks chain, each block's first offset is the previous block's next offset;
+ *        - log records are the ones flash_log_read() returns, in sequence order;
+ *        - history records tile the time, no record starts before the previous ended;
+ *        - samples come in tick order with the values that were fed;
+ *        - the end frame counts the records decoded.
+ *        The log is exported again with slower loop passes to show when refilling the
+ *        ring stops keeping the line busy. The line time is simulated, not measured on a
+ *        board with a receiving PC.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <string.h>
+#include "export.h"
+#include "general.h"
+#include "telemetry.h"
+#include "uart_tx.h"
+#include "flash_log.h"
+#include "history.h"
+#include "packed_history.h"
+#include "crc.h"
+#include "config.h"
+
+/* Defines */
+#define PAGES 3
+#define FILL_HOURS 30
+#define SAMPLE_MS 2000U
+#define LOOP_US 100					//main loop pass, simulated
+#define CAPTURE_BYTES (256 * 1024)
+
+/**
+ * @brief What the decoder found in one export.
+ */
+typedef struct {
+	uint32_t frames;
+	uint32_t bad_frames;			//COBS or CRC error, wrong type or source
+	uint32_t blocks;
+	uint32_t records;
+	uint32_t breaks;				//block not starting at the previous one's next offset
+	uint32_t wrong;					//records out of order or not as fed
+	uint32_t ends;
+	uint32_t end_records;
+} Decoded;
+
+/* Variables */
+uint8_t stub_flash[PAGES * FLASH_PAGE_SIZE] __attribute__((aligned(8)));
+__asm__(".global _flash_log_start\n.set _flash_log_start, stub_flash\n"
+		".global _flash_log_end\n.set _flash_log_end, stub_flash + 3 * 2048");
+
+Uart_Tx_Stats uart_tx_stats;
+
+static uint64_t now_us = 0;
+static uint32_t queued = 0;				//bytes in the transmit ring
+static uint32_t line_bits = 0;			//bit times sent of the byte on the wire, times TELEMETRY_BAUD
+static uint64_t last_byte_us = 0;		//the last byte left the wire
+static uint8_t capture[CAPTURE_BYTES];
+static uint32_t captured = 0;
+static int failures = 0;
+
+uint32_t HAL_GetTick(void) { return (uint32_t)(now_us / 1000); }
+uint32_t get_cycle_count(void) { return 0; }
+uint8_t i2c_bus_idle(void) { return 1; }
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { return HAL_OK; }
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	memcpy(stub_flash + (uint32_t)(Address - FLASH_BASE), &Data, 8);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError)
+{
+	memset(stub_flash + pEraseInit->Page * FLASH_PAGE_SIZE, 0xFF, pEraseInit->NbPages * FLASH_PAGE_SIZE);
+	return HAL_OK;
+}
+
+uint16_t uart_tx_free(void)
+{
+	return (uint16_t)(UART_TX_RING_BYTES - 1 - queued);
+}
+
+uint8_t uart_tx_write(const uint8_t* data, uint16_t length)
+{
+	if (length > uart_tx_free())
+	{
+		uart_tx_stats.dropped_writes++;
+		return 0;
+	}
+	memcpy(&capture[captured], data, length);
+	captured += length;
+	queued += length;
+	uart_tx_stats.bytes += length;
+	return 1;
+}
+
+/**
+ * @brief Advances the simulated time, the line sending what the ring holds meanwhile.
+ *
+ * @param us Microseconds
+ * @return None
+ */
+static void advance(uint32_t us)
+{
+	for (uint32_t i = 0; i < us; i++)
+	{
+		now_us++;
+		if (queued == 0)
+		{
+			line_bits = 0;
+			continue;
+		}
+		line_bits += TELEMETRY_BAUD / 1000;		//bit times per ms, so per us times 1000
+		if (line_bits >= 10 * 1000000U / 1000)
+		{
+			line_bits -= 10 * 1000000U / 1000;
+			queued--;
+			if (queued == 0)
+				last_byte_us = now_us;
+		}
+	}
+}
+
+/**
+ * @brief Reads a little endian word.
+ *
+ * @param bytes 4 bytes
+ * @return Word
+ */
+static uint32_t get_u32(const uint8_t* bytes)
+{
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+/**
+ * @brief Undoes COBS.
+ *
+ * @param in Frame without its delimiter, length Its length, out Decoded bytes
+ * @return Decoded length, -1 if malformed
+ */
+static int cobs_decode(const uint8_t* in, uint32_t length, uint8_t* out)
+{
+	uint32_t i = 0;
+	int n = 0;
+
+	while (i < length)
+	{
+		uint8_t code = in[i++];
+
+		if (code == 0)
+			return -1;
+		for (uint8_t j = 1; j < code; j++)
+		{
+			if (i >= length)
+				return -1;
+			out[n++] = in[i++];
+		}
+		if (code < 0xFF && i < length)
+			out[n++] = 0;
+	}
+	return n;
+}
+
+/**
+ * @brief Checks the records of a block against the source they came from.
+ *
+ * @param source Source, records First record, count Number of records, last Offset of
+ *        the previous record, continued
+ * @return Records that are wrong
+ */
+static uint32_t check_records(EXPORT_SOURCE source, const uint8_t* records, uint8_t count, uint32_t* last)
+{
+	uint32_t wrong = 0;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (source == EXPORT_LOG)
+		{
+			Flash_Log_Record record, stored;
+
+			memcpy(&record, &records[i * FLASH_LOG_RECORD_BYTES], FLASH_LOG_RECORD_BYTES);
+			wrong += !flash_log_read(record.sequence, &stored) || memcmp(&record, &stored, sizeof(record)) != 0
+					|| (*last != 0 && (int32_t)(record.sequence - *last) <= 0);
+			*last = record.sequence;
+		}
+		else if (source == EXPORT_HISTORY)
+		{
+			static const uint32_t span_ms[HISTORY_TIERS] = {1, HISTORY_MINUTE_MS, HISTORY_HOUR_MS};
+			const uint8_t* r = &records[i * EXPORT_HISTORY_RECORD_BYTES];
+
+			wrong += r[6] >= HISTORY_TIERS || (*last != 0 && (int32_t)(get_u32(r) - *last) < 0);
+			*last = get_u32(r) + span_ms[r[6] % HISTORY_TIERS];
+		}
+		else
+		{
+			const uint8_t* r = &records[i * EXPORT_SAMPLE_RECORD_BYTES];
+			uint32_t time_ms = get_u32(r);
+
+			wrong += (*last != 0 && (int32_t)(time_ms - *last) <= 0)
+					|| (int16_t)(r[4] | r[5] << 8) != (int16_t)(time_ms / 1000 % 400)
+					|| (int16_t)(r[6] | r[7] << 8) != (int16_t)(time_ms / SAMPLE_MS % 300);
+			*last = time_ms;
+		}
+	}
+	return wrong;
+}
+
+/**
+ * @brief Decodes the captured bytes of one export.
+ *
+ * @param source Source expected in every block
+ * @return What was found
+ */
+static Decoded decode(EXPORT_SOURCE source)
+{
+	static const uint8_t record_bytes[] = {FLASH_LOG_RECORD_BYTES, EXPORT_HISTORY_RECORD_BYTES, EXPORT_SAMPLE_RECORD_BYTES};
+	Decoded result = {0};
+	uint8_t frame[TELEMETRY_FRAME_BYTES];
+	uint32_t start = 0, next = 0, last = 0;
+
+	for (uint32_t i = 0; i < captured; i++)
+	{
+		if (capture[i] != 0)
+			continue;
+		uint32_t length = i - start;
+		int n = length > TELEMETRY_FRAME_BYTES ? -1 : cobs_decode(&capture[start], length, frame);
+
+		start = i + 1;
+		if (length == 0)
+			continue;		//the lone delimiter an export starts with
+		result.frames++;
+		if (n < 3 || crc16_ccitt(frame, (uint16_t)(n - 2)) != (frame[n - 2] | frame[n - 1] << 8) || frame[1] != source)
+		{
+			result.bad_frames++;
+			continue;
+		}
+		if (frame[0] == TELEMETRY_FRAME_EXPORT_BLOCK && n - 2 == EXPORT_HEADER_BYTES + frame[10] * record_bytes[source])
+		{
+			result.breaks += result.blocks > 0 && get_u32(&frame[2]) != next;
+			next = get_u32(&frame[6]);
+			result.blocks++;
+			result.records += frame[10];
+			result.wrong += check_records(source, &frame[EXPORT_HEADER_BYTES], frame[10], &last);
+		}
+		else if (frame[0] == TELEMETRY_FRAME_EXPORT_END)
+		{
+			result.ends++;
+			result.end_records = get_u32(&frame[6]);
+		}
+		else
+			result.bad_frames++;
+	}
+	return result;
+}
+
+/**
+ * @brief Runs an export in the simulated main loop until its last byte left the wire,
+ *        decodes it and prints the transfer.
+ *
+ * @param name Source name, source Source, loop_us Main loop pass
+ * @return Transfer time in microseconds, start to last byte sent
+ */
+static uint64_t run_export(const char* name, EXPORT_SOURCE source, uint32_t loop_us)
+{
+	uint64_t start_us = now_us;
+	Decoded result;
+
+	captured = 0;
+	export_start(source, export_oldest(source));
+	while (export_active())
+	{
+		export_task();
+		advance(loop_us);
+	}
+	while (queued)
+		advance(1);
+
+	result = decode(source);
+	printf("%s, %u us passes: %u records in %u blocks, %u bytes in %.1f ms on the line (export_stats %u ms, %u bytes)\n",
+			name, loop_us, result.records, result.blocks, captured, (last_byte_us - start_us) / 1000.0,
+			export_stats.last_ms, export_stats.last_bytes);
+	if (result.bad_frames || result.breaks || result.wrong || result.ends != 1 || result.end_records != result.records
+			|| result.records == 0 || export_stats.last_bytes != captured)
+	{
+		printf("  %u bad frames, %u breaks, %u wrong records, %u end frames counting %u\n", result.bad_frames,
+				result.breaks, result.wrong, result.ends, result.end_records);
+		failures++;
+	}
+	return last_byte_us - start_us;
+}
+
+int main(void)
+{
+	uint64_t line_us, slow_us;
+	uint32_t bytes;
+
+	memset(stub_flash, 0xFF, sizeof(stub_flash));
+	flash_log_init();
+	for (uint32_t t = SAMPLE_MS; t < FILL_HOURS * 3600000U; t += SAMPLE_MS)
+	{
+		int16_t values[HISTORY_CHANNELS] = {(int16_t)(t / 1000 % 400), (int16_t)(t / SAMPLE_MS % 300)};
+
+		now_us = (uint64_t)t * 1000;
+		flash_log_add(values, t);
+		flash_log_task();
+		history_add(values, t);
+		packed_history_add(values, t);
+	}
+	advance(SAMPLE_MS * 1000);
+
+	line_us = run_export("log", EXPORT_LOG, LOOP_US);
+	bytes = captured;
+	if (line_us > (uint64_t)bytes * 10 * 1000000 / TELEMETRY_BAUD * 101 / 100)
+	{
+		printf("the line went idle during the log export\n");
+		failures++;
+	}
+	run_export("history", EXPORT_HISTORY, LOOP_US);
+	run_export("samples", EXPORT_SAMPLES, LOOP_US);
+	for (uint32_t loop_us = 2000; loop_us <= 8000; loop_us *= 2)
+	{
+		slow_us = run_export("log", EXPORT_LOG, loop_us);
+		printf("  %.0f %% of the line's rate\n", 100.0 * line_us / slow_us);
+	}
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
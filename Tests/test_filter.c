@@ -0,0 +1,94 @@
+/**
+ * @file test_filter.c
+ * @author Auska Wang
+ * @brief Checks filter.c, with the stages set in config.h, on a synthetic trace.
+ *
+ *        3000 frames at 2 s: temperature 20.0 C plus a 3.0 C swing, humidity 50.0 %,
+ *        with uniform noise of up to 0.2 C and 0.6 %. Every 97th frame has a +80.0 C
+ *        spike, and at frame 1500 the temperature steps up by 30.0 C for good, as if
+ *        the unit were carried outdoors. The trace is synthetic, not a recording.
+ *        - every spike must be dropped, and nothing else but the step;
+ *        - the step must be taken on its FILTER_REJECT_LIMIT + 1th frame;
+ *        - the RMS error of the accepted frames against the noiseless trace must be
+ *          lower after the filter than before, away from the step.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "filter.h"
+#include "config.h"
+
+/* Defines */
+#define FRAMES 3000
+#define STEP_AT 1500
+#define SPIKE_EVERY 97
+#define SETTLE_FRAMES 20		//frames after the start and the step left out of the RMS
+
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+
+int main(void)
+{
+	double raw_squares = 0, filtered_squares = 0;
+	uint32_t now_ms = 0, expected_rejects = 0;
+	int compared = 0, failures = 0, step_taken = -1;
+
+	srand(1);
+	for (int i = 0; i < FRAMES; i++)
+	{
+		double truth = 200 + (i >= STEP_AT ? 300 : 0) + 30 * sin(i / 200.0);
+		int noise = rand() % 5 - 2;
+		int spike = i % SPIKE_EVERY == 5;
+		int16_t values[HISTORY_CHANNELS];
+		int16_t raw;
+		uint8_t accepted;
+
+		now_ms += 2000;
+		values[HISTORY_TEMPERATURE] = (int16_t)lround(truth) + noise + (spike ? 800 : 0);
+		values[HISTORY_HUMIDITY] = 500 + noise * 3;
+		raw = values[HISTORY_TEMPERATURE];
+		accepted = filter_apply(values, now_ms);
+
+		if (spike)
+		{
+			expected_rejects++;
+			if (accepted)
+			{
+				printf("spike at frame %d accepted\n", i);
+				failures++;
+			}
+		}
+		else if (i >= STEP_AT && step_taken < 0)
+		{
+			if (accepted)
+				step_taken = i;
+			else
+				expected_rejects++;
+		}
+		else if (!accepted)
+		{
+			printf("frame %d dropped\n", i);
+			failures++;
+		}
+
+		if (accepted && !spike && i > SETTLE_FRAMES && (i < STEP_AT || i > STEP_AT + SETTLE_FRAMES))
+		{
+			raw_squares += (raw - truth) * (raw - truth);
+			filtered_squares += (values[HISTORY_TEMPERATURE] - truth) * (values[HISTORY_TEMPERATURE] - truth);
+			compared++;
+		}
+	}
+
+	printf("%u frames, %u dropped, %u restarts, step taken at frame %d\n", filter_stats.frames,
+			filter_stats.rejected, filter_stats.reseeds, step_taken);
+	printf("RMS error of %d frames: %.2f tenths raw, %.2f filtered\n", compared, sqrt(raw_squares / compared),
+			sqrt(filtered_squares / compared));
+	failures += filter_stats.rejected != expected_rejects;
+	failures += step_taken != STEP_AT + FILTER_REJECT_LIMIT || filter_stats.reseeds != 1;
+	failures += filtered_squares >= raw_squares;
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
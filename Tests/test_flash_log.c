@@ -0,0 +1,220 @@
+/**
+ * @file test_flash_log.c
+ * @author Auska Wang
+ * @brief Checks that flash_log.c finds its head again after every kind of reset and
+ *        that every record it reports is readable.
+ *
+ *        The 3 log pages are a RAM array; the flash calls program and erase it and
+ *        refuse to program a double word that is not erased. A reset is simulated by
+ *        clearing the module's RAM state and calling flash_log_init() again. Cases:
+ *        - pages left over by another image, then a fresh log;
+ *        - three laps of the ring, with a reset after each;
+ *        - a record torn by a reset between its two double words;
+ *        - slot 0 of a page torn by a failed program, records after it intact.
+ *        After each reset the next sequence must be where writing stopped (past a torn
+ *        record) and every record from flash_log_oldest() on must read back.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include "../Core/Src/flash_log.c"
+
+/* Defines */
+#define PAGES 3
+#define INTERVAL_MS (FLASH_LOG_INTERVAL_S * 1000U)
+
+/* Variables */
+uint8_t stub_flash[PAGES * FLASH_PAGE_SIZE] __attribute__((aligned(8)));
+__asm__(".global _flash_log_start\n.set _flash_log_start, stub_flash\n"
+		".global _flash_log_end\n.set _flash_log_end, stub_flash + 3 * 2048");
+
+static int fail_program = -1;		//program calls until one fails, -1 never
+static int stop_program = -1;		//program calls until the power goes, -1 never
+static int overwrites = 0;			//programs of a double word that was not erased
+static uint32_t torn[2];			//sequences of the records torn on purpose
+static int torn_count = 0;
+static uint32_t now_ms = 0;
+static int failures = 0;
+
+uint32_t HAL_GetTick(void) { return now_ms; }
+uint32_t get_cycle_count(void) { return 0; }
+uint8_t i2c_bus_idle(void) { return 1; }
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { return HAL_OK; }
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint8_t* target = stub_flash + (uint32_t)(Address - FLASH_BASE);
+
+	if (stop_program == 0)
+		return HAL_OK;		//powered off, nothing reaches the flash
+	if (stop_program > 0)
+		stop_program--;
+	if (fail_program >= 0 && fail_program-- == 0)
+		return HAL_ERROR;
+	for (int i = 0; i < 8; i++)
+	{
+		if (target[i] != 0xFF)
+		{
+			overwrites++;
+			return HAL_ERROR;
+		}
+	}
+	memcpy(target, &Data, 8);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError)
+{
+	if (stop_program == 0)
+		return HAL_OK;
+	memset(stub_flash + pEraseInit->Page * FLASH_PAGE_SIZE, 0xFF, pEraseInit->NbPages * FLASH_PAGE_SIZE);
+	return HAL_OK;
+}
+
+/**
+ * @brief Simulates a reset: RAM state is lost, the flash keeps what was programmed.
+ *
+ * @return None
+ */
+static void reset(void)
+{
+	head_page = 0xA5;
+	head_slot = 0xA5A5;
+	head_base = 0xA5A5A5A5;
+	oldest_sequence = 0xA5A5A5A5;
+	boot = 0;
+	head_erased = 0;
+	queue_first = 0;
+	queue_length = 0;
+	interval_count = 0;
+	stop_program = -1;
+	flash_log_init();
+}
+
+/**
+ * @brief Logs records, one interval each, and lets the task program them.
+ *
+ * @param count Records to log
+ * @return None
+ */
+static void log_records(int count)
+{
+	int16_t values[HISTORY_CHANNELS];
+
+	for (int i = 0; i <= count; i++)	//the interval closes on the first sample of the next
+	{
+		values[HISTORY_TEMPERATURE] = (int16_t)(now_ms / INTERVAL_MS % 400);
+		values[HISTORY_HUMIDITY] = boot;
+		flash_log_add(values, now_ms);
+		if (i < count)
+			now_ms += INTERVAL_MS;
+		for (int pass = 0; pass < 3; pass++)
+			flash_log_task();
+	}
+	interval_count = 0;		//the open interval is not part of the test
+}
+
+/**
+ * @brief Reads every record from flash_log_oldest() on, except the torn ones.
+ *
+ * @param name Case
+ * @return Records read
+ */
+static uint32_t check_readable(const char* name)
+{
+	Flash_Log_Record record;
+	uint32_t read = 0;
+	int skipped;
+
+	for (uint32_t sequence = flash_log_oldest(); sequence != flash_log_next(); sequence++)
+	{
+		if (flash_log_read(sequence, &record) && record.sequence == sequence
+				&& record.values[HISTORY_TEMPERATURE] == (int16_t)(record.uptime_s * 1000U / INTERVAL_MS % 400))
+		{
+			read++;
+			continue;
+		}
+		skipped = 0;
+		for (int i = 0; i < torn_count; i++)
+			skipped |= sequence == torn[i];
+		if (!skipped)
+		{
+			printf("%s: record %u unreadable\n", name, sequence);
+			failures++;
+			break;
+		}
+	}
+	return read;
+}
+
+/**
+ * @brief Checks the next sequence after a reset.
+ *
+ * @param name Case, expected Next sequence
+ * @return None
+ */
+static void check_next(const char* name, uint32_t expected)
+{
+	if (flash_log_next() != expected)
+	{
+		printf("%s: next %u after the reset, expected %u\n", name, flash_log_next(), expected);
+		failures++;
+	}
+}
+
+int main(void)
+{
+	uint32_t next, read;
+
+	memset(stub_flash, 0x5A, sizeof(stub_flash));
+	reset();
+	check_next("another image", 0);
+	log_records(200);
+	read = check_readable("another image");
+	printf("another image: %u of 200 records\n", read);
+
+	for (int lap = 0; lap < 3; lap++)
+	{
+		log_records(PAGES * RECORDS_PER_PAGE);
+		next = flash_log_next();
+		reset();
+		check_next("laps", next);
+		read = check_readable("laps");
+		printf("lap %d: next %u, %u records readable, boot %u\n", lap + 1, next, read, boot);
+		if (read < (PAGES - 1) * RECORDS_PER_PAGE)
+			failures++;
+	}
+
+	//reset after the first double word of a record, the next boot skips that slot
+	log_records(5);
+	next = flash_log_next();
+	stop_program = 1;
+	log_records(1);
+	torn[torn_count++] = next;
+	reset();
+	check_next("torn by a reset", next + 1);
+	log_records(10);
+	read = check_readable("torn by a reset");
+	printf("torn by a reset: record %u skipped, next %u, %u records readable\n", next, flash_log_next(), read);
+
+	//slot 0 of a page torn by a failed program; the page must still be found
+	log_records((RECORDS_PER_PAGE - flash_log_next() % RECORDS_PER_PAGE) % RECORDS_PER_PAGE);
+	next = flash_log_next();	//slot 0 of a new page comes next
+	torn[torn_count++] = next;
+	fail_program = 1;
+	log_records(40);
+	next += 41;
+	reset();
+	check_next("slot 0 torn", next);
+	read = check_readable("slot 0 torn");
+	printf("slot 0 torn: next %u, %u records readable\n", flash_log_next(), read);
+
+	if (overwrites)
+	{
+		printf("%d programs of a double word that was not erased\n", overwrites);
+		failures++;
+	}
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file test_forecast.c
+ * @author Auska Wang
+ * @brief Checks forecast.c: its O(1) sums against a least squares fit recomputed in
+ *        double precision, and its slopes and dew point estimate on linear ramps.
+ *
+ *        - 20000 noisy frames at 2 to 3 s: after every frame, each channel's level and
+ *          slope must equal the double precision fit through the points in its window,
+ *          rounded the same way.
+ *        - staircase ramps of +0.5, -1.0 and -1.0 per minute, sampled every 2 s, then
+ *          every 30 s so intervals are interpolated: slopes within 1 hundredth per
+ *          minute of the ramp once the window is full, and the minutes until the
+ *          spread reaches 0 within 1 of the truth.
+ *        - a gap as long as the window: no trend on the frame after it.
+ *        The frames are synthetic.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../Core/Src/forecast.c"
+
+/* Defines */
+#define NOISY_FRAMES 20000
+
+/* Variables */
+static int failures = 0;
+
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+
+/**
+ * @brief Fits a line through a channel's window in double precision.
+ *
+ * @param channel Channel, level and slope Filled in, rounded like forecast_get()
+ * @return None
+ */
+static void reference_fit(FORECAST_CHANNEL channel, int16_t* level, int16_t* slope)
+{
+	double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0, per_point, mean_x, mean_y;
+	uint8_t oldest = count < FORECAST_POINTS ? 0 : head;
+
+	for (int x = 0; x < count; x++)
+	{
+		double y = windows[channel].points[(oldest + x) % FORECAST_POINTS];
+
+		sum_x += x;
+		sum_y += y;
+		sum_xx += (double)x * x;
+		sum_xy += x * y;
+	}
+	mean_x = sum_x / count;
+	mean_y = sum_y / count;
+	per_point = (sum_xy - count * mean_x * mean_y) / (sum_xx - count * mean_x * mean_x);
+	*slope = (int16_t)lround(per_point * 10 * 60 / FORECAST_INTERVAL_S);
+	*level = (int16_t)lround(mean_y + per_point * (count - 1 - mean_x));
+}
+
+/**
+ * @brief Feeds noisy frames and compares every channel with the reference after each.
+ *
+ * @return None
+ */
+static void check_against_reference(void)
+{
+	int16_t values[FORECAST_CHANNELS] = {215, 480, 90};
+	uint32_t now_ms = 1000, compared = 0, differed = 0;
+
+	srand(7);
+	for (int i = 0; i < NOISY_FRAMES; i++)
+	{
+		now_ms += 2000 + rand() % 1000;
+		for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+			values[ch] += rand() % 7 - 3;
+		forecast_add(values, now_ms);
+
+		for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+		{
+			Forecast forecast;
+			int16_t level, slope;
+
+			if (!forecast_get((FORECAST_CHANNEL)ch, &forecast))
+				continue;
+			reference_fit((FORECAST_CHANNEL)ch, &level, &slope);
+			compared++;
+			if (forecast.level != level || forecast.slope != slope)
+			{
+				if (differed++ < 5)
+					printf("frame %d channel %d: level %d slope %d, reference %d %d\n", i, ch, forecast.level,
+							forecast.slope, level, slope);
+			}
+		}
+	}
+	printf("noisy frames: %u fits compared, %u differ from the reference\n", compared, differed);
+	failures += differed != 0;
+}
+
+/**
+ * @brief Feeds ramps at a sampling interval and checks the slopes and dew point estimate.
+ *
+ * @param name Case, interval_ms Time between frames, now_ms Start, continued
+ * @return None
+ */
+static void check_ramps(const char* name, uint32_t interval_ms, uint32_t* now_ms)
+{
+	static const int16_t expected[FORECAST_CHANNELS] = {50, -100, -100};		//hundredths per minute
+	uint32_t start_ms = *now_ms;
+	int worst_slope = 0, worst_minutes = 0;
+
+	for (int i = 0; i < 600 * 1000 / (int)interval_ms + FORECAST_POINTS; i++)
+	{
+		uint32_t elapsed_ms = *now_ms - start_ms;
+		int16_t values[FORECAST_CHANNELS] = {
+			(int16_t)(200 + elapsed_ms / 12000),		//+1 tenth per 12 s
+			(int16_t)(600 - elapsed_ms / 6000),			//-1 tenth per 6 s
+			(int16_t)(400 - elapsed_ms / 6000)
+		};
+		Forecast forecast;
+
+		forecast_add(values, *now_ms);
+		if (elapsed_ms >= (FORECAST_POINTS + 1) * FORECAST_INTERVAL_S * 1000U)
+		{
+			for (int ch = 0; ch < FORECAST_CHANNELS; ch++)
+			{
+				forecast_get((FORECAST_CHANNEL)ch, &forecast);
+				if (abs(forecast.slope - expected[ch]) > worst_slope)
+					worst_slope = abs(forecast.slope - expected[ch]);
+			}
+			if (values[FORECAST_DEW_SPREAD] > 0)
+			{
+				int truth = values[FORECAST_DEW_SPREAD];	//tenths of a minute at 1 tenth per 6 s
+
+				forecast_get(FORECAST_DEW_SPREAD, &forecast);
+				if (abs(forecast_minutes_until(&forecast, 0) * 10 - truth) > worst_minutes)
+					worst_minutes = abs(forecast_minutes_until(&forecast, 0) * 10 - truth);
+			}
+		}
+		*now_ms += interval_ms;
+	}
+	printf("%s: slopes at most %d hundredths/min off, dew point estimate at most %d.%d min off\n", name,
+			worst_slope, worst_minutes / 10, worst_minutes % 10);
+	failures += worst_slope > 1 || worst_minutes > 10;
+}
+
+int main(void)
+{
+	uint32_t now_ms;
+	int16_t values[FORECAST_CHANNELS] = {200, 500, 100};
+	Forecast forecast;
+
+	check_against_reference();
+
+	now_ms = 10000000;					//each ramp starts after a gap, so from an empty window
+	check_ramps("ramps every 2 s", 2000, &now_ms);
+	now_ms += FORECAST_POINTS * FORECAST_INTERVAL_S * 1000U;
+	check_ramps("ramps every 30 s", 30000, &now_ms);
+
+	now_ms += FORECAST_POINTS * FORECAST_INTERVAL_S * 1000U;
+	forecast_add(values, now_ms);
+	if (forecast_get(FORECAST_TEMPERATURE, &forecast))
+	{
+		printf("trend reported right after a gap as long as the window\n");
+		failures++;
+	}
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,290 @@
+/**
+ * @file test_modbus.c
+ * @author Auska Wang
+ * @brief Replays Modbus RTU requests through modbus.c's reception path and reports the
+ *        response latency.
+ *
+ *        A request is written into rx[] where the DMA would put it, wrapping around, then
+ *        the idle line and TIM17 handling run as their interrupts would, and
+ *        modbus_task() answers; the response is taken from the transmit ring.
+ *        - each request of the table must get the function or exception code listed, a
+ *          good CRC, or no answer for another slave, a broadcast or a bad CRC;
+ *        - input registers 8 and 9 must read back the latency modbus_stats holds;
+ *        - a mix of reads and writes is replayed 100000 times with no frame lost.
+ *        get_cycle_count() counts the host's time in 48 MHz cycles, so the latency, from
+ *        the end of the gap to the response queued, is the host's. On target it is
+ *        read from the same registers.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <time.h>
+#include "../Core/Src/modbus.c"
+
+/* Defines */
+#define NO_ANSWER -1
+#define REPLAYS 100000
+
+/**
+ * @brief A request, its data in hex without address and CRC, and the expected answer:
+ *        the function code, the exception code or'ed with EXCEPTION, or NO_ANSWER.
+ */
+typedef struct {
+	const char* name;
+	uint8_t address;
+	const char* hex;
+	int expected;
+} Request;
+
+/* Variables */
+TEMP_UNITS temp_units = FAHRENHEIT;
+uint8_t light_mode = 1;
+UART_HandleTypeDef huart2;
+TIM_HandleTypeDef htim17;
+Alarm_Stats alarm_stats = {.raised = 3};
+Filter_Stats filter_stats = {.rejected = 7};
+
+static DMA_Channel_TypeDef dma_channel = {MODBUS_RX_BYTES};
+static DMA_HandleTypeDef dma = {&dma_channel};
+static uint8_t sent[MODBUS_MAX_FRAME];
+static uint16_t sent_length = 0;
+static Calibration_Point points[HISTORY_CHANNELS][CALIBRATION_MAX_POINTS] = {{{0, 0}, {1000, 1000}}, {{0, 0}, {1000, 1000}}};
+static uint8_t point_counts[HISTORY_CHANNELS] = {2, 2};
+static int16_t thresholds[ALARM_RULES] = {300, 50, 700, 300, 150};
+static uint32_t fixed_ms = 0;
+static int failures = 0;
+
+static const Request requests[] = {
+	{"read input 0 to 9", MODBUS_ADDRESS, "0400000009", READ_INPUT},
+	{"read input statistics", MODBUS_ADDRESS, "04000A001E", READ_INPUT},
+	{"read input past the end", MODBUS_ADDRESS, "0400280001", EXCEPTION | ILLEGAL_ADDRESS},
+	{"read 126 registers", MODBUS_ADDRESS, "040000007E", EXCEPTION | ILLEGAL_VALUE},
+	{"read holding 0 to 8", MODBUS_ADDRESS, "0300000009", READ_HOLDING},
+	{"read holding calibration", MODBUS_ADDRESS, "03000A0011", READ_HOLDING},
+	{"write units", MODBUS_ADDRESS, "0600000001", WRITE_SINGLE},
+	{"write units out of range", MODBUS_ADDRESS, "0600000002", EXCEPTION | ILLEGAL_VALUE},
+	{"write interval", MODBUS_ADDRESS, "060002000A", WRITE_SINGLE},
+	{"write threshold", MODBUS_ADDRESS, "060004012C", WRITE_SINGLE},
+	{"write unassigned", MODBUS_ADDRESS, "0600090001", EXCEPTION | ILLEGAL_ADDRESS},
+	{"write several", MODBUS_ADDRESS, "100000000204 0000 0001", WRITE_MULTIPLE},
+	{"write several, one bad", MODBUS_ADDRESS, "100000000204 0001 0005", EXCEPTION | ILLEGAL_VALUE},
+	{"write calibration", MODBUS_ADDRESS, "10000A00070E 0003 FFD8 FFD6 0064 0064 01F4 01F7", WRITE_MULTIPLE},
+	{"calibration not monotonic", MODBUS_ADDRESS, "10001E00050A 0002 0064 0064 0032 0032", EXCEPTION | ILLEGAL_VALUE},
+	{"unknown function", MODBUS_ADDRESS, "0800000000", EXCEPTION | ILLEGAL_FUNCTION},
+	{"other slave", MODBUS_ADDRESS + 1, "0300000001", NO_ANSWER},
+	{"broadcast", BROADCAST, "0600000000", NO_ANSWER},
+};
+
+uint32_t HAL_GetTick(void) { return 123456789; }
+void display_set_units(TEMP_UNITS units) { temp_units = units; }
+void display_set_light(uint8_t on) { light_mode = on; }
+int16_t comfort_dew_point(int16_t temperature, int16_t humidity) { return 111; }
+uint8_t alarm_latched(void) { return 1; }
+uint8_t alarm_near(void) { return 0; }
+void alarm_acknowledge(void) { }
+uint8_t alarm_threshold_valid(uint8_t rule, int32_t value) { return value >= -400 && value <= 800; }
+void alarm_set_threshold(uint8_t rule, int16_t value) { thresholds[rule] = value; }
+void scheduler_set_fixed(uint32_t interval_ms) { fixed_ms = interval_ms; }
+uint32_t scheduler_fixed(void) { return fixed_ms; }
+void sampling_set_interval(uint32_t interval_ms) { }
+
+int16_t alarm_threshold(uint8_t rule, ALARM_SOURCE* source, ALARM_DIRECTION* direction)
+{
+	return thresholds[rule];
+}
+
+uint8_t display_reading(int16_t* values)
+{
+	values[HISTORY_TEMPERATURE] = 234;
+	values[HISTORY_HUMIDITY] = 456;
+	return 1;
+}
+
+uint8_t calibration_points(HISTORY_CHANNEL channel, Calibration_Point* out)
+{
+	memcpy(out, points[channel], sizeof(points[channel]));
+	return point_counts[channel];
+}
+
+Calibration_Status calibration_load(HISTORY_CHANNEL channel, const Calibration_Point* in, uint8_t count)
+{
+	for (uint8_t i = 1; i < count; i++)
+	{
+		if (in[i].raw <= in[i - 1].raw)
+			return CALIBRATION_NOT_MONOTONIC;
+	}
+	memcpy(points[channel], in, count * sizeof(*in));
+	point_counts[channel] = count;
+	return CALIBRATION_OK;
+}
+
+uint8_t rolling_stats_get(STATS_CHANNEL channel, STATS_WINDOW window, Stats_Summary* out)
+{
+	out->min = -150;
+	out->mean = 2280;
+	out->max = 2410;
+	out->stddev = 45;
+	out->count = 30;
+	return window != STATS_DAY;
+}
+
+uint8_t uart_tx_write(const uint8_t* data, uint16_t length)
+{
+	memcpy(sent, data, length);
+	sent_length = length;
+	return 1;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	dma_channel.CNDTR = Size;
+	return HAL_OK;
+}
+
+/**
+ * @brief The host's time, counted in cycles of the 48 MHz core.
+ *
+ * @return Cycles
+ */
+uint32_t get_cycle_count(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint32_t)((time.tv_sec * 1000000000ULL + time.tv_nsec) * 48 / 1000);
+}
+
+/**
+ * @brief Builds a frame: address, the hex bytes (spaces allowed) and the CRC.
+ *
+ * @param address Slave, hex Function and data, frame Filled in
+ * @return Frame length
+ */
+static uint16_t build(uint8_t address, const char* hex, uint8_t* frame)
+{
+	uint16_t length = 0;
+	unsigned value;
+	int used;
+
+	frame[length++] = address;
+	while (sscanf(hex, " %2x%n", &value, &used) == 1)
+	{
+		frame[length++] = (uint8_t)value;
+		hex += used;
+	}
+	uint16_t crc = crc16_modbus(frame, length);
+
+	frame[length++] = (uint8_t)crc;
+	frame[length++] = (uint8_t)(crc >> 8);
+	return length;
+}
+
+/**
+ * @brief Receives a frame as the DMA, the idle line and TIM17 interrupts would, then lets
+ *        modbus_task() answer it.
+ *
+ * @param frame Bytes, length Number of bytes
+ * @return Response length in sent[], 0 if none
+ */
+static uint16_t receive(const uint8_t* frame, uint16_t length)
+{
+	uint16_t position = MODBUS_RX_BYTES - dma_channel.CNDTR;
+
+	for (uint16_t i = 0; i < length; i++)
+	{
+		rx[position] = frame[i];
+		position = (position + 1) % MODBUS_RX_BYTES;
+	}
+	dma_channel.CNDTR = MODBUS_RX_BYTES - position;
+	idle_position = position;		//HAL_UARTEx_RxEventCallback(), built only with MODBUS set
+	modbus_gap_elapsed();
+
+	sent_length = 0;
+	modbus_task();
+	return sent_length;
+}
+
+/**
+ * @brief Replays the table and checks each answer.
+ *
+ * @return None
+ */
+static void check_requests(void)
+{
+	uint8_t frame[MODBUS_MAX_FRAME];
+	uint16_t length;
+
+	for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++)
+	{
+		uint16_t size = receive(frame, build(requests[i].address, requests[i].hex, frame));
+		int answer = size == 0 ? NO_ANSWER : (sent[1] & EXCEPTION) ? EXCEPTION | sent[2] : sent[1];
+
+		if (answer != requests[i].expected || (size && (sent[0] != MODBUS_ADDRESS || crc16_modbus(sent, size) != 0)))
+		{
+			printf("%s: answered %d, expected %d\n", requests[i].name, answer, requests[i].expected);
+			failures++;
+		}
+	}
+
+	length = build(MODBUS_ADDRESS, "0300000001", frame);
+	frame[length - 1] ^= 0x01;		//CRC broken
+	if (receive(frame, length) != 0 || modbus_stats.crc_errors != 1)
+	{
+		printf("bad CRC answered\n");
+		failures++;
+	}
+	printf("%d requests replayed\n", (int)(sizeof(requests) / sizeof(requests[0])) + 1);
+
+	receive(frame, build(MODBUS_ADDRESS, "0400000009", frame));
+	if (get16(&sent[3]) != 234 || get16(&sent[5]) != 456 || get16(&sent[7]) != 111 || get16(&sent[17]) != 7)
+	{
+		printf("input registers 0 to 7 read wrong\n");
+		failures++;
+	}
+}
+
+int main(void)
+{
+	static const char* mix[] = {"0400000009", "04000A001E", "0300000009", "060002000A", "100000000204 0000 0001"};
+	uint8_t frame[MODBUS_MAX_FRAME];
+	uint16_t lengths[5];
+	uint8_t frames[5][MODBUS_MAX_FRAME];
+	uint64_t total_cycles = 0;
+	uint32_t answered = 0;
+
+	huart2.hdmarx = &dma;
+	modbus_init();
+	check_requests();
+
+	for (int i = 0; i < 5; i++)
+		lengths[i] = build(MODBUS_ADDRESS, mix[i], frames[i]);
+	for (int i = 0; i < REPLAYS; i++)
+	{
+		if (receive(frames[i % 5], lengths[i % 5]))
+		{
+			total_cycles += modbus_stats.last_latency_cycles;
+			answered++;
+		}
+	}
+	if (answered != REPLAYS || modbus_stats.overruns)
+	{
+		printf("%u of %u replays answered, %u overruns\n", answered, REPLAYS, modbus_stats.overruns);
+		failures++;
+	}
+
+	//the registers hold the latency of the request before the one reading them
+	uint32_t last_cycles = modbus_stats.last_latency_cycles;
+
+	receive(frame, build(MODBUS_ADDRESS, "0400080002", frame));
+	if (get16(&sent[3]) != latency_us(last_cycles) || get16(&sent[5]) != latency_us(modbus_stats.max_latency_cycles))
+	{
+		printf("latency registers read %u and %u\n", get16(&sent[3]), get16(&sent[5]));
+		failures++;
+	}
+	printf("host latency over %u replays: mean %.2f us, max %u us (input registers 8 and 9: %u, %u)\n", answered,
+			total_cycles / 48.0 / answered, CYCLES_TO_US(modbus_stats.max_latency_cycles), get16(&sent[3]), get16(&sent[5]));
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
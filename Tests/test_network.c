@@ -0,0 +1,286 @@
+/**
+ * @file test_network.c
+ * @author Auska Wang
+ * @brief Checks the frame format and the beacon handling of network.c, then follows
+ *        synthetic beacons with a node clock off by up to 1 % and checks every reading
+ *        lands inside its slot.
+ *
+ *        - telemetry_encode() and telemetry_decode(): 20000 random payloads of 1 to
+ *          TELEMETRY_MAX_PAYLOAD bytes, a third of them zeros, plus all zeros and all
+ *          0xFF; no zero before the delimiter, the payload back, and any byte changed or
+ *          the frame cut short refused.
+ *        - network_schedule(): this node's slot and the first open one found; beacons with
+ *          the wrong type, a length that does not match the table, slots too short for a
+ *          reading or not fitting the period refused.
+ *        - timing: 500 beacons every 100 ms at NETWORK_BAUD, 16 slots of 1.6 ms after a
+ *          15 ms lead. The idle line interrupt comes 0 to 20 us late, once 3 ms late, and
+ *          network_task() runs 0 to 10 ms after the beacon. The node's clock runs 1 %
+ *          slow, true or 0.8 % fast; TIM17 counts in that clock. Every frame sent must
+ *          start and end inside the node's slot, and a node left out of the table must
+ *          join in the open slot.
+ *        The beacons and clocks are simulated; no bus was measured.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../Core/Src/network.c"
+
+/* Defines */
+#define ROUND_TRIPS 20000
+#define BEACONS 500
+#define PERIOD_US 100000U
+#define LEAD_US 15000U
+#define SLOT_US 1600U
+#define SLOTS 16
+#define MY_SLOT 5
+#define OPEN_SLOT 9
+#define LATE_BEACON 200				//its idle line interrupt comes 3 ms late
+
+/* Variables */
+UART_HandleTypeDef huart2;
+TIM_HandleTypeDef htim17;
+Uart_Tx_Stats uart_tx_stats;
+
+static double now_us = 0;
+static double clock_ppm = 0;			//node clock error
+static uint16_t write_position = 0;		//where the DMA writes next in rx[]
+static uint8_t sent[TELEMETRY_FRAME_BYTES];
+static uint16_t sent_length = 0;
+static double sent_us;
+static int failures = 0;
+
+uint32_t HAL_GetTick(void) { return (uint32_t)(now_us / 1000); }
+uint8_t alarm_latched(void) { return 0; }
+uint8_t alarm_near(void) { return 0; }
+uint32_t display_reading_ms(void) { return 0; }
+uint16_t uart_tx_free(void) { return UART_TX_RING_BYTES - 1; }
+
+uint8_t display_reading(int16_t* values)
+{
+	values[0] = 215;
+	values[1] = 480;
+	return 1;
+}
+
+uint8_t uart_tx_write(const uint8_t* data, uint16_t length)
+{
+	memcpy(sent, data, length);
+	sent_length = length;
+	sent_us = now_us;
+	return 1;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	write_position = 0;
+	return HAL_OK;
+}
+
+/**
+ * @brief The node's cycle count at the simulated time, its clock off by clock_ppm.
+ *
+ * @return Cycles
+ */
+uint32_t get_cycle_count(void)
+{
+	return (uint32_t)(uint64_t)llround(now_us * CYCLES_PER_US * (1 + clock_ppm * 1e-6));
+}
+
+/**
+ * @brief Checks encoding and decoding of random and extreme payloads.
+ *
+ * @return None
+ */
+static void check_frames(void)
+{
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD], frame[TELEMETRY_FRAME_BYTES], copy[TELEMETRY_FRAME_BYTES];
+	int bad = 0, refused = 0, changes = 0;
+
+	srand(11);
+	for (int i = 0; i < ROUND_TRIPS + 2; i++)
+	{
+		uint8_t length = (uint8_t)(1 + rand() % TELEMETRY_MAX_PAYLOAD);
+
+		for (uint8_t j = 0; j < length; j++)
+			payload[j] = rand() % 3 == 0 ? 0 : (uint8_t)(1 + rand() % 255);
+		if (i >= ROUND_TRIPS)
+		{
+			length = TELEMETRY_MAX_PAYLOAD;
+			memset(payload, i == ROUND_TRIPS ? 0x00 : 0xFF, length);
+		}
+
+		uint16_t size = telemetry_encode(payload, length, frame);
+
+		if (memchr(frame, 0, size - 1) != NULL || frame[size - 1] != 0 || size > TELEMETRY_FRAME_BYTES)
+			bad++;
+		memcpy(copy, frame, size);
+		if (telemetry_decode(copy, size - 1) != length || memcmp(copy, payload, length) != 0)
+			bad++;
+
+		//one byte changed, or the frame cut short
+		memcpy(copy, frame, size);
+		copy[rand() % (size - 1)] ^= (uint8_t)(1 + rand() % 255);
+		refused += telemetry_decode(copy, size - 1) == 0;
+		memcpy(copy, frame, size);
+		refused += telemetry_decode(copy, size - 1 - (1 + rand() % (size - 2))) == 0;
+		changes += 2;
+	}
+	printf("frames: %d round trips, %d wrong, %d of %d damaged frames refused\n", ROUND_TRIPS + 2, bad, refused, changes);
+	failures += bad != 0 || refused != changes;
+}
+
+/**
+ * @brief Builds a beacon payload.
+ *
+ * @param payload Filled in, cycle Cycle, period_us Period, slot_us Slot length, slots Slot
+ *        count, with_me 1 to give this node MY_SLOT
+ * @return Payload length
+ */
+static uint8_t beacon(uint8_t* payload, uint16_t cycle, uint32_t period_us, uint16_t slot_us, uint8_t slots, uint8_t with_me)
+{
+	payload[0] = NETWORK_FRAME_BEACON;
+	put16(&payload[1], cycle);
+	put16(&payload[3], (uint16_t)period_us);
+	put16(&payload[5], (uint16_t)(period_us >> 16));
+	put16(&payload[7], LEAD_US);
+	put16(&payload[9], slot_us);
+	payload[11] = slots;
+	for (uint8_t i = 0; i < slots; i++)
+		payload[NETWORK_BEACON_BYTES + i] = (uint8_t)(NETWORK_ADDRESS + 1 + i);
+	if (with_me)
+		payload[NETWORK_BEACON_BYTES + MY_SLOT] = NETWORK_ADDRESS;
+	if (slots > OPEN_SLOT)
+		payload[NETWORK_BEACON_BYTES + OPEN_SLOT] = 0;
+	return NETWORK_BEACON_BYTES + slots;
+}
+
+/**
+ * @brief Checks the beacons network_schedule() must take and the ones it must refuse.
+ *
+ * @return None
+ */
+static void check_schedule(void)
+{
+	uint8_t payload[NETWORK_BEACON_BYTES + NETWORK_MAX_SLOTS + 1];
+	Network_Schedule schedule;
+	uint8_t length;
+	int wrong = 0;
+
+	length = beacon(payload, 7, PERIOD_US, SLOT_US, SLOTS, 1);
+	wrong += !network_schedule(payload, length, NETWORK_ADDRESS, &schedule) || schedule.slot != MY_SLOT
+			|| schedule.open_slot != OPEN_SLOT || schedule.cycle != 7 || schedule.period_us != PERIOD_US;
+	length = beacon(payload, 7, PERIOD_US, SLOT_US, SLOTS, 0);
+	wrong += !network_schedule(payload, length, NETWORK_ADDRESS, &schedule) || schedule.slot != -1;
+	length = beacon(payload, 7, PERIOD_US, SLOT_US, 0, 0);
+	wrong += !network_schedule(payload, length, NETWORK_ADDRESS, &schedule) || schedule.open_slot != -1;
+	length = beacon(payload, 7, 2000000, SLOT_US, NETWORK_MAX_SLOTS, 1);
+	wrong += !network_schedule(payload, length, NETWORK_ADDRESS, &schedule);
+
+	length = beacon(payload, 7, PERIOD_US, SLOT_US, SLOTS, 1);
+	wrong += network_schedule(payload, length - 1, NETWORK_ADDRESS, &schedule);		//table cut short
+	wrong += network_schedule(payload, NETWORK_BEACON_BYTES - 1, NETWORK_ADDRESS, &schedule);
+	payload[0] = NETWORK_FRAME_READING;
+	wrong += network_schedule(payload, length, NETWORK_ADDRESS, &schedule);
+	length = beacon(payload, 7, PERIOD_US, NETWORK_READING_US - 1, SLOTS, 1);
+	wrong += network_schedule(payload, length, NETWORK_ADDRESS, &schedule);
+	length = beacon(payload, 7, LEAD_US + SLOTS * SLOT_US - 1, SLOT_US, SLOTS, 1);
+	wrong += network_schedule(payload, length, NETWORK_ADDRESS, &schedule);
+	length = beacon(payload, 7, NETWORK_MAX_PERIOD_US + 1, SLOT_US, SLOTS, 1);
+	wrong += network_schedule(payload, length, NETWORK_ADDRESS, &schedule);
+	length = beacon(payload, 7, 10000000, SLOT_US, NETWORK_MAX_SLOTS, 1);
+	payload[11] = NETWORK_MAX_SLOTS + 1;
+	wrong += network_schedule(payload, length + 1, NETWORK_ADDRESS, &schedule);
+
+	printf("schedule: 11 beacons, %d handled wrong\n", wrong);
+	failures += wrong != 0;
+}
+
+/**
+ * @brief Follows beacons with the node clock off by clock_ppm and checks each frame sent.
+ *
+ * @param with_me 1 for beacons giving this node MY_SLOT, 0 to make it join
+ * @return None
+ */
+static void follow(uint8_t with_me)
+{
+	uint8_t payload[NETWORK_BEACON_BYTES + SLOTS], frame[TELEMETRY_FRAME_BYTES];
+	int sent_count = 0, inside = 0, wrong = 0;
+	double worst_us = SLOT_US;
+	uint8_t slot = with_me ? MY_SLOT : OPEN_SLOT;
+
+	memset(&network_stats, 0, sizeof(network_stats));
+	have_last = 0;
+	have_period = 0;
+	tx_length = 0;
+	network_init();
+	srand(5);
+	for (int b = 0; b < BEACONS; b++)
+	{
+		uint16_t size = telemetry_encode(payload, beacon(payload, (uint16_t)b, PERIOD_US, SLOT_US, SLOTS, with_me), frame);
+		double end_us = (double)b * PERIOD_US + size * NETWORK_CHAR_US;	//last byte's stop bit
+
+		for (uint16_t i = 0; i < size; i++)
+		{
+			rx[write_position] = frame[i];
+			write_position = (write_position + 1) % NETWORK_RX_BYTES;
+		}
+		now_us = end_us + NETWORK_CHAR_US + rand() % 20 + (b == LATE_BEACON ? 3000 : 0);
+		event_cycles = get_cycle_count();		//HAL_UARTEx_RxEventCallback(), built only with NETWORK set
+		event_position = write_position;
+		now_us = end_us + rand() % 10000;
+		if (now_us < end_us + NETWORK_CHAR_US + 20 + (b == LATE_BEACON ? 3000 : 0))
+			now_us = end_us + NETWORK_CHAR_US + 20 + (b == LATE_BEACON ? 3000 : 0);
+		network_task();
+		if (!htim17.enabled)
+			continue;
+
+		//TIM17 counts 10 us ticks of the node's clock
+		htim17.enabled = 0;
+		now_us += (htim17.autoreload + 1) * 10.0 / (1 + clock_ppm * 1e-6);
+		sent_length = 0;
+		network_slot_elapsed();
+		if (sent_length == 0)
+			continue;
+
+		double slot_start = end_us + LEAD_US + slot * SLOT_US;
+		double slot_end = slot_start + SLOT_US;
+		double frame_end = sent_us + sent_length * NETWORK_CHAR_US;
+		uint8_t length = telemetry_decode(sent, sent_length - 1);
+
+		sent_count++;
+		inside += sent_us >= slot_start && frame_end <= slot_end;
+		worst_us = fmin(worst_us, fmin(sent_us - slot_start, slot_end - frame_end));
+		wrong += length == 0 || sent[1] != NETWORK_ADDRESS || (with_me
+				? sent[0] != NETWORK_FRAME_READING || get16(&sent[2]) != b : sent[0] != NETWORK_FRAME_JOIN);
+	}
+
+	printf("%s, clock %+.0f ppm: %d frames, %d inside the slot, worst margin %.0f us, late %u, unsynced %u, "
+			"clock_ppm %d, handling up to %u us\n", with_me ? "readings" : "joins", clock_ppm, sent_count, inside,
+			worst_us, network_stats.late, network_stats.unsynced, network_stats.clock_ppm, network_stats.max_handling_us);
+	failures += inside != sent_count || wrong != 0 || network_stats.bad_frames != 0;
+	if (with_me)
+		failures += sent_count < BEACONS - 6 || fabs(network_stats.clock_ppm - clock_ppm) > 100;
+	else
+		failures += sent_count < BEACONS / NETWORK_JOIN_CHANCE / 2;
+}
+
+int main(void)
+{
+	static const double clocks_ppm[] = {-10000, 0, 8000};
+
+	huart2.RxState = HAL_UART_STATE_BUSY_RX;
+	check_frames();
+	check_schedule();
+	for (int i = 0; i < 3; i++)
+	{
+		clock_ppm = clocks_ppm[i];
+		follow(1);
+	}
+	follow(0);
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file test_packed_history.c
+ * @author Auska Wang
+ * @brief Checks that packed_history.c gives back every sample it still holds, from any
+ *        seek position, and reports its density on a synthetic trace.
+ *
+ *        The trace is 5000 samples at 2 s with +-2 ms tick jitter and a 70 s gap;
+ *        temperature moves by a tenth on one sample in six, humidity by up to 0.2 on
+ *        one in four. It is synthetic, not a recording of the sensor. From every 37th
+ *        sample still held, a seek must land on it and the cursor must then return
+ *        every later sample exactly and stop at the end.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include "packed_history.h"
+
+/* Defines */
+#define SAMPLES 5000
+#define SEEK_EVERY 37
+
+/* Variables */
+static int16_t values[SAMPLES][HISTORY_CHANNELS];
+static uint32_t times_ms[SAMPLES];
+
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+
+/**
+ * @brief Seeks to just before sample k and reads to the end of the history.
+ *
+ * @param k First sample expected
+ * @return 1 if every sample came back in order and nothing after the last
+ */
+static int read_from(int k)
+{
+	Packed_Cursor cursor;
+	uint32_t time_ms;
+	int16_t read[HISTORY_CHANNELS];
+
+	if (!packed_history_seek(&cursor, times_ms[k] - 1))
+		return 0;
+	for (int j = k; j < SAMPLES; j++)
+	{
+		if (!packed_history_next(&cursor, &time_ms, read) || time_ms != times_ms[j]
+			|| read[HISTORY_TEMPERATURE] != values[j][HISTORY_TEMPERATURE] || read[HISTORY_HUMIDITY] != values[j][HISTORY_HUMIDITY])
+		{
+			printf("seek to sample %d: sample %d differs\n", k, j);
+			return 0;
+		}
+	}
+	return !packed_history_next(&cursor, &time_ms, read);
+}
+
+int main(void)
+{
+	uint32_t now_ms = 1000, oldest_ms;
+	int16_t temperature = 215, humidity = 480;
+	int failures = 0, seeks = 0;
+	Packed_Cursor cursor;
+
+	srand(3);
+	for (int i = 0; i < SAMPLES; i++)
+	{
+		now_ms += 2000 + rand() % 5 - 2;
+		if (i == 2000)
+			now_ms += 70000;
+		if (rand() % 6 == 0)
+			temperature += rand() % 3 - 1;
+		if (rand() % 4 == 0)
+			humidity += rand() % 5 - 2;
+		times_ms[i] = now_ms;
+		values[i][HISTORY_TEMPERATURE] = temperature;
+		values[i][HISTORY_HUMIDITY] = humidity;
+		packed_history_add(values[i], now_ms);
+	}
+	packed_history_report();
+
+	int first = SAMPLES - (int)packed_history_stats.samples;
+	if (!packed_history_oldest(&oldest_ms) || oldest_ms != times_ms[first])
+		failures++;
+	for (int k = first; k < SAMPLES; k += SEEK_EVERY, seeks++)
+		failures += !read_from(k);
+	failures += packed_history_seek(&cursor, now_ms + 1);		//nothing after the newest sample
+	failures += !packed_history_seek(&cursor, times_ms[first] - 5000);	//before the oldest starts at it
+
+	printf("%u samples held in %u bytes, %u samples per KB (raw: 128), %.1f min of 2 s samples\n",
+		packed_history_stats.samples, packed_history_stats.bytes, packed_history_stats.samples_per_kb,
+		packed_history_stats.samples * 2.0 / 60);
+	printf("%d seeks, %d failures\n", seeks, failures);
+	return failures != 0;
+}
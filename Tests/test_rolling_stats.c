@@ -0,0 +1,120 @@
+/**
+ * @file test_rolling_stats.c
+ * @author Auska Wang
+ * @brief Checks rolling_stats.c against a brute-force recompute of every window.
+ *
+ *        200k samples at 2 s, with one read in ten late by up to 20 s and a 3 h gap
+ *        halfway, are fed through history.c and rolling_stats.c. Every 997th sample,
+ *        and the last few, each window's min, max, mean, deviation and count are
+ *        recomputed from the samples it covers:
+ *        - minute: the last 32 samples younger than 60 s;
+ *        - hour: samples from the start of the oldest closed minute;
+ *        - day: samples from the start of the oldest closed hour.
+ *        Means may differ by rounding (half a hundredth), deviations by one hundredth.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "rolling_stats.h"
+
+/* Defines */
+#define SAMPLES 200000
+#define CHECK_EVERY 997
+#define MAX_REPORTED 10
+
+/* Variables */
+static int16_t values[SAMPLES][STATS_CHANNELS];
+static uint32_t times_ms[SAMPLES];
+
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+
+/**
+ * @brief Whether sample j is in a window, as of sample i.
+ *
+ * @param window Window, i Newest sample, j Sample, start_ms Window start for hour and day
+ * @return 1 if covered
+ */
+static int covered(STATS_WINDOW window, int i, int j, uint32_t start_ms)
+{
+	if (window == STATS_MINUTE)
+		return times_ms[i] - times_ms[j] < HISTORY_MINUTE_MS && i - j < HISTORY_RAW_SAMPLES;
+	return (int32_t)(times_ms[j] - start_ms) >= 0;
+}
+
+/**
+ * @brief Recomputes one window of one channel and compares it.
+ *
+ * @param i Newest sample, window Window, channel Channel
+ * @return 1 if it matches
+ */
+static int check(int i, STATS_WINDOW window, STATS_CHANNEL channel)
+{
+	Stats_Summary summary;
+	uint8_t present = rolling_stats_get(channel, window, &summary);
+	uint32_t start_ms = 0;
+	int64_t sum = 0;
+	double squares = 0;
+	int n = 0, low = 32767, high = -32768;
+
+	if (window != STATS_MINUTE)
+		history_start_ms(window == STATS_HOUR ? HISTORY_MINUTE : HISTORY_HOUR, &start_ms);
+	for (int j = i; j >= 0; j--)
+	{
+		if (!covered(window, i, j, start_ms))
+			break;
+		int v = values[j][channel];
+		sum += v;
+		squares += (double)v * v;
+		n++;
+		low = v < low ? v : low;
+		high = v > high ? v : high;
+	}
+
+	if (!present)
+		return n == 0;
+	double mean = (double)sum / n;
+	double deviation = sqrt(squares / n - mean * mean);
+	if (summary.count == (uint32_t)n && summary.min == low * 10 && summary.max == high * 10
+		&& fabs(summary.mean - mean * 10) <= 0.51 && fabs(summary.stddev - deviation * 10) <= 1.01)
+		return 1;
+
+	printf("sample %d window %d channel %d: count %u/%d min %d/%d max %d/%d mean %d/%.2f sd %u/%.2f\n",
+		i, window, channel, summary.count, n, summary.min, low * 10, summary.max, high * 10,
+		summary.mean, mean * 10, summary.stddev, deviation * 10);
+	return 0;
+}
+
+int main(void)
+{
+	uint32_t now_ms = 12345;
+	int checks = 0, failures = 0;
+
+	srand(1);
+	rolling_stats_init();
+	for (int i = 0; i < SAMPLES; i++)
+	{
+		now_ms += 2000 + (rand() % 10 == 0 ? rand() % 20000 : 0);
+		if (i == SAMPLES / 2)
+			now_ms += 3 * HISTORY_HOUR_MS;
+		times_ms[i] = now_ms;
+		values[i][STATS_TEMPERATURE] = (i % 3000 < 1500 ? i % 1500 : 3000 - i % 3000) - 400 + rand() % 21 - 10;
+		values[i][STATS_HUMIDITY] = 300 + rand() % 700;
+		rolling_stats_add(values[i], now_ms);
+
+		if (i % CHECK_EVERY != 0 && i < SAMPLES - 5)
+			continue;
+		for (int w = 0; w < STATS_WINDOWS; w++)
+			for (int ch = 0; ch < STATS_CHANNELS; ch++)
+			{
+				checks++;
+				if (!check(i, (STATS_WINDOW)w, (STATS_CHANNEL)ch) && ++failures >= MAX_REPORTED)
+					return 1;
+			}
+	}
+
+	printf("%d samples, %d window checks, %d failures\n", SAMPLES, checks, failures);
+	return failures != 0;
+}
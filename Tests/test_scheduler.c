@@ -0,0 +1,142 @@
+/**
+ * @file test_scheduler.c
+ * @author Auska Wang
+ * @brief Runs scheduler.c over a synthetic day and reports the reads and display lines
+ *        against the fixed 2 s schedule.
+ *
+ *        The day is made up, not recorded: temperature swings 21.0 +- 1.5 C and humidity
+ *        45 -+ 4 % over 24 h, heating cycles of 20 min add up to 1.5 C from 07:00 to
+ *        09:00 and 18:00 to 22:00, a door opened at 12:00 drops the temperature by 4.0 C
+ *        and raises the humidity by 8 % over 12 minutes, and every read carries +-0.1 C
+ *        and +-0.2 % of noise. Reads pass through filter.c as configured. The display is
+ *        modelled as the readings view, temperature in F and humidity with one decimal,
+ *        one line each; a line equal to the shown one is not sent.
+ *        - no interval may exceed SCHEDULER_SLOW_S;
+ *        - once the room has moved STALE_TENTHS away from the last read, checked every
+ *          second between reads, the next read must come within SCHEDULER_SLOW_S.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "scheduler.h"
+#include "filter.h"
+#include "dht22.h"
+#include "config.h"
+
+/* Defines */
+#define DAY_MS 86400000U
+#define DOOR_MS (12 * 3600000U)
+#define DOOR_LENGTH_MS (12 * 60000U)
+#define HEATING_CYCLE_S 1200.0
+#define STALE_TENTHS 5				//room this far from the last read, either channel
+
+/* Variables */
+static uint32_t interval_ms = DHT22_MIN_INTERVAL_MS;	//TIM14 period
+
+uint32_t HAL_GetTick(void) { return 0; }
+uint32_t get_cycle_count(void) { return 0; }
+
+void sampling_set_interval(uint32_t new_interval_ms)
+{
+	interval_ms = new_interval_ms;
+}
+
+/**
+ * @brief The synthetic room at a time of day.
+ *
+ * @param s Seconds since midnight, temperature and humidity Filled in, tenths
+ * @return None
+ */
+static void room(double s, double* temperature, double* humidity)
+{
+	double hour = s / 3600;
+	double diurnal = sin((hour - 9) / 24 * 2 * M_PI);
+
+	*temperature = 210 + 15 * diurnal;
+	*humidity = 450 - 40 * diurnal;
+	if ((hour > 7 && hour < 9) || (hour > 18 && hour < 22))
+	{
+		double phase = fmod(s, HEATING_CYCLE_S) / HEATING_CYCLE_S;
+
+		*temperature += phase < 0.3 ? phase / 0.3 * 15 : 15 * (1 - (phase - 0.3) / 0.7);
+	}
+	if (s * 1000 >= DOOR_MS && s * 1000 < DOOR_MS + DOOR_LENGTH_MS)
+	{
+		double door = sin((s * 1000 - DOOR_MS) / DOOR_LENGTH_MS * M_PI);
+
+		*temperature -= 40 * door;
+		*humidity += 80 * door;
+	}
+}
+
+int main(void)
+{
+	char shown[2][24] = {"", ""}, line[2][24];
+	uint32_t now_ms = 0, written = 0, longest_ms = 0, stale_ms = 0, door_fast_ms = 0;
+	uint32_t fixed_reads = DAY_MS / DHT22_MIN_INTERVAL_MS;
+	int failures = 0;
+
+	srand(3);
+	while (now_ms < DAY_MS)
+	{
+		double temperature, humidity;
+		int16_t values[HISTORY_CHANNELS];
+		uint8_t accepted;
+
+		room(now_ms / 1000.0, &temperature, &humidity);
+		values[HISTORY_TEMPERATURE] = (int16_t)lround(temperature) + rand() % 3 - 1;
+		values[HISTORY_HUMIDITY] = (int16_t)lround(humidity) + (rand() % 3 - 1) * 2;
+		accepted = filter_apply(values, now_ms);
+		scheduler_update(accepted, values, 0, now_ms);
+
+		if (accepted)
+		{
+			int32_t fahrenheit = values[HISTORY_TEMPERATURE] * 18 / 10 + 320;
+
+			snprintf(line[0], sizeof(line[0]), "Temp: %d.%d F", (int)(fahrenheit / 10), (int)(fahrenheit % 10));
+			snprintf(line[1], sizeof(line[1]), "Hum: %d.%d %%", values[HISTORY_HUMIDITY] / 10, values[HISTORY_HUMIDITY] % 10);
+			for (int row = 0; row < 2; row++)
+			{
+				if (strcmp(line[row], shown[row]) != 0)
+				{
+					strcpy(shown[row], line[row]);
+					written++;
+				}
+			}
+		}
+
+		if (!door_fast_ms && now_ms >= DOOR_MS && interval_ms == DHT22_MIN_INTERVAL_MS)
+			door_fast_ms = now_ms;
+		if (interval_ms > longest_ms)
+			longest_ms = interval_ms;
+
+		//how long the room was off by STALE_TENTHS before the next read
+		double read_temperature = temperature, read_humidity = humidity;
+
+		for (uint32_t s = 1000; s < interval_ms; s += 1000)
+		{
+			room((now_ms + s) / 1000.0, &temperature, &humidity);
+			if (fabs(temperature - read_temperature) >= STALE_TENTHS || fabs(humidity - read_humidity) >= STALE_TENTHS)
+			{
+				if (interval_ms - s > stale_ms)
+					stale_ms = interval_ms - s;
+				break;
+			}
+		}
+		now_ms += interval_ms;
+	}
+
+	printf("synthetic day: %u reads of %u fixed (%.1f %%), %u at 2 s\n", scheduler_stats.frames, fixed_reads,
+			100.0 * scheduler_stats.frames / fixed_reads, scheduler_stats.fast_frames);
+	printf("display lines: %u of %u fixed (%.1f %%)\n", written, 2 * fixed_reads, 100.0 * written / (2 * fixed_reads));
+	printf("longest interval %u s, a %d.%d change waited at most %u s for a read, door read at 2 s from %u s after it opened\n",
+			longest_ms / 1000, STALE_TENTHS / 10, STALE_TENTHS % 10, stale_ms / 1000, (door_fast_ms - DOOR_MS) / 1000);
+	failures += longest_ms > SCHEDULER_SLOW_S * 1000U;
+	failures += stale_ms > SCHEDULER_SLOW_S * 1000U;
+
+	printf("%d failures\n", failures);
+	return failures != 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file test_settings.c
+ * @author Auska Wang
+ * @brief Checks that settings.c keeps every stored value across resets, including
+ *        resets in the middle of a compaction.
+ *
+ *        The 2 settings pages are a RAM array; the flash calls program and erase it and
+ *        refuse to program a double word that is not erased. A reset is simulated by
+ *        clearing the module's RAM state and calling settings_init() again. Cases:
+ *        - a page written by the single page firmware, without header;
+ *        - a thousand changes, several compactions, a reset after each change;
+ *        - the power cut after every program or erase of a compaction in turn.
+ *        After each reset every value must be the last one stored; a change that was
+ *        being written when the power went may read back either way.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include "../Core/Src/settings.c"
+
+/* Defines */
+#define PAGES_BYTES (PAGES * FLASH_PAGE_SIZE)
+#define KEPT_KEYS (ALARM_RULES + 1)		//set away from their default, copied by every compaction
+
+/* Variables */
+uint8_t stub_flash[PAGES_BYTES] __attribute__((aligned(8)));
+__asm__(".global _settings_start\n.set _settings_start, stub_flash");
+
+static int stop_flash = -1;			//flash operations until the power goes, -1 never
+static int overwrites = 0;			//programs of a double word that was not erased
+static uint32_t now_ms = 0;
+static int32_t expected[SETTINGS];	//last value of each key known to be stored
+static int failures = 0;
+
+uint32_t HAL_GetTick(void) { return now_ms; }
+uint32_t get_cycle_count(void) { return 0; }
+uint8_t i2c_bus_idle(void) { return 1; }
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { return HAL_OK; }
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { return HAL_OK; }
+
+/**
+ * @brief Counts a flash operation against the power cut.
+ *
+ * @return 1 if the power is still on
+ */
+static int powered(void)
+{
+	if (stop_flash == 0)
+		return 0;
+	if (stop_flash > 0)
+		stop_flash--;
+	return 1;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint8_t* target = stub_flash + (uint32_t)(Address - FLASH_BASE);
+
+	if (!powered())
+		return HAL_OK;		//nothing reaches the flash
+	for (int i = 0; i < 8; i++)
+	{
+		if (target[i] != 0xFF)
+		{
+			overwrites++;
+			return HAL_ERROR;
+		}
+	}
+	memcpy(target, &Data, 8);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError)
+{
+	if (!powered())
+		return HAL_OK;
+	memset(stub_flash + pEraseInit->Page * FLASH_PAGE_SIZE, 0xFF, pEraseInit->NbPages * FLASH_PAGE_SIZE);
+	return HAL_OK;
+}
+
+/**
+ * @brief Simulates a reset: RAM state is lost, the flash keeps what was programmed.
+ *
+ * @return None
+ */
+static void reset(void)
+{
+	memset((void*)values, 0xA5, sizeof(values));
+	memset(stored, 0xA5, sizeof(stored));
+	next_slot = 0xA5A5;
+	active_page = 0xA5;
+	generation = 0xA5A5A5A5;
+	stop_flash = -1;
+	settings_init();
+}
+
+/**
+ * @brief Changes a setting and lets the task write it once the quiet time passed.
+ *
+ * @param key Setting, value New value
+ * @return None
+ */
+static void change(SETTING_KEY key, int32_t value)
+{
+	settings_set(key, value);
+	now_ms += SETTINGS_QUIET_MS;
+	settings_task();
+}
+
+/**
+ * @brief Compares every setting with the expected values after a reset.
+ *
+ * @param name Case, pending Key whose change was cut by the power, -1 none, pending_value Its new value
+ * @return None
+ */
+static void check(const char* name, int pending, int32_t pending_value)
+{
+	reset();
+	for (int key = 0; key < SETTINGS; key++)
+	{
+		int32_t value = settings_get((SETTING_KEY)key);
+
+		if (key == pending && value == pending_value)
+			expected[key] = value;	//the change made it before the power went
+		if (value != expected[key])
+		{
+			printf("FAIL %s: key %d reads %d, expected %d\n", name, key, (int)value, (int)expected[key]);
+			failures++;
+		}
+	}
+}
+
+/**
+ * @brief Changes a setting and checks every value after a reset.
+ *
+ * @param name Case, key Setting, value New value
+ * @return None
+ */
+static void change_and_check(const char* name, SETTING_KEY key, int32_t value)
+{
+	change(key, value);
+	expected[key] = value;
+	check(name, -1, 0);
+}
+
+/**
+ * @brief Toggles the backlight setting until the active page has no erased slot left.
+ *
+ * @return None
+ */
+static void fill_page(void)
+{
+	while (next_slot < SLOTS)
+	{
+		expected[SETTING_LIGHT_MODE] = !expected[SETTING_LIGHT_MODE];
+		change(SETTING_LIGHT_MODE, expected[SETTING_LIGHT_MODE]);
+	}
+}
+
+int main(void)
+{
+	char name[48];
+
+	//a page of the single page firmware: records from slot 0 of the last page, no header
+	memset(stub_flash, 0xFF, sizeof(stub_flash));
+	for (int key = 0; key < SETTINGS; key++)
+		expected[key] = defaults[key];
+	active_page = PAGES - 1;
+	next_slot = 0;
+	append(SETTING_TEMP_UNITS, 1);
+	append(SETTING_LIGHT_MODE, 0);
+	expected[SETTING_TEMP_UNITS] = 1;
+	expected[SETTING_LIGHT_MODE] = 0;
+	check("single page firmware", -1, 0);
+	printf("single page firmware: %u records, page %u\n", settings_stats.records, active_page);
+
+	for (int i = 0; i < ALARM_RULES; i++)
+		change_and_check("thresholds", SETTING_ALARM_THRESHOLD(i), 100 + i);
+	change_and_check("calibration", SETTING_CALIBRATION_POINTS(HISTORY_TEMPERATURE), 2);
+
+	//changes across several compactions, a reset after each
+	for (int i = 0; i < 1000; i++)
+	{
+		SETTING_KEY key = (i % 3 == 0) ? SETTING_TEMP_UNITS : SETTING_LIGHT_MODE;
+
+		change_and_check("changes", key, !expected[key]);
+	}
+	printf("changes: %u compactions, generation %u, page %u, %u records\n",
+			(unsigned)settings_stats.compactions, (unsigned)generation, active_page, settings_stats.records);
+
+	//the power goes after every flash operation of a compaction in turn
+	for (int cut = 0; cut < KEPT_KEYS + 6; cut++)
+	{
+		int32_t value;
+
+		fill_page();
+		value = !expected[SETTING_TEMP_UNITS];
+		stop_flash = cut;
+		settings_set(SETTING_TEMP_UNITS, value);
+		now_ms += SETTINGS_QUIET_MS;
+		settings_task();	//compaction, then the change itself
+		snprintf(name, sizeof(name), "power cut after %d", cut);
+		check(name, SETTING_TEMP_UNITS, value);
+		printf("%s: generation %u on page %u, change %s\n", name, (unsigned)generation, active_page,
+				settings_get(SETTING_TEMP_UNITS) == value ? "kept" : "lost");
+		change_and_check(name, SETTING_LIGHT_MODE, !expected[SETTING_LIGHT_MODE]);		//writing goes on from there
+	}
+
+	if (overwrites)
+	{
+		printf("FAIL %d programs of a double word that was not erased\n", overwrites);
+		failures++;
+	}
+	printf("%d failures\n", failures);
+	return failures != 0;
+}